@@ -6,6 +6,8 @@
 #include "esp_camera.h"
 #include "img_converters.h"
 #include "Arduino.h"
+#include <Preferences.h>
+#include "path_codec.h"
 
 // =======================
 // Motor Pin Definitions
@@ -24,6 +26,47 @@ extern String WiFiAddr;
 int speed = 150; // Motor speed (0-255)
 httpd_handle_t camera_httpd = NULL;
 httpd_handle_t stream_httpd = NULL;
+esp_timer_handle_t drive_timer = NULL;  // ends a timed /drive
+
+// =======================
+// Motor Calibration
+// =======================
+// Fitted by client/calibrate.py and stored in NVS through /calib. Each
+// wheel and direction has a deadband (the duty below which the wheel does
+// not turn) and a gain, and a drive at `speed` is sent to the wheel as
+//   duty = deadband + gain * speed * (255 - deadband) / 255
+// which gives every wheel the same response. rates are the
+// go/back speeds (px/s) and left/right turn rates (deg/s) measured at
+// `speed` after compensation; they are only stored for the client.
+#define WHEEL_LEFT  0
+#define WHEEL_RIGHT 1
+#define DIR_FWD     0   // M1 pin
+#define DIR_BACK    1   // M0 pin
+
+struct MotorCalibration {
+    bool enabled;
+    float gain[2][2];         // [wheel][direction]
+    uint8_t deadband[2][2];
+    float rates[4];           // go, back, left, right
+};
+
+MotorCalibration calib;
+Preferences prefs;
+
+// =======================
+// Planned Path
+// =======================
+// Last path POSTed to /path in the binary format of path_codec.h (what
+// PathGUI publishes on robot/path), kept for on-board following and
+// reported by GET /path.
+#define PATH_MAX_BYTES   16384
+#define PATH_MAX_POINTS  512
+
+PathPoint path_points[PATH_MAX_POINTS];
+uint32_t path_count = 0;
+float path_length = 0;   // px
+uint16_t path_revision = 0;
+uint8_t path_method = 255;
 
 // =======================
 // Function Declarations
@@ -33,6 +76,39 @@ void robot_fwd();
 void robot_back();
 void robot_left();
 void robot_right();
+void robot_drive(int left, int right);
+void robot_drive_raw(int left, int right);
+
+// =======================
+// Calibration Storage
+// =======================
+void calib_defaults() {
+    calib.enabled = true;
+    for (int w = 0; w < 2; w++) {
+        for (int d = 0; d < 2; d++) {
+            calib.gain[w][d] = 1.0f;
+            calib.deadband[w][d] = 0;
+        }
+    }
+    for (int i = 0; i < 4; i++) calib.rates[i] = 0.0f;
+}
+
+void calib_load() {
+    calib_defaults();
+    prefs.begin("motor", true);
+    if (prefs.getBytesLength("calib") == sizeof(calib)) {  // skip a blob from another layout
+        prefs.getBytes("calib", &calib, sizeof(calib));
+        Serial.println("Motor calibration loaded");
+    }
+    prefs.end();
+}
+
+void calib_save() {
+    prefs.begin("motor", false);
+    prefs.putBytes("calib", &calib, sizeof(calib));
+    prefs.end();
+    Serial.println("Motor calibration saved");
+}
 
 // =======================
 // Motor Control Functions
@@ -52,47 +128,65 @@ void robot_setup() {
     ledcAttach(RIGHT_M0, 2000, 8);  
     ledcAttach(RIGHT_M1, 2000, 8);  
     
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = [](void*) { robot_stop(); };
+    timer_args.name = "drive";
+    esp_timer_create(&timer_args, &drive_timer);
+    
+    calib_load();
     robot_stop();
     Serial.println("Motors initialized");
 }
 
+// Duty for one wheel with its calibration applied; signed, positive
+// drives the M1 pin
+int wheel_duty(int wheel, int duty) {
+    if (!calib.enabled || duty == 0) return duty;
+    int dir = duty > 0 ? DIR_FWD : DIR_BACK;
+    int deadband = calib.deadband[wheel][dir];
+    int out = deadband + (int)(calib.gain[wheel][dir] * abs(duty) * (255 - deadband) / 255.0f + 0.5f);
+    out = min(out, 255);
+    return duty > 0 ? out : -out;
+}
+
+void set_wheel(int pin_back, int pin_fwd, int duty) {
+    ledcWrite(pin_back, duty < 0 ? -duty : 0);
+    ledcWrite(pin_fwd, duty > 0 ? duty : 0);
+}
+
+// Signed duties (-255..255) exactly as given; also ends a timed /drive
+void robot_drive_raw(int left, int right) {
+    if (drive_timer) esp_timer_stop(drive_timer);
+    set_wheel(LEFT_M0, LEFT_M1, left);
+    set_wheel(RIGHT_M0, RIGHT_M1, right);
+}
+
+void robot_drive(int left, int right) {
+    robot_drive_raw(wheel_duty(WHEEL_LEFT, left), wheel_duty(WHEEL_RIGHT, right));
+}
+
 void robot_stop() {
-    ledcWrite(LEFT_M0, 0);
-    ledcWrite(LEFT_M1, 0);
-    ledcWrite(RIGHT_M0, 0);
-    ledcWrite(RIGHT_M1, 0);
+    robot_drive_raw(0, 0);
     Serial.println("Motors: STOP");
 }
 
 void robot_left() {
-    ledcWrite(LEFT_M0, 0);
-    ledcWrite(LEFT_M1, speed);
-    ledcWrite(RIGHT_M0, 0);
-    ledcWrite(RIGHT_M1, speed);
+    robot_drive(speed, speed);
     Serial.println("Motors: FORWARD");
 }
 
 void robot_right() {
-    ledcWrite(LEFT_M0, speed);
-    ledcWrite(LEFT_M1, 0);
-    ledcWrite(RIGHT_M0, speed);
-    ledcWrite(RIGHT_M1, 0);
+    robot_drive(-speed, -speed);
     Serial.println("Motors: BACKWARD");
 }
 
 void robot_fwd() {
-    ledcWrite(LEFT_M0, speed);
-    ledcWrite(LEFT_M1, 0);
-    ledcWrite(RIGHT_M0, 0);
-    ledcWrite(RIGHT_M1, speed);
+    robot_drive(-speed, speed);
     Serial.println("Motors: LEFT");
 }
 
 void robot_back() {
-    ledcWrite(LEFT_M0, 0);
-    ledcWrite(LEFT_M1, speed);
-    ledcWrite(RIGHT_M0, speed);
-    ledcWrite(RIGHT_M1, 0);
+    robot_drive(speed, -speed);
     Serial.println("Motors: RIGHT");
 }
 
@@ -216,34 +310,205 @@ static esp_err_t capture_handler(httpd_req_t *req) {
     return res;
 }
 
-static esp_err_t go_handler(httpd_req_t *req) {
-    robot_fwd();
+// Reply to a motor command, echoing its ?seq= query as X-Seq so a client
+// queueing commands on one keep-alive connection can match the replies
+static esp_err_t send_command_ok(httpd_req_t *req) {
+    char query[64];
+    char seq[12];
     httpd_resp_set_type(req, "text/html");
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "seq", seq, sizeof(seq)) == ESP_OK) {
+        httpd_resp_set_hdr(req, "X-Seq", seq);
+    }
     return httpd_resp_send(req, "OK", 2);
 }
 
+static esp_err_t go_handler(httpd_req_t *req) {
+    robot_fwd();
+    return send_command_ok(req);
+}
+
 static esp_err_t back_handler(httpd_req_t *req) {
     robot_back();
-    httpd_resp_set_type(req, "text/html");
-    return httpd_resp_send(req, "OK", 2);
+    return send_command_ok(req);
 }
 
 static esp_err_t left_handler(httpd_req_t *req) {
     robot_left();
-    httpd_resp_set_type(req, "text/html");
-    return httpd_resp_send(req, "OK", 2);
+    return send_command_ok(req);
 }
 
 static esp_err_t right_handler(httpd_req_t *req) {
     robot_right();
-    httpd_resp_set_type(req, "text/html");
-    return httpd_resp_send(req, "OK", 2);
+    return send_command_ok(req);
 }
 
 static esp_err_t stop_handler(httpd_req_t *req) {
     robot_stop();
-    httpd_resp_set_type(req, "text/html");
-    return httpd_resp_send(req, "OK", 2);
+    return send_command_ok(req);
+}
+
+// Raw timed drive for calibration: /drive?l=<duty>&r=<duty>&ms=<duration>
+// with signed duties (-255..255, positive drives the M1 pin) applied
+// without the calibration. The device stops the wheels after ms, so the
+// pulse length does not depend on the network.
+static esp_err_t drive_handler(httpd_req_t *req) {
+    char query[64];
+    char value[12];
+    int left = 0, right = 0, ms = 0;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "l", value, sizeof(value)) == ESP_OK) left = constrain(atoi(value), -255, 255);
+        if (httpd_query_key_value(query, "r", value, sizeof(value)) == ESP_OK) right = constrain(atoi(value), -255, 255);
+        if (httpd_query_key_value(query, "ms", value, sizeof(value)) == ESP_OK) ms = constrain(atoi(value), 0, 5000);
+    }
+    robot_drive_raw(left, right);
+    if (ms > 0) esp_timer_start_once(drive_timer, (uint64_t)ms * 1000);
+    Serial.printf("Motors: DRIVE %d %d for %dms\n", left, right, ms);
+    return send_command_ok(req);
+}
+
+// Motor calibration as JSON. Query keys change it and store it in NVS:
+//   lf, lb, rf, rb = gain,deadband   (left/right wheel, forward/back)
+//   rates = go,back,left,right       enable = 0|1       reset = 1
+static esp_err_t calib_handler(httpd_req_t *req) {
+    static const char* keys[2][2] = {{"lf", "lb"}, {"rf", "rb"}};
+    char query[192];
+    char value[48];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        bool changed = false;
+        if (httpd_query_key_value(query, "reset", value, sizeof(value)) == ESP_OK) {
+            calib_defaults();
+            changed = true;
+        }
+        for (int w = 0; w < 2; w++) {
+            for (int d = 0; d < 2; d++) {
+                float gain;
+                int deadband;
+                if (httpd_query_key_value(query, keys[w][d], value, sizeof(value)) == ESP_OK &&
+                    sscanf(value, "%f,%d", &gain, &deadband) == 2) {
+                    calib.gain[w][d] = constrain(gain, 0.0f, 2.0f);
+                    calib.deadband[w][d] = constrain(deadband, 0, 254);
+                    changed = true;
+                }
+            }
+        }
+        float rates[4];
+        if (httpd_query_key_value(query, "rates", value, sizeof(value)) == ESP_OK &&
+            sscanf(value, "%f,%f,%f,%f", &rates[0], &rates[1], &rates[2], &rates[3]) == 4) {
+            memcpy(calib.rates, rates, sizeof(rates));
+            changed = true;
+        }
+        if (httpd_query_key_value(query, "enable", value, sizeof(value)) == ESP_OK) {
+            calib.enabled = atoi(value) != 0;
+            changed = true;
+        }
+        if (changed) calib_save();
+    }
+
+    char json[320];
+    int len = snprintf(json, sizeof(json),
+        "{\"enabled\":%s,\"speed\":%d,"
+        "\"gain\":[[%.3f,%.3f],[%.3f,%.3f]],\"deadband\":[[%d,%d],[%d,%d]],"
+        "\"rates\":{\"go\":%.1f,\"back\":%.1f,\"left\":%.1f,\"right\":%.1f}}",
+        calib.enabled ? "true" : "false", speed,
+        calib.gain[0][0], calib.gain[0][1], calib.gain[1][0], calib.gain[1][1],
+        calib.deadband[0][0], calib.deadband[0][1], calib.deadband[1][0], calib.deadband[1][1],
+        calib.rates[0], calib.rates[1], calib.rates[2], calib.rates[3]);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+// Binary path upload: POST /path with a path_codec.h message as the body.
+// The message is decoded and checked (header, CRC, every varint) into a
+// scratch buffer and only then replaces the stored path, so a bad upload
+// leaves the previous one in place; the reply is JSON with the point count
+// and length, or a 400 naming what was wrong.
+static esp_err_t path_handler(httpd_req_t *req) {
+    if (req->content_len == 0 || req->content_len > PATH_MAX_BYTES) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                            req->content_len == 0 ? "empty path" : "path too large");
+        return ESP_FAIL;
+    }
+    uint8_t* body = (uint8_t*)malloc(req->content_len);
+    if (body == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    size_t received = 0;
+    while (received < req->content_len) {
+        int n = httpd_req_recv(req, (char*)body + received, req->content_len - received);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (n <= 0) {
+            free(body);
+            return ESP_FAIL;
+        }
+        received += n;
+    }
+
+    PathDecoder decoder;
+    PathStatus status = decoder.begin(body, received);
+    if (status == PATH_OK && decoder.header().count > PATH_MAX_POINTS) status = PATH_OVERFLOW;
+    PathPoint* scratch = NULL;
+    if (status == PATH_OK && decoder.header().count > 0) {
+        scratch = (PathPoint*)malloc(decoder.header().count * sizeof(PathPoint));
+        if (scratch == NULL) {
+            free(body);
+            httpd_resp_send_500(req);
+            return ESP_FAIL;
+        }
+    }
+    uint32_t count = 0;
+    float length = 0;
+    if (status == PATH_OK) {
+        PathPoint point;
+        while (decoder.next(point)) {
+            if (count > 0) length += hypotf(point.x - scratch[count - 1].x, point.y - scratch[count - 1].y);
+            scratch[count++] = point;
+        }
+        status = decoder.status();
+    }
+    free(body);
+
+    if (status != PATH_OK) {
+        free(scratch);
+        Serial.printf("Path rejected: %s\n", path_status_name(status));
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, path_status_name(status));
+        return ESP_FAIL;
+    }
+    if (count > 0) memcpy(path_points, scratch, count * sizeof(PathPoint));
+    free(scratch);
+    path_count = count;
+    path_length = length;
+    path_revision = decoder.header().revision;
+    path_method = decoder.header().method;
+    Serial.printf("Path: %u points, %.0f px\n", (unsigned)path_count, path_length);
+
+    char json[96];
+    int len = snprintf(json, sizeof(json), "{\"points\":%u,\"length\":%.1f,\"method\":%u,\"bytes\":%u}",
+                       (unsigned)path_count, path_length, decoder.header().method, (unsigned)received);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+// GET /path: what the car holds, to check an upload (or a live PathGUI
+// session's revision) arrived. Ends are null when no path is stored.
+static esp_err_t path_info_handler(httpd_req_t *req) {
+    char json[192];
+    int len;
+    if (path_count == 0) {
+        len = snprintf(json, sizeof(json),
+                       "{\"points\":0,\"length\":0,\"revision\":%u,\"method\":%u,\"start\":null,\"end\":null}",
+                       path_revision, path_method);
+    } else {
+        const PathPoint& a = path_points[0];
+        const PathPoint& b = path_points[path_count - 1];
+        len = snprintf(json, sizeof(json),
+                       "{\"points\":%u,\"length\":%.1f,\"revision\":%u,\"method\":%u,"
+                       "\"start\":[%.1f,%.1f],\"end\":[%.1f,%.1f]}",
+                       (unsigned)path_count, path_length, path_revision, path_method, a.x, a.y, b.x, b.y);
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
 }
 
 static esp_err_t ledon_handler(httpd_req_t *req) {
@@ -266,6 +531,8 @@ static esp_err_t ledoff_handler(httpd_req_t *req) {
 void startCameraServer() {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
+    config.lru_purge_enable = true;  // controllers hold keep-alive sockets; recycle idle ones
+    config.max_uri_handlers = 16;    // the default of 8 is fewer than we register
 
     httpd_uri_t index_uri = {
         .uri = "/",
@@ -309,6 +576,34 @@ void startCameraServer() {
         .user_ctx = NULL
     };
     
+    httpd_uri_t drive_uri = {
+        .uri = "/drive",
+        .method = HTTP_GET,
+        .handler = drive_handler,
+        .user_ctx = NULL
+    };
+    
+    httpd_uri_t calib_uri = {
+        .uri = "/calib",
+        .method = HTTP_GET,
+        .handler = calib_handler,
+        .user_ctx = NULL
+    };
+    
+    httpd_uri_t path_uri = {
+        .uri = "/path",
+        .method = HTTP_POST,
+        .handler = path_handler,
+        .user_ctx = NULL
+    };
+    
+    httpd_uri_t path_info_uri = {
+        .uri = "/path",
+        .method = HTTP_GET,
+        .handler = path_info_handler,
+        .user_ctx = NULL
+    };
+    
     httpd_uri_t ledon_uri = {
         .uri = "/ledon",
         .method = HTTP_GET,
@@ -345,6 +640,10 @@ void startCameraServer() {
         httpd_register_uri_handler(camera_httpd, &stop_uri);
         httpd_register_uri_handler(camera_httpd, &left_uri);
         httpd_register_uri_handler(camera_httpd, &right_uri);
+        httpd_register_uri_handler(camera_httpd, &drive_uri);
+        httpd_register_uri_handler(camera_httpd, &calib_uri);
+        httpd_register_uri_handler(camera_httpd, &path_uri);
+        httpd_register_uri_handler(camera_httpd, &path_info_uri);
         httpd_register_uri_handler(camera_httpd, &ledon_uri);
         httpd_register_uri_handler(camera_httpd, &ledoff_uri);
         httpd_register_uri_handler(camera_httpd, &capture_uri);
@@ -0,0 +1,205 @@
+// path_codec.cpp
+// Encoder and decoder for the binary path format (see path_codec.h)
+
+#include "path_codec.h"
+
+#include <math.h>
+#include <string.h>
+
+static const double HEADING_UNITS = 65536.0 / (2.0 * M_PI);
+static const double CURVATURE_UNITS = 1048576.0;   // 2^20
+static const double SPEED_UNITS = 16.0;
+
+// CRC-32 (IEEE, as zlib) a nibble at a time: a 64-byte table instead of 1 KB
+static const uint32_t crc_nibbles[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t path_crc32(const uint8_t* data, size_t len, uint32_t crc) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = crc_nibbles[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+        crc = crc_nibbles[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+const char* path_status_name(PathStatus status) {
+    switch (status) {
+        case PATH_OK:          return "ok";
+        case PATH_TRUNCATED:   return "truncated";
+        case PATH_BAD_MAGIC:   return "bad magic";
+        case PATH_BAD_VERSION: return "unsupported version";
+        case PATH_BAD_CRC:     return "CRC mismatch";
+        case PATH_BAD_PAYLOAD: return "bad payload";
+        case PATH_OVERFLOW:    return "buffer too small";
+    }
+    return "unknown";
+}
+
+static uint32_t read_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void write_u32(uint8_t* p, uint32_t v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static int field_count(uint8_t flags) {
+    return 2 + ((flags & PATH_FLAG_HEADING) != 0) + ((flags & PATH_FLAG_CURVATURE) != 0) +
+           ((flags & PATH_FLAG_SPEED) != 0);
+}
+
+// Heading in int16 turns, kept as 0..65535
+static int64_t heading_turns(float heading) {
+    return llrint(heading * HEADING_UNITS) & 0xFFFF;
+}
+
+// =======================
+// Decoder
+// =======================
+PathStatus PathDecoder::begin(const uint8_t* data, size_t len) {
+    decoded = 0;
+    memset(acc, 0, sizeof(acc));
+    if (len < PATH_HEADER_SIZE + PATH_CRC_SIZE) return state = PATH_TRUNCATED;
+    if (data[0] != 'V' || data[1] != 'P') return state = PATH_BAD_MAGIC;
+
+    hdr.version = data[2];
+    hdr.flags = data[3];
+    hdr.method = data[4];
+    hdr.coord_bits = data[5];
+    hdr.revision = data[6] | (data[7] << 8);
+    hdr.count = read_u32(data + 8);
+    hdr.payload_len = read_u32(data + 12);
+    if (hdr.version != PATH_VERSION) return state = PATH_BAD_VERSION;
+    if (hdr.coord_bits > 24) return state = PATH_BAD_PAYLOAD;
+    if (hdr.payload_len > len - PATH_HEADER_SIZE - PATH_CRC_SIZE) return state = PATH_TRUNCATED;
+
+    size_t body = PATH_HEADER_SIZE + hdr.payload_len;
+    if (path_crc32(data, body) != read_u32(data + body)) return state = PATH_BAD_CRC;
+
+    pos = data + PATH_HEADER_SIZE;
+    end = data + body;
+    fields = field_count(hdr.flags);
+    return state = PATH_OK;
+}
+
+bool PathDecoder::read_varint(int64_t& value) {
+    uint64_t raw = 0;
+    for (int shift = 0; shift < 64 && pos < end; shift += 7) {
+        uint8_t byte = *pos++;
+        raw |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            value = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PathDecoder::next(PathPoint& point) {
+    if (state != PATH_OK) return false;
+    if (decoded == hdr.count) {
+        // Every byte must have been a point's
+        if (pos != end) state = PATH_BAD_PAYLOAD;
+        return false;
+    }
+    for (int i = 0; i < fields; i++) {
+        int64_t delta;
+        if (!read_varint(delta)) {
+            state = PATH_BAD_PAYLOAD;
+            return false;
+        }
+        acc[i] += delta;
+    }
+
+    float scale = 1.0f / (float)(1UL << hdr.coord_bits);
+    point.x = acc[0] * scale;
+    point.y = acc[1] * scale;
+    point.heading = point.curvature = point.speed = NAN;
+    int i = 2;
+    if (hdr.flags & PATH_FLAG_HEADING) {
+        acc[i] &= 0xFFFF;
+        bool open_end = (hdr.flags & PATH_FLAG_OPEN_END) && decoded + 1 == hdr.count;
+        if (!open_end) point.heading = (acc[i] >= 0x8000 ? acc[i] - 0x10000 : acc[i]) / HEADING_UNITS;
+        i++;
+    }
+    if (hdr.flags & PATH_FLAG_CURVATURE) point.curvature = acc[i++] / CURVATURE_UNITS;
+    if (hdr.flags & PATH_FLAG_SPEED) point.speed = acc[i++] / SPEED_UNITS;
+    decoded++;
+    return true;
+}
+
+// =======================
+// Encoder
+// =======================
+PathEncoder::PathEncoder(uint8_t* buffer, size_t capacity, uint8_t method, uint8_t flags, uint8_t coord_bits,
+                         uint16_t revision)
+    : buf(buffer), cap(capacity), len(PATH_HEADER_SIZE), state(PATH_OK) {
+    hdr.version = PATH_VERSION;
+    hdr.flags = flags & (PATH_FLAG_HEADING | PATH_FLAG_CURVATURE | PATH_FLAG_SPEED);
+    hdr.method = method;
+    hdr.coord_bits = coord_bits;
+    hdr.revision = revision;
+    hdr.count = 0;
+    hdr.payload_len = 0;
+    if (cap < PATH_HEADER_SIZE + PATH_CRC_SIZE) state = PATH_OVERFLOW;
+}
+
+bool PathEncoder::write_varint(int64_t value) {
+    uint64_t raw = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    do {
+        if (len + PATH_CRC_SIZE >= cap) {
+            state = PATH_OVERFLOW;
+            return false;
+        }
+        uint8_t byte = raw & 0x7F;
+        raw >>= 7;
+        buf[len++] = byte | (raw ? 0x80 : 0);
+    } while (raw);
+    return true;
+}
+
+bool PathEncoder::add(const PathPoint& point) {
+    if (state != PATH_OK) return false;
+    int64_t value[PATH_MAX_FIELDS];
+    double scale = (double)(1UL << hdr.coord_bits);
+    value[0] = llrint(point.x * scale);
+    value[1] = llrint(point.y * scale);
+    int n = 2;
+    if (hdr.flags & PATH_FLAG_HEADING) {
+        // A missing heading repeats the last one; only the final point may have none
+        last_heading_missing = isnan(point.heading);
+        value[n++] = last_heading_missing ? prev[2] : heading_turns(point.heading);
+    }
+    if (hdr.flags & PATH_FLAG_CURVATURE) value[n++] = isnan(point.curvature) ? 0 : llrint(point.curvature * CURVATURE_UNITS);
+    if (hdr.flags & PATH_FLAG_SPEED) value[n++] = isnan(point.speed) ? 0 : llrint(point.speed * SPEED_UNITS);
+
+    for (int i = 0; i < n; i++) {
+        int64_t delta = value[i] - prev[i];
+        if (i == 2 && (hdr.flags & PATH_FLAG_HEADING)) delta = ((delta + 0x8000) & 0xFFFF) - 0x8000;
+        if (!write_varint(delta)) return false;
+        prev[i] = value[i];
+    }
+    hdr.count++;
+    return true;
+}
+
+size_t PathEncoder::finish() {
+    if (state != PATH_OK) return 0;
+    if (last_heading_missing && hdr.count > 0) hdr.flags |= PATH_FLAG_OPEN_END;
+    hdr.payload_len = len - PATH_HEADER_SIZE;
+    buf[0] = 'V';
+    buf[1] = 'P';
+    buf[2] = hdr.version;
+    buf[3] = hdr.flags;
+    buf[4] = hdr.method;
+    buf[5] = hdr.coord_bits;
+    buf[6] = hdr.revision;
+    buf[7] = hdr.revision >> 8;
+    write_u32(buf + 8, hdr.count);
+    write_u32(buf + 12, hdr.payload_len);
+    write_u32(buf + len, path_crc32(buf, len));
+    return len + PATH_CRC_SIZE;
+}
\ No newline at end of file
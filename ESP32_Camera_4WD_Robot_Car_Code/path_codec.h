@@ -0,0 +1,107 @@
+// path_codec.h
+// Binary path wire format for robot/path, shared with client/path_codec.py
+//
+// A 16-byte little-endian header (magic "VP", version, flags, method,
+// coord_bits, revision, point count, payload length), the payload, and a
+// CRC-32 of both. The payload holds per point the zigzag varint change of
+// x, y (fixed point, 1/2^coord_bits px) and, when flagged, heading (int16
+// turns, wrapping), curvature (1/2^20 per px) and speed (1/16 px/s).
+//
+// PathDecoder checks the header and CRC up front and then yields one
+// point at a time, so a path never has to be held as floats all at once.
+// Plain C++ with no Arduino dependencies; client/native builds it for the
+// host benchmark.
+
+#ifndef PATH_CODEC_H
+#define PATH_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PATH_VERSION        1
+#define PATH_HEADER_SIZE    16
+#define PATH_CRC_SIZE       4
+
+#define PATH_FLAG_HEADING   1
+#define PATH_FLAG_CURVATURE 2
+#define PATH_FLAG_SPEED     4
+#define PATH_FLAG_OPEN_END  8   // the last point has no heading
+
+#define PATH_MAX_FIELDS     5
+
+enum PathStatus {
+    PATH_OK = 0,
+    PATH_TRUNCATED,
+    PATH_BAD_MAGIC,
+    PATH_BAD_VERSION,
+    PATH_BAD_CRC,
+    PATH_BAD_PAYLOAD,
+    PATH_OVERFLOW,
+};
+
+struct PathHeader {
+    uint8_t version;
+    uint8_t flags;
+    uint8_t method;       // 0 point, 1 linear, 2 catmull, 3 cubic, 4 bezier, 255 unknown
+    uint8_t coord_bits;
+    uint16_t revision;    // of a live PathGUI session (client/path_link.py), else 0
+    uint32_t count;
+    uint32_t payload_len;
+};
+
+struct PathPoint {
+    float x, y;           // px
+    float heading;        // radians; NAN when not sent and at an open end
+    float curvature;      // 1/px; NAN when not sent
+    float speed;          // px/s; NAN when not sent
+};
+
+uint32_t path_crc32(const uint8_t* data, size_t len, uint32_t crc = 0);
+const char* path_status_name(PathStatus status);
+
+class PathDecoder {
+public:
+    // Validate a whole message; points then come from next()
+    PathStatus begin(const uint8_t* data, size_t len);
+    // False after the last point or on a malformed payload (see status())
+    bool next(PathPoint& point);
+
+    const PathHeader& header() const { return hdr; }
+    PathStatus status() const { return state; }
+
+private:
+    bool read_varint(int64_t& value);
+
+    const uint8_t* pos = nullptr;
+    const uint8_t* end = nullptr;
+    PathHeader hdr = {};
+    PathStatus state = PATH_TRUNCATED;
+    uint32_t decoded = 0;
+    int fields = 0;
+    int64_t acc[PATH_MAX_FIELDS] = {};
+};
+
+class PathEncoder {
+public:
+    // Fields written are the flags' (PATH_FLAG_OPEN_END is set by finish())
+    PathEncoder(uint8_t* buffer, size_t capacity, uint8_t method, uint8_t flags, uint8_t coord_bits = 4,
+                uint16_t revision = 0);
+    bool add(const PathPoint& point);
+    // Total message size, or 0 if the buffer was too small
+    size_t finish();
+
+    PathStatus status() const { return state; }
+
+private:
+    bool write_varint(int64_t value);
+
+    uint8_t* buf;
+    size_t cap;
+    size_t len;
+    PathHeader hdr;
+    PathStatus state;
+    bool last_heading_missing = false;
+    int64_t prev[PATH_MAX_FIELDS] = {};
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""
+Benchmark inference backends on recorded video
+
+Runs frames from the repo's recorded videos through each backend and
+reports throughput and per-stage timings, plus keypoint accuracy measured
+against the full-precision PyTorch model on the same frames.
+
+With --roi every backend also runs in ROI-tracking mode (roi_tracking.py)
+on consecutive frames, reported as "<backend>+roi".
+
+Usage:
+  python3 bench_backends.py
+  python3 bench_backends.py --backends torch onnx onnx-int8 --threads 4
+  python3 bench_backends.py --videos ../client/good.mp4 --frames 200
+  python3 bench_backends.py --backends onnx --roi --stride 1
+"""
+
+import argparse
+import glob
+import os
+import time
+
+import numpy as np
+
+from cpu_backend import CpuPoseBackend, export_model, read_video_frames
+from roi_tracking import RoiTracker
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_VIDEOS = sorted(glob.glob(os.path.join(HERE, '..', 'client', '*.mp4')))
+
+
+def extract(result):
+    """(N, 2) box centers and (N, K, 3) keypoints from a Results object"""
+    if result.keypoints is None or len(result.boxes) == 0:
+        return np.zeros((0, 2)), np.zeros((0, 0, 3))
+    xyxy = result.boxes.xyxy.cpu().numpy()
+    centers = (xyxy[:, :2] + xyxy[:, 2:4]) / 2
+    kpts = np.concatenate([result.keypoints.xy.cpu().numpy(),
+                           result.keypoints.conf.cpu().numpy()[..., None]], axis=2)
+    return centers, kpts
+
+
+def compare(reference, candidate, match_px=30.0):
+    """Match detections by box center; return (matched, total, keypoint errors in px)"""
+    ref_centers, ref_kpts = reference
+    cand_centers, cand_kpts = candidate
+    errors = []
+    matched = 0
+    for i, center in enumerate(ref_centers):
+        if len(cand_centers) == 0:
+            break
+        dist = np.linalg.norm(cand_centers - center, axis=1)
+        j = int(np.argmin(dist))
+        if dist[j] > match_px:
+            continue
+        matched += 1
+        errors.extend(np.linalg.norm(cand_kpts[j, :, :2] - ref_kpts[i, :, :2], axis=1))
+    return matched, len(ref_centers), errors
+
+
+def make_backend(name, args, model, imgsz):
+    """Return predict(frame) -> (result, timings) for a backend spec like 'onnx-int8'"""
+    backend, _, variant = name.partition('-')
+    if backend == 'torch':
+        def predict(frame):
+            result = model.predict(frame, device='cpu', imgsz=imgsz, verbose=False)[0]
+            return result, dict(result.speed)
+        return predict
+
+    exported = export_model(args.model, backend, imgsz=imgsz, int8=variant == 'int8',
+                            calib_video=args.calib_video or args.videos[0])
+    runner = CpuPoseBackend(exported, backend, model.names, imgsz=imgsz, threads=args.threads)
+    return runner.predict
+
+
+def make_roi_backend(name, args, model):
+    """ROI-tracking predict(frame) -> (result, timings); the tracker carries state across frames"""
+    tracker = RoiTracker(make_backend(name, args, model, args.imgsz),
+                         make_backend(name, args, model, args.roi_imgsz))
+
+    def predict(frame):
+        result, timings, _ = tracker.process(frame)
+        return result, timings
+    predict.tracker = tracker
+    return predict
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark nn_server inference backends')
+    parser.add_argument('--model', default=os.path.join(HERE, 'best.pt'))
+    parser.add_argument('--videos', nargs='+', default=DEFAULT_VIDEOS)
+    parser.add_argument('--backends', nargs='+',
+                        default=['torch', 'onnx', 'onnx-int8', 'openvino', 'openvino-int8'])
+    parser.add_argument('--frames', type=int, default=100, help='Frames per video (default: 100)')
+    parser.add_argument('--stride', type=int, default=3, help='Use every Nth frame (default: 3)')
+    parser.add_argument('--threads', type=int, default=None)
+    parser.add_argument('--imgsz', type=int, default=640)
+    parser.add_argument('--calib-video', default=None)
+    parser.add_argument('--roi', action='store_true', help='Also benchmark ROI-tracking mode')
+    parser.add_argument('--roi-imgsz', type=int, default=320)
+    args = parser.parse_args()
+
+    import torch
+    from ultralytics import YOLO
+    if args.threads:
+        torch.set_num_threads(args.threads)
+
+    model = YOLO(args.model)
+    reference_model = lambda frame: model.predict(frame, device='cpu', imgsz=args.imgsz, verbose=False)[0]
+
+    backends = {}
+    for name in args.backends:
+        try:
+            backends[name] = make_backend(name, args, model, args.imgsz)
+            if args.roi:
+                backends[name + '+roi'] = make_roi_backend(name, args, model)
+        except Exception as e:
+            print(f"Skipping {name}: {e}")
+
+    stats = {name: {'frames': 0, 'wall': 0.0, 'stages': {}, 'matched': 0, 'total': 0, 'errors': []}
+             for name in backends}
+
+    for video in args.videos:
+        frames = list(read_video_frames(video, args.frames, args.stride))
+        print(f"{os.path.basename(video)}: {len(frames)} frames")
+        references = [extract(reference_model(frame)) for frame in frames]
+
+        for name, predict in backends.items():
+            s = stats[name]
+            for frame in frames[:3]:
+                predict(frame)  # warm up
+            if hasattr(predict, 'tracker'):
+                predict.tracker.last_boxes = None  # start each video with a full search
+            for frame, reference in zip(frames, references):
+                t0 = time.perf_counter()
+                result, timings = predict(frame)
+                s['wall'] += time.perf_counter() - t0
+                s['frames'] += 1
+                for stage, ms in timings.items():
+                    s['stages'][stage] = s['stages'].get(stage, 0.0) + ms
+                matched, total, errors = compare(reference, extract(result))
+                s['matched'] += matched
+                s['total'] += total
+                s['errors'].extend(errors)
+
+    print()
+    print(f"{'backend':<20}{'fps':>8}{'pre ms':>9}{'infer ms':>10}{'post ms':>9}"
+          f"{'recall':>9}{'kpt err':>10}{'kpt p95':>10}")
+    for name, s in stats.items():
+        n = max(s['frames'], 1)
+        stage = lambda key: s['stages'].get(key, 0.0) / n
+        recall = s['matched'] / s['total'] if s['total'] else float('nan')
+        err = np.mean(s['errors']) if s['errors'] else float('nan')
+        p95 = np.percentile(s['errors'], 95) if s['errors'] else float('nan')
+        print(f"{name:<20}{n / max(s['wall'], 1e-9):>8.1f}{stage('preprocess'):>9.1f}"
+              f"{stage('inference'):>10.1f}{stage('postprocess'):>9.1f}"
+              f"{recall:>9.1%}{err:>8.2f}px{p95:>8.2f}px")
+
+
+if __name__ == '__main__':
+    main()
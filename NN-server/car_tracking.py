@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""
+Persistent car IDs for the YOLO pose server
+
+Detections come out of the model in arbitrary order, so their index is not
+an identity. CarTracker associates each frame's detections with the tracks
+from previous frames by solving an assignment problem over a cost that
+combines box overlap and keypoint distance, and hands out IDs that stay
+with a car for as long as it keeps being seen. A track survives a few
+missed frames (occlusion, a low-confidence frame) before its ID is retired.
+"""
+
+import itertools
+
+import numpy as np
+
+try:
+    from scipy.optimize import linear_sum_assignment
+except ImportError:  # scipy ships with ultralytics, but keep a fallback
+    linear_sum_assignment = None
+
+
+def box_iou(a, b):
+    """Pairwise IoU between (N, 4) and (M, 4) xyxy boxes"""
+    x1 = np.maximum(a[:, None, 0], b[None, :, 0])
+    y1 = np.maximum(a[:, None, 1], b[None, :, 1])
+    x2 = np.minimum(a[:, None, 2], b[None, :, 2])
+    y2 = np.minimum(a[:, None, 3], b[None, :, 3])
+    inter = np.clip(x2 - x1, 0, None) * np.clip(y2 - y1, 0, None)
+    area_a = (a[:, 2] - a[:, 0]) * (a[:, 3] - a[:, 1])
+    area_b = (b[:, 2] - b[:, 0]) * (b[:, 3] - b[:, 1])
+    return inter / np.maximum(area_a[:, None] + area_b[None, :] - inter, 1e-9)
+
+
+def greedy_assignment(cost):
+    """Cheapest-first matching, used when scipy is unavailable"""
+    rows, cols = [], []
+    for flat in np.argsort(cost, axis=None):
+        r, c = np.unravel_index(flat, cost.shape)
+        if r not in rows and c not in cols:
+            rows.append(r)
+            cols.append(c)
+    return np.array(rows, dtype=int), np.array(cols, dtype=int)
+
+
+class Track:
+    def __init__(self, track_id, box, keypoints):
+        self.track_id = track_id
+        self.box = box
+        self.keypoints = keypoints
+        self.velocity = np.zeros(2)  # box center motion per frame
+        self.misses = 0
+        self.hits = 1
+
+    def predicted(self):
+        """Box and keypoints extrapolated to the next frame at constant velocity"""
+        shift = self.velocity * (self.misses + 1)
+        return self.box + np.tile(shift, 2), self.keypoints + shift
+
+    def update(self, box, keypoints):
+        center = (box[:2] + box[2:]) / 2
+        previous = (self.box[:2] + self.box[2:]) / 2
+        self.velocity = 0.5 * self.velocity + 0.5 * (center - previous) / (self.misses + 1)
+        self.box = box
+        self.keypoints = keypoints
+        self.misses = 0
+        self.hits += 1
+
+
+class CarTracker:
+    def __init__(self, max_misses=15, iou_weight=0.5, max_cost=0.9):
+        """
+        Args:
+            max_misses: Frames a track may go undetected before its ID is retired
+            iou_weight: Share of the cost from box overlap; the rest is keypoint
+                        distance relative to the box diagonal
+            max_cost: Pairs costing more than this are never matched
+        """
+        self.max_misses = max_misses
+        self.iou_weight = iou_weight
+        self.max_cost = max_cost
+        self.tracks = []
+        self.ids = itertools.count()
+
+    def cost_matrix(self, boxes, keypoints):
+        """(tracks, detections) association cost in [0, 1+]"""
+        predicted = [track.predicted() for track in self.tracks]
+        track_boxes = np.array([p[0] for p in predicted])
+        track_kpts = np.array([p[1] for p in predicted])
+
+        iou_cost = 1.0 - box_iou(track_boxes, boxes)
+        diag = np.linalg.norm(track_boxes[:, 2:] - track_boxes[:, :2], axis=1)
+        kpt_dist = np.linalg.norm(track_kpts[:, None] - keypoints[None], axis=3).mean(axis=2)
+        kpt_cost = np.minimum(kpt_dist / np.maximum(diag[:, None], 1.0), 2.0)
+        return self.iou_weight * iou_cost + (1 - self.iou_weight) * kpt_cost
+
+    def update(self, boxes, keypoints):
+        """
+        Associate one frame's detections with the existing tracks
+
+        Args:
+            boxes: (N, 4) xyxy boxes
+            keypoints: (N, K, 2) keypoint coordinates
+
+        Returns the track ID of each detection, in detection order.
+        """
+        boxes = np.asarray(boxes, dtype=float).reshape(-1, 4)
+        keypoints = np.asarray(keypoints, dtype=float)
+        if len(boxes):
+            keypoints = keypoints.reshape(len(boxes), -1, 2)
+        ids = [None] * len(boxes)
+        matched_tracks = set()
+
+        if self.tracks and len(boxes):
+            cost = self.cost_matrix(boxes, keypoints)
+            solve = linear_sum_assignment or greedy_assignment
+            for t, d in zip(*solve(cost)):
+                if cost[t, d] > self.max_cost:
+                    continue
+                track = self.tracks[t]
+                track.update(boxes[d], keypoints[d])
+                ids[d] = track.track_id
+                matched_tracks.add(t)
+
+        for t, track in enumerate(self.tracks):
+            if t not in matched_tracks:
+                track.misses += 1
+        self.tracks = [track for track in self.tracks if track.misses <= self.max_misses]
+
+        for d in range(len(boxes)):
+            if ids[d] is None:
+                track = Track(next(self.ids), boxes[d], keypoints[d])
+                self.tracks.append(track)
+                ids[d] = track.track_id
+
+        return ids
+
+    @property
+    def active_ids(self):
+        return [track.track_id for track in self.tracks if track.misses == 0]
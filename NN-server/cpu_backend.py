@@ -0,0 +1,227 @@
+#!/usr/bin/env python3
+"""
+CPU inference backends for the YOLO pose server
+
+Exports the trained PyTorch model (best.pt) to ONNX or OpenVINO, optionally
+quantized to INT8, and runs it with an explicit intra-op thread count.
+Pre- and postprocessing are done here rather than by ultralytics so each
+stage can be timed and the runtime session can be configured directly.
+Results are returned as ultralytics Results objects, so detection
+extraction and plotting work exactly as with the PyTorch backend.
+"""
+
+import os
+import time
+import logging
+
+import cv2
+import numpy as np
+
+logger = logging.getLogger(__name__)
+
+BACKENDS = ('torch', 'onnx', 'openvino')
+
+
+def export_model(pt_path, backend, imgsz=640, int8=False, calib_video=None, calib_frames=300):
+    """
+    Export best.pt for a CPU backend and return the path of the exported model
+
+    Exports are cached next to the .pt file and reused on later runs.
+
+    Args:
+        pt_path: Trained PyTorch model
+        backend: 'onnx' or 'openvino'
+        imgsz: Square input size the model is exported for
+        int8: Quantize weights (ONNX: dynamic quantization) or weights and
+              activations (OpenVINO: post-training quantization on calib_video)
+        calib_video: Recorded video used as calibration data for OpenVINO INT8
+        calib_frames: Number of frames to calibrate on
+    """
+    from ultralytics import YOLO
+
+    stem = os.path.splitext(pt_path)[0]
+    suffix = f"_{imgsz}" + ("_int8" if int8 else "")
+
+    if backend == 'onnx':
+        target = f"{stem}{suffix}.onnx"
+        if os.path.exists(target):
+            return target
+        logger.info(f"Exporting {pt_path} to ONNX (imgsz={imgsz})...")
+        exported = YOLO(pt_path).export(format='onnx', imgsz=imgsz, dynamic=False, simplify=True)
+        if int8:
+            from onnxruntime.quantization import quantize_dynamic, QuantType
+            logger.info("Quantizing ONNX weights to INT8...")
+            quantize_dynamic(exported, target, weight_type=QuantType.QUInt8)
+        else:
+            os.replace(exported, target)
+        return target
+
+    if backend == 'openvino':
+        target = f"{stem}{suffix}_openvino/model.xml"
+        if os.path.exists(target):
+            return target
+        logger.info(f"Exporting {pt_path} to OpenVINO (imgsz={imgsz})...")
+        exported_dir = YOLO(pt_path).export(format='openvino', imgsz=imgsz, half=False)
+        xml = os.path.join(exported_dir, os.path.basename(stem) + '.xml')
+
+        import openvino as ov
+        core = ov.Core()
+        model = core.read_model(xml)
+        if int8:
+            if not calib_video:
+                raise ValueError("OpenVINO INT8 needs --calib-video for calibration frames")
+            import nncf
+            logger.info(f"Quantizing OpenVINO model to INT8 on {calib_video}...")
+            frames = list(read_video_frames(calib_video, calib_frames))
+            dataset = nncf.Dataset(frames, lambda f: letterbox(f, imgsz)[0])
+            model = nncf.quantize(model, dataset, preset=nncf.QuantizationPreset.MIXED)
+        os.makedirs(os.path.dirname(target), exist_ok=True)
+        ov.save_model(model, target)
+        return target
+
+    raise ValueError(f"Unknown CPU backend: {backend}")
+
+
+def read_video_frames(path, limit=None, stride=1):
+    """Yield BGR frames from a video file"""
+    capture = cv2.VideoCapture(path)
+    index = 0
+    yielded = 0
+    try:
+        while limit is None or yielded < limit:
+            ret, frame = capture.read()
+            if not ret:
+                break
+            if index % stride == 0:
+                yield frame
+                yielded += 1
+            index += 1
+    finally:
+        capture.release()
+
+
+def letterbox(frame, imgsz):
+    """
+    Resize keeping aspect ratio and pad to imgsz x imgsz (ultralytics style)
+
+    Returns the NCHW float32 input tensor, the scale and the (left, top) padding.
+    """
+    h, w = frame.shape[:2]
+    scale = min(imgsz / h, imgsz / w)
+    new_w, new_h = int(round(w * scale)), int(round(h * scale))
+    left = (imgsz - new_w) // 2
+    top = (imgsz - new_h) // 2
+
+    canvas = np.full((imgsz, imgsz, 3), 114, dtype=np.uint8)
+    canvas[top:top + new_h, left:left + new_w] = cv2.resize(frame, (new_w, new_h),
+                                                            interpolation=cv2.INTER_LINEAR)
+    blob = cv2.dnn.blobFromImage(canvas, 1 / 255.0, swapRB=True)
+    return blob, scale, (left, top)
+
+
+def decode_pose_output(output, num_classes, scale, pad, frame_shape,
+                       conf_threshold=0.25, iou_threshold=0.7, max_det=300):
+    """
+    Decode a raw YOLO pose head output of shape (1, 4 + nc + K*3, anchors)
+
+    Returns (boxes, keypoints): boxes is (N, 6) [x1, y1, x2, y2, conf, cls]
+    and keypoints is (N, K, 3) [x, y, conf], both in frame coordinates.
+    """
+    preds = output[0].T  # (anchors, channels)
+    scores = preds[:, 4:4 + num_classes]
+    cls = scores.argmax(axis=1)
+    conf = scores[np.arange(len(scores)), cls]
+    keep = conf > conf_threshold
+    preds, cls, conf = preds[keep], cls[keep], conf[keep]
+
+    num_kpts = (preds.shape[1] - 4 - num_classes) // 3
+    if len(preds) == 0:
+        return np.zeros((0, 6), np.float32), np.zeros((0, num_kpts, 3), np.float32)
+
+    cx, cy, w, h = preds[:, 0], preds[:, 1], preds[:, 2], preds[:, 3]
+    xywh = np.stack([cx - w / 2, cy - h / 2, w, h], axis=1)
+    indices = cv2.dnn.NMSBoxes(xywh.tolist(), conf.tolist(), conf_threshold, iou_threshold)
+    indices = np.array(indices, dtype=int).reshape(-1)[:max_det]
+
+    left, top = pad
+    xyxy = np.stack([cx - w / 2, cy - h / 2, cx + w / 2, cy + h / 2], axis=1)[indices]
+    xyxy[:, [0, 2]] = (xyxy[:, [0, 2]] - left) / scale
+    xyxy[:, [1, 3]] = (xyxy[:, [1, 3]] - top) / scale
+    fh, fw = frame_shape[:2]
+    xyxy[:, [0, 2]] = xyxy[:, [0, 2]].clip(0, fw)
+    xyxy[:, [1, 3]] = xyxy[:, [1, 3]].clip(0, fh)
+    boxes = np.concatenate([xyxy, conf[indices, None], cls[indices, None]], axis=1)
+
+    kpts = preds[indices, 4 + num_classes:].reshape(-1, num_kpts, 3).copy()
+    kpts[..., 0] = (kpts[..., 0] - left) / scale
+    kpts[..., 1] = (kpts[..., 1] - top) / scale
+    return boxes.astype(np.float32), kpts.astype(np.float32)
+
+
+class CpuPoseBackend:
+    """Runs an exported YOLO pose model on ONNX Runtime or OpenVINO"""
+
+    def __init__(self, model_path, backend, names, imgsz=640, threads=None):
+        """
+        Args:
+            model_path: Exported model (.onnx or OpenVINO .xml)
+            backend: 'onnx' or 'openvino'
+            names: Class names dict from the original model
+            imgsz: Input size the model was exported for
+            threads: Intra-op thread count (None = runtime default)
+        """
+        self.backend = backend
+        self.names = names
+        self.imgsz = imgsz
+
+        if backend == 'onnx':
+            import onnxruntime as ort
+            options = ort.SessionOptions()
+            if threads:
+                options.intra_op_num_threads = threads
+                options.inter_op_num_threads = 1
+            options.execution_mode = ort.ExecutionMode.ORT_SEQUENTIAL
+            self.session = ort.InferenceSession(model_path, options,
+                                                providers=['CPUExecutionProvider'])
+            self.input_name = self.session.get_inputs()[0].name
+            self._run = lambda blob: self.session.run(None, {self.input_name: blob})[0]
+        elif backend == 'openvino':
+            import openvino as ov
+            config = {'PERFORMANCE_HINT': 'LATENCY'}
+            if threads:
+                config['INFERENCE_NUM_THREADS'] = threads
+            self.compiled = ov.Core().compile_model(model_path, 'CPU', config)
+            self.request = self.compiled.create_infer_request()
+            self._run = lambda blob: self.request.infer({0: blob})[self.compiled.output(0)]
+        else:
+            raise ValueError(f"Unknown CPU backend: {backend}")
+
+        logger.info(f"✓ {backend} backend loaded: {model_path} "
+                    f"(imgsz={imgsz}, threads={threads or 'default'})")
+
+    def predict(self, frame, conf=0.25, iou=0.7):
+        """
+        Run detection on one BGR frame
+
+        Returns (result, timings) where result is an ultralytics Results
+        object and timings holds preprocess/inference/postprocess in ms.
+        """
+        import torch
+        from ultralytics.engine.results import Results
+
+        t0 = time.perf_counter()
+        blob, scale, pad = letterbox(frame, self.imgsz)
+        t1 = time.perf_counter()
+        output = self._run(blob)
+        t2 = time.perf_counter()
+        boxes, kpts = decode_pose_output(output, len(self.names), scale, pad, frame.shape,
+                                         conf_threshold=conf, iou_threshold=iou)
+        result = Results(frame, path=None, names=self.names,
+                         boxes=torch.from_numpy(boxes), keypoints=torch.from_numpy(kpts))
+        t3 = time.perf_counter()
+
+        return result, {
+            'preprocess': (t1 - t0) * 1000,
+            'inference': (t2 - t1) * 1000,
+            'postprocess': (t3 - t2) * 1000
+        }
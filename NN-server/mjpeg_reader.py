@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""
+MJPEG multipart reader that keeps per-frame headers
+
+cv2.VideoCapture hides the multipart part headers, which is where
+video_server.py puts each frame's capture time (X-Timestamp) and sequence
+number (X-Frame-Seq). MjpegReader reads the stream itself, returning the
+JPEG bytes together with those headers, and uses Content-Length when the
+server sends it instead of scanning the payload for JPEG markers.
+"""
+
+import time
+import struct
+import logging
+
+import cv2
+import requests
+
+logger = logging.getLogger(__name__)
+
+
+# estimate_clock_offset, jpeg_size and scale_for are the same as in
+# client/mjpeg_stream.py (the client and this server are deployed
+# separately); keep the two copies identical.
+
+def estimate_clock_offset(url, samples=5, timeout=2.0):
+    """
+    Offset to add to the remote clock to get local time, from a JSON
+    endpoint that reports its clock as 'time'
+
+    Uses the sample with the smallest round trip (NTP style). Returns
+    (offset, rtt) in seconds, or (0.0, None) if the server does not report
+    its clock.
+    """
+    best = None
+    for _ in range(samples):
+        try:
+            t0 = time.time()
+            remote = requests.get(url, timeout=timeout).json().get('time')
+            t1 = time.time()
+        except Exception:
+            continue
+        if remote is None:
+            return 0.0, None
+        if best is None or t1 - t0 < best[1]:
+            best = ((t0 + t1) / 2 - remote, t1 - t0)
+    return best if best is not None else (0.0, None)
+
+
+# cv2.imdecode flags for decoding at 1/N scale in the JPEG's IDCT
+REDUCED_COLOR = {1: cv2.IMREAD_COLOR, 2: cv2.IMREAD_REDUCED_COLOR_2,
+                 4: cv2.IMREAD_REDUCED_COLOR_4, 8: cv2.IMREAD_REDUCED_COLOR_8}
+
+
+def jpeg_size(jpeg):
+    """(width, height) from a JPEG's SOF marker without decoding it, or None"""
+    data = memoryview(jpeg)
+    i = 2
+    while i + 9 <= len(data):
+        if data[i] != 0xFF:
+            return None
+        marker = data[i + 1]
+        if marker == 0xFF:  # fill byte
+            i += 1
+            continue
+        if 0xC0 <= marker <= 0xCF and marker not in (0xC4, 0xC8, 0xCC):
+            height, width = struct.unpack('>HH', data[i + 5:i + 9])
+            return width, height
+        i += 2 + struct.unpack('>H', data[i + 2:i + 4])[0]
+    return None
+
+
+def scale_for(width, height, target_width=0, target_height=0):
+    """Largest JPEG decode scale denominator (8, 4, 2, 1) whose output still covers the target size"""
+    for denom in (8, 4, 2):
+        if width / denom >= target_width and height / denom >= target_height:
+            return denom
+    return 1
+
+
+class MjpegReader:
+    """Reads (jpeg_bytes, headers, receive_time) parts from a multipart/x-mixed-replace stream"""
+
+    def __init__(self, url, timeout=10, chunk_size=16384):
+        self.url = url
+        self.timeout = timeout
+        self.chunk_size = chunk_size
+        self.response = None
+        self.chunks = None
+        self.buffer = b''
+        self.boundary = b'--frame'
+
+    def open(self):
+        self.response = requests.get(self.url, stream=True, timeout=self.timeout)
+        if self.response.status_code != 200:
+            raise ConnectionError(f"HTTP {self.response.status_code} from {self.url}")
+        content_type = self.response.headers.get('Content-Type', '')
+        if 'boundary=' in content_type:
+            boundary = content_type.split('boundary=', 1)[1].split(';')[0].strip().strip('"')
+            self.boundary = boundary.encode() if boundary.startswith('--') else b'--' + boundary.encode()
+        self.chunks = self.response.iter_content(chunk_size=self.chunk_size)
+        self.buffer = b''
+        return self
+
+    def close(self):
+        if self.response is not None:
+            self.response.close()
+            self.response = None
+
+    def _fill(self):
+        chunk = next(self.chunks, None)
+        if not chunk:
+            raise ConnectionError("Stream ended")
+        self.buffer += chunk
+
+    def read(self):
+        """
+        Return the next part as (jpeg_bytes, headers, receive_time)
+
+        headers has lower-case names; receive_time is when the last byte of
+        the part arrived.
+        """
+        # Part headers: boundary line up to the blank line
+        while True:
+            start = self.buffer.find(self.boundary)
+            end = self.buffer.find(b'\r\n\r\n', start) if start != -1 else -1
+            if end != -1:
+                break
+            self._fill()
+
+        headers = {}
+        for line in self.buffer[start + len(self.boundary):end].split(b'\r\n'):
+            name, sep, value = line.partition(b':')
+            if sep:
+                headers[name.strip().lower().decode()] = value.strip().decode()
+        body_start = end + 4
+
+        # Body: Content-Length when given, otherwise up to the next boundary
+        length = headers.get('content-length')
+        if length is not None:
+            body_end = body_start + int(length)
+            while len(self.buffer) < body_end:
+                self._fill()
+        else:
+            while True:
+                body_end = self.buffer.find(self.boundary, body_start)
+                if body_end != -1:
+                    break
+                self._fill()
+        receive_time = time.time()
+
+        jpeg = self.buffer[body_start:body_end].rstrip(b'\r\n') if length is None \
+            else self.buffer[body_start:body_end]
+        self.buffer = self.buffer[body_end:]
+        return jpeg, headers, receive_time
@@ -17,35 +17,90 @@ from collections import deque
 from datetime import datetime
 import json
 
+from car_tracking import CarTracker
+from mjpeg_reader import MjpegReader, estimate_clock_offset, jpeg_size, scale_for, REDUCED_COLOR
+
 logging.basicConfig(level=logging.INFO)
 logger = logging.getLogger(__name__)
 
 app = Flask(__name__)
 CORS(app)  # Enable CORS for cross-origin requests
 
+STAGES = ('decode', 'preprocess', 'inference', 'postprocess')
+# Per-hop latency of each frame, from its capture on the video server
+LATENCY_HOPS = ('capture_to_receive', 'receive_to_publish', 'capture_to_publish')
+
+
 class YOLOPoseProcessor:
-    def __init__(self, source_url, model_name="yolo11n-pose.pt"):
+    def __init__(self, source_url, model_name="yolo11n-pose.pt", device="auto",
+                 backend="torch", int8=False, threads=None, imgsz=640, calib_video=None,
+                 roi=False, roi_imgsz=320, decode_scale='auto'):
         """
         Initialize YOLO pose processor
         
         Args:
             source_url: URL of the video stream (e.g., http://pi-hostname:5000/video_feed)
             model_name: YOLO model to use (yolo11n-pose.pt, yolo11s-pose.pt, etc.)
+            device: 'auto' (first GPU if available, else CPU), a CUDA index, or 'cpu'
+            backend: 'torch', or a CPU backend from cpu_backend.py ('onnx', 'openvino')
+            int8: Quantize the model for the CPU backend
+            threads: Intra-op thread count for CPU inference (None = all cores)
+            imgsz: Inference input size
+            calib_video: Video used to calibrate OpenVINO INT8 quantization
+            roi: Track the car and run inference on a crop around it (see roi_tracking.py)
+            roi_imgsz: Inference input size for ROI crops
+            decode_scale: Decode source JPEGs at 1/N size (1, 2, 4, 8), or 'auto'
+                          for the smallest that still covers imgsz (full size
+                          with roi, whose crops need the detail)
         """
         # Ensure the URL points to the video_feed endpoint
         self.source_url = self._validate_source_url(source_url)
         self.model_name = model_name
         self.model = None
+        self.device = device
+        self.backend_name = backend
+        self.backend = None  # CpuPoseBackend when not using torch
+        self.int8 = int8
+        self.threads = threads
+        self.imgsz = imgsz
+        self.calib_video = calib_video
+        self.roi = roi
+        self.roi_imgsz = roi_imgsz
+        self.roi_tracker = None
+        self.roi_backend = None
+        self.decode_scale_setting = decode_scale
+        self.decode_scale = 1
+        self.source_size = None  # full (width, height) of the source frames
+        self.frame_scale = 1.0   # source pixels per decoded pixel of the current frame
         
-        # Frame storage
-        self.annotated_frame = None
+        # Frame-to-frame association so car_id stays with the same car
+        self.car_tracker = CarTracker()
+        
+        # Frame storage: the raw result is kept and only plotted/encoded when
+        # a viewer asks for it, once per frame however many viewers there are
+        self.latest_result = None
+        self.latest_result_seq = 0
         self.frame_lock = threading.Lock()
+        self.frame_cond = threading.Condition(self.frame_lock)
+        self.jpeg_lock = threading.Lock()
+        self.jpeg_seq = 0
+        self.jpeg_bytes = None
+        self.viewers = 0
+        self.frames_encoded = 0
         
         # Detection results storage
         self.latest_results = None
+        self.latest_seq = 0
+        self.latest_provenance = None
         self.results_lock = threading.Lock()
         self.results_history = deque(maxlen=100)  # Keep last 100 results
         
+        # Compact per-frame pose records for push subscribers
+        self.frame_seq = 0
+        self.pose_record = None
+        self.pose_record_seq = -1
+        self.pose_record_cond = threading.Condition()
+        
         # Processing state
         self.running = False
         self.processing_thread = None
@@ -54,10 +109,17 @@ class YOLOPoseProcessor:
         self.last_fps_update = time.time()
         
         # Performance metrics
+        self.stage_ms = {stage: 0.0 for stage in STAGES}  # smoothed per-stage timings
         self.inference_time = 0
         self.total_inference_time = 0
         self.total_frames_processed = 0
         
+        # Frame provenance: capture time and sequence number from video_server
+        self.clock_offset = 0.0  # add to video_server's clock to get ours
+        self.latency_ms = {hop: 0.0 for hop in LATENCY_HOPS}  # smoothed
+        self.source_seq = 0
+        self.source_frames_skipped = 0
+        
     def _validate_source_url(self, url):
         """
         Validate and correct the source URL to ensure it points to video_feed endpoint
@@ -95,13 +157,40 @@ class YOLOPoseProcessor:
             logger.info(f"Loading YOLO model: {self.model_name}")
             self.model = YOLO(self.model_name)
             
-            # Verify CUDA is available
             import torch
-            if torch.cuda.is_available():
-                logger.info(f"✓ CUDA available - GPU: {torch.cuda.get_device_name(0)}")
+            if self.threads:
+                torch.set_num_threads(self.threads)
+            
+            if self.backend_name != 'torch':
+                from cpu_backend import CpuPoseBackend, export_model
+                exported = export_model(self.model_name, self.backend_name, imgsz=self.imgsz,
+                                        int8=self.int8, calib_video=self.calib_video)
+                self.backend = CpuPoseBackend(exported, self.backend_name, self.model.names,
+                                              imgsz=self.imgsz, threads=self.threads)
+                if self.roi:
+                    # Exported models have a fixed input size, so crops need their own
+                    exported = export_model(self.model_name, self.backend_name, imgsz=self.roi_imgsz,
+                                            int8=self.int8, calib_video=self.calib_video)
+                    self.roi_backend = CpuPoseBackend(exported, self.backend_name, self.model.names,
+                                                      imgsz=self.roi_imgsz, threads=self.threads)
+                self.device = 'cpu'
+            elif self.device == 'auto':
+                self.device = 0 if torch.cuda.is_available() else 'cpu'
+            
+            if self.roi:
+                from roi_tracking import RoiTracker
+                self.roi_tracker = RoiTracker(
+                    full_predict=lambda frame: self._predict(frame, self.backend, self.imgsz),
+                    roi_predict=lambda crop: self._predict(crop, self.roi_backend, self.roi_imgsz)
+                )
+                logger.info(f"✓ ROI tracking enabled (crop imgsz={self.roi_imgsz})")
+            
+            # Report the device in use
+            if self.device != 'cpu' and torch.cuda.is_available():
+                logger.info(f"✓ CUDA available - GPU: {torch.cuda.get_device_name(self.device)}")
                 logger.info(f"✓ CUDA version: {torch.version.cuda}")
-            else:
-                logger.warning("⚠ CUDA not available, using CPU (will be slow)")
+            elif self.backend is None:
+                logger.warning("⚠ Running PyTorch on CPU (consider --backend onnx or openvino)")
             
             logger.info("Model loaded successfully")
             return True
@@ -131,46 +220,62 @@ class YOLOPoseProcessor:
         retry_count = 0
         
         while retry_count < max_retries and self.running:
+            capture = None
+            reader = None
             try:
                 logger.info(f"Connecting to stream: {self.source_url}")
                 
-                # Run inference on the stream
-                # stream=True returns a generator for efficient processing
-                results_generator = self.model(
-                    self.source_url,
-                    stream=True,
-                    verbose=False,
-                    device=0  # Use GPU 0 (your 4070)
-                )
+                # Frames are read here rather than by ultralytics so decoding
+                # can be timed separately from inference. HTTP streams are
+                # demuxed by MjpegReader to get each frame's capture time.
+                if self.source_url.startswith(('http://', 'https://')):
+                    reader = MjpegReader(self.source_url).open()
+                    self._sync_source_clock()
+                else:
+                    capture = cv2.VideoCapture(self.source_url)
+                    if not capture.isOpened():
+                        raise ConnectionError(f"Could not open {self.source_url}")
+                    capture.set(cv2.CAP_PROP_BUFFERSIZE, 1)
                 
                 # Reset retry count on successful connection
                 retry_count = 0
                 
-                for result in results_generator:
-                    if not self.running:
-                        break
+                while self.running:
+                    frame, provenance, decode_ms = self._read_frame(reader, capture)
+                    if frame is None:
+                        continue
                     
-                    start_time = time.time()
+                    result, timings = self._infer(frame)
+                    timings['decode'] = decode_ms
+                    self._update_stage_timings(timings)
                     
-                    # Get annotated frame with pose keypoints drawn
-                    annotated_frame = result.plot()
-                    
-                    # Extract detection data
+                    # Extract detection data and push it to subscribers first,
+                    # before any annotation work
                     detection_data = self._extract_detections(result)
+                    self.frame_seq += 1
+                    latency = self._update_latency(provenance, time.time())
+                    self._publish_pose_record(self.frame_seq, provenance, detection_data)
                     
-                    # Update stored frame and results
-                    with self.frame_lock:
-                        self.annotated_frame = annotated_frame.copy()
+                    # Update stored frame (annotated lazily) and results
+                    with self.frame_cond:
+                        self.latest_result = result
+                        self.latest_result_seq = self.frame_seq
+                        self.frame_cond.notify_all()
                     
                     with self.results_lock:
                         self.latest_results = detection_data
+                        self.latest_seq = self.frame_seq
+                        self.latest_provenance = dict(provenance, latency_ms=latency)
                         self.results_history.append({
                             'timestamp': datetime.now().isoformat(),
+                            'seq': self.frame_seq,
+                            'source_seq': provenance['source_seq'],
+                            'capture_time': provenance['capture_time'],
+                            'latency_ms': latency,
                             'detections': detection_data
                         })
                     
                     # Update performance metrics
-                    self.inference_time = time.time() - start_time
                     self.total_inference_time += self.inference_time
                     self.total_frames_processed += 1
                     
@@ -182,7 +287,9 @@ class YOLOPoseProcessor:
                         self.last_fps_update = time.time()
                         
                         avg_inference = self.total_inference_time / self.total_frames_processed
-                        logger.info(f"FPS: {self.fps} | Inference: {avg_inference*1000:.1f}ms")
+                        stages = " ".join(f"{k}={v:.1f}" for k, v in self.stage_ms.items())
+                        logger.info(f"FPS: {self.fps} | Inference: {avg_inference*1000:.1f}ms | {stages} | "
+                                    f"capture->publish {self.latency_ms['capture_to_publish']:.0f}ms")
             
             except ConnectionError as e:
                 retry_count += 1
@@ -204,21 +311,135 @@ class YOLOPoseProcessor:
                 logger.error(f"Error in processing stream: {e}")
                 logger.exception(e)
                 break
+            
+            finally:
+                if capture is not None:
+                    capture.release()
+                if reader is not None:
+                    reader.close()
                 
         logger.info("Processing thread stopped")
         self.running = False
     
+    def _sync_source_clock(self):
+        """Estimate the video server's clock offset from its /status endpoint"""
+        from urllib.parse import urlparse
+        parsed = urlparse(self.source_url)
+        offset, rtt = estimate_clock_offset(f"{parsed.scheme}://{parsed.netloc}/status")
+        self.clock_offset = offset
+        if rtt is None:
+            logger.warning("Video server does not report its clock; assuming clocks are in sync")
+        else:
+            logger.info(f"Video server clock offset: {offset * 1000:+.1f}ms (rtt {rtt * 1000:.1f}ms)")
+    
+    def _read_frame(self, reader, capture):
+        """
+        Read and decode the next frame
+        
+        Returns (frame, provenance, decode_ms). provenance holds the source
+        sequence number and the capture and receive times on our clock; when
+        the source sends no timestamp the receive time stands in for capture.
+        """
+        if reader is not None:
+            jpeg, headers, receive_time = reader.read()
+            decode_start = time.perf_counter()
+            self._pick_decode_scale(jpeg)
+            frame = cv2.imdecode(np.frombuffer(jpeg, dtype=np.uint8), REDUCED_COLOR[self.decode_scale])
+            decode_ms = (time.perf_counter() - decode_start) * 1000
+            source_seq = int(headers.get('x-frame-seq', 0))
+            capture_time = (float(headers['x-timestamp']) + self.clock_offset
+                            if 'x-timestamp' in headers else receive_time)
+        else:
+            # Decode time includes waiting for the frame to arrive
+            decode_start = time.perf_counter()
+            ret, frame = capture.read()
+            if not ret:
+                raise ConnectionError("Stream ended")
+            decode_ms = (time.perf_counter() - decode_start) * 1000
+            receive_time = time.time()
+            capture_time = receive_time
+            source_seq = self.source_seq + 1
+        
+        if frame is not None:
+            source_width = self.source_size[0] if self.source_size else frame.shape[1]
+            self.frame_scale = source_width / frame.shape[1]
+        
+        if self.source_seq and source_seq > self.source_seq + 1:
+            self.source_frames_skipped += source_seq - self.source_seq - 1
+        self.source_seq = source_seq
+        
+        return frame, {
+            'source_seq': source_seq,
+            'capture_time': capture_time,
+            'receive_time': receive_time
+        }, decode_ms
+    
+    def _pick_decode_scale(self, jpeg):
+        """Choose the JPEG decode scale when the source resolution is first seen or changes"""
+        size = jpeg_size(jpeg)
+        if size is None or size == self.source_size:
+            return
+        self.source_size = size
+        if self.decode_scale_setting != 'auto':
+            self.decode_scale = int(self.decode_scale_setting)
+        elif self.roi:
+            self.decode_scale = 1
+        else:
+            # The model letterboxes to imgsz, so only the long side needs covering
+            long_side = (self.imgsz, 0) if size[0] >= size[1] else (0, self.imgsz)
+            self.decode_scale = scale_for(*size, *long_side)
+        logger.info(f"Source {size[0]}x{size[1]}: decoding at 1/{self.decode_scale} "
+                    f"({size[0] // self.decode_scale}x{size[1] // self.decode_scale}) for imgsz {self.imgsz}")
+    
+    def _update_latency(self, provenance, publish_time, alpha=0.1):
+        """Per-hop latency of one frame in ms; also folded into the smoothed stats"""
+        latency = {
+            'capture_to_receive': (provenance['receive_time'] - provenance['capture_time']) * 1000,
+            'receive_to_publish': (publish_time - provenance['receive_time']) * 1000,
+            'capture_to_publish': (publish_time - provenance['capture_time']) * 1000
+        }
+        for hop, value in latency.items():
+            previous = self.latency_ms[hop]
+            self.latency_ms[hop] = value if previous == 0 else previous + alpha * (value - previous)
+        return {hop: round(ms, 1) for hop, ms in latency.items()}
+    
+    def _predict(self, frame, backend, imgsz):
+        """Run the model on an image with the given CPU backend (or torch if None)"""
+        if backend is not None:
+            return backend.predict(frame)
+        result = self.model.predict(frame, device=self.device, imgsz=imgsz, verbose=False)[0]
+        return result, dict(result.speed)
+    
+    def _infer(self, frame):
+        """Run pose detection on one frame; returns (result, per-stage timings in ms)"""
+        if self.roi_tracker is not None:
+            result, timings, _ = self.roi_tracker.process(frame)
+        else:
+            result, timings = self._predict(frame, self.backend, self.imgsz)
+        
+        self.inference_time = sum(timings.values()) / 1000
+        return result, timings
+    
+    def _update_stage_timings(self, timings, alpha=0.1):
+        for stage in STAGES:
+            value = timings.get(stage, 0.0)
+            previous = self.stage_ms[stage]
+            self.stage_ms[stage] = value if previous == 0 else previous + alpha * (value - previous)
+    
     def _extract_detections(self, result):
         """
         Extract pose detection data from YOLO result
         
         Returns structured detection data with bounding boxes and keypoints
         For custom car dataset: 2 keypoints with flip_idx [1, 0]
+        Coordinates are in source-frame pixels, whatever scale it was decoded at.
         """
         detections = []
+        scale = self.frame_scale
         
         # Check if pose keypoints are available
         if result.keypoints is None or len(result.keypoints) == 0:
+            self.car_tracker.update(np.zeros((0, 4)), np.zeros((0, 0, 2)))
             return detections
         
         # Get boxes and keypoints
@@ -230,7 +451,7 @@ class YOLOPoseProcessor:
             
             # Bounding box
             box = boxes[i]
-            xyxy = box.xyxy[0].cpu().numpy()  # x1, y1, x2, y2
+            xyxy = box.xyxy[0].cpu().numpy() * scale  # x1, y1, x2, y2
             detection['bbox'] = {
                 'x1': float(xyxy[0]),
                 'y1': float(xyxy[1]),
@@ -245,7 +466,7 @@ class YOLOPoseProcessor:
             
             # Pose keypoints
             # Custom dataset has 2 keypoints: typically front and back of car
-            kpts = keypoints[i].xy[0].cpu().numpy()  # Shape: (2, 2)
+            kpts = keypoints[i].xy[0].cpu().numpy() * scale  # Shape: (2, 2)
             kpts_conf = keypoints[i].conf[0].cpu().numpy()  # Shape: (2,)
             
             # Based on your dataset, these would be the two key points of the car
@@ -263,22 +484,105 @@ class YOLOPoseProcessor:
                     })
             
             detection['keypoints'] = pose_keypoints
-            detection['car_id'] = i  # Simple ID based on detection order
             
             detections.append(detection)
         
+        # Persistent track IDs rather than detection order
+        car_ids = self.car_tracker.update(boxes.xyxy.cpu().numpy() * scale, keypoints.xy.cpu().numpy() * scale)
+        for detection, car_id in zip(detections, car_ids):
+            detection['car_id'] = car_id
+        
         return detections
     
+    def _publish_pose_record(self, seq, provenance, detections):
+        """
+        Build the compact push record for one frame and wake subscribers
+        
+        Format: {"seq", "src", "cap", "t", "ms", "cars": [[car_id, conf, x0, y0, c0, x1, y1, c1], ...]}
+        src/cap are the source frame sequence and capture time, t the publish time.
+        """
+        cars = []
+        for det in detections:
+            car = [det['car_id'], round(det['bbox']['confidence'], 3)]
+            for kp in det['keypoints']:
+                car += [round(kp['x'], 1), round(kp['y'], 1), round(kp['confidence'], 3)]
+            cars.append(car)
+        
+        record = json.dumps({
+            'seq': seq,
+            'src': provenance['source_seq'],
+            'cap': round(provenance['capture_time'], 4),
+            't': round(time.time(), 4),
+            'ms': round(self.inference_time * 1000, 1),
+            'cars': cars
+        }, separators=(',', ':'))
+        
+        with self.pose_record_cond:
+            self.pose_record = record
+            self.pose_record_seq = seq
+            self.pose_record_cond.notify_all()
+    
+    def wait_for_pose_record(self, after_seq, timeout=1.0):
+        """Block until a record newer than after_seq exists; returns (seq, record) or (after_seq, None)"""
+        with self.pose_record_cond:
+            self.pose_record_cond.wait_for(
+                lambda: self.pose_record_seq > after_seq or not self.running, timeout)
+            if self.pose_record_seq > after_seq:
+                return self.pose_record_seq, self.pose_record
+            return after_seq, None
+    
     def get_annotated_frame(self):
         """Get latest annotated frame with pose overlay"""
         with self.frame_lock:
-            return self.annotated_frame.copy() if self.annotated_frame is not None else None
+            result = self.latest_result
+        return result.plot() if result is not None else None
+    
+    def get_annotated_jpeg(self):
+        """
+        Get (seq, JPEG bytes) of the latest annotated frame
+        
+        The first caller for a new frame plots and encodes it; everyone else
+        gets the same cached bytes.
+        """
+        with self.frame_lock:
+            result, seq = self.latest_result, self.latest_result_seq
+        if result is None:
+            return 0, None
+        
+        with self.jpeg_lock:
+            if self.jpeg_seq != seq:
+                ret, buffer = cv2.imencode('.jpg', result.plot(), [cv2.IMWRITE_JPEG_QUALITY, 85])
+                if not ret:
+                    return 0, None
+                self.jpeg_bytes = buffer.tobytes()
+                self.jpeg_seq = seq
+                self.frames_encoded += 1
+            return self.jpeg_seq, self.jpeg_bytes
+    
+    def wait_for_annotated_jpeg(self, after_seq, timeout=1.0):
+        """Block until a frame newer than after_seq is processed, then return get_annotated_jpeg()"""
+        with self.frame_cond:
+            self.frame_cond.wait_for(
+                lambda: self.latest_result_seq > after_seq or not self.running, timeout)
+            if self.latest_result_seq <= after_seq:
+                return after_seq, None
+        return self.get_annotated_jpeg()
     
     def get_latest_results(self):
         """Get latest detection results"""
         with self.results_lock:
             return self.latest_results
     
+    def get_latest_seq(self):
+        """Frame sequence number of the latest results"""
+        with self.results_lock:
+            return self.latest_seq
+    
+    def get_latest_provenance(self):
+        """Source sequence, capture/receive times and per-hop latency of the latest results"""
+        with self.results_lock:
+            return self.latest_provenance
+    
     def get_results_history(self):
         """Get history of detection results"""
         with self.results_lock:
@@ -294,6 +598,20 @@ class YOLOPoseProcessor:
             'total_frames_processed': self.total_frames_processed,
             'average_inference_ms': avg_inference * 1000,
             'latest_inference_ms': self.inference_time * 1000,
+            'stage_ms': {stage: round(ms, 2) for stage, ms in self.stage_ms.items()},
+            'backend': self.backend_name,
+            'roi_hit_rate': self.roi_tracker.roi_hit_rate if self.roi_tracker else None,
+            'source_size': self.source_size,  # detections are in these pixels
+            'decode_scale': self.decode_scale,
+            'device': str(self.device),
+            'tracked_cars': self.car_tracker.active_ids,
+            'latency_ms': {hop: round(ms, 1) for hop, ms in self.latency_ms.items()},
+            'clock_offset_ms': round(self.clock_offset * 1000, 1),
+            'source_seq': self.source_seq,
+            'source_frames_skipped': self.source_frames_skipped,
+            'time': time.time(),  # for clock offset estimation by clients
+            'viewers': self.viewers,
+            'frames_encoded': self.frames_encoded,
             'running': self.running
         }
     
@@ -310,23 +628,40 @@ class YOLOPoseProcessor:
 processor = None
 
 
-def generate_mjpeg_stream(get_frame_func):
+def generate_mjpeg_stream(wait_for_jpeg):
     """
-    Generate MJPEG stream from frame getter function
+    Generate MJPEG stream, one part per processed frame
     
     Args:
-        get_frame_func: Function that returns a frame (numpy array)
+        wait_for_jpeg: Function (after_seq) -> (seq, jpeg_bytes) that blocks
+                       until a newer frame is available
     """
-    while True:
-        frame = get_frame_func()
-        if frame is not None:
-            # Encode as JPEG
-            ret, buffer = cv2.imencode('.jpg', frame, [cv2.IMWRITE_JPEG_QUALITY, 85])
-            if ret:
-                frame_bytes = buffer.tobytes()
+    with processor.frame_lock:
+        processor.viewers += 1
+    try:
+        seq = 0
+        while processor.running:
+            seq, frame_bytes = wait_for_jpeg(seq)
+            if frame_bytes is not None:
                 yield (b'--frame\r\n'
                        b'Content-Type: image/jpeg\r\n\r\n' + frame_bytes + b'\r\n')
-        time.sleep(1/30)  # ~30 FPS
+    finally:
+        with processor.frame_lock:
+            processor.viewers -= 1
+
+
+def generate_pose_events():
+    """
+    Server-sent events: one compact pose record per processed frame,
+    sent as soon as detection finishes
+    """
+    seq = -1
+    while processor and processor.running:
+        seq, record = processor.wait_for_pose_record(seq, timeout=1.0)
+        if record is None:
+            yield ': keepalive\n\n'
+            continue
+        yield f'id: {seq}\ndata: {record}\n\n'
 
 
 @app.route('/')
@@ -342,6 +677,7 @@ def index():
         'endpoints': {
             'annotated_stream': '/video_feed',
             'detections': '/detections',
+            'detections_stream': '/detections/stream',
             'detections_history': '/detections/history',
             'single_frame': '/frame',
             'stats': '/stats',
@@ -382,7 +718,7 @@ def video_feed():
         return jsonify({'error': 'Processor not running'}), 503
     
     return Response(
-        generate_mjpeg_stream(processor.get_annotated_frame),
+        generate_mjpeg_stream(processor.wait_for_annotated_jpeg),
         mimetype='multipart/x-mixed-replace; boundary=frame'
     )
 
@@ -393,11 +729,9 @@ def get_single_frame():
     if not processor or not processor.running:
         return jsonify({'error': 'Processor not running'}), 503
     
-    frame = processor.get_annotated_frame()
-    if frame is not None:
-        ret, buffer = cv2.imencode('.jpg', frame, [cv2.IMWRITE_JPEG_QUALITY, 85])
-        if ret:
-            return Response(buffer.tobytes(), mimetype='image/jpeg')
+    _, frame_bytes = processor.get_annotated_jpeg()
+    if frame_bytes is not None:
+        return Response(frame_bytes, mimetype='image/jpeg')
     
     return jsonify({'error': 'No frame available'}), 500
 
@@ -414,9 +748,15 @@ def get_detections():
     
     results = processor.get_latest_results()
     stats = processor.get_stats()
+    provenance = processor.get_latest_provenance() or {}
     
     return jsonify({
         'timestamp': datetime.now().isoformat(),
+        'seq': processor.get_latest_seq(),
+        'source_seq': provenance.get('source_seq'),
+        'capture_time': provenance.get('capture_time'),
+        'latency_ms': provenance.get('latency_ms'),
+        'time': time.time(),
         'detections': results if results else [],
         'num_detections': len(results) if results else 0,
         'fps': stats['fps'],
@@ -424,6 +764,26 @@ def get_detections():
     })
 
 
+@app.route('/detections/stream')
+def stream_detections():
+    """
+    Push channel for pose detections (text/event-stream)
+    
+    Each event's data is a compact record for one frame, with the source
+    frame's sequence number and capture time (on this server's clock):
+    {"seq": 42, "src": 1289, "cap": 1733512345.0611, "t": 1733512345.1234, "ms": 12.3,
+     "cars": [[car_id, conf, x0, y0, c0, x1, y1, c1], ...]}
+    """
+    if not processor or not processor.running:
+        return jsonify({'error': 'Processor not running'}), 503
+    
+    return Response(
+        generate_pose_events(),
+        mimetype='text/event-stream',
+        headers={'Cache-Control': 'no-cache', 'X-Accel-Buffering': 'no'}
+    )
+
+
 @app.route('/detections/history')
 def get_detections_history():
     """
@@ -461,6 +821,59 @@ def main():
         default='best.pt',
         help='YOLO model to use (default: best.pt for custom trained model)'
     )
+    parser.add_argument(
+        '--device',
+        type=str,
+        default='auto',
+        help="Inference device for the torch backend: auto, cpu or a CUDA index (default: auto)"
+    )
+    parser.add_argument(
+        '--backend',
+        choices=['torch', 'onnx', 'openvino'],
+        default='torch',
+        help='Inference backend; onnx and openvino run on CPU (default: torch)'
+    )
+    parser.add_argument(
+        '--int8',
+        action='store_true',
+        help='Quantize the exported model to INT8 (onnx/openvino backends)'
+    )
+    parser.add_argument(
+        '--threads',
+        type=int,
+        default=None,
+        help='Intra-op thread count for CPU inference (default: all cores)'
+    )
+    parser.add_argument(
+        '--imgsz',
+        type=int,
+        default=640,
+        help='Inference input size (default: 640)'
+    )
+    parser.add_argument(
+        '--calib-video',
+        type=str,
+        default=None,
+        help='Recorded video used to calibrate OpenVINO INT8 quantization'
+    )
+    parser.add_argument(
+        '--roi',
+        action='store_true',
+        help='Run inference on a crop around the last detection, with periodic full-frame searches'
+    )
+    parser.add_argument(
+        '--roi-imgsz',
+        type=int,
+        default=320,
+        help='Inference input size for ROI crops (default: 320)'
+    )
+    parser.add_argument(
+        '--decode-scale',
+        choices=['auto', '1', '2', '4', '8'],
+        default='auto',
+        help='Decode source frames at 1/N size; auto picks the smallest that covers --imgsz '
+             '(full size with --roi). Detections stay in source pixels (default: auto)'
+    )
     parser.add_argument(
         '--host',
         type=str,
@@ -484,13 +897,23 @@ def main():
         logger.info("="*60)
         logger.info(f"Source: {args.source}")
         logger.info(f"Model: {args.model}")
+        logger.info(f"Backend: {args.backend}{' (INT8)' if args.int8 else ''} | Device: {args.device}")
         logger.info(f"Server: {args.host}:{args.port}")
         logger.info("="*60)
         
         # Initialize processor
         processor = YOLOPoseProcessor(
             source_url=args.source,
-            model_name=args.model
+            model_name=args.model,
+            device=int(args.device) if args.device.isdigit() else args.device,
+            backend=args.backend,
+            int8=args.int8,
+            threads=args.threads,
+            imgsz=args.imgsz,
+            calib_video=args.calib_video,
+            roi=args.roi,
+            roi_imgsz=args.roi_imgsz,
+            decode_scale=args.decode_scale
         )
         
         # Start processing
@@ -502,6 +925,7 @@ def main():
         logger.info("\nEndpoints:")
         logger.info(f"  - Annotated stream: http://{args.host}:{args.port}/video_feed")
         logger.info(f"  - Detections:       http://{args.host}:{args.port}/detections")
+        logger.info(f"  - Pose stream:      http://{args.host}:{args.port}/detections/stream")
         logger.info(f"  - Stats:            http://{args.host}:{args.port}/stats")
         logger.info("")
         
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""
+Region-of-interest tracking for the YOLO pose server
+
+A car covers a small, slowly moving patch of the overhead image, so after
+a detection the next frame only needs to be searched around it. RoiTracker
+crops a margin around each tracked car (merging crops that overlap) and
+runs the model on each crop at a smaller input size, mapping results back
+into frame coordinates. A full-frame search runs periodically, when nothing
+was being tracked, when the crops would be too large or too many to save
+anything, and whenever they find fewer confident cars than were tracked.
+"""
+
+import numpy as np
+
+
+def shift_result(result, frame, x0, y0):
+    """Re-anchor a Results object computed on a crop at (x0, y0) onto the full frame"""
+    return merge_results([(result, x0, y0)], frame)
+
+
+def merge_results(parts, frame):
+    """One Results on the full frame from [(crop result, x0, y0), ...]"""
+    import torch
+    from ultralytics.engine.results import Results
+
+    boxes, keypoints = [], []
+    for result, x0, y0 in parts:
+        b = result.boxes.data.clone()
+        b[:, [0, 2]] += x0
+        b[:, [1, 3]] += y0
+        boxes.append(b)
+        if result.keypoints is not None:
+            k = result.keypoints.data.clone()
+            k[..., 0] += x0
+            k[..., 1] += y0
+            keypoints.append(k)
+    keypoints = torch.cat(keypoints) if len(keypoints) == len(parts) else None
+    return Results(frame, path=None, names=parts[0][0].names, boxes=torch.cat(boxes), keypoints=keypoints)
+
+
+class RoiTracker:
+    def __init__(self, full_predict, roi_predict, margin=0.75, min_size=192,
+                 full_interval=30, min_confidence=0.5, max_side=640, max_crops=3):
+        """
+        Args:
+            full_predict: frame -> (result, timings) at the full input size
+            roi_predict: crop -> (result, timings) at the reduced input size
+            margin: Padding around a tracked box, as a fraction of its size
+            min_size: Smallest crop side in pixels
+            full_interval: Force a full-frame search every N frames
+            min_confidence: Detections below this confidence don't count as tracked
+            max_side: Largest crop side in pixels; cars spread wider than this
+                      are searched in the full frame, since the crop would be
+                      shrunk to the ROI input size more than the frame is
+            max_crops: Most crops per frame (each is one inference) before a
+                       full-frame search is cheaper
+        """
+        self.full_predict = full_predict
+        self.roi_predict = roi_predict
+        self.margin = margin
+        self.min_size = min_size
+        self.full_interval = full_interval
+        self.min_confidence = min_confidence
+        self.max_side = max_side
+        self.max_crops = max_crops
+
+        self.last_boxes = None  # (N, 4) xyxy of the tracked cars
+        self.frames_since_full = 0
+        self.roi_frames = 0
+        self.full_frames = 0
+        self.last_rois = []  # [(x0, y0, x1, y1)] of the last crops, for display/stats
+
+    def _square(self, x1, y1, x2, y2, w, h, margin=0.0):
+        """Square crop around a box plus margin, clamped to the frame; None above max_side"""
+        size = max(x2 - x1, y2 - y1) * (1 + 2 * margin)
+        if size > self.max_side:
+            return None
+        side = int(min(max(size, self.min_size), w, h))
+        cx, cy = (x1 + x2) / 2, (y1 + y2) / 2
+        x0 = int(np.clip(cx - side / 2, 0, w - side))
+        y0 = int(np.clip(cy - side / 2, 0, h - side))
+        return x0, y0, x0 + side, y0 + side
+
+    def crop_regions(self, frame_shape):
+        """
+        Square crops covering the tracked cars: one per car, with crops that
+        overlap merged so no car is detected twice. None when a crop would
+        exceed max_side or there would be more than max_crops, i.e. when the
+        full frame is the better search.
+        """
+        h, w = frame_shape[:2]
+        crops = [self._square(*box, w, h, self.margin) for box in self.last_boxes]
+        i = 0
+        while i < len(crops):
+            a = crops[i]
+            if a is None:
+                return None
+            for j in range(i + 1, len(crops)):
+                b = crops[j]
+                if b is not None and a[0] < b[2] and b[0] < a[2] and a[1] < b[3] and b[1] < a[3]:
+                    crops[i] = self._square(min(a[0], b[0]), min(a[1], b[1]),
+                                            max(a[2], b[2]), max(a[3], b[3]), w, h)
+                    del crops[j]
+                    i = -1  # the grown crop may now overlap earlier ones
+                    break
+            i += 1
+        return crops if len(crops) <= self.max_crops else None
+
+    def process(self, frame):
+        """Detect on one frame; returns (result, timings, used_roi)"""
+        crops = None
+        if self.last_boxes is not None and self.frames_since_full < self.full_interval:
+            crops = self.crop_regions(frame.shape)
+        if crops is None:
+            result, timings = self.full_predict(frame)
+            return self._full(result), timings, False
+
+        parts, timings = [], {}
+        for x0, y0, x1, y1 in crops:
+            result, crop_timings = self.roi_predict(frame[y0:y1, x0:x1])
+            for stage, ms in crop_timings.items():
+                timings[stage] = timings.get(stage, 0.0) + ms
+            if len(result.boxes):
+                parts.append((result, x0, y0))
+        confident = sum(int((result.boxes.conf.cpu().numpy() >= self.min_confidence).sum())
+                        for result, _, _ in parts)
+        if confident >= len(self.last_boxes):
+            result = merge_results(parts, frame)
+            keep = result.boxes.conf.cpu().numpy() >= self.min_confidence
+            self.last_boxes = result.boxes.xyxy.cpu().numpy()[keep]
+            self.last_rois = crops
+            self.frames_since_full += 1
+            self.roi_frames += 1
+            return result, timings, True
+
+        # Lost a car: search the whole frame this time, adding up both passes
+        full_result, full_timings = self.full_predict(frame)
+        for stage, ms in full_timings.items():
+            timings[stage] = timings.get(stage, 0.0) + ms
+        return self._full(full_result), timings, False
+
+    def _full(self, result):
+        self.full_frames += 1
+        self.frames_since_full = 0
+        self.last_rois = []
+        if len(result.boxes):
+            confident = result.boxes.conf.cpu().numpy() >= self.min_confidence
+            boxes = result.boxes.xyxy.cpu().numpy()[confident]
+            self.last_boxes = boxes if len(boxes) else None
+        else:
+            self.last_boxes = None
+        return result
+
+    @property
+    def roi_hit_rate(self):
+        total = self.roi_frames + self.full_frames
+        return self.roi_frames / total if total else 0.0
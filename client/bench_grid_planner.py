@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""
+Benchmark: replanning around obstacles, D* Lite repair vs A* from scratch
+
+Renders the simulator's 1280x720 overhead view with furniture
+(SimParams.obstacles), builds the occupancy grid from it by background
+subtraction and plans from the car to the far side of the arena. Then, for
+a number of steps, the car moves along its path and a box (someone walking
+through) crosses the route, and every step replans:
+
+  repair  - grid_planner.DStarLite: the search kept from the last step,
+            moved to the car and told which cells changed
+  scratch - A* over the same grid, costs and moves, started fresh
+
+and checks both find paths of the same length. Reports, per grid cell
+size, the time to turn a frame into a grid, the first plan, the mean and
+90th percentile search time per replan, the states each expands, and the
+whole replan (search plus smoothing and sampling the path).
+
+Usage:
+  python3 bench_grid_planner.py
+  python3 bench_grid_planner.py --cells 4 8 16 --obstacles 12 --steps 40
+"""
+
+import argparse
+import heapq
+import time
+
+import cv2
+import numpy as np
+
+from grid_planner import DStarLite, GridPlanner, STRAIGHT, DIAGONAL, INF
+from simulator import SimParams, SimWorld
+
+
+# ============================================================
+#   REFERENCE: A* FROM SCRATCH
+# ============================================================
+
+def astar(blocked, start, goal):
+    """(cost in cells, states expanded) with DStarLite's moves and costs"""
+    rows, cols = blocked.shape
+    w = cols + 2
+    free = np.zeros((rows + 2, cols + 2), dtype=bool)
+    free[1:-1, 1:-1] = ~blocked
+    free = free.ravel().tolist()
+    moves = [(-w, STRAIGHT, 0, 0), (w, STRAIGHT, 0, 0), (-1, STRAIGHT, 0, 0), (1, STRAIGHT, 0, 0),
+             (-w - 1, DIAGONAL, -w, -1), (-w + 1, DIAGONAL, -w, 1),
+             (w - 1, DIAGONAL, w, -1), (w + 1, DIAGONAL, w, 1)]
+    s = (start[0] + 1) * w + start[1] + 1
+    t = (goal[0] + 1) * w + goal[1] + 1
+    tr, tc = divmod(t, w)
+
+    def h(u):
+        r, c = divmod(u, w)
+        dr, dc = abs(r - tr), abs(c - tc)
+        return STRAIGHT * max(dr, dc) + (DIAGONAL - STRAIGHT) * min(dr, dc)
+
+    g = {s: 0}
+    queue = [(h(s), s)]
+    closed = set()
+    while queue:
+        _, u = heapq.heappop(queue)
+        if u in closed:
+            continue
+        if u == t:
+            return g[u] / STRAIGHT, len(closed)
+        closed.add(u)
+        for off, cost, a, b in moves:
+            v = u + off
+            if not free[v] or (a and not (free[u + a] and free[u + b])):
+                continue
+            new = g[u] + cost
+            if new < g.get(v, INF):
+                g[v] = new
+                heapq.heappush(queue, (new + h(v), v))
+    return INF, len(closed)
+
+
+def best_of(repeats, fn):
+    best, result = float('inf'), None
+    for _ in range(repeats):
+        t0 = time.perf_counter()
+        result = fn()
+        best = min(best, time.perf_counter() - t0)
+    return best, result
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark incremental grid replanning')
+    parser.add_argument('--cells', type=float, nargs='+', default=[4, 8, 16],
+                        help='Grid cell sizes in px (default: 4 8 16)')
+    parser.add_argument('--obstacles', type=int, default=10)
+    parser.add_argument('--steps', type=int, default=30, help='Replans per cell size (default: 30)')
+    parser.add_argument('--advance', type=float, default=25.0, help='Car travel per step in px (default: 25)')
+    parser.add_argument('--inflate', type=float, default=30.0)
+    parser.add_argument('--seed', type=int, default=3)
+    parser.add_argument('--repeats', type=int, default=3)
+    args = parser.parse_args()
+
+    params = SimParams(obstacles=args.obstacles)
+    world = SimWorld(params, cars=1, seed=args.seed)
+    car = world.cars[0]
+    furniture, world.obstacles = world.obstacles, []
+    background = world.render()
+    world.obstacles = furniture
+    home = (car.x, car.y)
+    goal = (params.width - home[0] * 0.2 - 60, params.height - home[1] * 0.2 - 60) \
+        if home[0] < params.width / 2 else (60.0, 60.0)
+
+    print(f"{params.width}x{params.height} arena, {args.obstacles} obstacles, inflate {args.inflate:g}px, "
+          f"{args.steps} replans with a box crossing the route")
+    print(f"{'cell':>5} {'grid':>9} {'frame->grid':>12} {'first D*':>9} {'first A*':>9} "
+          f"{'repair':>9} {'p90':>8} {'scratch':>9} {'p90':>8} {'speedup':>8} {'replan':>9} "
+          f"{'exp repair':>11} {'exp A*':>8} {'same':>5}")
+
+    for cell in args.cells:
+        car.x, car.y = home
+        planner = GridPlanner(cell, args.inflate)
+        planner.set_background(background)
+        me = lambda: [(car.x, car.y, params.marker_distance)]
+        frame = world.render()
+        t_grid, grid = best_of(args.repeats, lambda: planner.update_grid(frame, me()))
+        start_cell = grid.nearest_free(grid.to_cell(car.x, car.y))
+        goal_cell = grid.nearest_free(grid.to_cell(*goal))
+        t_first, _ = best_of(args.repeats, lambda: DStarLite(grid.blocked, start_cell, goal_cell).compute())
+        t_astar, _ = best_of(args.repeats, lambda: astar(grid.blocked, start_cell, goal_cell))
+        path = planner.plan((car.x, car.y), goal)
+        if path is None:
+            print(f"{cell:>5g} no path to the goal")
+            continue
+
+        repair, scratch, replan, exp_repair, exp_scratch, same = [], [], [], [], [], True
+        walker = np.array(planner.grid.to_point(planner.cells[len(planner.cells) // 2])) + (-250.0, -150.0)
+        for step in range(args.steps):
+            # Car moves along the path; the walker crosses it diagonally
+            pts = np.array([p["point"] for p in path])
+            along = np.concatenate(([0.0], np.cumsum(np.hypot(*np.diff(pts, axis=0).T))))
+            car.x = float(np.interp(args.advance, along, pts[:, 0]))
+            car.y = float(np.interp(args.advance, along, pts[:, 1]))
+            walker += (500.0 / args.steps, 300.0 / args.steps)
+            frame = world.render()
+            cv2.fillPoly(frame, [np.int32(cv2.boxPoints((tuple(walker), (120, 60), 30)))], (170, 170, 40))
+
+            grid = planner.update_grid(frame, me())
+            start_cell = grid.nearest_free(grid.to_cell(car.x, car.y))
+            search = planner.search
+            before = search.expanded
+            t0 = time.perf_counter()
+            search.set_blocked(grid.blocked)
+            search.move_start(start_cell)
+            search.compute()
+            repair.append(time.perf_counter() - t0)
+            exp_repair.append(search.expanded - before)
+
+            t0 = time.perf_counter()
+            cost, expanded = astar(grid.blocked, start_cell, search._cell(search.goal))
+            scratch.append(time.perf_counter() - t0)
+            exp_scratch.append(expanded)
+            same &= abs(cost - search.cost) < 1e-9 or (cost == INF and search.cost == INF)
+
+            # The whole replan as the controller runs it: the search is already
+            # repaired, so this is smoothing and sampling the new path
+            t0 = time.perf_counter()
+            path = planner.replan((car.x, car.y)) or path
+            replan.append(time.perf_counter() - t0 + repair[-1])
+
+        repair, scratch, replan = np.array(repair) * 1000, np.array(scratch) * 1000, np.array(replan) * 1000
+        rows, cols = planner.grid.shape
+        print(f"{cell:>5g} {cols:>4}x{rows:<4} {t_grid * 1000:>10.1f}ms {t_first * 1000:>7.1f}ms "
+              f"{t_astar * 1000:>7.1f}ms {repair.mean():>7.2f}ms {np.percentile(repair, 90):>6.2f}ms "
+              f"{scratch.mean():>7.2f}ms {np.percentile(scratch, 90):>6.2f}ms "
+              f"{scratch.mean() / repair.mean():>7.1f}x {replan.mean():>7.2f}ms {np.mean(exp_repair):>11.0f} {np.mean(exp_scratch):>8.0f} "
+              f"{'yes' if same else 'NO':>5}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""
+Benchmark: MJPEG demux + decode, old client loop vs mjpeg_stream.py
+
+Builds an in-memory 720p MJPEG stream from a recorded video, in the same
+multipart format video_server.py sends, and runs it through:
+
+  legacy  - the loop the clients used: 1 KB chunks appended to a bytes
+            object, FFD8/FFD9 searched from the start, cv2.imdecode
+  python  - mjpeg_stream.PyMjpegParser + cv2.imdecode
+  native  - native/libvizcar_mjpeg parser + libjpeg-turbo decode into a
+            reused buffer (build it first: make -C native)
+
+Each frame carries an EXIF-style embedded thumbnail, as many cameras add,
+to check that frames are not cut at the thumbnail's end marker. Reports
+parse-only and parse+decode throughput, CPU per frame as a share of a 30
+fps budget, and how many frames came out intact.
+
+A second table decodes the same frames at each DCT scale (1/1 to 1/8), in
+colour and grayscale, with the decoder consumers use (native if built,
+else cv2), reporting time and output bytes written per frame.
+
+Usage:
+  python3 bench_mjpeg.py
+  python3 bench_mjpeg.py --frames 300 --no-thumbnail --no-content-length
+"""
+
+import argparse
+import os
+import struct
+import time
+
+import cv2
+import numpy as np
+
+import mjpeg_stream
+from mjpeg_stream import PyMjpegParser, JpegDecoder, SCALES
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def with_thumbnail(jpeg, thumbnail):
+    """Insert an APP1 segment holding a small JPEG right after SOI"""
+    payload = b'Exif\x00\x00' + thumbnail
+    return jpeg[:2] + b'\xff\xe1' + struct.pack('>H', len(payload) + 2) + payload + jpeg[2:]
+
+
+def build_stream(video, frames, thumbnail, content_length):
+    capture = cv2.VideoCapture(video)
+    jpegs = []
+    while len(jpegs) < frames:
+        ret, frame = capture.read()
+        if not ret:
+            capture.set(cv2.CAP_PROP_POS_FRAMES, 0)
+            continue
+        frame = cv2.resize(frame, (1280, 720))
+        jpeg = cv2.imencode('.jpg', frame, [cv2.IMWRITE_JPEG_QUALITY, 80])[1].tobytes()
+        if thumbnail:
+            thumb = cv2.imencode('.jpg', cv2.resize(frame, (160, 90)))[1].tobytes()
+            jpeg = with_thumbnail(jpeg, thumb)
+        jpegs.append(jpeg)
+    capture.release()
+
+    parts = []
+    for seq, jpeg in enumerate(jpegs, 1):
+        headers = b'--frame\r\nContent-Type: image/jpeg\r\n'
+        if content_length:
+            headers += f'Content-Length: {len(jpeg)}\r\nX-Frame-Seq: {seq}\r\n'.encode()
+        parts.append(headers + b'\r\n' + jpeg + b'\r\n')
+    parts.append(b'--frame--\r\n')  # closing boundary ends the last part
+    return jpegs, b''.join(parts)
+
+
+def chunks(data, size):
+    for i in range(0, len(data), size):
+        yield data[i:i + size]
+
+
+def legacy(stream, decode):
+    """The clients' original loop"""
+    out = []
+    bytes_data = b''
+    for chunk in chunks(stream, 1024):
+        bytes_data += chunk
+        start = bytes_data.find(b'\xff\xd8')
+        end = bytes_data.find(b'\xff\xd9')
+        if start != -1 and end != -1 and start < end:
+            jpg_data = bytes_data[start:end + 2]
+            bytes_data = bytes_data[end + 2:]
+            if decode:
+                frame = cv2.imdecode(np.frombuffer(jpg_data, dtype=np.uint8), cv2.IMREAD_COLOR)
+                if frame is not None:
+                    out.append(frame.shape)
+            else:
+                out.append(jpg_data)
+    return out
+
+
+def run_parser(parser, stream, decode, chunk_size=65536):
+    decoder = JpegDecoder() if decode else None
+    out = []
+    for chunk in chunks(stream, chunk_size):
+        parser.feed(chunk)
+        while True:
+            part = parser.next_frame()
+            if part is None:
+                break
+            if decode:
+                frame = decoder.decode(part[0])
+                if frame is not None:
+                    out.append(frame.shape)
+            else:
+                out.append(bytes(part[0]))
+    return out
+
+
+def bench_scales(jpegs, repeat=3):
+    """ms and output bytes per frame for each scale, colour and gray"""
+    rows = []
+    for gray in (False, True):
+        for denom in SCALES:
+            decoder = JpegDecoder(scale_denom=denom, gray=gray)
+            shape = decoder.decode(jpegs[0]).shape
+            t0 = time.perf_counter()
+            for _ in range(repeat):
+                for jpeg in jpegs:
+                    decoder.decode(jpeg)
+            ms = (time.perf_counter() - t0) / (repeat * len(jpegs)) * 1000
+            rows.append((denom, gray, shape, ms, int(np.prod(shape))))
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark MJPEG demux/decode')
+    parser.add_argument('--video', default=os.path.join(HERE, 'good.mp4'))
+    parser.add_argument('--frames', type=int, default=150)
+    parser.add_argument('--no-thumbnail', action='store_true')
+    parser.add_argument('--no-content-length', action='store_true')
+    args = parser.parse_args()
+
+    jpegs, stream = build_stream(args.video, args.frames, not args.no_thumbnail,
+                                 not args.no_content_length)
+    print(f"{len(jpegs)} frames at 1280x720, {len(stream) / 1e6:.1f} MB, "
+          f"thumbnail={'no' if args.no_thumbnail else 'yes'}, "
+          f"content-length={'no' if args.no_content_length else 'yes'}")
+
+    methods = {
+        'legacy': lambda decode: legacy(stream, decode),
+        'python': lambda decode: run_parser(PyMjpegParser(), stream, decode),
+    }
+    if mjpeg_stream.NATIVE:
+        methods['native'] = lambda decode: run_parser(mjpeg_stream.NativeMjpegParser(), stream, decode)
+    else:
+        print("native module not built (make -C native), skipping")
+
+    print(f"{'method':<8}{'intact':>10}{'parse MB/s':>12}{'parse+decode fps':>18}"
+          f"{'ms/frame':>10}{'of 30fps':>10}")
+    for name, run in methods.items():
+        t0 = time.perf_counter()
+        parts = run(False)
+        parse_s = time.perf_counter() - t0
+        intact = sum(1 for part, jpeg in zip(parts, jpegs) if part == jpeg)
+
+        t0 = time.perf_counter()
+        frames = run(True)
+        total_s = time.perf_counter() - t0
+        print(f"{name:<8}{intact:>5}/{len(jpegs):<4}{len(stream) / parse_s / 1e6:>12.1f}"
+              f"{len(frames) / total_s:>18.0f}", end='')
+        if frames:
+            ms = total_s / len(frames) * 1000
+            print(f"{ms:>10.2f}{ms / (1000 / 30):>10.0%}")
+        else:
+            print(f"{'-':>10}{'-':>10}")
+
+    print(f"\nReduced decode ({'native' if mjpeg_stream.NATIVE else 'cv2'})")
+    print(f"{'scale':<7}{'mode':<6}{'output':>11}{'ms/frame':>10}{'speedup':>9}{'KB out':>9}")
+    rows = bench_scales(jpegs)
+    base_ms = rows[0][3]
+    for denom, gray, shape, ms, nbytes in rows:
+        print(f"1/{denom:<5}{'gray' if gray else 'bgr':<6}{shape[1]:>6}x{shape[0]:<4}"
+              f"{ms:>10.2f}{base_ms / ms:>8.1f}x{nbytes / 1024:>9.0f}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""
+Benchmark: robot/path payload size and decode time, JSON vs binary
+
+Builds arc-length paths of increasing length through random waypoints and
+sends each as PathGUI used to (json.dumps of {"method", "path"} with a dict
+per point) and in the binary format of path_codec.py, with headings only
+and with curvature and speed as well. For each it reports the payload
+size, the time to encode and decode it in Python (json vs path_codec, to
+dicts and to arrays), the time the firmware's C++ decoder takes on the
+host (native/libvizcar_path, build it first: make -C native) and the
+worst quantization error.
+
+The C++ codec is also checked against the Python one both ways: C++
+decoding Python's messages and Python decoding C++'s.
+
+Usage:
+  python3 bench_path_codec.py
+  python3 bench_path_codec.py --points 500 5000 --coord-bits 3
+"""
+
+import argparse
+import ctypes
+import json
+import math
+import os
+import sys
+import time
+
+import numpy as np
+
+import path_codec
+from path_calculations import arc_length_path
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def load_native():
+    name = 'libvizcar_path.dylib' if sys.platform == 'darwin' else 'libvizcar_path.so'
+    try:
+        lib = ctypes.CDLL(os.path.join(HERE, 'native', name))
+    except OSError:
+        return None
+    lib.path_decode.restype = ctypes.c_long
+    lib.path_decode.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_size_t]
+    lib.path_encode.restype = ctypes.c_size_t
+    lib.path_encode.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_uint8, ctypes.c_uint8,
+                                ctypes.c_uint8, ctypes.c_void_p, ctypes.c_size_t]
+    lib.path_error.restype = ctypes.c_char_p
+    lib.path_error.argtypes = [ctypes.c_long]
+    return lib
+
+
+def native_decode(lib, data, count):
+    out = np.empty((count, 5), dtype=np.float32)
+    n = lib.path_decode(data, len(data), out.ctypes.data, count)
+    if n < 0:
+        raise path_codec.PathFormatError(lib.path_error(n).decode())
+    return out[:n]
+
+
+def native_encode(lib, rows, method, flags, coord_bits):
+    rows = np.ascontiguousarray(rows, dtype=np.float32)
+    out = np.empty(16 * len(rows) * 5 + 64, dtype=np.uint8)
+    size = lib.path_encode(rows.ctypes.data, len(rows), path_codec.METHODS.index(method), flags,
+                           coord_bits, out.ctypes.data, len(out))
+    return out[:size].tobytes()
+
+
+def best_of(repeats, fn):
+    best, result = float('inf'), None
+    for _ in range(repeats):
+        t0 = time.perf_counter()
+        result = fn()
+        best = min(best, time.perf_counter() - t0)
+    return best, result
+
+
+def waypoints_for(count, spacing, rng):
+    """Random walk long enough for about count samples at spacing"""
+    steps = int(count * spacing / 80) + 4
+    headings = np.cumsum(rng.normal(0.0, 0.6, steps))
+    lengths = rng.uniform(60.0, 180.0, steps)
+    return 500 + np.cumsum(np.column_stack((lengths * np.cos(headings), lengths * np.sin(headings))), axis=0)
+
+
+def angle_error(a, b):
+    return float(np.max(np.abs((np.asarray(a) - np.asarray(b) + math.pi) % (2 * math.pi) - math.pi)))
+
+
+def check_native(lib, path, payload, coord_bits):
+    """C++ decode of Python's message and Python decode of C++'s agree to quantization"""
+    _, arrays = path_codec.decode_arrays(payload)
+    rows = native_decode(lib, payload, len(path))
+    ok = np.allclose(rows[:, :2], arrays["points"], atol=1e-3)
+    if "heading" in arrays:
+        ok &= angle_error(rows[:-1, 2], arrays["heading"][:-1]) < 1e-4
+    if "speed" in arrays:
+        ok &= np.allclose(rows[:, 4], arrays["speed"], atol=1e-3)
+
+    source = np.array([[p["point"][0], p["point"][1],
+                        math.nan if p["heading"] is None else p["heading"],
+                        p.get("curvature", math.nan), p.get("speed", math.nan)] for p in path])
+    flags = path_codec.decode_arrays(payload)[0]["flags"] & ~path_codec.FLAG_OPEN_END
+    _, back = path_codec.decode_path(native_encode(lib, source, "catmull", flags, coord_bits))
+    ok &= back[-1]["heading"] is None or path[-1]["heading"] is not None
+    ok &= np.allclose([p["point"] for p in back], [p["point"] for p in path], atol=2 ** -coord_bits)
+    return bool(ok)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark the binary path format against JSON')
+    parser.add_argument('--points', type=int, nargs='+', default=[100, 500, 2000, 10000])
+    parser.add_argument('--spacing', type=float, default=5.0, help='Path sample spacing in px (default: 5)')
+    parser.add_argument('--coord-bits', type=int, default=4, help='Fractional bits for x, y (default: 4)')
+    parser.add_argument('--repeats', type=int, default=5)
+    args = parser.parse_args()
+
+    lib = load_native()
+    rng = np.random.default_rng(0)
+    print(f"Coordinates to 1/{1 << args.coord_bits}px, best of {args.repeats}; "
+          f"C++ decoder {'native/libvizcar_path' if lib else 'not built (make -C native)'}")
+    print(f"{'points':>7} {'fields':>10} {'json':>9} {'binary':>8} {'ratio':>6} "
+          f"{'json enc':>9} {'bin enc':>9} {'json dec':>9} {'bin dicts':>10} {'bin arrays':>11} "
+          f"{'c++ dec':>9} {'xy err':>7} {'hdg err':>8} {'c++':>4}")
+
+    for count in args.points:
+        profile = arc_length_path(waypoints_for(count, args.spacing, rng), "catmull", args.spacing)
+        full = profile.path_with_headings()[:count]
+        headings = [{"point": p["point"], "heading": p["heading"]} for p in full]
+        headings[-1]["heading"] = None
+        for fields, path in (("heading", headings), ("+curv+spd", full)):
+            message = {"method": "catmull", "path": path}
+            t_json_enc, text = best_of(args.repeats, lambda: json.dumps(message).encode())
+            t_bin_enc, payload = best_of(args.repeats, lambda: path_codec.encode_path(path, "catmull", args.coord_bits))
+            t_json_dec, _ = best_of(args.repeats, lambda: json.loads(text))
+            t_dicts, (_, decoded) = best_of(args.repeats, lambda: path_codec.decode_path(payload))
+            t_arrays, _ = best_of(args.repeats, lambda: path_codec.decode_arrays(payload))
+            if lib:
+                t_native, _ = best_of(args.repeats, lambda: native_decode(lib, payload, len(path)))
+                native = f"{t_native * 1e6:>7.0f}us"
+                agree = "yes" if check_native(lib, path, payload, args.coord_bits) else "NO"
+            else:
+                native, agree = f"{'-':>9}", "-"
+
+            xy = float(np.max(np.abs(np.array([p["point"] for p in path]) -
+                                     np.array([p["point"] for p in decoded]))))
+            hdg = angle_error([p["heading"] for p in path[:-1]], [p["heading"] for p in decoded[:-1]])
+            print(f"{len(path):>7} {fields:>10} {len(text):>9} {len(payload):>8} {len(text) / len(payload):>5.1f}x "
+                  f"{t_json_enc * 1e6:>7.0f}us {t_bin_enc * 1e6:>7.0f}us {t_json_dec * 1e6:>7.0f}us "
+                  f"{t_dicts * 1e6:>8.0f}us {t_arrays * 1e6:>9.0f}us {native} "
+                  f"{xy:>7.3f} {math.degrees(hdg):>7.3f}° {agree:>4}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+Benchmark: path generation, per-segment loops vs path_calculations.py
+
+Builds random-walk waypoint lists of a few thousand points and generates a
+path through them with each method three ways:
+
+  legacy  - the loops path_calculations used: one segment per Python
+            iteration with n samples each, then path_with_headings() with
+            an arctan2 call per point
+  batched - the same n samples per segment from the batched cubic
+            coefficients, and the vectorized path_with_headings()
+  arc     - arc_length_path(): uniform arc-length samples with heading,
+            curvature, speed profile and timing
+
+Reports sampling and heading time per path for legacy and batched, whether
+they agree, and how uneven the sample spacing is (coefficient of
+variation of the step lengths) with n per segment versus arc length.
+
+Usage:
+  python3 bench_path_engine.py
+  python3 bench_path_engine.py --waypoints 1000 10000 --n 30 --spacing 5
+"""
+
+import argparse
+import time
+
+import numpy as np
+
+from path_calculations import (
+    linear_path, catmull_path, cubic_path, bezier_chained, bezier_segment, point_path,
+    path_with_headings, heading_from_points, uniform_t, arc_length_path,
+)
+
+
+# ============================================================
+#   LEGACY LOOPS (as path_calculations had them)
+# ============================================================
+
+def legacy_headings(path):
+    pts = np.array(path)
+    result = []
+    for i in range(len(pts) - 1):
+        x1, y1 = pts[i]
+        x2, y2 = pts[i + 1]
+        result.append({"point": (float(x1), float(y1)),
+                       "heading": float(heading_from_points((x1, y1), (x2, y2)))})
+    result.append({"point": (float(pts[-1][0]), float(pts[-1][1])), "heading": None})
+    return result
+
+
+def legacy_linear(points, n):
+    pts = np.array(points, dtype=float)
+    segments = []
+    for i in range(len(pts) - 1):
+        seg = point_path(pts[i], pts[i + 1], n)
+        segments.append(seg[1:] if i > 0 else seg)
+    return np.vstack(segments)
+
+
+def legacy_catmull(points, n):
+    pts = np.array(points, dtype=float)
+    out = []
+    for i in range(len(pts) - 3):
+        P0, P1, P2, P3 = pts[i:i + 4]
+        t = uniform_t(n)
+        t2 = t * t
+        t3 = t * t * t
+        M = 0.5 * ((2 * P1)[None, :]
+                   + (-P0 + P2)[None, :] * t[:, None]
+                   + (2 * P0 - 5 * P1 + 4 * P2 - P3)[None, :] * t2[:, None]
+                   + (-P0 + 3 * P1 - 3 * P2 + P3)[None, :] * t3[:, None])
+        out.append(M[1:] if i > 0 else M)
+    return np.vstack(out)
+
+
+def legacy_cubic(points, n):
+    pts = np.array(points, dtype=float)
+    tangents = np.zeros_like(pts)
+    tangents[1:-1] = (pts[2:] - pts[:-2]) / 2
+    tangents[0] = pts[1] - pts[0]
+    tangents[-1] = pts[-1] - pts[-2]
+    out = []
+    for i in range(len(pts) - 1):
+        t = uniform_t(n)
+        t2 = t * t
+        t3 = t * t * t
+        M = ((2 * t3 - 3 * t2 + 1)[:, None] * pts[i] + (t3 - 2 * t2 + t)[:, None] * tangents[i]
+             + (-2 * t3 + 3 * t2)[:, None] * pts[i + 1] + (t3 - t2)[:, None] * tangents[i + 1])
+        out.append(M[1:] if i > 0 else M)
+    return np.vstack(out)
+
+
+def legacy_bezier(points, n):
+    pts = np.array(points)
+    path = []
+    for i in range(0, len(pts) - 3, 3):
+        seg = bezier_segment(*pts[i:i + 4], n=n)
+        path.append(seg[1:] if i > 0 else seg)
+    return np.vstack(path)
+
+
+METHODS = {
+    "linear": (legacy_linear, linear_path),
+    "catmull": (legacy_catmull, catmull_path),
+    "cubic": (legacy_cubic, cubic_path),
+    "bezier": (legacy_bezier, bezier_chained),
+}
+
+
+def random_walk(count, rng):
+    """Waypoints 20-200 px apart with gentle turns, like a long drawn route"""
+    headings = np.cumsum(rng.normal(0.0, 0.6, count))
+    steps = rng.uniform(20.0, 200.0, count)
+    return np.cumsum(np.column_stack((steps * np.cos(headings), steps * np.sin(headings))), axis=0)
+
+
+def best_of(repeats, fn):
+    best, result = float('inf'), None
+    for _ in range(repeats):
+        t0 = time.perf_counter()
+        result = fn()
+        best = min(best, time.perf_counter() - t0)
+    return best, result
+
+
+def spacing_cv(points):
+    steps = np.hypot(*np.diff(points, axis=0).T)
+    steps = steps[steps > 1e-9]
+    return float(np.std(steps) / np.mean(steps))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark batched path generation')
+    parser.add_argument('--waypoints', type=int, nargs='+', default=[1000, 5000, 20000])
+    parser.add_argument('--methods', nargs='+', choices=list(METHODS), default=list(METHODS))
+    parser.add_argument('--n', type=int, default=30, help='Samples per segment (default: 30)')
+    parser.add_argument('--spacing', type=float, default=5.0, help='Arc-length spacing in px (default: 5)')
+    parser.add_argument('--repeats', type=int, default=3)
+    args = parser.parse_args()
+
+    rng = np.random.default_rng(0)
+    print(f"{args.n} samples per segment, arc spacing {args.spacing:g}px, best of {args.repeats}")
+    print(f"{'':>19}{'sampling':^28}{'headings':^28}")
+    print(f"{'waypoints':>9} {'method':>8} {'legacy':>9} {'batched':>9} {'speedup':>8} "
+          f"{'legacy':>9} {'batched':>9} {'speedup':>8} {'same':>5} {'arc':>9} "
+          f"{'samples':>8} {'arc samples':>12} {'cv n/seg':>9} {'cv arc':>7}")
+
+    for count in args.waypoints:
+        waypoints = random_walk(count, rng)
+        for method in args.methods:
+            legacy, batched = METHODS[method]
+            t_legacy, old = best_of(args.repeats, lambda: legacy(waypoints, args.n))
+            t_batched, new = best_of(args.repeats, lambda: batched(waypoints, args.n))
+            h_legacy, old_hdg = best_of(args.repeats, lambda: legacy_headings(old))
+            h_batched, new_hdg = best_of(args.repeats, lambda: path_with_headings(new))
+            t_arc, profile = best_of(args.repeats, lambda: arc_length_path(waypoints, method, args.spacing))
+            same = (old.shape == new.shape and np.allclose(old, new) and
+                    np.allclose([p["heading"] for p in old_hdg[:-1]], [p["heading"] for p in new_hdg[:-1]]))
+            print(f"{count:>9} {method:>8} {t_legacy * 1000:>7.1f}ms {t_batched * 1000:>7.1f}ms "
+                  f"{t_legacy / t_batched:>7.1f}x {h_legacy * 1000:>7.1f}ms {h_batched * 1000:>7.1f}ms "
+                  f"{h_legacy / h_batched:>7.1f}x {'yes' if same else 'NO':>5} {t_arc * 1000:>7.1f}ms "
+                  f"{len(new):>8} {len(profile.s):>12} {spacing_cv(new):>9.2f} {spacing_cv(profile.points):>7.3f}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+Benchmark: pure-pursuit path following vs. the point-to-point controller
+
+Drives both controllers through the same smooth path in a kinematic
+simulation of the car (pulse rates with noise, fixed sensing/command
+latency per iteration) and reports simulated completion time, iteration
+count and cross-track error against the planned path.
+
+The point-to-point controller is given evenly spaced points along the path
+one at a time, which is how an operator drives it today by clicking each
+waypoint.
+
+Usage:
+  python3 bench_path_following.py
+  python3 bench_path_following.py --method cubic --trials 20 --latency 0.4
+  python3 bench_path_following.py --spacing 5
+"""
+
+import argparse
+import contextlib
+import io
+import math
+import random
+import time
+
+import numpy as np
+
+from path_calculations import catmull_path, cubic_path, bezier_chained, linear_path, path_with_headings, arc_length_path
+from video_client_controller import (
+    ControlState, RobotPose, PathPlanningController, PathFollowingController, move_pose, COMMAND_TWIST
+)
+
+WAYPOINTS = [(150, 600), (350, 450), (600, 520), (850, 300), (1100, 380)]
+
+PATH_METHODS = {
+    "linear": linear_path,
+    "catmull": catmull_path,
+    "cubic": cubic_path,
+    "bezier": bezier_chained,
+}
+
+
+class SimCar:
+    """Ground-truth car: executes pulses with rate noise and per-iteration latency"""
+
+    def __init__(self, pose: RobotPose, forward_speed: float, turn_rate: float,
+                 latency: float, noise: float, rng: random.Random):
+        self.pose = pose
+        self.forward_speed = forward_speed
+        self.turn_rate = turn_rate
+        self.latency = latency
+        self.noise = noise
+        self.rng = rng
+        self.clock = 0.0
+
+    def pulse(self, command: str, duration: float):
+        forward, turn = COMMAND_TWIST.get(command, (0.0, 0.0))
+        gain = 1.0 + self.rng.gauss(0.0, self.noise)
+        self.pose = move_pose(self.pose,
+                              forward * self.forward_speed * duration * gain,
+                              turn * self.turn_rate * duration * gain)
+        # Pulse time plus sending the command and waiting for a fresh pose
+        self.clock += duration + self.latency
+
+
+def cross_track(point, path):
+    """Distance from point to the path polyline"""
+    a, b = path[:-1], path[1:]
+    ab = b - a
+    seg_len2 = np.maximum(np.einsum('ij,ij->i', ab, ab), 1e-12)
+    t = np.clip(np.einsum('ij,ij->i', np.asarray(point) - a, ab) / seg_len2, 0.0, 1.0)
+    return float(np.min(np.linalg.norm(a + ab * t[:, None] - point, axis=1)))
+
+
+def run_controller(controller, targets, car, path, max_iterations=2000):
+    """Drive the car through each target in turn; return (success, iterations, errors)"""
+    errors = []
+    with contextlib.redirect_stdout(io.StringIO()):
+        return _drive(controller, targets, car, path, max_iterations, errors)
+
+
+def _drive(controller, targets, car, path, max_iterations, errors):
+    iterations = 0
+    for target in targets:
+        target(controller)
+        while controller.state not in (ControlState.SUCCESS, ControlState.FAILED):
+            pulse = controller.get_pulse(car.pose)
+            iterations += 1
+            if pulse is None or iterations > max_iterations:
+                return False, iterations, errors
+            car.pulse(*pulse)
+            errors.append(cross_track(car.pose.front, path))
+        if controller.state == ControlState.FAILED:
+            return False, iterations, errors
+    return True, iterations, errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark path following controllers in simulation')
+    parser.add_argument('--method', choices=list(PATH_METHODS), default='catmull')
+    parser.add_argument('--trials', type=int, default=10)
+    parser.add_argument('--latency', type=float, default=0.3,
+                        help='Command + sensing latency per iteration in seconds (default: 0.3)')
+    parser.add_argument('--noise', type=float, default=0.1,
+                        help='Relative std-dev of pulse response (default: 0.1)')
+    parser.add_argument('--forward-speed', type=float, default=150.0)
+    parser.add_argument('--turn-rate', type=float, default=90.0)
+    parser.add_argument('--lookahead', type=float, default=60.0)
+    parser.add_argument('--spacing', type=float, default=None,
+                        help='Resample the path every SPACING px of arc length instead of 30 samples per segment')
+    args = parser.parse_args()
+
+    if args.spacing:
+        path_hdg = arc_length_path(WAYPOINTS, args.method, args.spacing).path_with_headings()
+    else:
+        path_hdg = path_with_headings(PATH_METHODS[args.method](WAYPOINTS, n=30))
+    path = np.array([p["point"] for p in path_hdg])
+    turn_rate = math.radians(args.turn_rate)
+
+    start_heading = path_hdg[0]["heading"]
+    sx, sy = path[0]
+    half = 20.0
+    start = RobotPose(sx + half * math.cos(start_heading), sy + half * math.sin(start_heading),
+                      sx - half * math.cos(start_heading), sy - half * math.sin(start_heading))
+
+    steps = np.linalg.norm(np.diff(path, axis=0), axis=1)
+    arc = np.concatenate(([0.0], np.cumsum(steps)))
+    stops = np.linspace(0, arc[-1], len(WAYPOINTS))[1:]
+    clicks = [(np.interp(s, arc, path[:, 0]), np.interp(s, arc, path[:, 1])) for s in stops]
+
+    def point_to_point():
+        controller = PathPlanningController(heading_threshold=math.radians(8))
+        targets = [lambda c, p=p: c.set_target(*p) for p in clicks]
+        return controller, targets
+
+    def pure_pursuit():
+        controller = PathFollowingController(lookahead=args.lookahead,
+                                             forward_speed=args.forward_speed,
+                                             turn_rate=turn_rate,
+                                             heading_threshold=math.radians(8))
+        return controller, [lambda c: c.set_path(path_hdg)]
+
+    print(f"Path: {args.method}, {len(path)} samples, {args.trials} trials, "
+          f"latency {args.latency * 1000:.0f}ms, noise {args.noise:.0%}")
+    print(f"{'controller':<16}{'success':>8}{'iters':>8}{'sim time':>10}{'mean xte':>10}{'max xte':>10}{'cpu/iter':>10}")
+
+    for name, factory in (("point-to-point", point_to_point), ("pure-pursuit", pure_pursuit)):
+        rng = random.Random(0)
+        successes, iters, sim_times, mean_err, max_err, cpu = 0, [], [], [], [], 0.0
+        for _ in range(args.trials):
+            car = SimCar(start, args.forward_speed, turn_rate, args.latency, args.noise, rng)
+            controller, targets = factory()
+            t0 = time.perf_counter()
+            ok, n, errors = run_controller(controller, targets, car, path)
+            cpu += (time.perf_counter() - t0) / max(n, 1)
+            successes += ok
+            iters.append(n)
+            sim_times.append(car.clock)
+            mean_err.append(np.mean(errors) if errors else 0.0)
+            max_err.append(np.max(errors) if errors else 0.0)
+        print(f"{name:<16}{successes:>5}/{args.trials:<2}{np.mean(iters):>8.1f}{np.mean(sim_times):>9.1f}s"
+              f"{np.mean(mean_err):>8.1f}px{np.mean(max_err):>8.1f}px{cpu / args.trials * 1e6:>8.0f}us")
+
+
+if __name__ == '__main__':
+    main()
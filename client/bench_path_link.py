@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""
+Benchmark: replanning latency over MQTT, connect-per-path vs a session
+
+Replays a PathGUI editing session (click waypoints, drag one of them in
+small steps, add one, undo) against a broker and measures, for every edit,
+the time from "publish" until a subscriber has the new path:
+
+  connect  - what PathGUI.publish did: a new client per path, connect,
+             publish the whole path, disconnect
+  session  - path_link.PathPublisher: one open session, patches for edits
+             and a retained snapshot once edits pause
+
+The subscriber is a path_link.PathSubscriber in both cases, and its final
+path is checked against what the GUI last drew. Also reports bytes per
+edit, with the JSON payload PathGUI used to send for comparison.
+
+Needs a broker (mosquitto on the Pi, or locally).
+
+Usage:
+  python3 bench_path_link.py --broker localhost
+  python3 bench_path_link.py --broker 100.101.214.30 --method cubic --drag-steps 100
+"""
+
+import argparse
+import json
+import threading
+import time
+
+import numpy as np
+
+import path_codec
+from path_calculations import catmull_path, cubic_path, bezier_chained, linear_path, path_with_headings
+from path_link import PathPublisher, PathSubscriber, PATH_TOPIC, make_client
+
+PATH_METHODS = {
+    "linear": linear_path,
+    "catmull": catmull_path,
+    "cubic": cubic_path,
+    "bezier": bezier_chained,
+}
+
+
+def edit_session(waypoints, drag_steps, rng):
+    """Waypoint lists after each edit: drag one point, add one, undo"""
+    points = [tuple(p) for p in waypoints]
+    edits = []
+    k = len(points) // 2
+    for _ in range(drag_steps):
+        x, y = points[k]
+        points[k] = (x + int(rng.integers(-4, 5)), y + int(rng.integers(-4, 5)))
+        edits.append(list(points))
+    points.append((points[-1][0] + 60, points[-1][1] - 40))
+    edits.append(list(points))
+    points.pop()
+    edits.append(list(points))
+    return edits
+
+
+def connect_and_publish(broker, port, path, method):
+    client = make_client("", clean_session=True)
+    client.connect(broker, port, 60)
+    client.loop_start()
+    client.publish(PATH_TOPIC, path_codec.encode_path(path, method), qos=1, retain=True).wait_for_publish(5)
+    client.disconnect()
+    client.loop_stop()
+
+
+def run(mode, args, edits, make_path):
+    arrived = threading.Event()
+    subscriber = PathSubscriber(args.broker, args.port, client_id=f"bench-{mode}",
+                                on_update=lambda path, revision: arrived.set())
+    publisher = PathPublisher(args.broker, args.port, snapshot_delay=0.5) if mode == "session" else None
+    time.sleep(0.5)  # both connected, retained path from a previous run delivered
+
+    latencies, sizes = [], []
+    for points in edits:
+        path = make_path(points)
+        arrived.clear()
+        t0 = time.perf_counter()
+        if publisher is not None:
+            kind, size = publisher.publish(path, args.method)
+            if kind == "unchanged":
+                continue
+        else:
+            connect_and_publish(args.broker, args.port, path, args.method)
+            size = len(path_codec.encode_path(path, args.method))
+        if not arrived.wait(5):
+            print(f"⚠️ {mode}: edit not received within 5s")
+            continue
+        latencies.append(time.perf_counter() - t0)
+        sizes.append(size)
+
+    final = make_path(edits[-1])
+    if publisher is not None:
+        publisher.close()
+    time.sleep(0.3)
+    got = subscriber.path
+    subscriber.close()
+    same = got is not None and len(got) == len(final) and np.allclose(
+        [p["point"] for p in got], [p["point"] for p in final], atol=0.05)
+    stats = publisher.stats if publisher else {"snapshots": len(sizes), "patches": 0}
+    return np.array(latencies) * 1000, sizes, same, stats
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark path replanning latency over MQTT')
+    parser.add_argument('--broker', default='localhost')
+    parser.add_argument('--port', type=int, default=1883)
+    parser.add_argument('--method', choices=list(PATH_METHODS), default='catmull')
+    parser.add_argument('--waypoints', type=int, default=12)
+    parser.add_argument('--n', type=int, default=20, help='Samples per segment (default: 20)')
+    parser.add_argument('--drag-steps', type=int, default=50)
+    args = parser.parse_args()
+
+    rng = np.random.default_rng(0)
+    waypoints = np.column_stack((np.linspace(100, 1100, args.waypoints),
+                                 rng.integers(200, 600, args.waypoints))).astype(int)
+    edits = [[tuple(p) for p in waypoints]] + edit_session(waypoints, args.drag_steps, rng)
+    make_path = lambda points: path_with_headings(PATH_METHODS[args.method](points, n=args.n))
+    json_size = len(json.dumps({"method": args.method, "path": make_path(edits[0])}))
+
+    print(f"{args.method}, {args.waypoints} waypoints x {args.n} samples, {len(edits)} edits "
+          f"via {args.broker}:{args.port}; JSON payload was {json_size} bytes")
+    print(f"{'mode':<9}{'edits':>6}{'mean':>9}{'p50':>9}{'p90':>9}{'max':>9}"
+          f"{'bytes/edit':>12}{'snapshots':>11}{'patches':>9}{'final':>7}")
+    for mode in ("connect", "session"):
+        latencies, sizes, same, stats = run(mode, args, edits, make_path)
+        if not len(latencies):
+            print(f"{mode:<9} nothing arrived")
+            continue
+        print(f"{mode:<9}{len(latencies):>6}{latencies.mean():>7.1f}ms{np.percentile(latencies, 50):>7.1f}ms"
+              f"{np.percentile(latencies, 90):>7.1f}ms{latencies.max():>7.1f}ms{np.mean(sizes):>12.0f}"
+              f"{stats['snapshots']:>11}{stats['patches']:>9}{'ok' if same else 'WRONG':>7}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,316 @@
+#!/usr/bin/env python3
+"""
+Closed-loop motor calibration for the ESP32 car
+
+The firmware drives every wheel at one `speed` duty, but no two motors
+answer it alike, so "forward" curves and the controller spends iterations
+re-aligning. This drives each wheel alone with timed raw pulses (/drive),
+watches the car pivot in the NN server's poses, and fits per wheel and
+direction
+
+  deadband  the duty below which the wheel does not move the car
+  gain      heading rate per unit of duty above the deadband
+
+The compensation is stored on the car (/calib, kept in NVS), after which
+every wheel answers `speed` alike. The go/back speeds and
+left/right turn rates are then measured through the normal commands and
+stored too (video_client_controller.py --robot-calib uses them), and
+--evaluate drives to the same targets with compensation off and on and
+reports the iterations each needed.
+
+  python3 calibrate.py NN_SERVER_IP ROBOT_IP [--car-id N] [--evaluate 4]
+"""
+
+import argparse
+import math
+import statistics
+import time
+
+import numpy as np
+import requests
+
+from video_client_controller import CarAgent, ControlState, RobotCommander, RobotPose, normalize_angle
+
+WHEELS = ("left", "right")
+DIRECTIONS = ("fwd", "back")
+CALIB_KEYS = (("lf", "lb"), ("rf", "rb"))  # /calib query keys by [wheel][direction]
+
+
+class MotorCalibrator:
+    """Scripted pulses on one car, measured from its poses"""
+
+    def __init__(self, agent: CarAgent, pulse: float = 0.5, rest: float = 0.4,
+                 samples: int = 3, min_turn: float = 2.0):
+        self.agent = agent
+        self.robot_url = agent.robot_url
+        self.pose_client = agent.pose_client
+        self.commander = RobotCommander(agent.robot_url)  # blocking, for the rate pulses
+        self.session = requests.Session()
+        self.pulse = pulse          # seconds per calibration pulse
+        self.rest = rest            # seconds for the car to come to rest after a pulse
+        self.samples = samples      # poses averaged per measurement
+        self.min_turn = min_turn    # degrees; less than this is noise, not motion
+        self.rest_after = 0.0       # when the last pulse will have settled
+
+    def calibration(self, **query) -> dict:
+        """GET /calib, changing it by `query`; built by hand since the firmware does not URL-decode"""
+        url = f"{self.robot_url}/calib"
+        if query:
+            url += "?" + "&".join(f"{key}={value}" for key, value in query.items())
+        response = self.session.get(url, timeout=2)
+        response.raise_for_status()
+        return response.json()
+
+    def rest_pose(self) -> RobotPose:
+        """Average of `samples` poses captured once the car is at rest"""
+        poses = []
+        after = self.rest_after
+        while len(poses) < self.samples:
+            pose = self.pose_client.wait_for_pose(after=after, timeout=5.0)
+            if pose is None:
+                raise RuntimeError("no pose from the NN server; is the car in view?")
+            poses.append(pose)
+            after = pose.timestamp
+        heading = math.atan2(sum(math.sin(p.heading) for p in poses), sum(math.cos(p.heading) for p in poses))
+        cx = statistics.mean(p.center[0] for p in poses)
+        cy = statistics.mean(p.center[1] for p in poses)
+        half = statistics.mean(math.hypot(p.front_x - p.back_x, p.front_y - p.back_y) for p in poses) / 2
+        dx, dy = half * math.cos(heading), half * math.sin(heading)
+        return RobotPose(cx + dx, cy + dy, cx - dx, cy - dy, timestamp=poses[-1].timestamp)
+
+    def drive(self, left: int, right: int, duration: float):
+        """Raw wheel duties, stopped by the car after `duration`"""
+        response = self.session.get(f"{self.robot_url}/drive?l={left}&r={right}&ms={int(duration * 1000)}",
+                                    timeout=2)
+        response.raise_for_status()
+        # The pulse started before the reply left the car, so it ends before this
+        self.rest_after = time.time() + duration + self.rest
+
+    def command(self, command: str, duration: float):
+        """One pulse of a normal command, compensated by the firmware"""
+        self.commander.pulse(command, duration)
+        self.rest_after = time.time() + self.rest
+
+    # ---------------------------------------------------------------
+    # Per-wheel fit
+    # ---------------------------------------------------------------
+
+    def measure_wheels(self, duties, repeats: int):
+        """{(wheel, direction): [(duty, heading rate deg/s), ...]} from single-wheel pivots"""
+        points = {(w, d): [] for w in range(2) for d in range(2)}
+        pose = self.rest_pose()
+        for wheel in range(2):
+            for duty in duties:
+                turns = ([], [])
+                for _ in range(repeats):
+                    # Forward then back at the same duty, so the car pivots back
+                    for direction, sign in enumerate((1, -1)):
+                        wheels = [0, 0]
+                        wheels[wheel] = sign * duty
+                        self.drive(wheels[0], wheels[1], self.pulse)
+                        after = self.rest_pose()
+                        turn = math.degrees(normalize_angle(after.heading - pose.heading))
+                        pose = after
+                        points[wheel, direction].append((duty, turn / self.pulse))
+                        turns[direction].append(turn)
+                print(f"   {WHEELS[wheel]:>5} duty {duty:>3}: fwd {statistics.mean(turns[0]):+6.1f}°, "
+                      f"back {statistics.mean(turns[1]):+6.1f}°")
+        return points
+
+    def fit(self, points):
+        """{(wheel, direction): (deg/s per duty, deadband)} by a line through the duties that moved"""
+        table = {}
+        for (wheel, direction), samples in points.items():
+            moving = [(duty, abs(rate)) for duty, rate in samples if abs(rate) * self.pulse >= self.min_turn]
+            name = f"{WHEELS[wheel]} wheel {DIRECTIONS[direction]}"
+            if len(moving) < 2:
+                raise RuntimeError(f"{name} barely moved the car; check it or try higher --duties")
+            slope, intercept = np.polyfit([d for d, _ in moving], [r for _, r in moving], 1)
+            if slope <= 0:
+                raise RuntimeError(f"{name} does not speed up with duty; measurements too noisy")
+            deadband = min(max(0.0, -intercept / slope), min(d for d, _ in moving))
+            table[wheel, direction] = (slope, deadband)
+        return table
+
+    @staticmethod
+    def compensation(table, speed):
+        """
+        {(wheel, direction): (gain, deadband)} for the firmware's
+        duty = deadband + gain * speed * (255 - deadband) / 255
+
+        Every wheel is matched to the mean response, or to as much as the
+        weakest one reaches without going past duty 255 at `speed`
+        """
+        strength = {key: slope * (255 - deadband) for key, (slope, deadband) in table.items()}
+        common = min(statistics.mean(strength.values()), min(strength.values()) * 255 / speed)
+        return {key: (common / strength[key], int(round(table[key][1]))) for key in table}
+
+    # ---------------------------------------------------------------
+    # Command rates
+    # ---------------------------------------------------------------
+
+    def measure_commands(self, duration: float, repeats: int):
+        """
+        Per command: mean speed (px/s for go/back, deg/s for left/right) and
+        heading drift of go/back in degrees per 100 px driven
+        """
+        results = {}
+        pose = self.rest_pose()
+        for pair in (("back", "go"), ("left", "right")):
+            samples = {command: [] for command in pair}
+            for _ in range(repeats):
+                for command in pair:  # each pair undoes itself
+                    self.command(command, duration)
+                    after = self.rest_pose()
+                    distance = math.hypot(after.center[0] - pose.center[0], after.center[1] - pose.center[1])
+                    turn = math.degrees(normalize_angle(after.heading - pose.heading))
+                    samples[command].append((distance, turn))
+                    pose = after
+            for command, values in samples.items():
+                distance = statistics.mean(d for d, _ in values)
+                turn = statistics.mean(t for _, t in values)
+                if command in ("go", "back"):
+                    drift = turn / distance * 100 if distance > 1 else 0.0
+                    results[command] = (distance / duration, drift)
+                else:
+                    results[command] = (abs(turn) / duration, None)
+        return results
+
+
+def print_commands(label, results):
+    print(f"   {label}:")
+    for command, (rate, drift) in results.items():
+        if drift is None:
+            print(f"     {command:>5}: {rate:6.1f}°/s")
+        else:
+            print(f"     {command:>5}: {rate:6.1f}px/s, drift {drift:+5.1f}°/100px")
+
+
+def evaluate(agent: CarAgent, targets, timeout: float):
+    """Drive to each target; returns [(state, iterations, seconds)]"""
+    results = []
+    for x, y in targets:
+        agent.set_target(x, y)
+        deadline = time.time() + timeout
+        while agent.controller.state not in (ControlState.SUCCESS, ControlState.FAILED):
+            if time.time() > deadline:
+                agent.cancel()
+                break
+            time.sleep(0.05)
+        elapsed, _ = agent.controller.run_rate()
+        results.append((agent.controller.state, agent.controller.iteration, elapsed))
+        time.sleep(0.5)
+    return results
+
+
+def eval_targets(pose: RobotPose, count: int, distance: float):
+    """Out to `count` points around the start and back to the start after each"""
+    cx, cy = pose.center
+    targets = []
+    for i in range(count):
+        angle = pose.heading + math.pi / 4 + 2 * math.pi * i / count
+        targets += [(cx + distance * math.cos(angle), cy + distance * math.sin(angle)), (cx, cy)]
+    return targets
+
+
+def summarize(label, results):
+    ok = [r for r in results if r[0] == ControlState.SUCCESS]
+    line = f"   {label}: {len(ok)}/{len(results)} reached"
+    if ok:
+        line += (f", iterations mean {statistics.mean(r[1] for r in ok):.1f} "
+                 f"(median {statistics.median(r[1] for r in ok):.0f}), "
+                 f"time mean {statistics.mean(r[2] for r in ok):.1f}s")
+    print(line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='VizCar motor calibration',
+                                     formatter_class=argparse.RawDescriptionHelpFormatter,
+                                     epilog=__doc__)
+    parser.add_argument('nn_server_ip', help='IP address of NN server')
+    parser.add_argument('robot_ip', help='IP address of the ESP32 robot')
+    parser.add_argument('--nn-port', type=int, default=5000, help='NN server port (default: 5000)')
+    parser.add_argument('--robot-port', type=int, default=80, help='Robot HTTP port (default: 80)')
+    parser.add_argument('--car-id', type=int, default=None,
+                        help="The car's NN server track ID when several cars are in view")
+    parser.add_argument('--front-keypoint', type=int, default=0, choices=[0, 1])
+    parser.add_argument('--duties', type=str, default='60,90,120,150,180,210',
+                        help='Comma-separated duties to pulse each wheel at (default: 60,90,120,150,180,210)')
+    parser.add_argument('--pulse', type=float, default=0.5, help='Seconds per wheel pulse (default: 0.5)')
+    parser.add_argument('--rest', type=float, default=0.4,
+                        help='Seconds to let the car settle after a pulse (default: 0.4)')
+    parser.add_argument('--samples', type=int, default=3, help='Poses averaged per measurement (default: 3)')
+    parser.add_argument('--repeats', type=int, default=2,
+                        help='Pulses per wheel and duty, and per command for the rates (default: 2)')
+    parser.add_argument('--rate-pulse', type=float, default=0.3,
+                        help='Seconds per command pulse for the rates (default: 0.3)')
+    parser.add_argument('--evaluate', type=int, default=0,
+                        help='Compare iterations to N targets (and back) with compensation off and on')
+    parser.add_argument('--eval-distance', type=float, default=250.0,
+                        help='Distance of the evaluation targets in pixels (default: 250)')
+    parser.add_argument('--eval-timeout', type=float, default=120.0, help='Seconds per target (default: 120)')
+    parser.add_argument('--skip-fit', action='store_true', help='Keep the stored calibration, only measure')
+    args = parser.parse_args()
+
+    agent = CarAgent(f"http://{args.nn_server_ip}:{args.nn_port}",
+                     f"http://{args.robot_ip}:{args.robot_port}",
+                     car_id=args.car_id, front_keypoint=args.front_keypoint)
+    calibrator = MotorCalibrator(agent, pulse=args.pulse, rest=args.rest, samples=args.samples)
+    duties = [int(d) for d in args.duties.split(',')]
+
+    print("=" * 60)
+    print("🔧 VizCar motor calibration")
+    print("=" * 60)
+    try:
+        stored = calibrator.calibration()
+    except (requests.RequestException, ValueError) as e:
+        print(f"❌ Robot has no /calib ({e}); flash the current firmware")
+        return
+    speed = stored['speed']
+    agent.start()
+    try:
+        calibrator.calibration(enable=0)
+        print_commands("Uncompensated", calibrator.measure_commands(args.rate_pulse, args.repeats))
+
+        if not args.skip_fit:
+            print(f"🛞 Pivoting on each wheel at duties {duties} for {args.pulse}s")
+            table = calibrator.fit(calibrator.measure_wheels(duties, args.repeats))
+            gains = calibrator.compensation(table, speed)
+            print(f"📐 {'wheel':>11} {'°/s/duty':>9} {'deadband':>9} {'gain':>6}")
+            for (wheel, direction), (slope, deadband) in sorted(table.items()):
+                print(f"   {WHEELS[wheel]:>5} {DIRECTIONS[direction]:<5} {slope:>9.3f} {deadband:>9.1f} "
+                      f"{gains[wheel, direction][0]:>6.3f}")
+            calibrator.calibration(**{CALIB_KEYS[wheel][direction]: f"{gain:.3f},{deadband}"
+                                      for (wheel, direction), (gain, deadband) in gains.items()})
+
+        calibrator.calibration(enable=1)
+        compensated = calibrator.measure_commands(args.rate_pulse, args.repeats)
+        print_commands("Compensated", compensated)
+        rates = ",".join(f"{compensated[c][0]:.1f}" for c in ("go", "back", "left", "right"))
+        stored = calibrator.calibration(rates=rates)
+        print(f"💾 Stored on the robot at speed {speed}: {stored}")
+
+        if args.evaluate:
+            targets = eval_targets(calibrator.rest_pose(), args.evaluate, args.eval_distance)
+            results = {}
+            for label, enable in (("Uncompensated", 0), ("Compensated", 1)):
+                calibrator.calibration(enable=enable)
+                print(f"🎯 {label}: {len(targets)} targets")
+                results[label] = evaluate(agent, targets, args.eval_timeout)
+            print("📊 Iterations to target:")
+            for label, result in results.items():
+                summarize(label, result)
+    except KeyboardInterrupt:
+        print("\n⏹️ Interrupted")
+    except RuntimeError as e:
+        print(f"❌ {e}")
+    finally:
+        try:
+            calibrator.calibration(enable=1)
+        except requests.RequestException:
+            pass
+        agent.stop()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""
+Glass-to-glass latency probe for the video pipeline
+
+Shows a window that flips between black and white and watches the camera
+stream for the flip. Point the camera at the window (filling a good part
+of the image) and run it against video_server.py or nn_server.py; the
+time from drawing the flip to receiving a frame that shows it is the full
+camera -> server -> network -> client latency, including the display.
+
+video_server's /status CPU figure is sampled while the probe runs, so
+comparing video_server --mode decode and --mode passthrough gives both
+numbers from one run each.
+
+Usage:
+  python3 glass_to_glass.py http://PI_IP:5000
+  python3 glass_to_glass.py http://PI_IP:5000 --flips 40 --period 0.8
+"""
+
+import argparse
+import statistics
+import threading
+import time
+
+import cv2
+import numpy as np
+import requests
+
+from mjpeg_stream import MjpegStream
+
+
+class BrightnessWatcher:
+    """Reads the stream in the background, recording (receive time, mean brightness)"""
+
+    def __init__(self, stream_url):
+        self.stream_url = stream_url
+        self.samples = []
+        self.lock = threading.Lock()
+        self.running = False
+        self.thread = None
+
+    def start(self):
+        self.running = True
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+
+    def _run(self):
+        # Only the brightness matters: decode 1/8-scale grayscale, which is
+        # cheap enough not to add decode time to the measured latency
+        stream = MjpegStream(self.stream_url, scale_denom=8, gray=True)
+        while self.running:
+            try:
+                for frame, _, _ in stream:
+                    received = time.time()
+                    h, w = frame.shape[:2]
+                    center = frame[h // 4:3 * h // 4, w // 4:3 * w // 4]
+                    with self.lock:
+                        self.samples.append((received, float(center.mean())))
+                    if not self.running:
+                        break
+            except Exception:
+                time.sleep(0.1)
+            stream.close()
+
+    def stop(self):
+        self.running = False
+        if self.thread:
+            self.thread.join(timeout=2)
+
+    def since(self, t):
+        with self.lock:
+            return [s for s in self.samples if s[0] >= t]
+
+
+def server_cpu(base_url):
+    """CPU % reported by video_server /status, or None"""
+    try:
+        return requests.get(f"{base_url}/status", timeout=2).json().get('cpu_percent')
+    except Exception:
+        return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Measure glass-to-glass latency of the video stream')
+    parser.add_argument('server', help='Server base URL, e.g. http://PI_IP:5000')
+    parser.add_argument('--flips', type=int, default=20, help='Number of black/white flips (default: 20)')
+    parser.add_argument('--period', type=float, default=1.0, help='Seconds between flips (default: 1.0)')
+    parser.add_argument('--size', type=int, default=600, help='Window size in pixels (default: 600)')
+    args = parser.parse_args()
+
+    base_url = args.server.rstrip('/')
+    watcher = BrightnessWatcher(f"{base_url}/video_feed")
+    watcher.start()
+
+    window = 'glass-to-glass'
+    cv2.namedWindow(window)
+    black = np.zeros((args.size, args.size, 3), np.uint8)
+    white = np.full((args.size, args.size, 3), 255, np.uint8)
+
+    # Let the stream settle on black; the black/white threshold is taken
+    # from the levels seen over the whole run
+    cv2.imshow(window, black)
+    cv2.waitKey(int(2000 * args.period))
+    flips = []  # (time drawn, now white)
+    white_now = False
+    cpu_samples = []
+    for i in range(args.flips + 1):
+        white_now = not white_now
+        cv2.imshow(window, white if white_now else black)
+        cv2.waitKey(1)
+        flips.append((time.time(), white_now))
+        deadline = time.time() + args.period
+        while time.time() < deadline:
+            if cv2.waitKey(10) & 0xFF == ord('q'):
+                break
+        cpu = server_cpu(base_url)
+        if cpu is not None:
+            cpu_samples.append(cpu)
+    cv2.destroyWindow(window)
+    watcher.stop()
+
+    levels = [b for _, b in watcher.since(flips[0][0])]
+    if not levels:
+        print("No frames received from the stream")
+        return
+    threshold = (min(levels) + max(levels)) / 2
+
+    latencies = []
+    for drawn, now_white in flips[1:]:  # the first flip only calibrates
+        for received, brightness in watcher.since(drawn):
+            if (brightness > threshold) == now_white:
+                latencies.append((received - drawn) * 1000)
+                break
+
+    if not latencies:
+        print("Never saw the window flip - is the camera pointed at it?")
+        return
+    latencies.sort()
+    p90 = latencies[min(len(latencies) - 1, int(0.9 * len(latencies)))]
+    print(f"Glass-to-glass over {len(latencies)}/{args.flips} flips: "
+          f"median {statistics.median(latencies):.0f}ms, p90 {p90:.0f}ms, "
+          f"min {latencies[0]:.0f}ms, max {latencies[-1]:.0f}ms")
+    if cpu_samples:
+        print(f"Server CPU: {statistics.mean(cpu_samples):.0f}% of one core "
+              f"(max {max(cpu_samples):.0f}%)")
+
+
+if __name__ == '__main__':
+    main()
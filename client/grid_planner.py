@@ -0,0 +1,483 @@
+#!/usr/bin/env python3
+"""
+Obstacle-aware path planning on the overhead view
+
+path_calculations fits curves through the operator's clicks; this plans the
+route itself, around whatever the camera sees in the way:
+
+  obstacle_mask   obstacle pixels in a frame: those that differ from a
+                  background frame of the empty arena, and/or those in an HSV
+                  colour range (tape or mats marking no-go areas)
+  OccupancyGrid   the mask reduced to square cells of `cell` pose pixels and
+                  inflated by the car's radius, so a path through free cell
+                  centres keeps the whole car clear
+  DStarLite       incremental shortest paths on the 8-connected grid (D* Lite,
+                  Koenig & Likhachev 2002). It searches from the goal, so the
+                  car moving costs nothing, and when cells change only the
+                  states whose distance changed are repaired instead of
+                  searching again from scratch
+  GridPlanner     frame in, path_with_headings() list out: the cell path is
+                  cut down to line-of-sight waypoints and sampled with
+                  arc_length_path, ready for PathFollowingController
+
+Coordinates in and out are pose (source frame) pixels as in the rest of the
+clients; cells are (row, col).
+
+Usage (plan across a frame and show the grid and path):
+  python3 grid_planner.py frame.jpg --background empty.jpg --start 100 600 --goal 1180 120
+  python3 grid_planner.py frame.jpg --hsv-low 0 120 80 --hsv-high 10 255 255 --start 100 600 --goal 1180 120
+"""
+
+import argparse
+import heapq
+import math
+from typing import Iterable, List, Optional, Sequence, Tuple
+
+import cv2
+import numpy as np
+
+from path_calculations import arc_length_path
+
+INF = float('inf')
+# Move costs in tenths of a cell. Integers keep the keys exact: with float
+# sqrt(2) steps, km and g drift by rounding and the queue can stop a
+# repair early on a tie that should have gone the other way
+STRAIGHT = 10
+DIAGONAL = 14
+
+Cell = Tuple[int, int]
+
+
+# ============================================================
+#   OBSTACLES
+# ============================================================
+
+def obstacle_mask(frame: np.ndarray, background: Optional[np.ndarray] = None,
+                  hsv_low: Optional[Sequence[int]] = None, hsv_high: Optional[Sequence[int]] = None,
+                  threshold: int = 40, open_px: int = 5) -> np.ndarray:
+    """
+    uint8 mask (255 = obstacle) of a BGR frame: pixels where any channel
+    differs from background by more than threshold, plus pixels inside the
+    HSV range. A morphological opening of open_px drops JPEG noise, grid
+    lines and thin overlay text.
+    """
+    mask = np.zeros(frame.shape[:2], dtype=np.uint8)
+    if background is not None:
+        diff = cv2.absdiff(frame, background)
+        # Largest channel difference; cv2.max is ~20x faster than ndarray.max(axis=2)
+        b, g, r = cv2.split(diff)
+        largest = cv2.max(cv2.max(b, g), r)
+        mask |= cv2.threshold(largest, threshold, 255, cv2.THRESH_BINARY)[1]
+    if hsv_low is not None and hsv_high is not None:
+        hsv = cv2.cvtColor(frame, cv2.COLOR_BGR2HSV)
+        mask |= cv2.inRange(hsv, np.array(hsv_low, np.uint8), np.array(hsv_high, np.uint8))
+    if open_px > 1:
+        kernel = cv2.getStructuringElement(cv2.MORPH_ELLIPSE, (open_px, open_px))
+        mask = cv2.morphologyEx(mask, cv2.MORPH_OPEN, kernel)
+    return mask
+
+
+def clear_discs(image: np.ndarray, discs: Iterable[Tuple[float, float, float]], scale: float = 1.0,
+                value=0) -> np.ndarray:
+    """Fill (x, y, radius) discs given in pose pixels, e.g. the car itself, in place"""
+    for x, y, r in discs:
+        cv2.circle(image, (int(x * scale), int(y * scale)), int(math.ceil(r * scale)), value, -1)
+    return image
+
+
+class OccupancyGrid:
+    """Blocked cells of `cell` pose pixels; row r, col c covers y in [r*cell, (r+1)*cell)"""
+
+    def __init__(self, blocked: np.ndarray, cell: float):
+        self.blocked = blocked
+        self.cell = cell
+
+    @classmethod
+    def from_mask(cls, mask: np.ndarray, cell: float, scale: float = 1.0, inflate: float = 0.0,
+                  fill: float = 0.25) -> 'OccupancyGrid':
+        """
+        Grid from an obstacle mask at frame resolution (scale = frame pixels
+        per pose pixel). A cell is blocked when more than `fill` of it is
+        obstacle, then obstacles grow by `inflate` pose pixels.
+        """
+        rows = max(1, int(math.ceil(mask.shape[0] / scale / cell)))
+        cols = max(1, int(math.ceil(mask.shape[1] / scale / cell)))
+        coverage = cv2.resize(mask, (cols, rows), interpolation=cv2.INTER_AREA)
+        blocked = (coverage > 255 * fill).astype(np.uint8)
+        radius = int(math.ceil(inflate / cell))
+        if radius > 0:
+            kernel = cv2.getStructuringElement(cv2.MORPH_ELLIPSE, (2 * radius + 1, 2 * radius + 1))
+            blocked = cv2.dilate(blocked, kernel)
+        return cls(blocked.astype(bool), cell)
+
+    @property
+    def shape(self) -> Tuple[int, int]:
+        return self.blocked.shape
+
+    def to_cell(self, x: float, y: float) -> Cell:
+        rows, cols = self.blocked.shape
+        return (min(rows - 1, max(0, int(y // self.cell))),
+                min(cols - 1, max(0, int(x // self.cell))))
+
+    def to_point(self, cell: Cell) -> Tuple[float, float]:
+        return ((cell[1] + 0.5) * self.cell, (cell[0] + 0.5) * self.cell)
+
+    def nearest_free(self, cell: Cell) -> Optional[Cell]:
+        """cell itself if free, else the closest free cell (None if all are blocked)"""
+        if not self.blocked[cell]:
+            return cell
+        free = np.argwhere(~self.blocked)
+        if not len(free):
+            return None
+        i = int(np.argmin(np.sum((free - cell) ** 2, axis=1)))
+        return int(free[i][0]), int(free[i][1])
+
+    def line_of_sight(self, a: Cell, b: Cell) -> bool:
+        """No blocked cell on the straight line between the centres of a and b"""
+        steps = 2 * max(abs(b[0] - a[0]), abs(b[1] - a[1])) + 1
+        rows = np.rint(np.linspace(a[0], b[0], steps)).astype(int)
+        cols = np.rint(np.linspace(a[1], b[1], steps)).astype(int)
+        return not self.blocked[rows, cols].any()
+
+    def outline(self) -> List[np.ndarray]:
+        """Blocked regions as polygons in pose pixels, for drawing"""
+        mask = self.blocked.astype(np.uint8)
+        contours, _ = cv2.findContours(mask, cv2.RETR_EXTERNAL, cv2.CHAIN_APPROX_SIMPLE)
+        return [(c.reshape(-1, 2) + 0.5) * self.cell for c in contours]
+
+
+# ============================================================
+#   D* LITE
+# ============================================================
+
+class DStarLite:
+    """
+    Shortest 8-connected paths from start to goal that repair themselves.
+
+    Moves cost STRAIGHT and DIAGONAL (1 and ~1.4 cells); a diagonal move needs both
+    cells it squeezes between to be free, so paths never cut an obstacle's
+    corner. The grid is stored flat with a blocked border, so neighbours
+    need no bounds checks. g and rhs are plain lists and the priority queue
+    a heap with lazy deletion, which is what keeps this fast in Python.
+
+    Usage: plan once with compute(), then per update move_start() and/or
+    set_blocked() followed by compute() again, and read path().
+    """
+
+    def __init__(self, blocked: np.ndarray, start: Cell, goal: Cell):
+        rows, cols = blocked.shape
+        self.rows, self.cols = rows, cols
+        self.width = w = cols + 2
+        free = np.zeros((rows + 2, cols + 2), dtype=bool)
+        free[1:-1, 1:-1] = ~blocked
+        self.free_mask = free.ravel()     # numpy copy, to diff new grids against
+        self.free = self.free_mask.tolist()
+        size = len(self.free)
+        self.g = [INF] * size
+        self.rhs = [INF] * size
+        self.row = [i // w for i in range(size)]
+        self.col = [i % w for i in range(size)]
+
+        # (offset, cost, corner offsets a diagonal squeezes between)
+        self.moves = [(-w, STRAIGHT, 0, 0), (w, STRAIGHT, 0, 0), (-1, STRAIGHT, 0, 0), (1, STRAIGHT, 0, 0),
+                      (-w - 1, DIAGONAL, -w, -1), (-w + 1, DIAGONAL, -w, 1),
+                      (w - 1, DIAGONAL, w, -1), (w + 1, DIAGONAL, w, 1)]
+
+        self.queue = []
+        self.queued = {}   # state -> its current key; heap entries that differ are stale
+        self.km = 0
+        self.start = self.last = self._id(start)
+        self.goal = self._id(goal)
+        self.rhs[self.goal] = 0
+        self._push(self.goal)
+        self.expanded = 0  # states expanded, over the planner's lifetime
+
+    def _id(self, cell: Cell) -> int:
+        return (cell[0] + 1) * self.width + cell[1] + 1
+
+    def _cell(self, s: int) -> Cell:
+        r, c = divmod(s, self.width)
+        return r - 1, c - 1
+
+    def _h(self, a: int, b: int) -> float:
+        # Octile distance: admissible and consistent for these move costs
+        dr, dc = abs(self.row[a] - self.row[b]), abs(self.col[a] - self.col[b])
+        return STRAIGHT * max(dr, dc) + (DIAGONAL - STRAIGHT) * min(dr, dc)
+
+    def _key(self, s: int) -> Tuple[float, float]:
+        m = min(self.g[s], self.rhs[s])
+        return m + self._h(self.start, s) + self.km, m
+
+    def _push(self, s: int):
+        key = self._key(s)
+        self.queued[s] = key
+        heapq.heappush(self.queue, (key[0], key[1], s))
+
+    def _update(self, s: int):
+        if self.g[s] != self.rhs[s]:
+            self._push(s)
+        else:
+            self.queued.pop(s, None)
+
+    def _neighbours(self, s: int):
+        """(neighbour, move cost) for every move out of s, inf when blocked"""
+        free = self.free
+        out = []
+        for off, cost, a, b in self.moves:
+            t = s + off
+            if not (free[s] and free[t]) or (a and not (free[s + a] and free[s + b])):
+                out.append((t, INF))
+            else:
+                out.append((t, cost))
+        return out
+
+    def _best(self, s: int) -> float:
+        """min over moves of cost + g: what rhs[s] should be"""
+        free = self.free
+        if not free[s]:
+            return INF   # also keeps border cells from looking past the array
+        g = self.g
+        best = INF
+        for off, cost, a, b in self.moves:
+            t = s + off
+            if free[t] and (not a or (free[s + a] and free[s + b])):
+                v = cost + g[t]
+                if v < best:
+                    best = v
+        return best
+
+    def compute(self) -> bool:
+        """Repair g until start's distance is exact; False if the goal is unreachable"""
+        g, rhs, queue, queued = self.g, self.rhs, self.queue, self.queued
+        free, moves = self.free, self.moves
+        start, goal = self.start, self.goal
+        while queue:
+            k1, k2, u = queue[0]
+            if queued.get(u) != (k1, k2):
+                heapq.heappop(queue)
+                continue
+            if (k1, k2) >= self._key(start) and rhs[start] == g[start]:
+                break
+            heapq.heappop(queue)
+            new = self._key(u)
+            if (k1, k2) < new:
+                queued[u] = new
+                heapq.heappush(queue, (new[0], new[1], u))
+                continue
+            del queued[u]
+            self.expanded += 1
+            # Moves are symmetric, so u's successors are also its predecessors
+            open_u = free[u]
+            if g[u] > rhs[u]:
+                g[u] = gu = rhs[u]
+                for off, cost, a, b in moves:
+                    s = u + off
+                    if (open_u and free[s] and (not a or (free[u + a] and free[u + b]))
+                            and s != goal and cost + gu < rhs[s]):
+                        rhs[s] = cost + gu
+                        self._update(s)
+            else:
+                g_old, g[u] = g[u], INF
+                for off, cost, a, b in moves:
+                    s = u + off
+                    if (open_u and free[s] and (not a or (free[u + a] and free[u + b]))
+                            and s != goal and rhs[s] == cost + g_old):
+                        rhs[s] = self._best(s)
+                    self._update(s)
+                if u != goal:
+                    rhs[u] = self._best(u)
+                self._update(u)
+        return rhs[start] < INF
+
+    def move_start(self, cell: Cell):
+        """The car moved: keys already queued stay valid lower bounds via km"""
+        s = self._id(cell)
+        if s != self.start:
+            self.km += self._h(self.last, s)
+            self.last = self.start = s
+
+    def set_blocked(self, blocked: np.ndarray) -> int:
+        """Take a new occupancy; returns how many cells changed"""
+        free = np.zeros((self.rows + 2, self.cols + 2), dtype=bool)
+        free[1:-1, 1:-1] = ~blocked
+        free = free.ravel()
+        changed = np.flatnonzero(free != self.free_mask)
+        if not len(changed):
+            return 0
+        self.free_mask = free
+        for s in changed.tolist():
+            self.free[s] = bool(free[s])
+        # A cell's moves, and diagonals squeezing past it, all join cells of
+        # its 3x3 block; recomputing rhs there covers every changed edge
+        affected = set()
+        w = self.width
+        for s in changed.tolist():
+            for off in (0, -w - 1, -w, -w + 1, -1, 1, w - 1, w, w + 1):
+                affected.add(s + off)
+        for s in affected:
+            if s != self.goal:
+                self.rhs[s] = self._best(s)
+                self._update(s)
+        return len(changed)
+
+    @property
+    def cost(self) -> float:
+        """Path length from start to goal in cells (inf if unreachable)"""
+        return self.rhs[self.start] / STRAIGHT
+
+    def path(self) -> List[Cell]:
+        """Cells from start to goal, greedily down g"""
+        if self.rhs[self.start] == INF:
+            return []
+        s, path = self.start, [self._cell(self.start)]
+        for _ in range(len(self.free)):
+            if s == self.goal:
+                return path
+            best, step = INF, None
+            for t, cost in self._neighbours(s):
+                v = cost + self.g[t]
+                if v < best:
+                    best, step = v, t
+            if step is None:
+                return []
+            s = step
+            path.append(self._cell(s))
+        return []
+
+
+def shortcut(cells: List[Cell], grid: OccupancyGrid) -> List[Cell]:
+    """Drop cells while the next waypoint stays in line of sight"""
+    if len(cells) <= 2:
+        return list(cells)
+    out = [cells[0]]
+    i = 0
+    while i < len(cells) - 1:
+        j = i + 1
+        while j + 1 < len(cells) and grid.line_of_sight(cells[i], cells[j + 1]):
+            j += 1
+        out.append(cells[j])
+        i = j
+    return out
+
+
+# ============================================================
+#   PLANNER
+# ============================================================
+
+class GridPlanner:
+    """
+    Occupancy from camera frames plus a D* Lite search kept across frames:
+    plan() once per goal, then replan() with each new frame and car
+    position repairs the same search.
+    """
+
+    def __init__(self, cell: float = 8.0, inflate: float = 30.0, spacing: float = 5.0,
+                 hsv_low: Optional[Sequence[int]] = None, hsv_high: Optional[Sequence[int]] = None,
+                 threshold: int = 40):
+        self.cell = cell
+        self.inflate = inflate        # pose px, about the car's half-diagonal
+        self.spacing = spacing        # pose px between path samples
+        self.hsv_low, self.hsv_high = hsv_low, hsv_high
+        self.threshold = threshold
+        self.background: Optional[np.ndarray] = None
+        self.grid: Optional[OccupancyGrid] = None
+        self.search: Optional[DStarLite] = None
+        self.goal: Optional[Tuple[float, float]] = None
+        self.cells: List[Cell] = []
+        self.last_changed = 0
+
+    @property
+    def ready(self) -> bool:
+        """Has something to detect obstacles with"""
+        return self.background is not None or self.hsv_low is not None
+
+    def set_background(self, frame: np.ndarray, exclude: Sequence[Tuple[float, float, float]] = (),
+                       scale: float = 1.0):
+        """Background for obstacle_mask; the excluded discs (cars) are painted over from around them"""
+        mask = clear_discs(np.zeros(frame.shape[:2], np.uint8), exclude, scale, 255)
+        self.background = cv2.inpaint(frame, mask, 5, cv2.INPAINT_TELEA) if mask.any() else frame.copy()
+
+    def update_grid(self, frame: np.ndarray, exclude: Sequence[Tuple[float, float, float]] = (),
+                    scale: float = 1.0) -> OccupancyGrid:
+        """Occupancy of a frame, with the excluded discs (the car being planned for) kept free"""
+        mask = obstacle_mask(frame, self.background, self.hsv_low, self.hsv_high, self.threshold)
+        clear_discs(mask, exclude, scale)
+        self.grid = OccupancyGrid.from_mask(mask, self.cell, scale, self.inflate)
+        return self.grid
+
+    def plan(self, start: Tuple[float, float], goal: Tuple[float, float]) -> Optional[List[dict]]:
+        """New search from start to goal on the current grid; None if there is no way"""
+        grid = self.grid
+        s = grid.nearest_free(grid.to_cell(*start))
+        g = grid.nearest_free(grid.to_cell(*goal))
+        self.goal = goal
+        if s is None or g is None:
+            self.search = None
+            return None
+        self.search = DStarLite(grid.blocked, s, g)
+        return self._path(start)
+
+    def replan(self, start: Tuple[float, float]) -> Optional[List[dict]]:
+        """Repair the search for the current grid and car position; None if blocked off"""
+        if self.search is None:
+            return self.plan(start, self.goal) if self.goal is not None else None
+        grid = self.grid
+        self.last_changed = self.search.set_blocked(grid.blocked)
+        s = grid.nearest_free(grid.to_cell(*start))
+        if s is None:
+            return None
+        self.search.move_start(s)
+        return self._path(start)
+
+    def _path(self, start: Tuple[float, float]) -> Optional[List[dict]]:
+        if not self.search.compute():
+            self.cells = []
+            return None
+        self.cells = self.search.path()
+        # End on the clicked goal unless it is inside an obstacle's margin
+        end = self.goal
+        if self.grid.blocked[self.grid.to_cell(*end)]:
+            end = self.grid.to_point(self.cells[-1])
+        points = [start] + [self.grid.to_point(c) for c in shortcut(self.cells, self.grid)[1:-1]] + [end]
+        if math.dist(start, end) < self.spacing:
+            points = [start, end]
+        return arc_length_path(np.array(points, dtype=float), "linear", self.spacing).path_with_headings()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Plan an obstacle-free path across an overhead frame')
+    parser.add_argument('frame', help='Overhead camera image')
+    parser.add_argument('--background', help='The same view without obstacles')
+    parser.add_argument('--hsv-low', type=int, nargs=3, help='Obstacle colour range, OpenCV HSV (H 0-179)')
+    parser.add_argument('--hsv-high', type=int, nargs=3)
+    parser.add_argument('--start', type=float, nargs=2, required=True)
+    parser.add_argument('--goal', type=float, nargs=2, required=True)
+    parser.add_argument('--cell', type=float, default=8.0, help='Grid cell size in px (default: 8)')
+    parser.add_argument('--inflate', type=float, default=30.0, help='Obstacle inflation in px (default: 30)')
+    parser.add_argument('--output', default='grid_plan.jpg')
+    args = parser.parse_args()
+
+    frame = cv2.imread(args.frame)
+    planner = GridPlanner(args.cell, args.inflate, hsv_low=args.hsv_low, hsv_high=args.hsv_high)
+    if args.background:
+        planner.set_background(cv2.imread(args.background))
+    if not planner.ready:
+        parser.error('give --background and/or --hsv-low/--hsv-high')
+
+    grid = planner.update_grid(frame)
+    path = planner.plan(tuple(args.start), tuple(args.goal))
+    print(f"🧱 Grid {grid.shape[1]}x{grid.shape[0]} cells of {args.cell:g}px, "
+          f"{int(grid.blocked.sum())} blocked")
+    cv2.polylines(frame, [np.int32(c) for c in grid.outline()], True, (0, 0, 255), 1)
+    if path is None:
+        print("❌ No obstacle-free path")
+    else:
+        print(f"🛣️ {len(path)} points, {len(planner.cells)} cells, "
+              f"{planner.search.cost * args.cell:.0f}px, {planner.search.expanded} states expanded")
+        cv2.polylines(frame, [np.int32([p["point"] for p in path])], False, (255, 0, 255), 2)
+    cv2.imwrite(args.output, frame)
+    print(f"🖼️ Saved {args.output}")
+
+
+if __name__ == '__main__':
+    main()
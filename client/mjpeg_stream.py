@@ -0,0 +1,364 @@
+#!/usr/bin/env python3
+"""
+MJPEG stream reading shared by the VizCar clients
+
+MjpegStream reads a multipart/x-mixed-replace stream (video_server.py or
+nn_server.py /video_feed) and yields decoded frames with their provenance
+headers. Parsing and decoding use the native module in native/ when it has
+been built (`make -C native`), and fall back to an equivalent pure-Python
+parser plus cv2.imdecode otherwise.
+
+Either way parts are delimited by Content-Length when the server sends it,
+or by the multipart boundary - never by scanning for JPEG start/end
+markers, which breaks on JPEGs with embedded thumbnails - and each byte is
+searched at most once.
+
+Consumers that show or analyse frames smaller than the camera's resolution
+ask for a target size instead of resizing: the JPEG is then decoded at the
+largest 1/2, 1/4 or 1/8 scale that still covers it (and optionally to
+grayscale), which skips most of the IDCT and colour conversion work.
+"""
+
+import ctypes
+import os
+import struct
+import sys
+import time
+
+import cv2
+import numpy as np
+import requests
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def _load_native():
+    """Load native/libvizcar_mjpeg.so, or None if not built or disabled (VIZCAR_NATIVE=0)"""
+    if os.environ.get('VIZCAR_NATIVE', '1') == '0':
+        return None
+    name = 'libvizcar_mjpeg.dylib' if sys.platform == 'darwin' else 'libvizcar_mjpeg.so'
+    try:
+        lib = ctypes.CDLL(os.path.join(HERE, 'native', name))
+    except OSError:
+        return None
+
+    lib.mjpeg_parser_new.restype = ctypes.c_void_p
+    lib.mjpeg_parser_new.argtypes = [ctypes.c_char_p, ctypes.c_size_t]
+    lib.mjpeg_parser_free.argtypes = [ctypes.c_void_p]
+    lib.mjpeg_parser_feed.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+    lib.mjpeg_parser_next.restype = ctypes.c_int
+    lib.mjpeg_parser_next.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_void_p),
+                                      ctypes.POINTER(ctypes.c_size_t),
+                                      ctypes.POINTER(ctypes.c_double),
+                                      ctypes.POINTER(ctypes.c_longlong)]
+    lib.mjpeg_decoder_new.restype = ctypes.c_void_p
+    lib.mjpeg_decoder_free.argtypes = [ctypes.c_void_p]
+    lib.mjpeg_decoder_error.restype = ctypes.c_char_p
+    lib.mjpeg_decoder_error.argtypes = [ctypes.c_void_p]
+    lib.mjpeg_decoder_size.restype = ctypes.c_int
+    lib.mjpeg_decoder_size.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int,
+                                       ctypes.c_int, ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int)]
+    lib.mjpeg_decoder_decode.restype = ctypes.c_int
+    lib.mjpeg_decoder_decode.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int,
+                                         ctypes.c_int, ctypes.c_void_p, ctypes.c_int, ctypes.c_int,
+                                         ctypes.c_int]
+    return lib
+
+
+_native = _load_native()
+NATIVE = _native is not None
+
+
+def _address(data):
+    """(address, length) of a bytes-like object without copying it"""
+    array = np.frombuffer(data, dtype=np.uint8)
+    return array.ctypes.data, array.size
+
+
+SCALES = (1, 2, 4, 8)
+
+
+# Same code as NN-server/mjpeg_reader.py's helpers, which the server ships
+# with on its own machine; change both together.
+
+def jpeg_size(jpeg):
+    """(width, height) from a JPEG's SOF marker without decoding it, or None"""
+    data = memoryview(jpeg)
+    i = 2
+    while i + 9 <= len(data):
+        if data[i] != 0xFF:
+            return None
+        marker = data[i + 1]
+        if marker == 0xFF:  # fill byte
+            i += 1
+            continue
+        if 0xC0 <= marker <= 0xCF and marker not in (0xC4, 0xC8, 0xCC):
+            height, width = struct.unpack('>HH', data[i + 5:i + 9])
+            return width, height
+        i += 2 + struct.unpack('>H', data[i + 2:i + 4])[0]
+    return None
+
+
+def scale_for(width, height, target_width=0, target_height=0):
+    """Largest JPEG decode scale denominator (8, 4, 2, 1) whose output still covers the target size"""
+    for denom in (8, 4, 2):
+        if width / denom >= target_width and height / denom >= target_height:
+            return denom
+    return 1
+
+
+def estimate_clock_offset(url, samples=5, timeout=2.0):
+    """
+    Offset to add to the remote clock to get local time, from a JSON
+    endpoint that reports its clock as 'time'
+
+    Uses the sample with the smallest round trip (NTP style). Returns
+    (offset, rtt) in seconds, or (0.0, None) if the server does not report
+    its clock.
+    """
+    best = None
+    for _ in range(samples):
+        try:
+            t0 = time.time()
+            remote = requests.get(url, timeout=timeout).json().get('time')
+            t1 = time.time()
+        except Exception:
+            continue
+        if remote is None:
+            return 0.0, None
+        if best is None or t1 - t0 < best[1]:
+            best = ((t0 + t1) / 2 - remote, t1 - t0)
+    return best if best is not None else (0.0, None)
+
+
+class PyMjpegParser:
+    """Incremental multipart parser in pure Python (fallback for the native one)"""
+
+    def __init__(self, boundary=b'--frame'):
+        self.boundary = boundary if boundary.startswith(b'--') else b'--' + boundary
+        self.buffer = bytearray()
+        self.scan = 0
+        self.body_start = None
+        self.headers = {}
+
+    def feed(self, data):
+        self.buffer += data
+
+    def next_frame(self):
+        """Next complete part as (jpeg, seq, timestamp), or None; seq is -1 and timestamp 0 if not sent"""
+        buf = self.buffer
+        if self.body_start is None:
+            start = buf.find(self.boundary, self.scan)
+            if start == -1:
+                # Drop what can't hold a boundary, keeping a partial one
+                keep = max(0, len(buf) - len(self.boundary))
+                del buf[:keep]
+                self.scan = 0
+                return None
+            end = buf.find(b'\r\n\r\n', start)
+            if end == -1:
+                del buf[:start]
+                self.scan = 0
+                return None
+            self.headers = {}
+            for line in bytes(buf[start + len(self.boundary):end]).split(b'\r\n'):
+                name, sep, value = line.partition(b':')
+                if sep:
+                    self.headers[name.strip().lower()] = value.strip()
+            self.body_start = end + 4
+            self.scan = self.body_start
+
+        length = self.headers.get(b'content-length')
+        if length is not None:
+            body_end = self.body_start + int(length)
+            if len(buf) < body_end:
+                return None
+            resume = body_end
+        else:
+            body_end = buf.find(self.boundary, self.scan)
+            if body_end == -1:
+                self.scan = max(self.body_start, len(buf) - len(self.boundary))
+                return None
+            resume = body_end
+            while body_end > self.body_start and buf[body_end - 1] in b'\r\n':
+                body_end -= 1
+
+        jpeg = bytes(buf[self.body_start:body_end])
+        del buf[:resume]
+        self.body_start = None
+        self.scan = 0
+        seq = int(self.headers.get(b'x-frame-seq', -1))
+        timestamp = float(self.headers.get(b'x-timestamp', 0.0))
+        return jpeg, seq, timestamp
+
+
+class NativeMjpegParser:
+    """Incremental multipart parser backed by native/mjpeg_native.cpp"""
+
+    def __init__(self, boundary=b'--frame', capacity=1 << 20):
+        self.handle = _native.mjpeg_parser_new(boundary, capacity)
+        self._ptr = ctypes.c_void_p()
+        self._len = ctypes.c_size_t()
+        self._timestamp = ctypes.c_double()
+        self._seq = ctypes.c_longlong()
+
+    def __del__(self):
+        if getattr(self, 'handle', None):
+            _native.mjpeg_parser_free(self.handle)
+            self.handle = None
+
+    def feed(self, data):
+        _native.mjpeg_parser_feed(self.handle, data, len(data))
+
+    def next_frame(self):
+        """
+        Next complete part as (jpeg, seq, timestamp), or None
+
+        jpeg is a view into the parser's buffer, valid until the next
+        feed() or next_frame() call; copy it (bytes(jpeg)) to keep it.
+        """
+        if not _native.mjpeg_parser_next(self.handle, ctypes.byref(self._ptr), ctypes.byref(self._len),
+                                         ctypes.byref(self._timestamp), ctypes.byref(self._seq)):
+            return None
+        jpeg = (ctypes.c_ubyte * self._len.value).from_address(self._ptr.value)
+        return memoryview(jpeg).cast('B'), self._seq.value, self._timestamp.value
+
+
+def MjpegParser(boundary=b'--frame'):
+    """Native parser when available, otherwise the pure-Python one"""
+    return NativeMjpegParser(boundary) if NATIVE else PyMjpegParser(boundary)
+
+
+class JpegDecoder:
+    """
+    Decodes JPEGs to BGR, reusing a pool of preallocated output buffers
+
+    A returned frame stays valid until `pool_size` more frames have been
+    decoded, so size the pool above the number of frames a caller keeps
+    in flight (queued or displayed). Frames are decoded at 1/scale_denom
+    of full size (1, 2, 4 or 8), or at the smallest of those that covers
+    target_size = (width, height) when given; gray=True decodes to a
+    single 8-bit channel.
+    """
+
+    def __init__(self, pool_size=8, scale_denom=1, target_size=None, gray=False):
+        self.pool_size = pool_size
+        self.scale_denom = scale_denom
+        self.target_size = target_size
+        self.gray = gray
+        self.source_size = None  # full (width, height) of the last JPEG
+        self.pool = []
+        self.next_buffer = 0
+        self.handle = _native.mjpeg_decoder_new() if NATIVE else None
+
+    def __del__(self):
+        if getattr(self, 'handle', None):
+            _native.mjpeg_decoder_free(self.handle)
+            self.handle = None
+
+    def _buffer(self, height, width):
+        shape = (height, width) if self.gray else (height, width, 3)
+        if self.pool and self.pool[0].shape != shape:
+            self.pool = []  # stream resolution changed
+        if len(self.pool) < self.pool_size:
+            self.pool.append(np.empty(shape, dtype=np.uint8))
+            return self.pool[-1]
+        buffer = self.pool[self.next_buffer]
+        self.next_buffer = (self.next_buffer + 1) % self.pool_size
+        return buffer
+
+    def _pick_scale(self, jpeg):
+        """Re-pick scale_denom for target_size when the source resolution changes"""
+        size = jpeg_size(jpeg)
+        if size is not None and size != self.source_size:
+            self.source_size = size
+            if self.target_size is not None:
+                self.scale_denom = scale_for(*size, *self.target_size)
+
+    def decode(self, jpeg):
+        """Decode one JPEG; returns the BGR (or gray) frame or None if it is corrupt"""
+        self._pick_scale(jpeg)
+        if self.handle is None:
+            if self.gray:
+                flags = {1: cv2.IMREAD_GRAYSCALE, 2: cv2.IMREAD_REDUCED_GRAYSCALE_2,
+                         4: cv2.IMREAD_REDUCED_GRAYSCALE_4, 8: cv2.IMREAD_REDUCED_GRAYSCALE_8}
+            else:
+                flags = {1: cv2.IMREAD_COLOR, 2: cv2.IMREAD_REDUCED_COLOR_2,
+                         4: cv2.IMREAD_REDUCED_COLOR_4, 8: cv2.IMREAD_REDUCED_COLOR_8}
+            return cv2.imdecode(np.frombuffer(jpeg, dtype=np.uint8), flags[self.scale_denom])
+
+        address, length = _address(jpeg)
+        width, height = ctypes.c_int(), ctypes.c_int()
+        if _native.mjpeg_decoder_size(self.handle, address, length, self.scale_denom, self.gray,
+                                      ctypes.byref(width), ctypes.byref(height)) != 0:
+            return None
+        out = self._buffer(height.value, width.value)
+        if _native.mjpeg_decoder_decode(self.handle, address, length, self.scale_denom, self.gray,
+                                        out.ctypes.data, width.value, height.value, out.strides[0]) != 0:
+            return None
+        return out
+
+
+class MjpegStream:
+    """
+    Iterate over (frame, seq, timestamp) from an MJPEG URL
+
+    seq and timestamp come from the X-Frame-Seq / X-Timestamp part headers
+    (-1 and 0.0 when the server does not send them). Frames come from a
+    JpegDecoder pool, see there for how long they stay valid; set
+    decode=False to get the JPEG bytes instead of a frame. scale_denom,
+    target_size and gray select a reduced decode, as for JpegDecoder.
+    jpeg_sink, when set, is called with every part's JPEG (a view valid
+    only during the call) before it is decoded, e.g. to record it as is.
+    """
+
+    def __init__(self, url, timeout=10, chunk_size=65536, pool_size=8, scale_denom=1, decode=True,
+                 target_size=None, gray=False):
+        self.url = url
+        self.timeout = timeout
+        self.chunk_size = chunk_size
+        self.decode = decode
+        self.decoder = JpegDecoder(pool_size, scale_denom, target_size, gray) if decode else None
+        self.jpeg_sink = None
+        self.response = None
+        self.running = False
+
+    def open(self):
+        self.response = requests.get(self.url, stream=True, timeout=self.timeout)
+        if self.response.status_code != 200:
+            raise ConnectionError(f"HTTP {self.response.status_code}")
+        content_type = self.response.headers.get('Content-Type', '')
+        boundary = b'--frame'
+        if 'boundary=' in content_type:
+            boundary = content_type.split('boundary=', 1)[1].split(';')[0].strip().strip('"').encode()
+        self.parser = MjpegParser(boundary)
+        self.running = True
+        return self
+
+    def close(self):
+        self.running = False
+        if self.response is not None:
+            self.response.close()
+            self.response = None
+
+    def __iter__(self):
+        if self.response is None:
+            self.open()
+        for chunk in self.response.iter_content(chunk_size=self.chunk_size):
+            if not self.running:
+                break
+            self.parser.feed(chunk)
+            while True:
+                part = self.parser.next_frame()
+                if part is None:
+                    break
+                jpeg, seq, timestamp = part
+                sink = self.jpeg_sink
+                if sink is not None:
+                    sink(jpeg)
+                if not self.decode:
+                    yield bytes(jpeg), seq, timestamp
+                    continue
+                frame = self.decoder.decode(jpeg)
+                if frame is not None:
+                    yield frame, seq, timestamp
@@ -0,0 +1,289 @@
+// Native MJPEG demuxer and JPEG decoder for the VizCar Python clients
+//
+// Loaded with ctypes by client/mjpeg_stream.py; everything here is plain C
+// ABI so no Python headers are needed, and ctypes drops the GIL around
+// each call, so decoding runs in parallel with the rest of the client.
+//
+// Parser: multipart/x-mixed-replace bytes are appended to a buffer that is
+// compacted in place; each part's headers are parsed once and its body is
+// delimited by Content-Length when present (otherwise by the next boundary,
+// searched from where the last search stopped), so the work per byte is
+// constant and JPEGs with embedded thumbnails (nested FFD8/FFD9) are safe.
+//
+// Decoder: libjpeg-turbo's libjpeg API, decoding straight to BGR (or
+// grayscale) rows of a caller-provided buffer, optionally at 1/2, 1/4 or 1/8
+// scale. Scaling happens in the IDCT, so a reduced decode does a fraction of
+// the work instead of decoding full size and resizing; grayscale skips the
+// chroma planes and colour conversion altogether.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csetjmp>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+namespace {
+
+struct Parser {
+    std::vector<uint8_t> buf;
+    size_t start = 0;        // first unconsumed byte
+    size_t end = 0;          // one past the last valid byte
+    size_t next_start = 0;   // consumption deferred until the returned frame is released
+    std::string boundary;
+
+    // State of the part being read
+    bool in_body = false;
+    size_t scan = 0;          // where the next boundary search resumes
+    size_t body_start = 0;
+    long long content_length = -1;
+    double timestamp = 0.0;
+    long long seq = -1;
+
+    size_t frames = 0;
+    size_t bytes = 0;
+};
+
+const uint8_t *find(const uint8_t *hay, size_t hay_len, const char *needle, size_t needle_len) {
+    return static_cast<const uint8_t *>(memmem(hay, hay_len, needle, needle_len));
+}
+
+bool header_is(const char *line, size_t len, const char *name) {
+    size_t n = strlen(name);
+    return len > n && strncasecmp(line, name, n) == 0 && line[n] == ':';
+}
+
+void parse_headers(Parser *p, const uint8_t *from, const uint8_t *to) {
+    p->content_length = -1;
+    p->timestamp = 0.0;
+    p->seq = -1;
+    const char *line = reinterpret_cast<const char *>(from);
+    const char *stop = reinterpret_cast<const char *>(to);
+    while (line < stop) {
+        const char *eol = static_cast<const char *>(memchr(line, '\n', stop - line));
+        if (!eol) eol = stop;
+        size_t len = eol - line;
+        std::string value;
+        const char *colon = static_cast<const char *>(memchr(line, ':', len));
+        if (colon) value.assign(colon + 1, eol);
+        if (header_is(line, len, "content-length")) p->content_length = atoll(value.c_str());
+        else if (header_is(line, len, "x-timestamp")) p->timestamp = atof(value.c_str());
+        else if (header_is(line, len, "x-frame-seq")) p->seq = atoll(value.c_str());
+        line = eol + 1;
+    }
+}
+
+void release(Parser *p) {
+    if (p->next_start > p->start) {
+        p->start = p->next_start;
+        if (p->scan < p->start) p->scan = p->start;
+    }
+}
+
+struct ErrorManager {
+    jpeg_error_mgr pub;
+    jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+};
+
+void on_error(j_common_ptr cinfo) {
+    auto *err = reinterpret_cast<ErrorManager *>(cinfo->err);
+    (*cinfo->err->format_message)(cinfo, err->message);
+    longjmp(err->jump, 1);
+}
+
+void on_warning(j_common_ptr, int) {}  // corrupt-data warnings: decode what we can
+
+struct Decoder {
+    jpeg_decompress_struct cinfo;
+    ErrorManager err;
+};
+
+// Reads the header and sets up scaling; returns false on a bad JPEG
+bool read_header(Decoder *d, const uint8_t *data, size_t len, int scale_denom, int gray) {
+    jpeg_mem_src(&d->cinfo, const_cast<unsigned char *>(data), static_cast<unsigned long>(len));
+    if (jpeg_read_header(&d->cinfo, TRUE) != JPEG_HEADER_OK) return false;
+    d->cinfo.scale_num = 1;
+    d->cinfo.scale_denom = scale_denom > 0 ? scale_denom : 1;
+    d->cinfo.out_color_space = gray ? JCS_GRAYSCALE : JCS_EXT_BGR;
+    jpeg_calc_output_dimensions(&d->cinfo);
+    return true;
+}
+
+}  // namespace
+
+extern "C" {
+
+// ---- Parser ---------------------------------------------------------------
+
+void *mjpeg_parser_new(const char *boundary, size_t capacity) {
+    auto *p = new Parser();
+    p->boundary = boundary && *boundary ? boundary : "--frame";
+    if (p->boundary.compare(0, 2, "--") != 0) p->boundary = "--" + p->boundary;
+    p->buf.resize(capacity ? capacity : (1 << 20));
+    return p;
+}
+
+void mjpeg_parser_free(void *handle) {
+    delete static_cast<Parser *>(handle);
+}
+
+// Append stream bytes; invalidates the frame returned by the last mjpeg_parser_next
+void mjpeg_parser_feed(void *handle, const uint8_t *data, size_t len) {
+    auto *p = static_cast<Parser *>(handle);
+    release(p);
+    p->bytes += len;
+
+    if (p->end + len > p->buf.size()) {
+        // Slide the unconsumed bytes to the front, growing only if still short
+        size_t live = p->end - p->start;
+        if (p->start > 0) {
+            memmove(p->buf.data(), p->buf.data() + p->start, live);
+            p->scan -= p->start;
+            p->body_start = p->body_start >= p->start ? p->body_start - p->start : 0;
+            p->next_start = p->next_start > p->start ? p->next_start - p->start : 0;
+            p->start = 0;
+            p->end = live;
+        }
+        if (p->end + len > p->buf.size()) {
+            size_t capacity = p->buf.size();
+            while (capacity < p->end + len) capacity *= 2;
+            p->buf.resize(capacity);
+        }
+    }
+    memcpy(p->buf.data() + p->end, data, len);
+    p->end += len;
+}
+
+// Returns 1 and the next complete JPEG (valid until the next feed/next call), or 0
+int mjpeg_parser_next(void *handle, const uint8_t **jpeg, size_t *jpeg_len,
+                      double *timestamp, long long *seq) {
+    auto *p = static_cast<Parser *>(handle);
+    release(p);
+    const uint8_t *base = p->buf.data();
+    const size_t blen = p->boundary.size();
+
+    if (!p->in_body) {
+        size_t from = p->scan > p->start ? p->scan : p->start;
+        const uint8_t *b = find(base + from, p->end - from, p->boundary.data(), blen);
+        if (!b) {
+            // Keep a boundary's worth of bytes in case it straddles the next chunk
+            p->scan = p->end > from + blen ? p->end - blen : from;
+            p->start = p->scan;  // nothing before a boundary is worth keeping
+            return 0;
+        }
+        size_t bpos = b - base;
+        p->scan = bpos;
+        const uint8_t *h = find(base + bpos, p->end - bpos, "\r\n\r\n", 4);
+        if (!h) return 0;
+        parse_headers(p, base + bpos + blen, h);
+        p->body_start = (h - base) + 4;
+        p->scan = p->body_start;
+        p->in_body = true;
+    }
+
+    size_t body_end;
+    size_t resume;
+    if (p->content_length >= 0) {
+        body_end = p->body_start + static_cast<size_t>(p->content_length);
+        if (body_end > p->end) return 0;
+        resume = body_end;
+    } else {
+        const uint8_t *b = find(base + p->scan, p->end - p->scan, p->boundary.data(), blen);
+        if (!b) {
+            p->scan = p->end > p->body_start + blen ? p->end - blen : p->body_start;
+            return 0;
+        }
+        body_end = b - base;
+        resume = body_end;
+        while (body_end > p->body_start && (base[body_end - 1] == '\n' || base[body_end - 1] == '\r'))
+            body_end--;
+    }
+
+    *jpeg = base + p->body_start;
+    *jpeg_len = body_end - p->body_start;
+    *timestamp = p->timestamp;
+    *seq = p->seq;
+    p->in_body = false;
+    p->next_start = resume;
+    p->scan = resume;
+    p->frames++;
+    return 1;
+}
+
+// ---- Decoder --------------------------------------------------------------
+
+void *mjpeg_decoder_new() {
+    auto *d = new Decoder();
+    d->cinfo.err = jpeg_std_error(&d->err.pub);
+    d->err.pub.error_exit = on_error;
+    d->err.pub.emit_message = on_warning;
+    d->err.message[0] = '\0';
+    jpeg_create_decompress(&d->cinfo);
+    return d;
+}
+
+void mjpeg_decoder_free(void *handle) {
+    auto *d = static_cast<Decoder *>(handle);
+    jpeg_destroy_decompress(&d->cinfo);
+    delete d;
+}
+
+const char *mjpeg_decoder_error(void *handle) {
+    return static_cast<Decoder *>(handle)->err.message;
+}
+
+// Output size of a JPEG decoded at 1/scale_denom; returns 0 on success
+int mjpeg_decoder_size(void *handle, const uint8_t *data, size_t len, int scale_denom,
+                       int gray, int *width, int *height) {
+    auto *d = static_cast<Decoder *>(handle);
+    if (setjmp(d->err.jump)) {
+        jpeg_abort_decompress(&d->cinfo);
+        return -1;
+    }
+    if (!read_header(d, data, len, scale_denom, gray)) {
+        jpeg_abort_decompress(&d->cinfo);
+        return -1;
+    }
+    *width = static_cast<int>(d->cinfo.output_width);
+    *height = static_cast<int>(d->cinfo.output_height);
+    jpeg_abort_decompress(&d->cinfo);
+    return 0;
+}
+
+// Decode to BGR (or 8-bit gray) into out (height rows of `stride` bytes);
+// returns 0 on success, -1 on a corrupt JPEG, -2 if the output size does not match
+int mjpeg_decoder_decode(void *handle, const uint8_t *data, size_t len, int scale_denom,
+                         int gray, uint8_t *out, int width, int height, int stride) {
+    auto *d = static_cast<Decoder *>(handle);
+    if (setjmp(d->err.jump)) {
+        jpeg_abort_decompress(&d->cinfo);
+        return -1;
+    }
+    if (!read_header(d, data, len, scale_denom, gray)) {
+        jpeg_abort_decompress(&d->cinfo);
+        return -1;
+    }
+    if (static_cast<int>(d->cinfo.output_width) != width ||
+        static_cast<int>(d->cinfo.output_height) != height) {
+        jpeg_abort_decompress(&d->cinfo);
+        return -2;
+    }
+    jpeg_start_decompress(&d->cinfo);
+    while (d->cinfo.output_scanline < d->cinfo.output_height) {
+        JSAMPROW rows[4];
+        int n = 0;
+        for (; n < 4 && d->cinfo.output_scanline + n < d->cinfo.output_height; n++)
+            rows[n] = out + static_cast<size_t>(d->cinfo.output_scanline + n) * stride;
+        jpeg_read_scanlines(&d->cinfo, rows, n);
+    }
+    jpeg_finish_decompress(&d->cinfo);
+    return 0;
+}
+
+}  // extern "C"
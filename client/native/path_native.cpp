@@ -0,0 +1,57 @@
+// Host build of the firmware's path codec for the VizCar Python clients
+//
+// ESP32_Camera_4WD_Robot_Car_Code/path_codec.cpp is compiled in unchanged
+// (see the Makefile) and wrapped in a plain C ABI for ctypes, so
+// bench_path_codec.py can check it against client/path_codec.py and time
+// the same decode the car runs.
+//
+// Points cross the boundary as 5 floats each: x, y, heading, curvature,
+// speed, with NAN for fields the message does not carry.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "path_codec.h"
+
+extern "C" {
+
+// Decode into out (max_points * 5 floats); returns the point count, or
+// minus the PathStatus on a bad message or when out is too small
+long path_decode(const uint8_t* data, size_t len, float* out, size_t max_points) {
+    PathDecoder decoder;
+    PathStatus status = decoder.begin(data, len);
+    if (status != PATH_OK) return -status;
+    if (decoder.header().count > max_points) return -PATH_OVERFLOW;
+
+    PathPoint point;
+    long count = 0;
+    while (decoder.next(point)) {
+        float* row = out + count * 5;
+        row[0] = point.x;
+        row[1] = point.y;
+        row[2] = point.heading;
+        row[3] = point.curvature;
+        row[4] = point.speed;
+        count++;
+    }
+    return decoder.status() == PATH_OK ? count : -decoder.status();
+}
+
+// Encode count points (5 floats each, as above) into out; returns the
+// message size, or 0 when out is too small
+size_t path_encode(const float* points, size_t count, uint8_t method, uint8_t flags, uint8_t coord_bits,
+                   uint8_t* out, size_t capacity) {
+    PathEncoder encoder(out, capacity, method, flags, coord_bits);
+    for (size_t i = 0; i < count; i++) {
+        const float* row = points + i * 5;
+        PathPoint point = {row[0], row[1], row[2], row[3], row[4]};
+        if (!encoder.add(point)) return 0;
+    }
+    return encoder.finish();
+}
+
+const char* path_error(long status) {
+    return path_status_name((PathStatus)(status < 0 ? -status : status));
+}
+
+}
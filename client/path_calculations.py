@@ -1,3 +1,6 @@
+import math
+from dataclasses import dataclass
+
 import numpy as np
 
 # ============================================================
@@ -18,24 +21,17 @@ def path_with_headings(path):
     Given a list/array of (x,y) points, compute heading for each segment.
     Returns a list of dicts: {"x": x, "y": y, "heading": theta}
     """
-    pts = np.array(path)
-    result = []
-
-    for i in range(len(pts) - 1):
-        x1, y1 = pts[i]
-        x2, y2 = pts[i+1]
+    pts = np.asarray(path, dtype=float)
+    steps = np.diff(pts, axis=0)
+    headings = np.arctan2(steps[:, 1], steps[:, 0]).tolist()
+    coords = pts.tolist()
 
-        heading = heading_from_points((x1, y1), (x2, y2))
-
-        result.append({
-            "point": (float(x1), float(y1)),
-            "heading": float(heading)
-        })
+    result = [{"point": (x, y), "heading": heading}
+              for (x, y), heading in zip(coords, headings)]
 
     # Last point has NO heading
-    x_last, y_last = pts[-1]
     result.append({
-        "point": (float(x_last), float(y_last)),
+        "point": tuple(coords[-1]),
         "heading": None      # or remove this field entirely
     })
 
@@ -47,6 +43,81 @@ def uniform_t(n):
     return np.linspace(0, 1, n)
 
 
+# ============================================================
+#   PIECEWISE CUBICS
+# ============================================================
+
+# Every method below is a chain of cubic segments
+#     P(t) = c0 + c1 t + c2 t^2 + c3 t^3,   t in [0, 1]
+# whose coefficients are BASIS @ the segment's control points, so all
+# segments are built and evaluated together instead of one per loop turn.
+
+LINEAR_BASIS = np.array([[1, 0], [-1, 1], [0, 0], [0, 0]], dtype=float)                   # P0, P1
+CATMULL_BASIS = 0.5 * np.array([[0, 2, 0, 0], [-1, 0, 1, 0],
+                                [2, -5, 4, -1], [-1, 3, -3, 1]], dtype=float)             # P0..P3
+HERMITE_BASIS = np.array([[1, 0, 0, 0], [0, 0, 1, 0],
+                          [-3, 3, -2, -1], [2, -2, 1, 1]], dtype=float)                   # P0, P1, T0, T1
+BEZIER_BASIS = np.array([[1, 0, 0, 0], [-3, 3, 0, 0],
+                         [3, -6, 3, 0], [-1, 3, -3, 1]], dtype=float)                     # P0..P3
+
+
+def segment_coefficients(points, method="catmull"):
+    """
+    Cubic coefficients of every segment of a path through the waypoints,
+    shape (segments, 4, 2). Catmull–Rom and Bézier need 4 points and fall
+    back to straight lines below that.
+    """
+    pts = np.asarray(points, dtype=float).reshape(-1, 2)
+    if len(pts) < 2:
+        return np.zeros((0, 4, 2))
+
+    if method == "catmull" and len(pts) >= 4:
+        controls = pts[np.arange(len(pts) - 3)[:, None] + np.arange(4)]
+        basis = CATMULL_BASIS
+    elif method == "cubic":
+        # Estimate tangents (finite difference)
+        tangents = np.zeros_like(pts)
+        tangents[1:-1] = (pts[2:] - pts[:-2]) / 2
+        tangents[0] = pts[1] - pts[0]
+        tangents[-1] = pts[-1] - pts[-2]
+        controls = np.stack([pts[:-1], pts[1:], tangents[:-1], tangents[1:]], axis=1)
+        basis = HERMITE_BASIS
+    elif method == "bezier" and len(pts) >= 4:
+        # Groups of 4 with overlap of 1 point; leftover points are ignored
+        controls = pts[np.arange(0, len(pts) - 3, 3)[:, None] + np.arange(4)]
+        basis = BEZIER_BASIS
+    else:
+        controls = np.stack([pts[:-1], pts[1:]], axis=1)
+        basis = LINEAR_BASIS
+
+    return np.einsum('kj,sjd->skd', basis, controls)
+
+
+def sample_segments(coeffs, n=50):
+    """
+    n evenly spaced parameters per segment, with the duplicate start of
+    every segment after the first removed. Returns an Nx2 array.
+    """
+    powers = uniform_t(n)[:, None] ** np.arange(4)
+    samples = np.einsum('nk,skd->snd', powers, coeffs)
+    return np.concatenate([samples[0], samples[1:, 1:].reshape(-1, 2)])
+
+
+def evaluate_segments(coeffs, u):
+    """
+    Position, first and second derivative at path parameters u, where the
+    integer part picks the segment and the fraction is t (u = segments is
+    the end of the last one). Each is an Nx2 array.
+    """
+    seg = np.minimum(u.astype(int), len(coeffs) - 1)
+    t = (u - seg)[:, None]
+    c0, c1, c2, c3 = np.moveaxis(coeffs[seg], 1, 0)
+    position = c0 + t * (c1 + t * (c2 + t * c3))
+    velocity = c1 + t * (2 * c2 + 3 * t * c3)
+    acceleration = 2 * c2 + 6 * t * c3
+    return position, velocity, acceleration
+
+
 # ============================================================
 #   1. POINT-TO-POINT PATH (straight line)
 # ============================================================
@@ -75,25 +146,11 @@ def linear_path(points, n=50):
     Returns an Nx2 array of concatenated segments.
     """
     pts = np.array(points, dtype=float)
-    segments = []
-
-    for i in range(len(pts)-1):
-        p1 = pts[i]
-        p2 = pts[i+1]
-
-        seg = point_path(p1, p2, n)
-
-        # remove duplicate start on segments > 0
-        if i > 0:
-            seg = seg[1:]
-
-        segments.append(seg)
-
-    if len(segments):
-        return np.vstack(segments)
-    else:
+    if len(pts) < 2:
         return pts
 
+    return sample_segments(segment_coefficients(pts, "linear"), n)
+
 
 # ============================================================
 #   3. CATMULL–ROM SPLINE
@@ -109,28 +166,7 @@ def catmull_path(points, n=50):
     if len(pts) < 4:
         return linear_path(points, n)
 
-    out = []
-    for i in range(len(pts)-3):
-        P0, P1, P2, P3 = pts[i:i+4]
-
-        t = uniform_t(n)
-        t2 = t*t
-        t3 = t*t*t
-
-        # Catmull-Rom equation (x and y handled together)
-        M = 0.5 * (
-            (2*P1)[None,:]
-            + (-P0 + P2)[None,:] * t[:,None]
-            + (2*P0 - 5*P1 + 4*P2 - P3)[None,:] * t2[:,None]
-            + (-P0 + 3*P1 - 3*P2 + P3)[None,:] * t3[:,None]
-        )
-
-        if i > 0:
-            M = M[1:]
-
-        out.append(M)
-
-    return np.vstack(out)
+    return sample_segments(segment_coefficients(pts, "catmull"), n)
 
 
 # ============================================================
@@ -146,41 +182,7 @@ def cubic_path(points, n=50):
     if len(pts) < 2:
         return pts
 
-    # Estimate tangents (finite difference)
-    tangents = np.zeros_like(pts)
-    tangents[1:-1] = (pts[2:] - pts[:-2]) / 2
-    tangents[0] = pts[1] - pts[0]
-    tangents[-1] = pts[-1] - pts[-2]
-
-    out = []
-    for i in range(len(pts)-1):
-        P0 = pts[i]
-        P1 = pts[i+1]
-        T0 = tangents[i]
-        T1 = tangents[i+1]
-
-        t = uniform_t(n)
-        t2 = t*t
-        t3 = t*t*t
-
-        h00 = 2*t3 - 3*t2 + 1
-        h10 = t3 - 2*t2 + t
-        h01 = -2*t3 + 3*t2
-        h11 = t3 - t2
-
-        M = (
-            h00[:,None]*P0
-            + h10[:,None]*T0
-            + h01[:,None]*P1
-            + h11[:,None]*T1
-        )
-
-        if i > 0:
-            M = M[1:]
-
-        out.append(M)
-
-    return np.vstack(out)
+    return sample_segments(segment_coefficients(pts, "cubic"), n)
 
 
 # ============================================================
@@ -219,15 +221,111 @@ def bezier_chained(points, n=50):
     if len(pts) < 4:
         return pts  # need at least 4 points
 
-    path = []
     # process groups of 4 with overlap of 1 point
-    for i in range(0, len(pts)-3, 3):
-        P0, P1, P2, P3 = pts[i:i+4]
-        seg = bezier_segment(P0, P1, P2, P3, n=n)
+    return sample_segments(segment_coefficients(pts, "bezier"), n)
 
-        if i > 0:
-            seg = seg[1:]
 
-        path.append(seg)
+# ============================================================
+#   6. ARC-LENGTH PATH WITH CURVATURE AND SPEED
+# ============================================================
 
-    return np.vstack(path)
\ No newline at end of file
+@dataclass
+class PathProfile:
+    """Path sampled at uniform arc length, with what the car can do along it"""
+    s: np.ndarray           # arc length of each sample (px)
+    points: np.ndarray      # Nx2 samples on the curve
+    heading: np.ndarray     # tangent direction (radians)
+    curvature: np.ndarray   # 1/px, positive turning clockwise on screen ("right")
+    speed: np.ndarray       # px/s allowed at each sample
+    time: np.ndarray        # seconds from the start at that speed
+
+    def path_with_headings(self):
+        """path_with_headings() style list, with curvature and speed per point"""
+        return [{"point": (x, y), "heading": heading, "curvature": curvature, "speed": speed}
+                for (x, y), heading, curvature, speed in zip(
+                    self.points.tolist(), self.heading.tolist(),
+                    self.curvature.tolist(), self.speed.tolist())]
+
+
+def speed_profile(curvature, spacing, max_speed=150.0, max_accel=300.0,
+                  max_lateral_accel=300.0, max_yaw_rate=math.pi / 2,
+                  start_speed=0.0, end_speed=0.0):
+    """
+    Fastest speed at each of a path's evenly spaced samples that keeps
+    lateral acceleration (v^2 |k|) and yaw rate (v |k|) within limits and
+    changes by at most max_accel between samples, starting and ending at
+    the given speeds.
+
+    The acceleration passes are closed forms rather than loops: going
+    forward, v_i^2 = min over j <= i of (cap_j^2 + 2 a spacing (i - j)),
+    which is a running minimum of cap_j^2 - 2 a spacing j; backward is the
+    same from the end.
+    """
+    k = np.abs(np.asarray(curvature, dtype=float))
+    cap = np.full(len(k), float(max_speed))
+    curved = k > 1e-12
+    if max_lateral_accel:
+        cap[curved] = np.minimum(cap[curved], np.sqrt(max_lateral_accel / k[curved]))
+    if max_yaw_rate:
+        cap[curved] = np.minimum(cap[curved], max_yaw_rate / k[curved])
+    cap[0] = min(cap[0], start_speed)
+    cap[-1] = min(cap[-1], end_speed)
+
+    ramp = 2 * max_accel * spacing * np.arange(len(k))
+    cap2 = cap * cap
+    forward = ramp + np.minimum.accumulate(cap2 - ramp)
+    backward = np.minimum.accumulate((cap2 + ramp)[::-1])[::-1] - ramp
+    return np.sqrt(np.maximum(np.minimum(forward, backward), 0.0))
+
+
+def arc_length_path(points, method="catmull", spacing=5.0, oversample=4, **limits):
+    """
+    Path through the waypoints resampled every `spacing` pixels of arc
+    length (the last step absorbs the remainder), so point density no
+    longer depends on how far apart the waypoints were clicked.
+
+    All segments are evaluated in one pass: a dense pass, with samples per
+    segment in proportion to its length, gives the arc length as a function
+    of the path parameter; that is inverted by interpolation and the curve
+    evaluated exactly at the uniform arc lengths. Headings come from the
+    analytic tangent and curvature from how fast they turn per pixel, so
+    the kinks at straight-line and chained Bézier joints count as sharp
+    turns. `limits` go to speed_profile().
+    """
+    coeffs = segment_coefficients(points, method)
+    pts = np.asarray(points, dtype=float).reshape(-1, 2)
+    if len(coeffs) == 0 or np.ptp(pts, axis=0).max() < 1e-9:
+        zero = np.zeros(min(1, len(pts)))
+        return PathProfile(zero, pts[:1], zero, zero, zero, zero)
+
+    # Rough segment lengths from 8 samples each
+    rough = np.diff(np.einsum('nk,skd->snd', uniform_t(8)[:, None] ** np.arange(4), coeffs), axis=1)
+    rough = np.hypot(rough[..., 0], rough[..., 1]).sum(axis=1)
+
+    # Dense parameters, a variable number per segment, without a Python loop
+    counts = np.maximum(2, np.ceil(rough * oversample / spacing).astype(int))
+    seg = np.repeat(np.arange(len(coeffs)), counts)
+    first = np.repeat(np.cumsum(counts) - counts, counts)
+    u = np.append(seg + (np.arange(len(seg)) - first) / np.repeat(counts, counts), len(coeffs))
+
+    dense = evaluate_segments(coeffs, u)[0]
+    cumulative = np.concatenate(([0.0], np.cumsum(np.hypot(*np.diff(dense, axis=0).T))))
+    total = cumulative[-1]
+
+    s = np.linspace(0.0, total, max(1, int(round(total / spacing))) + 1)
+    position, tangent, _ = evaluate_segments(coeffs, np.interp(s, cumulative, u))
+
+    # Cusps and repeated waypoints have no tangent; use the neighbouring chord
+    stalled = np.hypot(tangent[:, 0], tangent[:, 1]) < 1e-9
+    if stalled.any() and len(position) > 1:
+        tangent[stalled] = np.gradient(position, axis=0)[stalled]
+    heading = np.arctan2(tangent[:, 1], tangent[:, 0])
+
+    step = s[1] - s[0] if len(s) > 1 else spacing
+    curvature = np.gradient(np.unwrap(heading), step) if len(s) > 1 else np.zeros(1)
+    speed = speed_profile(curvature, step, **limits)
+
+    mean_speed = (speed[1:] + speed[:-1]) / 2
+    dt = np.divide(step, mean_speed, out=np.zeros_like(mean_speed), where=mean_speed > 0)
+    time = np.concatenate(([0.0], np.cumsum(dt)))
+    return PathProfile(s, position, heading, curvature, speed, time)
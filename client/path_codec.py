@@ -0,0 +1,339 @@
+#!/usr/bin/env python3
+"""
+Binary wire format for paths published on robot/path
+
+Replaces the JSON list of {"point": (x, y), "heading": h} dicts with a
+versioned little-endian message that a microcontroller can validate and
+walk point by point without a JSON parser:
+
+  offset  size  field
+       0     2  magic "VP"
+       2     1  version (1)
+       3     1  flags: 1 heading, 2 curvature, 4 speed, 8 open end
+       4     1  method (METHODS index, 255 unknown)
+       5     1  coord_bits: fractional bits of the fixed-point x, y
+       6     2  revision (0 outside a live session, see path_link.py)
+       8     4  point count
+      12     4  payload length in bytes
+      16     n  payload
+    16+n     4  CRC-32 (zlib/IEEE) of everything before it
+
+The payload holds, for each point in order, zigzag varints of the change
+from the previous point (the first from zero) of each field:
+
+  x, y       fixed point, 1/2^coord_bits px
+  heading    int16 turns (2pi/65536 rad), wrapping, so crossing +-pi is small
+  curvature  1/2^20 per px
+  speed      1/16 px/s
+
+Deltas are taken between quantized values, so rounding never accumulates.
+"Open end" marks a path_with_headings() list whose last heading is None.
+
+A patch (robot/path/patch) replaces points start .. start+removed-1 of the
+path at revision base with a complete path message of new points, giving
+revision `revision`:
+
+  offset  size  field
+       0     2  magic "VD"
+       2     1  version (1)
+       3     1  flags (0)
+       4     2  base revision
+       6     2  revision
+       8     4  start
+      12     4  points removed
+      16     m  replacement points, a path message as above
+    16+m     4  CRC-32 of everything before it
+
+The C++ encoder/decoder for the firmware is
+ESP32_Camera_4WD_Robot_Car_Code/path_codec.{h,cpp}.
+
+Usage:
+  python3 path_codec.py path.json path.vzpath     # JSON payload -> binary
+  python3 path_codec.py path.vzpath               # print a summary
+"""
+
+import argparse
+import json
+import math
+import struct
+import zlib
+from typing import List, Optional, Tuple
+
+import numpy as np
+
+MAGIC = b'VP'
+VERSION = 1
+HEADER = struct.Struct('<2sBBBBHII')
+CRC = struct.Struct('<I')
+PATCH_MAGIC = b'VD'
+PATCH_HEADER = struct.Struct('<2sBBHHII')
+
+FLAG_HEADING = 1
+FLAG_CURVATURE = 2
+FLAG_SPEED = 4
+FLAG_OPEN_END = 8
+
+METHODS = ["point", "linear", "catmull", "cubic", "bezier"]
+UNKNOWN_METHOD = 255
+
+HEADING_UNITS = 65536 / (2 * math.pi)
+CURVATURE_UNITS = float(1 << 20)
+SPEED_UNITS = 16.0
+
+
+class PathFormatError(ValueError):
+    """Malformed or corrupted binary path"""
+
+
+# ============================================================
+#   VARINTS
+# ============================================================
+
+def zigzag(values: np.ndarray) -> np.ndarray:
+    values = values.astype(np.int64)
+    return ((values << 1) ^ (values >> 63)).astype(np.uint64)
+
+
+def unzigzag(values: np.ndarray) -> np.ndarray:
+    values = values.astype(np.uint64)
+    return (values >> np.uint64(1)).astype(np.int64) ^ -(values & np.uint64(1)).astype(np.int64)
+
+
+def encode_varints(values: np.ndarray) -> bytes:
+    """LEB128 bytes of unsigned values, all at once: each value's byte count,
+    then every output byte picked from its value by position"""
+    values = values.astype(np.uint64)
+    lengths = np.ones(len(values), dtype=np.int64)
+    for k in range(1, 10):
+        lengths += values >= np.uint64(1) << np.uint64(7 * k)
+    owner = np.repeat(np.arange(len(values)), lengths)
+    position = np.arange(len(owner)) - np.repeat(np.cumsum(lengths) - lengths, lengths)
+    out = (values[owner] >> (np.uint64(7) * position.astype(np.uint64))) & np.uint64(0x7F)
+    out |= np.where(position < lengths[owner] - 1, np.uint64(0x80), np.uint64(0))
+    return out.astype(np.uint8).tobytes()
+
+
+def decode_varints(data: bytes) -> np.ndarray:
+    """Inverse of encode_varints(); one pass per byte position, not per value"""
+    raw = np.frombuffer(data, dtype=np.uint8)
+    if len(raw) == 0:
+        return np.zeros(0, dtype=np.uint64)
+    if raw[-1] & 0x80:
+        raise PathFormatError("payload ends inside a varint")
+    ends = np.flatnonzero(raw < 0x80)
+    starts = np.concatenate(([0], ends[:-1] + 1))
+    lengths = ends - starts + 1
+    if lengths.max() > 10:
+        raise PathFormatError("varint longer than 64 bits")
+    values = np.zeros(len(ends), dtype=np.uint64)
+    for k in range(int(lengths.max())):
+        has = lengths > k
+        values[has] |= (raw[starts[has] + k] & 0x7F).astype(np.uint64) << np.uint64(7 * k)
+    return values
+
+
+# ============================================================
+#   ENCODE / DECODE
+# ============================================================
+
+def encode_arrays(points, heading=None, curvature=None, speed=None, method: Optional[str] = None,
+                  coord_bits: int = 4, open_end: bool = False, revision: int = 0) -> bytes:
+    """Binary path from an Nx2 array and optional per-point arrays"""
+    points = np.asarray(points, dtype=float).reshape(-1, 2)
+    flags = FLAG_OPEN_END if open_end else 0
+    columns = [np.rint(points * (1 << coord_bits)).astype(np.int64)]
+    if heading is not None:
+        flags |= FLAG_HEADING
+        turns = np.rint(np.asarray(heading, dtype=float) * HEADING_UNITS).astype(np.int64) & 0xFFFF
+        columns.append(turns[:, None])
+    if curvature is not None:
+        flags |= FLAG_CURVATURE
+        columns.append(np.rint(np.asarray(curvature, dtype=float) * CURVATURE_UNITS).astype(np.int64)[:, None])
+    if speed is not None:
+        flags |= FLAG_SPEED
+        columns.append(np.rint(np.asarray(speed, dtype=float) * SPEED_UNITS).astype(np.int64)[:, None])
+
+    fields = np.hstack(columns)
+    deltas = np.diff(fields, axis=0, prepend=np.zeros((1, fields.shape[1]), dtype=np.int64))
+    if heading is not None:
+        # Shortest way round: wrap the heading step into int16
+        deltas[:, 2] = (deltas[:, 2] + 0x8000) % 0x10000 - 0x8000
+    payload = encode_varints(zigzag(deltas.ravel()))
+
+    method_id = METHODS.index(method) if method in METHODS else UNKNOWN_METHOD
+    header = HEADER.pack(MAGIC, VERSION, flags, method_id, coord_bits, revision & 0xFFFF,
+                         len(points), len(payload))
+    body = header + payload
+    return body + CRC.pack(zlib.crc32(body))
+
+
+def encode_path(path: List[dict], method: Optional[str] = None, coord_bits: int = 4,
+                revision: int = 0) -> bytes:
+    """
+    Binary path from path_with_headings() output (or PathProfile's, with
+    curvature and speed); fields only go on the wire if every point has them
+    """
+    points = np.array([p["point"] for p in path], dtype=float)
+    headings = [p.get("heading") for p in path]
+    open_end = len(path) > 1 and headings[-1] is None
+    if open_end:
+        headings[-1] = headings[-2]
+    has = lambda key: all(p.get(key) is not None for p in path)
+    return encode_arrays(
+        points,
+        heading=np.array(headings, dtype=float) if all(h is not None for h in headings) else None,
+        curvature=np.array([p["curvature"] for p in path]) if has("curvature") else None,
+        speed=np.array([p["speed"] for p in path]) if has("speed") else None,
+        method=method, coord_bits=coord_bits, open_end=open_end, revision=revision)
+
+
+def decode_arrays(data: bytes) -> Tuple[dict, dict]:
+    """
+    (header, arrays) of a binary path, the arrays being "points" (Nx2) and
+    whichever of "heading", "curvature" and "speed" were sent. Raises
+    PathFormatError on anything malformed.
+    """
+    if len(data) < HEADER.size + CRC.size:
+        raise PathFormatError(f"{len(data)} bytes is shorter than an empty path")
+    magic, version, flags, method_id, coord_bits, revision, count, payload_len = HEADER.unpack_from(data)
+    if magic != MAGIC:
+        raise PathFormatError(f"bad magic {magic!r}")
+    if version != VERSION:
+        raise PathFormatError(f"unsupported version {version}")
+    end = HEADER.size + payload_len
+    if len(data) < end + CRC.size:
+        raise PathFormatError(f"truncated: {len(data)} of {end + CRC.size} bytes")
+    if CRC.unpack_from(data, end)[0] != zlib.crc32(memoryview(data)[:end]):
+        raise PathFormatError("CRC mismatch")
+
+    width = 2 + sum(bool(flags & f) for f in (FLAG_HEADING, FLAG_CURVATURE, FLAG_SPEED))
+    values = unzigzag(decode_varints(bytes(memoryview(data)[HEADER.size:end])))
+    if len(values) != count * width:
+        raise PathFormatError(f"{len(values)} values for {count} points of {width} fields")
+    fields = np.cumsum(values.reshape(count, width), axis=0)
+
+    arrays = {"points": fields[:, :2] / float(1 << coord_bits)}
+    column = 2
+    if flags & FLAG_HEADING:
+        turns = (fields[:, column] + 0x8000) % 0x10000 - 0x8000
+        arrays["heading"] = turns / HEADING_UNITS
+        column += 1
+    if flags & FLAG_CURVATURE:
+        arrays["curvature"] = fields[:, column] / CURVATURE_UNITS
+        column += 1
+    if flags & FLAG_SPEED:
+        arrays["speed"] = fields[:, column] / SPEED_UNITS
+
+    header = {"version": version, "flags": flags, "count": count, "coord_bits": coord_bits, "revision": revision,
+              "method": METHODS[method_id] if method_id < len(METHODS) else None}
+    return header, arrays
+
+
+def decode_path(data: bytes) -> Tuple[Optional[str], List[dict]]:
+    """(method, path) with the path in path_with_headings() form"""
+    header, arrays = decode_arrays(data)
+    columns = {key: arrays[key].tolist() for key in ("heading", "curvature", "speed") if key in arrays}
+    path = []
+    for i, (x, y) in enumerate(arrays["points"].tolist()):
+        point = {"point": (x, y), "heading": columns["heading"][i] if "heading" in columns else None}
+        for key in ("curvature", "speed"):
+            if key in columns:
+                point[key] = columns[key][i]
+        path.append(point)
+    if header["flags"] & FLAG_OPEN_END and path:
+        path[-1]["heading"] = None
+    return header["method"], path
+
+
+def is_binary_path(data: bytes) -> bool:
+    return data[:2] == MAGIC
+
+
+# ============================================================
+#   PATCHES
+# ============================================================
+
+def _rows(path: List[dict]) -> np.ndarray:
+    """x, y, heading, curvature, speed per point, NaN where absent"""
+    get = lambda p, key: math.nan if p.get(key) is None else p[key]
+    return np.array([(p["point"][0], p["point"][1], get(p, "heading"), get(p, "curvature"), get(p, "speed"))
+                     for p in path], dtype=float).reshape(-1, 5)
+
+
+def diff_paths(old: List[dict], new: List[dict]) -> Tuple[int, int, List[dict]]:
+    """
+    Smallest single replacement turning old into new: (start, removed,
+    replacement), from the longest common prefix and then suffix. Editing
+    one waypoint only changes the samples of the spline segments it
+    controls, so this is the span of segments the edit touched.
+    """
+    a, b = _rows(old), _rows(new)
+    same = lambda x, y: np.all(np.isclose(x, y, rtol=0.0, atol=1e-9, equal_nan=True), axis=1)
+    n = min(len(a), len(b))
+    prefix = same(a[:n], b[:n])
+    start = n if prefix.all() else int(np.argmin(prefix))
+    m = n - start
+    suffix = same(a[len(a) - m:][::-1], b[len(b) - m:][::-1]) if m else np.zeros(0, dtype=bool)
+    tail = m if suffix.all() else int(np.argmin(suffix))
+    return start, len(old) - start - tail, new[start:len(new) - tail]
+
+
+def encode_patch(base: int, revision: int, start: int, removed: int, replacement: List[dict],
+                 method: Optional[str] = None, coord_bits: int = 4) -> bytes:
+    body = (PATCH_HEADER.pack(PATCH_MAGIC, VERSION, 0, base & 0xFFFF, revision & 0xFFFF, start, removed) +
+            encode_path(replacement, method, coord_bits, revision))
+    return body + CRC.pack(zlib.crc32(body))
+
+
+def decode_patch(data: bytes) -> Tuple[dict, List[dict]]:
+    """(header, replacement) of a patch; header has base, revision, start,
+    removed and the replacement's method"""
+    if len(data) < PATCH_HEADER.size + CRC.size:
+        raise PathFormatError(f"{len(data)} bytes is shorter than a patch")
+    magic, version, _, base, revision, start, removed = PATCH_HEADER.unpack_from(data)
+    if magic != PATCH_MAGIC:
+        raise PathFormatError(f"bad patch magic {magic!r}")
+    if version != VERSION:
+        raise PathFormatError(f"unsupported patch version {version}")
+    if CRC.unpack_from(data, len(data) - CRC.size)[0] != zlib.crc32(memoryview(data)[:-CRC.size]):
+        raise PathFormatError("patch CRC mismatch")
+    method, replacement = decode_path(bytes(memoryview(data)[PATCH_HEADER.size:-CRC.size]))
+    header = {"base": base, "revision": revision, "start": start, "removed": removed, "method": method}
+    return header, replacement
+
+
+def apply_patch(path: List[dict], start: int, removed: int, replacement: List[dict]) -> List[dict]:
+    if start + removed > len(path):
+        raise PathFormatError(f"patch replaces {start}..{start + removed} of a {len(path)}-point path")
+    return path[:start] + replacement + path[start + removed:]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert a JSON path to the binary wire format, or inspect one')
+    parser.add_argument('input', help='JSON payload / path_with_headings list, or a binary path')
+    parser.add_argument('output', nargs='?', help='Binary path to write')
+    parser.add_argument('--coord-bits', type=int, default=4, help='Fractional bits for x, y (default: 4)')
+    args = parser.parse_args()
+
+    with open(args.input, 'rb') as f:
+        data = f.read()
+    if is_binary_path(data):
+        header, arrays = decode_arrays(data)
+        fields = ", ".join(key for key in ("heading", "curvature", "speed") if key in arrays)
+        print(f"📦 {header['count']} points, method {header['method']}, v{header['version']}, "
+              f"1/{1 << header['coord_bits']}px, fields: x, y{', ' + fields if fields else ''}; "
+              f"{len(data)} bytes")
+        return
+
+    payload = json.loads(data)
+    method, path = (payload.get("method"), payload["path"]) if isinstance(payload, dict) else (None, payload)
+    binary = encode_path(path, method, args.coord_bits)
+    if args.output:
+        with open(args.output, 'wb') as f:
+            f.write(binary)
+    print(f"📦 {len(path)} points: {len(data)} bytes JSON -> {len(binary)} bytes binary "
+          f"({len(data) / len(binary):.1f}x){' -> ' + args.output if args.output else ''}")
+
+
+if __name__ == '__main__':
+    main()
@@ -3,8 +3,8 @@ from tkinter import ttk
 from PIL import Image, ImageTk
 import cv2
 import numpy as np
-import paho.mqtt.client as mqtt
-import json
+import threading
+import time
 
 # ------------------------------
 # DEFAULT SETTINGS
@@ -17,7 +17,91 @@ DEFAULT_VIDEO  = "http://100.101.214.30:5000/video_feed"
 # PATH FUNCTIONS IMPORT
 # ------------------------------
 from path_calculations import path_with_headings, point_path, linear_path, catmull_path, cubic_path, bezier_chained
+from path_link import PathPublisher
 
+# Clicks this close to a waypoint (px) grab it for dragging instead of adding one
+GRAB_RADIUS = 8
+
+# How often the Tk loop checks for a new frame (ms); frames are only drawn when new
+POLL_MS = 10
+
+
+# ================================================================
+#                     BACKGROUND FRAME GRABBER
+# ================================================================
+class FrameGrabber:
+    """
+    Reads the video stream on its own thread and keeps only the newest
+    frame, so cap.read() (and opening the stream) never blocks the Tk loop
+    and a slow UI shows the latest frame instead of falling behind.
+    """
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.frame = None
+        self.seq = 0              # increments per captured frame
+        self.taken_seq = 0
+        self.dropped = 0          # frames replaced before the UI took them
+        self.url = None
+        self.reopen = False
+        self.running = False
+        self.thread = None
+
+    def open(self, url):
+        """(Re)open url on the capture thread."""
+        with self.lock:
+            self.url, self.reopen = url, True
+        if not self.running:
+            self.running = True
+            self.thread = threading.Thread(target=self.run, daemon=True)
+            self.thread.start()
+
+    def latest(self, after_seq):
+        """(frame, seq) if a frame newer than after_seq exists, else (None, after_seq)."""
+        with self.lock:
+            if self.seq <= after_seq:
+                return None, after_seq
+            self.taken_seq = self.seq
+            return self.frame, self.seq
+
+    def run(self):
+        cap = None
+        while self.running:
+            if self.reopen:
+                with self.lock:
+                    url, self.reopen = self.url, False
+                if cap is not None:
+                    cap.release()
+                print("[DEBUG] Opening stream:", url)
+                cap = cv2.VideoCapture(url, cv2.CAP_FFMPEG)
+                if not cap.isOpened():
+                    print("[ERROR] Failed to open:", url)
+                else:
+                    print("[SUCCESS] Connected to video stream.")
+
+            if cap is None or not cap.isOpened():
+                time.sleep(0.1)
+                continue
+
+            ret, frame = cap.read()
+            if not ret or frame is None:
+                time.sleep(0.02)
+                continue
+
+            # A new array per read, so the UI can keep the one it took
+            with self.lock:
+                if self.seq > self.taken_seq:
+                    self.dropped += 1
+                self.frame = frame
+                self.seq += 1
+
+        if cap is not None:
+            cap.release()
+
+    def close(self):
+        self.running = False
+        if self.thread is not None:
+            self.thread.join(timeout=2)
 
 
 # ================================================================
@@ -30,14 +114,30 @@ class PathGUI:
         self.root.iconbitmap("robot.ico")
 
         self.points = []
-        self.cap = None
+        self.grabber = FrameGrabber()
         self.stop_flag = False
+        self.link = None          # MQTT session, opened on first publish
+        self.drag_index = None    # waypoint being dragged
+
+        # Display state: last frame drawn, cached preview and reused buffers
+        self.frame = None
+        self.frame_seq = 0
+        self.drawn_key = None     # (frame seq, preview key) of what is on screen
+        self.preview_key = None   # (points, method, #pts/seg) the cached preview is for
+        self.preview = None       # (path, int32 polyline) or None
+        self.disp = None          # BGR frame with overlay
+        self.rgb = None           # disp converted for Tk
+        self.imgtk = None
+        self.frame_ms = 0.0       # smoothed UI time per drawn frame
+        self.frames_drawn = 0
+        self.perf_time = time.perf_counter()
 
         # GUI default state variables
         self.method_var = tk.StringVar(value="linear")
         self.broker_var = tk.StringVar(value=DEFAULT_BROKER)
         self.npts_var   = tk.IntVar(value=2)
         self.url_var    = tk.StringVar(value=DEFAULT_VIDEO)
+        self.live_var   = tk.BooleanVar(value=False)
 
         # ------------------------------
         # CONTROL PANEL
@@ -74,10 +174,17 @@ class PathGUI:
         ttk.Button(ctrl, text="Publish", command=self.publish).grid(row=0, column=4, padx=6)
         ttk.Button(ctrl, text="Clear",   command=self.clear).grid(row=1, column=4, padx=6)
         ttk.Button(ctrl, text="Undo", command=self.undo).grid(row=0, column=5, padx=6)
+        # Live: publish after every edit, so a dragged waypoint reaches the car while dragging
+        ttk.Checkbutton(ctrl, text="Live", variable=self.live_var,
+                        command=self.on_edit).grid(row=1, column=5, padx=6)
 
         # Status label
-        self.status_var = tk.StringVar(value="Click video to add points. Right-click to undo.")
-        ttk.Label(root, textvariable=self.status_var, padding=(6,3)).pack(fill=tk.X)
+        self.status_var = tk.StringVar(value="Click video to add points, drag to move them. Right-click to undo.")
+        self.perf_var = tk.StringVar(value="")
+        status = ttk.Frame(root)
+        status.pack(fill=tk.X)
+        ttk.Label(status, textvariable=self.status_var, padding=(6,3)).pack(side=tk.LEFT)
+        ttk.Label(status, textvariable=self.perf_var, padding=(6,3)).pack(side=tk.RIGHT)
 
         # ------------------------------
         # VIDEO FEED WINDOW
@@ -85,9 +192,13 @@ class PathGUI:
         self.video_label = ttk.Label(root)
         self.video_label.pack()
 
-        self.video_label.bind("<Button-1>", self.add_point)
+        self.video_label.bind("<Button-1>", self.on_press)
+        self.video_label.bind("<B1-Motion>", self.on_drag)
+        self.video_label.bind("<ButtonRelease-1>", self.on_release)
         self.video_label.bind("<Button-3>", self.undo)
 
+        self.root.protocol("WM_DELETE_WINDOW", self.on_close)
+
         # Start video
         self.open_video()
         self.update_frame()
@@ -104,53 +215,61 @@ class PathGUI:
             self.npts_var.set(20)
 
         #self.status_var.set(f"Default #pts/seg set to {self.npts_var.get()} for {method}")
+        self.on_edit()
+
+    def on_close(self):
+        """Stop the video loop and flush the MQTT session before exiting."""
+        self.stop_flag = True
+        self.grabber.close()
+        if self.link is not None:
+            self.link.close()
+        self.root.destroy()
 
     # ================================================================
     #                        VIDEO HANDLING
     # ================================================================
     def open_video(self):
-        """Open video feed using FFMPEG backend."""
-        url = self.url_var.get().strip()
-        print("[DEBUG] Opening stream:", url)
-
-        # Close previous stream
-        if self.cap:
-            self.cap.release()
-
-        # Attempt to open the network MJPEG stream
-        self.cap = cv2.VideoCapture(url, cv2.CAP_FFMPEG)
-
-        if not self.cap.isOpened():
-            print("[ERROR] Failed to open:", url)
-        else:
-            print("[SUCCESS] Connected to video stream.")
+        """Open video feed using FFMPEG backend, on the grabber thread."""
+        self.grabber.open(self.url_var.get().strip())
 
     def update_frame(self):
+        """
+        Draw the newest frame with the path overlay. Runs every POLL_MS but
+        only does work when there is a new frame or the preview changed.
+        """
         if self.stop_flag:
             return
+        self.root.after(POLL_MS, self.update_frame)
 
-        if self.cap is None or not self.cap.isOpened():
-            self.root.after(20, self.update_frame)
+        frame, seq = self.grabber.latest(self.frame_seq)
+        if frame is not None:
+            self.frame, self.frame_seq = frame, seq
+        if self.frame is None:
             return
 
-        ret, frame = self.cap.read()
-        if not ret or frame is None:
-            self.root.after(20, self.update_frame)
+        preview = self.compute_preview()
+        key = (self.frame_seq, self.preview_key)
+        if key == self.drawn_key:
             return
+        self.drawn_key = key
+        t0 = time.perf_counter()
 
-        disp = frame.copy()
+        # Reuse the overlay and RGB buffers while the frame size is the same
+        if self.disp is None or self.disp.shape != self.frame.shape:
+            self.disp = np.empty_like(self.frame)
+            self.rgb = np.empty_like(self.frame)
+            self.imgtk = None
+        disp = self.disp
+        np.copyto(disp, self.frame)
 
         # -------------------------------------
         # Draw snapped / smooth path preview
         # -------------------------------------
-        path = self.compute_preview_path()
-        if path is not None:
+        if preview is not None:
+            path, polyline = preview
 
-            # 1. Draw full polyline
-            for i in range(len(path)-1):
-                p1 = (int(path[i][0]),   int(path[i][1]))
-                p2 = (int(path[i+1][0]), int(path[i+1][1]))
-                cv2.line(disp, p1, p2, (0, 255, 255), 2)
+            # 1. Draw full polyline in one call
+            cv2.polylines(disp, [polyline], False, (0, 255, 255), 2)
 
             # 2. Draw ONE arrow at the end of the segment
             end1 = (int(path[-2][0]), int(path[-2][1]))
@@ -163,21 +282,60 @@ class PathGUI:
         for (x, y) in self.points:
             cv2.circle(disp, (x, y), 5, (0, 0, 255), -1)
 
-        # Convert to tkinter
-        img_rgb = cv2.cvtColor(disp, cv2.COLOR_BGR2RGB)
-        img_pil = Image.fromarray(img_rgb)
-        imgtk = ImageTk.PhotoImage(img_pil)
+        # Convert to tkinter: into the same RGB buffer, pasted into the same
+        # PhotoImage instead of creating a Tk image per frame
+        cv2.cvtColor(disp, cv2.COLOR_BGR2RGB, dst=self.rgb)
+        img_pil = Image.fromarray(self.rgb)
+        if self.imgtk is None:
+            self.imgtk = ImageTk.PhotoImage(img_pil)
+            self.video_label.configure(image=self.imgtk)
+        else:
+            self.imgtk.paste(img_pil)
 
-        self.video_label.imgtk = imgtk
-        self.video_label.configure(image=imgtk)
+        self.report_frame_time(time.perf_counter() - t0)
 
-        self.root.after(20, self.update_frame)
+    def report_frame_time(self, elapsed):
+        """Smoothed UI time per drawn frame, shown in the status bar twice a second."""
+        self.frame_ms += 0.1 * (elapsed * 1000 - self.frame_ms)
+        self.frames_drawn += 1
+        now = time.perf_counter()
+        if now - self.perf_time >= 0.5:
+            fps = self.frames_drawn / (now - self.perf_time)
+            self.perf_var.set(f"UI {self.frame_ms:.1f} ms/frame | {fps:.0f} fps | "
+                              f"{self.grabber.dropped} frames skipped")
+            self.frames_drawn, self.perf_time = 0, now
 
 
 
     # ================================================================
     #                       POINT MANAGEMENT
     # ================================================================
+    def on_press(self, event):
+        """Grab the nearest waypoint within GRAB_RADIUS, else add a new one."""
+        if self.points:
+            d = np.hypot(*(np.array(self.points) - (event.x, event.y)).T)
+            i = int(np.argmin(d))
+            if d[i] <= GRAB_RADIUS:
+                self.drag_index = i
+                return
+        self.add_point(event)
+
+    def on_drag(self, event):
+        if self.drag_index is None:
+            return
+        self.points[self.drag_index] = (event.x, event.y)
+        self.on_edit()
+
+    def on_release(self, event):
+        if self.drag_index is not None:
+            self.status_var.set(f"Moved point {self.drag_index + 1}.")
+            self.drag_index = None
+
+    def on_edit(self):
+        """Publish the edited path straight away in live mode."""
+        if self.live_var.get():
+            self.publish(live=True)
+
     def add_point(self, event):
         """Add click coordinate as a waypoint."""
         x, y = event.x, event.y
@@ -194,6 +352,7 @@ class PathGUI:
         self.points.append((x, y))
 
         self.status_var.set(f"{len(self.points)} point(s) added.")
+        self.on_edit()
 
 
     def undo(self, event=None):
@@ -202,6 +361,7 @@ class PathGUI:
             self.points.pop()
             self.status_var.set("Removed last point.")
             self.status_var.set(f"{len(self.points)} point(s) remaining.")
+            self.on_edit()
         else:
             self.status_var.set("No points to undo.")
         # self.status_var.set(f"{len(self.points)} point(s) remaining.")
@@ -210,6 +370,7 @@ class PathGUI:
     def clear(self):
         self.points.clear()
         self.status_var.set("Points cleared.")
+        self.on_edit()
 
     def draw_arrow(self, img, p1, p2, color=(0, 255, 0), thickness=2, size=10):
         """
@@ -237,13 +398,29 @@ class PathGUI:
         
     def compute_preview_path(self):
         """Compute the full preview path using the chosen method."""
-        if len(self.points) < 2:
-            return None
+        preview = self.compute_preview()
+        return None if preview is None else preview[0]
 
-        method = self.method_var.get()
-        npts = self.npts_var.get()
-
-        pts = self.points
+    def compute_preview(self):
+        """
+        (path, int32 polyline) for the current points, method and #pts/seg,
+        recomputed only when one of them changed since the last call.
+        """
+        try:
+            npts = self.npts_var.get()
+        except tk.TclError:
+            # #pts/seg is being typed; keep the last preview until it parses
+            return self.preview
+        key = (tuple(self.points), self.method_var.get(), npts)
+        if key != self.preview_key:
+            self.preview_key = key
+            path = self.generate_path(*key)
+            self.preview = None if path is None else (path, np.asarray(path).astype(np.int32))
+        return self.preview
+
+    def generate_path(self, pts, method, npts):
+        if len(pts) < 2:
+            return None
 
         # if method == "point":
         #     path = point_path(pts[0], pts[-1], n=npts)
@@ -268,54 +445,49 @@ class PathGUI:
     # ================================================================
     #                       MQTT PUBLISHING
     # ================================================================
-    def publish(self):
+    def get_link(self):
+        """The MQTT session, reopened if the broker field changed."""
+        broker = self.broker_var.get().strip()
+        if self.link is None or self.link.broker != broker:
+            if self.link is not None:
+                self.link.close()
+            self.link = PathPublisher(broker)
+        return self.link
+
+    def publish(self, live=False):
         """Send path to robot via MQTT."""
         if len(self.points) < 2:
-            self.status_var.set("Need at least 2 points!")
+            if live:
+                # Fewer than 2 points in live mode: take the path off the robot
+                self.get_link().clear()
+            else:
+                self.status_var.set("Need at least 2 points!")
             return
 
         method = self.method_var.get()
         npts = self.npts_var.get()
 
-        # Select path generation
-        # if method == "point":
-        #     path = point_path(self.points[0], self.points[-1], n=npts)
-
-        if method == "linear":
-            path = linear_path(self.points, n=npts)
-
-        elif method == "catmull":
-            path = catmull_path(self.points, n=npts)
+        path = self.compute_preview_path()
+        if path is None:
+            self.status_var.set("Bezier needs at least 4 points.")
+            return
 
-        elif method == "cubic":
-            path = cubic_path(self.points, n=npts)
+        if not live:
+            print("DEBUG #pts/seg =", npts)
+            print("DEBUG points list:", self.points)
+            print("DEBUG generated path length:", len(path))
 
-        elif method == "bezier":
-            if len(self.points) < 4:
-                self.status_var.set("Bezier needs at least 4 points.")
-                return
-            path = bezier_chained(self.points, n=npts)
+        # Binary wire format (path_codec.py) over one long-lived session
+        # (path_link.py): an edit goes out as a patch of the segments it
+        # changed, and the retained full path follows once edits pause
+        kind, size = self.get_link().publish(path_with_headings(path), method)
 
-        print("DEBUG #pts/seg =", npts)
-        print("DEBUG points list:", self.points)
-        print("DEBUG generated path length:", len(path))
-        
-        # Convert to JSON text
-        # payload = json.dumps(path.tolist())
-        path_hdg = path_with_headings(path)
-        payload = json.dumps({
-            "method": method,
-            "path": path_hdg
-        })
-
-        # Send to MQTT
-        broker = self.broker_var.get().strip()
-        client = mqtt.Client()
-        client.connect(broker, 1883, 60)
-        client.publish("robot/path", payload)
-        client.disconnect()
-
-        self.status_var.set(f"Path published ({len(path)} pts).")
+        if kind == "unchanged":
+            if not live:
+                self.status_var.set("Path unchanged since last publish.")
+            return
+        if not live or self.drag_index is None:
+            self.status_var.set(f"Path published as {kind} ({len(path)} pts, {size} bytes).")
 
 
 
@@ -0,0 +1,304 @@
+#!/usr/bin/env python3
+"""
+Long-lived MQTT link for robot/path
+
+PathPublisher keeps one MQTT session open for the life of the GUI instead
+of connecting, publishing and disconnecting per path, so a replanned path
+costs one PUBLISH on an open socket rather than a TCP + CONNECT handshake.
+paho's network thread reconnects with backoff, and QoS 1 messages
+published while disconnected are queued and sent on reconnect.
+
+Each publish is diffed against the last one (path_codec.diff_paths):
+
+  robot/path        the whole path (path_codec format), retained, so a
+                    consumer that connects later gets the current path
+  robot/path/patch  "replace points start..start+removed-1 with these",
+                    against a base revision; not retained
+
+A patch is sent whenever it is smaller than the whole path, which is what
+editing one waypoint produces since only the spline segments it controls
+change. The retained snapshot is refreshed once edits pause
+(snapshot_delay), not on every drag step. An empty retained message clears
+the path.
+
+PathSubscriber is the consumer side: a persistent session (clean_session
+off, fixed client id) so the broker holds QoS 1 patches while it is away,
+applying patches whose base matches its revision and otherwise waiting for
+the next snapshot.
+
+Usage (print what arrives):
+  python3 path_link.py --broker 100.101.214.30
+"""
+
+import argparse
+import random
+import threading
+import time
+from typing import Callable, List, Optional, Tuple
+
+import paho.mqtt.client as mqtt
+
+import path_codec
+
+PATH_TOPIC = "robot/path"
+PATCH_TOPIC = "robot/path/patch"
+
+
+def make_client(client_id: str, clean_session: bool) -> mqtt.Client:
+    """paho client with the same callback signatures on paho 1.x and 2.x"""
+    try:
+        return mqtt.Client(mqtt.CallbackAPIVersion.VERSION2, client_id=client_id, clean_session=clean_session)
+    except AttributeError:
+        return mqtt.Client(client_id=client_id, clean_session=clean_session)
+
+
+def _reason(args) -> int:
+    # on_connect: (flags, rc) on paho 1.x, (flags, reason_code, properties) on 2.x
+    rc = args[1] if len(args) > 1 else args[0]
+    return getattr(rc, 'value', rc)
+
+
+class PathPublisher:
+    """One MQTT session that publishes paths as snapshots and patches"""
+
+    def __init__(self, broker: str, port: int = 1883, client_id: str = "vizcar-pathgui",
+                 qos: int = 1, keepalive: int = 30, snapshot_delay: float = 1.0):
+        self.broker = broker
+        self.qos = qos
+        self.snapshot_delay = snapshot_delay
+        self.lock = threading.Lock()
+        self.connected = threading.Event()
+
+        self.path: Optional[List[dict]] = None
+        self.method: Optional[str] = None
+        # Random start, so a restarted GUI's first snapshot never looks like
+        # one a subscriber already has
+        self.revision = random.randrange(1, 0xFFFF)
+        self.last_publish = None
+        self.was_connected = False
+        self.closing = False
+        self.snapshot_timer: Optional[threading.Timer] = None
+        self.snapshot_stale = False
+        self.stats = {"snapshots": 0, "patches": 0, "bytes": 0}
+
+        self.client = make_client(client_id, clean_session=True)
+        self.client.on_connect = self._on_connect
+        self.client.on_disconnect = self._on_disconnect
+        self.client.reconnect_delay_set(min_delay=0.2, max_delay=5)
+        self.client.connect_async(broker, port, keepalive)
+        self.client.loop_start()
+
+    def _on_connect(self, client, userdata, *args):
+        rc = _reason(args)
+        if rc == 0:
+            self.connected.set()
+            print(f"📡 MQTT connected to {self.broker}")
+            # A restarted broker may have lost the retained path. Not from
+            # paho's callback, which holds locks publish() may need
+            if self.was_connected:
+                threading.Thread(target=self._flush_snapshot, kwargs={'force': True}, daemon=True).start()
+            self.was_connected = True
+        else:
+            print(f"⚠️ MQTT connect to {self.broker} refused ({rc})")
+
+    def _on_disconnect(self, client, userdata, *args):
+        self.connected.clear()
+        if not self.closing:
+            print(f"⚠️ MQTT disconnected from {self.broker}, reconnecting")
+
+    def _next_revision(self) -> int:
+        # 0 means "not from a session", so skip it when wrapping
+        self.revision = self.revision % 0xFFFF + 1
+        return self.revision
+
+    def publish(self, path: List[dict], method: Optional[str]) -> Tuple[str, int]:
+        """
+        Send path (path_with_headings() form) as a patch if that is smaller,
+        else as a retained snapshot; returns ("patch"|"snapshot"|"unchanged",
+        bytes sent)
+        """
+        with self.lock:
+            edit = None
+            if self.path is not None and method == self.method:
+                edit = path_codec.diff_paths(self.path, path)
+                if edit[1] == 0 and not edit[2]:
+                    return "unchanged", 0
+
+            base = self.revision
+            revision = self._next_revision()
+            self.path, self.method = list(path), method
+            snapshot = path_codec.encode_path(path, method, revision=revision)
+            patch = path_codec.encode_patch(base, revision, *edit, method) if edit else None
+            if patch is not None and len(patch) < len(snapshot):
+                self.last_publish = self.client.publish(PATCH_TOPIC, patch, qos=self.qos)
+                self.stats["patches"] += 1
+                self.stats["bytes"] += len(patch)
+                self._schedule_snapshot()
+                return "patch", len(patch)
+
+            self._send_snapshot(snapshot)
+            return "snapshot", len(snapshot)
+
+    def clear(self):
+        """Drop the path, including the retained copy"""
+        with self.lock:
+            self._cancel_snapshot()
+            self.path = None
+            self.last_publish = self.client.publish(PATH_TOPIC, b"", qos=self.qos, retain=True)
+
+    def _send_snapshot(self, snapshot: bytes):
+        self._cancel_snapshot()
+        self.last_publish = self.client.publish(PATH_TOPIC, snapshot, qos=self.qos, retain=True)
+        self.stats["snapshots"] += 1
+        self.stats["bytes"] += len(snapshot)
+
+    def _schedule_snapshot(self):
+        # Restart the timer on every patch so a drag refreshes the retained
+        # copy once, after the drag
+        self._cancel_snapshot()
+        self.snapshot_stale = True
+        self.snapshot_timer = threading.Timer(self.snapshot_delay, self._flush_snapshot)
+        self.snapshot_timer.daemon = True
+        self.snapshot_timer.start()
+
+    def _cancel_snapshot(self):
+        if self.snapshot_timer is not None:
+            self.snapshot_timer.cancel()
+            self.snapshot_timer = None
+        self.snapshot_stale = False
+
+    def _flush_snapshot(self, force: bool = False):
+        with self.lock:
+            if (self.snapshot_stale or force) and self.path is not None:
+                self._send_snapshot(path_codec.encode_path(self.path, self.method, revision=self.revision))
+
+    def close(self, timeout: float = 2.0):
+        """Send any pending snapshot, wait for it to be acknowledged, disconnect"""
+        self._flush_snapshot()
+        # QoS 1 goes out in order, so the last message being acked means all were
+        if self.last_publish is not None and self.connected.is_set():
+            try:
+                self.last_publish.wait_for_publish(timeout)
+            except (RuntimeError, ValueError):
+                pass
+        self.closing = True
+        self.client.disconnect()
+        self.client.loop_stop()
+
+
+class PathSubscriber:
+    """
+    Current path from robot/path snapshots and patches. Updates are handed
+    over through take(), so the caller applies them on its own thread.
+    """
+
+    def __init__(self, broker: str, port: int = 1883, client_id: str = "vizcar-controller",
+                 qos: int = 1, keepalive: int = 30,
+                 on_update: Optional[Callable[[Optional[List[dict]], int], None]] = None):
+        self.broker = broker
+        self.qos = qos
+        self.on_update = on_update
+        self.lock = threading.Lock()
+
+        self.path: Optional[List[dict]] = None
+        self.method: Optional[str] = None
+        self.revision = 0
+        self.changed = False
+        self.received_at = 0.0
+        self.stats = {"snapshots": 0, "patches": 0, "stale": 0, "errors": 0}
+
+        self.client = make_client(client_id, clean_session=False)
+        self.client.on_connect = self._on_connect
+        self.client.on_message = self._on_message
+        self.client.reconnect_delay_set(min_delay=0.2, max_delay=5)
+        self.client.connect_async(broker, port, keepalive)
+        self.client.loop_start()
+
+    def _on_connect(self, client, userdata, *args):
+        rc = _reason(args)
+        if rc != 0:
+            print(f"⚠️ MQTT connect to {self.broker} refused ({rc})")
+            return
+        # Subscribe on every connect: a broker that lost the session has
+        # forgotten the subscriptions
+        client.subscribe([(PATH_TOPIC, self.qos), (PATCH_TOPIC, self.qos)])
+        print(f"📡 Listening for paths on {self.broker}")
+
+    def _on_message(self, client, userdata, message):
+        try:
+            if message.topic == PATH_TOPIC:
+                self._snapshot(message.payload)
+            elif message.topic == PATCH_TOPIC:
+                self._patch(message.payload)
+        except path_codec.PathFormatError as e:
+            self.stats["errors"] += 1
+            print(f"⚠️ Bad message on {message.topic}: {e}")
+
+    def _snapshot(self, payload: bytes):
+        with self.lock:
+            if not payload:
+                self.path, self.revision = None, 0
+            else:
+                method, path = path_codec.decode_path(payload)
+                revision = path_codec.HEADER.unpack_from(payload)[5]
+                if self.path is not None and revision and revision == self.revision:
+                    return  # the refresh of what patches already built
+                self.path, self.method, self.revision = path, method, revision
+            self.stats["snapshots"] += 1
+            self._updated()
+
+    def _patch(self, payload: bytes):
+        header, replacement = path_codec.decode_patch(payload)
+        with self.lock:
+            if self.path is None or header["base"] != self.revision:
+                self.stats["stale"] += 1   # missed one; the next snapshot resyncs
+                return
+            self.path = path_codec.apply_patch(self.path, header["start"], header["removed"], replacement)
+            self.revision = header["revision"]
+            self.stats["patches"] += 1
+            self._updated()
+
+    def _updated(self):
+        self.changed = True
+        self.received_at = time.time()
+        if self.on_update is not None:
+            self.on_update(self.path, self.revision)
+
+    def take(self) -> Optional[Tuple[Optional[List[dict]], int]]:
+        """(path, revision) if it changed since the last take(), else None"""
+        with self.lock:
+            if not self.changed:
+                return None
+            self.changed = False
+            return self.path, self.revision
+
+    def close(self):
+        self.client.disconnect()
+        self.client.loop_stop()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Print paths arriving on robot/path')
+    parser.add_argument('--broker', default='localhost')
+    parser.add_argument('--port', type=int, default=1883)
+    parser.add_argument('--client-id', default='vizcar-path-monitor')
+    args = parser.parse_args()
+
+    def show(path, revision):
+        if path is None:
+            print("🧹 Path cleared")
+        else:
+            print(f"🛣️ Revision {revision}: {len(path)} points")
+
+    subscriber = PathSubscriber(args.broker, args.port, args.client_id, on_update=show)
+    try:
+        while True:
+            time.sleep(1)
+    except KeyboardInterrupt:
+        pass
+    subscriber.close()
+    print(f"📊 {subscriber.stats}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,317 @@
+#!/usr/bin/env python3
+"""
+Pulse durations learned from run logs
+
+The path controller drives in fixed 0.2s pulses, however much heading
+error or distance is left: small corrections overshoot and long drives
+take dozens of pulses. This fits, per command, how far a pulse of a given
+length actually moves the car,
+
+    motion = rate * (duration - dead_time)
+
+(radians turned for left/right, pixels driven along the heading for back
+and go), from the pulses recorded in run logs: each STEP's pulse, timed by
+its COMMAND records, measured between the last pose before it started and
+the last pose before the next one started.
+dead_time absorbs motor spin-up and the stop arriving late, less the coast
+after it (so it comes out negative when the car rolls on); it can only be
+told apart from the rate when the logs hold pulses of several lengths
+(PathFollowingController or a policy run), so logs of fixed pulses give a
+rate through the origin.
+
+PulsePolicy inverts the model to choose the pulse that covers what is left
+of the error in one go, within [min_pulse, max_pulse]; the controllers use
+it in place of their fixed or constant-rate durations.
+
+  python3 pulse_policy.py run1.vzlog run2.vzlog --out pulse_model.json
+  python3 replay.py run1.vzlog --pulse-model pulse_model.json
+  python3 simulator.py --headless --pulse-model pulse_model.json
+
+Fitting reports each command's out-of-sample error, leaving out one log at
+a time (or one fifth of the pulses with a single log), next to the
+constant-rate model the controller would otherwise use.
+"""
+
+import argparse
+import bisect
+import json
+import math
+import statistics
+import struct
+from dataclasses import dataclass
+from typing import Dict, List, Optional, Tuple
+
+import numpy as np
+
+from video_client_controller import COMMAND_TWIST, PoseClient, normalize_angle
+import run_log
+from run_log import read_run_log
+
+MOTIONS = ("back", "go", "left", "right")
+
+
+@dataclass
+class PulseSample:
+    """One recorded pulse and what it did"""
+    command: str
+    duration: float  # as commanded, seconds
+    motion: float    # radians (turns) or pixels (drives) in the command's direction
+    drift: float     # pixels moved during a turn, radians turned during a drive
+    source: str = ""
+
+
+def car_poses(events, car_index, config):
+    """The car's poses as its PoseClient accepted them, in arrival order"""
+    client = PoseClient('http://replay', front_keypoint=config['front_keypoint'], car_id=config['car_id'])
+    poses = []
+    for kind, car, t, payload in events:
+        if car not in (car_index, run_log.NO_CAR):
+            continue
+        if kind == run_log.CLOCK:
+            client.clock_offset = payload['offset']
+            continue
+        if kind == run_log.POSE:
+            client.handle_record(json.loads(payload), t)
+        elif kind == run_log.DETECTIONS:
+            client.handle_detections(json.loads(payload[8:]), struct.unpack('<d', payload[:8])[0])
+        else:
+            continue
+        pose = client.get_latest()
+        if pose is not None and (not poses or pose is not poses[-1]):
+            poses.append(pose)
+    poses.sort(key=lambda pose: pose.timestamp)
+    return poses
+
+
+def extract_pulses(events, car_index=0, settle=0.15, source="") -> List[PulseSample]:
+    """
+    Pulses of one car in a run log, each with the motion between the last
+    pose before it started and the last pose before the next pulse started
+    (`settle` after it ended for the last one). Both poses must be captured
+    after the previous pulse ended, so pulses queued back to back under
+    prediction are skipped; the coasting each pulse leaves for the next
+    one's measurement evens out over a run.
+    """
+    config = next((e[3] for e in events if e[0] == run_log.CONFIG), None)
+    if config is None:
+        raise ValueError("run log has no CONFIG record")
+    poses = car_poses(events, car_index, config['cars'][car_index])
+    times = [pose.timestamp for pose in poses]
+    mine = [e for e in events if e[1] == car_index]
+    commands = [e[3] for e in mine if e[0] == run_log.COMMAND]
+    steps = [(e[2], e[3]['pulse']) for e in mine
+             if e[0] == run_log.STEP and e[3]['pulse'] and e[3]['pulse'][0] in MOTIONS]
+
+    # Execution interval of each pulse: its command and the stop after it,
+    # each taking effect half a round trip after it was sent
+    executed = []
+    index = 0
+    for t, (command, duration) in steps:
+        while index < len(commands) and (commands[index]['command'] != command or
+                                         commands[index]['sent'] < t - 1e-3):
+            index += 1
+        stop = next((c for c in commands[index + 1:] if c['command'] == 'stop'), None)
+        if index >= len(commands) or stop is None:
+            break
+        go = commands[index]
+        if go['ok'] and stop['ok']:
+            executed.append((command, duration, (go['sent'] + go['acked']) / 2,
+                             (stop['sent'] + stop['acked']) / 2))
+        index += 1
+
+    samples = []
+    for i, (command, duration, start, end) in enumerate(executed):
+        previous_end = executed[i - 1][3] if i else -math.inf
+        before = bisect.bisect_right(times, start) - 1
+        if i + 1 < len(executed):
+            after = bisect.bisect_right(times, executed[i + 1][2]) - 1
+        else:
+            after = bisect.bisect_left(times, end + settle)
+        if before < 0 or times[before] < previous_end or after >= len(poses) or times[after] < end:
+            continue
+        p0, p1 = poses[before], poses[after]
+        turn = normalize_angle(p1.heading - p0.heading)
+        dx, dy = p1.center[0] - p0.center[0], p1.center[1] - p0.center[1]
+        forward, rotation = COMMAND_TWIST[command]
+        if rotation:
+            samples.append(PulseSample(command, duration, turn * rotation, math.hypot(dx, dy), source))
+        else:
+            along = dx * math.cos(p0.heading) + dy * math.sin(p0.heading)
+            samples.append(PulseSample(command, duration, along * forward, turn, source))
+    return samples
+
+
+def load_samples(filenames) -> List[PulseSample]:
+    samples = []
+    for filename in filenames:
+        events = sorted(read_run_log(filename), key=lambda e: e[2])
+        config = next((e[3] for e in events if e[0] == run_log.CONFIG), None)
+        for car_index in range(len(config['cars']) if config else 0):
+            samples += extract_pulses(events, car_index, source=f"{filename}#{car_index}")
+    return samples
+
+
+class PulseModel:
+    """motion = rate * (duration - dead_time), per command"""
+
+    def __init__(self, fits: Dict[str, Tuple[float, float, float, int]]):
+        self.fits = fits  # command -> (rate, dead_time, residual std, samples)
+
+    @classmethod
+    def constant(cls, forward_speed=150.0, turn_rate=math.pi / 2):
+        """The controller's own constant-rate model"""
+        return cls({command: (forward_speed if command in ("back", "go") else turn_rate, 0.0, 0.0, 0)
+                    for command in MOTIONS})
+
+    @classmethod
+    def fit(cls, samples: List[PulseSample], min_samples: int = 3, min_spread: float = 0.05):
+        """Least-squares fit per command; a rate through the origin when the durations barely vary"""
+        fits = {}
+        for command in MOTIONS:
+            data = [(s.duration, s.motion) for s in samples if s.command == command]
+            if len(data) < min_samples:
+                continue
+            durations = np.array([d for d, _ in data])
+            motions = np.array([m for _, m in data])
+            if durations.max() - durations.min() >= min_spread:
+                rate, intercept = np.polyfit(durations, motions, 1)
+                dead_time = -intercept / rate if rate > 0 else 0.0
+            else:
+                rate = float(motions @ durations / (durations @ durations))
+                dead_time = 0.0
+            if rate <= 0:
+                continue
+            residual = motions - rate * (durations - dead_time)
+            fits[command] = (float(rate), float(dead_time), float(np.std(residual)), len(data))
+        return cls(fits)
+
+    def motion(self, command: str, duration: float) -> float:
+        rate, dead_time, _, _ = self.fits[command]
+        return rate * max(0.0, duration - dead_time)
+
+    def duration(self, command: str, motion: float) -> float:
+        rate, dead_time, _, _ = self.fits[command]
+        return motion / rate + dead_time
+
+    def to_dict(self) -> dict:
+        return {command: {'rate': rate, 'dead_time': dead_time, 'std': std, 'samples': n}
+                for command, (rate, dead_time, std, n) in self.fits.items()}
+
+    @classmethod
+    def from_dict(cls, data: dict):
+        return cls({command: (fit['rate'], fit['dead_time'], fit.get('std', 0.0), fit.get('samples', 0))
+                    for command, fit in data.items()})
+
+
+class PulsePolicy:
+    """
+    Pulse that covers the remaining heading error (radians) or distance
+    (pixels) in one go by the model, within [min_pulse, max_pulse]; commands
+    the model has no fit for get the constant-rate model
+    """
+
+    def __init__(self, model: PulseModel, min_pulse: float = 0.05, max_pulse: float = 0.6,
+                 fallback: Optional[PulseModel] = None):
+        self.model = model
+        self.min_pulse = min_pulse
+        self.max_pulse = max_pulse
+        self.fallback = fallback or PulseModel.constant()
+
+    def duration(self, command: str, remaining: float) -> float:
+        model = self.model if command in self.model.fits else self.fallback
+        return min(self.max_pulse, max(self.min_pulse, model.duration(command, remaining)))
+
+    def describe(self) -> str:
+        parts = []
+        for command, (rate, dead_time, _, _) in sorted(self.model.fits.items()):
+            unit = f"{rate:.0f}px/s" if command in ("back", "go") else f"{math.degrees(rate):.0f}°/s"
+            parts.append(f"{command} {unit} dead {dead_time * 1000:+.0f}ms")
+        return ", ".join(parts) + f"; pulses {self.min_pulse}-{self.max_pulse}s"
+
+    def to_dict(self) -> dict:
+        return {'model': self.model.to_dict(), 'min_pulse': self.min_pulse, 'max_pulse': self.max_pulse}
+
+    @classmethod
+    def from_dict(cls, data: dict):
+        return cls(PulseModel.from_dict(data['model']), data['min_pulse'], data['max_pulse'])
+
+    def save(self, filename: str):
+        with open(filename, 'w') as f:
+            json.dump(self.to_dict(), f, indent=2)
+
+    @classmethod
+    def load(cls, filename: str):
+        with open(filename) as f:
+            return cls.from_dict(json.load(f))
+
+
+def cross_validate(samples: List[PulseSample], folds: int = 5):
+    """{command: [(sample, predicted motion)]}, each predicted by a model fitted without it"""
+    sources = sorted({s.source for s in samples})
+    if len(sources) > 1:
+        groups = [[s for s in samples if s.source == source] for source in sources]
+    else:
+        groups = [samples[i::folds] for i in range(folds)]
+    predictions = {}
+    for held_out in groups:
+        held = {id(s) for s in held_out}
+        model = PulseModel.fit([s for s in samples if id(s) not in held])
+        for s in held_out:
+            if s.command in model.fits:
+                predictions.setdefault(s.command, []).append((s, model.motion(s.command, s.duration)))
+    return predictions
+
+
+def report(samples, model, baseline):
+    def unit(command, value):
+        return f"{value:.1f}px" if command in ("back", "go") else f"{math.degrees(value):.1f}°"
+
+    predictions = cross_validate(samples)
+    print(f"{'command':>8} {'pulses':>7} {'durations':>12} {'rate':>10} {'dead time':>10} "
+          f"{'CV error':>9} {'constant':>9}")
+    for command in MOTIONS:
+        if command not in model.fits:
+            continue
+        rate, dead_time, _, n = model.fits[command]
+        durations = [s.duration for s in samples if s.command == command]
+        cv = predictions.get(command, [])
+        cv_error = statistics.mean(abs(p - s.motion) for s, p in cv) if cv else float('nan')
+        constant = statistics.mean(abs(baseline.motion(command, s.duration) - s.motion)
+                                   for s in samples if s.command == command)
+        rate_text = f"{rate:.0f}px/s" if command in ("back", "go") else f"{math.degrees(rate):.0f}°/s"
+        print(f"{command:>8} {n:>7} {min(durations):>5.2f}-{max(durations):<5.2f}s {rate_text:>10} "
+              f"{dead_time * 1000:>+8.0f}ms {unit(command, cv_error):>9} {unit(command, constant):>9}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Fit pulse durations from VizCar run logs',
+                                     formatter_class=argparse.RawDescriptionHelpFormatter,
+                                     epilog=__doc__)
+    parser.add_argument('logs', nargs='+', help='Run logs written with --run-log')
+    parser.add_argument('--out', type=str, default='pulse_model.json',
+                        help='Where to write the policy (default: pulse_model.json)')
+    parser.add_argument('--min-pulse', type=float, default=0.05, help='Shortest pulse in seconds (default: 0.05)')
+    parser.add_argument('--max-pulse', type=float, default=0.6, help='Longest pulse in seconds (default: 0.6)')
+    parser.add_argument('--forward-speed', type=float, default=150.0,
+                        help='Constant-rate model to compare with, px/s (default: 150)')
+    parser.add_argument('--turn-rate', type=float, default=90.0,
+                        help='Constant-rate model to compare with, deg/s (default: 90)')
+    args = parser.parse_args()
+
+    samples = load_samples(args.logs)
+    print(f"📂 {len(samples)} pulses measured in {len(args.logs)} log(s)")
+    if not samples:
+        print("❌ Nothing to fit; pulses run back to back (prediction on) cannot be measured")
+        return
+    model = PulseModel.fit(samples)
+    if not model.fits:
+        print("❌ Too few pulses of any one command to fit")
+        return
+    report(samples, model, PulseModel.constant(args.forward_speed, math.radians(args.turn_rate)))
+    policy = PulsePolicy(model, args.min_pulse, args.max_pulse)
+    policy.save(args.out)
+    print(f"💾 {policy.describe()} -> {args.out}")
+
+
+if __name__ == '__main__':
+    main()
@@ -10,6 +10,7 @@ import requests
 import numpy as np
 import time
 import argparse
+from mjpeg_stream import JpegDecoder, MjpegStream
 from PyQt5.QtWidgets import QApplication, QMainWindow, QLabel, QMessageBox
 from PyQt5.QtCore import Qt, QThread, pyqtSignal
 from PyQt5.QtGui import QImage, QPixmap
@@ -24,44 +25,34 @@ class StreamThread(QThread):
         super().__init__()
         self.server_url = server_url
         self.running = False
+        self.frame_pending = False  # last frame not shown yet; newer ones are dropped
         
     def run(self):
         """Fetch frames from MJPEG stream"""
         self.running = True
         
         try:
-            response = requests.get(
-                f"{self.server_url}/video_feed", 
-                stream=True, 
-                timeout=10
-            )
-            
-            if response.status_code != 200:
-                self.connection_error.emit(f"HTTP Error {response.status_code}")
+            stream = MjpegStream(f"{self.server_url}/video_feed", decode=False)
+            try:
+                stream.open()
+            except ConnectionError as e:
+                self.connection_error.emit(f"HTTP Error: {e}")
                 return
-                
-            bytes_data = b''
             
-            for chunk in response.iter_content(chunk_size=1024):
+            # Decode only when the GUI has shown the previous frame: frames
+            # arriving meanwhile are dropped undecoded, and with one frame in
+            # flight a pool of two never reuses the buffer being displayed
+            decoder = JpegDecoder(pool_size=2)
+            for jpeg, _, _ in stream:
                 if not self.running:
                     break
-                    
-                bytes_data += chunk
-                
-                start = bytes_data.find(b'\xff\xd8')  # JPEG start
-                end = bytes_data.find(b'\xff\xd9')    # JPEG end
-                
-                if start != -1 and end != -1 and start < end:
-                    jpg_data = bytes_data[start:end + 2]
-                    bytes_data = bytes_data[end + 2:]
-                    
-                    frame = cv2.imdecode(
-                        np.frombuffer(jpg_data, dtype=np.uint8), 
-                        cv2.IMREAD_COLOR
-                    )
-                    
-                    if frame is not None:
-                        self.frame_ready.emit(frame)
+                if self.frame_pending:
+                    continue
+                frame = decoder.decode(jpeg)
+                if frame is not None:
+                    self.frame_pending = True
+                    self.frame_ready.emit(frame)
+            stream.close()
                         
         except Exception as e:
             self.connection_error.emit(f"Connection error: {str(e)}")
@@ -140,6 +131,7 @@ class VideoViewer(QMainWindow):
         )
         
         self.video_label.setPixmap(scaled_pixmap)
+        self.stream_thread.frame_pending = False
     
     def handle_error(self, error_msg):
         """Handle connection errors"""
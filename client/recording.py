@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+"""
+Background video recording for the VizCar clients
+
+Recorder takes frames from the display or stream thread and hands them to
+a dedicated writer thread through a bounded queue, so a slow encoder never
+stalls display or control: when the queue is full the frame is dropped and
+counted instead.
+
+Two formats:
+  encode - decoded BGR frames encoded to mp4 with cv2.VideoWriter
+           (needed when recording an overlay drawn by the client)
+  raw    - the JPEG bytes exactly as received from the server, written into
+           an MJPEG AVI with no decode or re-encode (MjpegAviWriter)
+"""
+
+import os
+import queue
+import struct
+import threading
+import time
+
+import cv2
+
+from mjpeg_stream import jpeg_size
+
+AVI_MAX_BYTES = 1 << 30  # AVI 1.0 indexes are 32-bit; start a new file well before that
+
+
+def _chunk(fourcc, data):
+    pad = b'\x00' if len(data) % 2 else b''
+    return fourcc + struct.pack('<I', len(data)) + data + pad
+
+
+class MjpegAviWriter:
+    """
+    Minimal AVI 1.0 writer that stores JPEG frames as they are
+
+    Frame count, sizes and the idx1 index are patched in on release(), so
+    a file cut short by a crash plays in most players but cannot be seeked.
+    """
+
+    def __init__(self, filename, fps, frame_size):
+        self.filename = filename
+        self.fps = fps
+        self.width, self.height = frame_size
+        self.file = open(filename, 'wb')
+        self.index = []  # (offset from 'movi', size)
+        self.frames = 0
+        self.max_frame = 0
+
+        self.file.write(self._header())
+        self.movi_start = self.file.tell()  # position of 'movi' fourcc
+        self.file.write(b'LIST\x00\x00\x00\x00movi')
+
+    def _header(self):
+        us_per_frame = int(round(1e6 / self.fps))
+        avih = struct.pack('<14I', us_per_frame, 0, 0, 0x10,  # AVIF_HASINDEX
+                           self.frames, 0, 1, self.max_frame,
+                           self.width, self.height, 0, 0, 0, 0)
+        strh = (b'vids' + b'MJPG' + struct.pack('<IHHI', 0, 0, 0, 0)
+                + struct.pack('<IIIIIII', 1000, int(round(self.fps * 1000)), 0, self.frames,
+                              self.max_frame, 0xFFFFFFFF, 0)
+                + struct.pack('<4h', 0, 0, self.width, self.height))
+        strf = struct.pack('<IiiHH4sIiiII', 40, self.width, self.height, 1, 24, b'MJPG',
+                           self.width * self.height * 3, 0, 0, 0, 0)
+        strl = _chunk(b'LIST', b'strl' + _chunk(b'strh', strh) + _chunk(b'strf', strf))
+        hdrl = _chunk(b'LIST', b'hdrl' + _chunk(b'avih', avih) + strl)
+        return b'RIFF\x00\x00\x00\x00AVI ' + hdrl
+
+    @property
+    def size(self):
+        return self.file.tell()
+
+    def write(self, jpeg):
+        offset = self.file.tell() - (self.movi_start + 8)  # from the 'movi' fourcc
+        self.file.write(_chunk(b'00dc', jpeg))
+        self.index.append((offset, len(jpeg)))
+        self.frames += 1
+        self.max_frame = max(self.max_frame, len(jpeg))
+
+    def release(self):
+        if self.file is None:
+            return
+        movi_end = self.file.tell()
+        idx1 = b''.join(struct.pack('<4sIII', b'00dc', 0x10, offset, size)  # AVIIF_KEYFRAME
+                        for offset, size in self.index)
+        self.file.write(_chunk(b'idx1', idx1))
+        riff_end = self.file.tell()
+
+        self.file.seek(0)
+        self.file.write(self._header())  # now with frame count and max frame size
+        self.file.seek(4)
+        self.file.write(struct.pack('<I', riff_end - 8))
+        self.file.seek(self.movi_start + 4)
+        self.file.write(struct.pack('<I', movi_end - self.movi_start - 8))
+        self.file.close()
+        self.file = None
+
+
+class Recorder:
+    """
+    Records on a background thread fed through a bounded queue
+
+    write() (decoded frames, 'encode' format) and write_jpeg() (JPEG bytes,
+    'raw' format) never block: they return False and count a drop when the
+    writer is `queue_size` frames behind, and return False once the writer
+    has failed. start() raises IOError when the file cannot be written.
+    """
+
+    def __init__(self, filename, fps=30.0, raw=False, queue_size=60):
+        self.filename = filename
+        self.fps = fps
+        self.raw = raw
+        self.queue = queue.Queue(maxsize=queue_size)
+        self.thread = None
+        self.writer = None
+        self.error = None
+        self.files = []
+
+        self.frames_queued = 0
+        self.frames_written = 0
+        self.frames_dropped = 0
+        self.max_queue_depth = 0
+        self.write_time = 0.0
+        self.start_time = None
+
+    def start(self):
+        # The writer itself opens on the first frame (it needs the frame
+        # size), so catch an unwritable path here rather than on its thread
+        directory = os.path.dirname(os.path.abspath(self.filename))
+        if not os.access(directory, os.W_OK) or (os.path.exists(self.filename) and
+                                                 not os.access(self.filename, os.W_OK)):
+            raise IOError(f"cannot write {self.filename}")
+        self.start_time = time.time()
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+        return self
+
+    @property
+    def failed(self):
+        """The writer thread has stopped on an error"""
+        return self.error is not None or (self.thread is not None and not self.thread.is_alive())
+
+    def _put(self, item):
+        if self.failed:
+            return False
+        try:
+            self.queue.put_nowait(item)
+        except queue.Full:
+            self.frames_dropped += 1
+            return False
+        self.frames_queued += 1
+        self.max_queue_depth = max(self.max_queue_depth, self.queue.qsize())
+        return True
+
+    def write(self, frame):
+        """Queue a decoded frame; it is copied, so the caller may draw on or reuse it"""
+        if self.raw:
+            raise ValueError("raw recorder takes JPEG bytes, use write_jpeg()")
+        if self.failed:
+            return False
+        if self.queue.full():
+            self.frames_dropped += 1
+            return False
+        return self._put(frame.copy())
+
+    def write_jpeg(self, jpeg):
+        """Queue one JPEG as received; it is copied, so a parser view may be passed"""
+        if not self.raw:
+            raise ValueError("encode recorder takes frames, use write()")
+        return self._put(bytes(jpeg))
+
+    def _open(self, item):
+        if self.raw:
+            size = jpeg_size(item)
+            if size is None:
+                return None
+            name = self.filename
+            if self.files:
+                root, ext = os.path.splitext(self.filename)
+                name = f"{root}_{len(self.files):03d}{ext}"
+            self.files.append(name)
+            return MjpegAviWriter(name, self.fps, size)
+
+        height, width = item.shape[:2]
+        writer = cv2.VideoWriter(self.filename, cv2.VideoWriter_fourcc(*'mp4v'), self.fps, (width, height))
+        if not writer.isOpened():
+            raise IOError(f"could not open video writer for {self.filename}")
+        self.files.append(self.filename)
+        return writer
+
+    def _run(self):
+        try:
+            while True:
+                item = self.queue.get()
+                if item is None:
+                    break
+                start = time.perf_counter()
+                if self.raw and self.writer is not None and self.writer.size > AVI_MAX_BYTES:
+                    self.writer.release()
+                    self.writer = None
+                if self.writer is None:
+                    self.writer = self._open(item)
+                    if self.writer is None:
+                        continue  # not a JPEG we can size; wait for the next one
+                self.writer.write(item)
+                self.write_time += time.perf_counter() - start
+                self.frames_written += 1
+        except Exception as e:
+            self.error = e
+            print(f"❌ Recording error: {e} (recording stopped)")
+        finally:
+            if self.writer is not None:
+                self.writer.release()
+                self.writer = None
+
+    def stop(self, timeout=10.0):
+        """Write out what is queued and close the file"""
+        if self.thread is None:
+            return
+        if self.thread.is_alive():
+            try:
+                # Blocks only while the queue is full and the writer catching up
+                self.queue.put(None, timeout=timeout)
+            except queue.Full:
+                pass
+        self.thread.join(timeout)
+        self.thread = None
+
+    @property
+    def duration(self):
+        return time.time() - self.start_time if self.start_time else 0.0
+
+    @property
+    def write_ms(self):
+        """Average writer time per frame"""
+        return self.write_time / self.frames_written * 1000 if self.frames_written else 0.0
+
+    def summary(self):
+        return (f"{self.frames_written} written, {self.frames_dropped} dropped, "
+                f"max queue {self.max_queue_depth}/{self.queue.maxsize}, {self.write_ms:.1f}ms/frame")
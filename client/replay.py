@@ -0,0 +1,499 @@
+#!/usr/bin/env python3
+"""
+Replay a run log through PoseClient and the path controllers, offline
+
+video_client_controller.py --run-log FILE records the poses the NN server
+sent, the operator's targets/paths/cancels, every control step and every
+robot command (see run_log.py). This feeds the poses and operator actions
+back, in order, into a fresh PoseClient and controller and re-runs the
+control loop on a virtual clock: no sleeping, no network, the same result
+on every run, and as fast as the controller can compute.
+
+Replay is open loop - the poses are those the real car produced under the
+recorded commands - so it answers "what would this controller have
+decided on the same inputs": each replayed step taken on the same pose as
+a recorded step is compared with it. Tune parameters with --set, e.g.
+
+  python3 replay.py run.vzlog
+  python3 replay.py run.vzlog --set arrival_threshold=40 --set pulse_duration=0.15
+  python3 replay.py run.vzlog --predict --video run.avi
+  python3 replay.py run.vzlog --pulse-model pulse_model.json
+
+--set takes controller attribute names and units (heading_threshold is
+in radians).
+"""
+
+import argparse
+import json
+import math
+import statistics
+import struct
+import time as real_time
+
+import video_client_controller as vcc
+from video_client_controller import (CarAgent, ControlState, PosePredictor, PoseTracker,
+                                     RobotCommander)
+from pulse_policy import PulsePolicy
+import run_log
+from run_log import read_run_log
+
+
+BURST = 0.002  # records this close together are handled before the control thread wakes
+
+
+class VirtualClock:
+    """Stands in for the time module inside video_client_controller during replay"""
+
+    def __init__(self, now=0.0):
+        self.now = now
+
+    def time(self):
+        return self.now
+
+    def sleep(self, seconds):
+        self.now += max(0.0, seconds)
+
+    def __getattr__(self, name):
+        return getattr(real_time, name)  # strftime, perf_counter, ...
+
+
+class ReplayCommander(RobotCommander):
+    """
+    Commander whose commands take the recorded round-trip times on the virtual clock
+
+    Round trips are taken from the log's COMMAND records in order (so an
+    unchanged replay sees the same smoothed rtt as the run did), then the
+    median once they run out. Blocking, like RobotCommander, or pipelined
+    like AsyncRobotCommander: pulse() then returns at once with the pulse
+    planned into command_history, replaced by the acknowledged timing once
+    the clock passes the stop's acknowledgement.
+    """
+
+    def __init__(self, clock, rtts, pulse_duration, asynchronous=False, max_pending=2):
+        super().__init__('http://replay', pulse_duration)
+        self.clock = clock
+        self.recorded_rtts = rtts
+        self.median_rtt = statistics.median(rtts) if rtts else 0.03
+        self.asynchronous = asynchronous
+        self.max_pending = max_pending
+        self.in_flight = []  # (planned, executed, stop acknowledgement) of queued pulses and stops
+        self.acks = []  # (acknowledgement time, rtt) of queued commands
+        self.busy_until = 0.0
+
+    def _next_rtt(self):
+        if self.commands_sent < len(self.recorded_rtts):
+            rtt = self.recorded_rtts[self.commands_sent]
+        else:
+            rtt = self.median_rtt
+        self.commands_sent += 1
+        return rtt
+
+    def _sent(self, command, sent, rtt):
+        """Called for every command with its send time and round trip"""
+        self._log_command(self.commands_sent, command, sent, sent + rtt, True)
+
+    def send_command(self, command):
+        rtt = self._next_rtt()
+        self._sent(command, self.clock.time(), rtt)
+        self.clock.sleep(rtt)
+        self.last_command = command
+        self.last_command_time = self.clock.time()
+        self._record_rtt(rtt)
+        return True
+
+    def next_execution_time(self):
+        if not self.asynchronous:
+            return super().next_execution_time()
+        return max(self.clock.time() + self.rtt / 2, self.busy_until)
+
+    def update(self):
+        """Apply the acknowledgements the clock has passed, as the async worker would"""
+        while self.acks and self.acks[0][0] <= self.clock.time():
+            self._record_rtt(self.acks.pop(0)[1])
+        while self.in_flight and self.in_flight[0][2] <= self.clock.time():
+            planned, executed, acked = self.in_flight.pop(0)
+            if planned is not None:
+                command, go_acked, _ = executed
+                actual = (command, go_acked - self.rtt / 2, acked - self.rtt / 2)
+                try:
+                    self.command_history[self.command_history.index(planned)] = actual
+                except ValueError:
+                    self.command_history.append(actual)
+            if not self.in_flight:
+                self.last_command_end = acked
+
+    def pulse(self, command, duration=None):
+        if not self.asynchronous:
+            return super().pulse(command, duration)
+        if duration is None:
+            duration = self.pulse_duration
+        self.update()
+        if command == "stop":
+            # Queued behind the pulses in flight, as AsyncRobotCommander does
+            sent = self.in_flight[-1][2] if self.in_flight else self.clock.time()
+            rtt = self._next_rtt()
+            self._sent(command, sent, rtt)
+            self.acks.append((sent + rtt, rtt))
+            self.in_flight.append((None, None, sent + rtt))
+            return True
+        pulses = [acked for planned, _, acked in self.in_flight if planned is not None]
+        if len(pulses) >= self.max_pending:
+            self.clock.now = max(self.clock.now, pulses[0])
+            self.update()
+        start = self.next_execution_time()
+        planned = (command, start, start + duration + self.rtt)
+        self.command_history.append(planned)
+        self.busy_until = self.last_command_end = planned[2]
+
+        # The worker sends go once the queue ahead of it drains, then stop
+        # `duration` after go's acknowledgement
+        sent = self.in_flight[-1][2] if self.in_flight else self.clock.time()
+        go_rtt, stop_rtt = self._next_rtt(), self._next_rtt()
+        go_acked = sent + go_rtt
+        stop_acked = go_acked + duration + stop_rtt
+        self._sent(command, sent, go_rtt)
+        self._sent("stop", go_acked + duration, stop_rtt)
+        self.acks += [(go_acked, go_rtt), (stop_acked, stop_rtt)]
+        self.in_flight.append((planned, (command, go_acked, stop_acked), stop_acked))
+        self.last_command = "stop"
+        return True
+
+    def idle_at(self):
+        """When the queued pulses and stops will all have been acknowledged"""
+        self.update()
+        return self.in_flight[-1][2] if self.in_flight else self.clock.time()
+
+    def wait_idle(self, timeout=None):
+        self.clock.now = max(self.clock.now, self.idle_at())
+        self.update()
+        return True
+
+    def stop(self):
+        if self.asynchronous:
+            for planned, _, _ in self.in_flight:
+                if planned is None:
+                    continue
+                try:
+                    self.command_history.remove(planned)
+                except ValueError:
+                    pass
+            self.in_flight = []
+            self.acks = []
+            self.busy_until = 0.0
+        self.send_command("stop")
+        self.last_command_end = self.clock.time()
+
+
+def parse_value(text):
+    try:
+        return json.loads(text)
+    except ValueError:
+        return text
+
+
+class VirtualControlLoop:
+    """
+    CarAgent.control_loop on a virtual clock, driven by a stream of events
+
+    Events are (type, car, time, payload) as in a run log, in time order;
+    between them the loop steps, waits for fresh poses and times out
+    exactly as the live loop would, with the agent's commander advancing
+    the clock. Used by Replayer and by simulator.py's headless mode.
+    """
+
+    def __init__(self, agent, clock):
+        self.agent = agent
+        self.clock = clock
+        self.steps = []  # (time, pose timestamp, pulse, state, iteration, compute ms)
+        self.step_times = {}  # pose timestamp -> earliest step time
+        self.run_starts = []  # when runs started after a target or path arrived
+        self.start_at = 0.0
+        self.wait_start = None
+        self.fresh_after = None
+        self.idle = False  # last step issued no pulse; wait for the next event
+        self.wake_at = None  # when queued pulses finish, if the loop waits for them
+
+    @property
+    def active(self):
+        return self.agent.controller.state in (ControlState.ROTATING, ControlState.MOVING)
+
+    def _start_run(self, t):
+        self.wait_start = t
+        self.fresh_after = None
+        self.start_at = next((start for start in self.run_starts if t <= start < t + 0.5), t)
+
+    def deliver(self, kind, t, payload):
+        agent = self.agent
+        if kind == run_log.POSE:
+            agent.pose_client.handle_record(json.loads(payload), t)
+        elif kind == run_log.DETECTIONS:
+            request_time = struct.unpack('<d', payload[:8])[0]
+            agent.pose_client.handle_detections(json.loads(payload[8:]), request_time)
+        elif kind == run_log.CLOCK:
+            agent.pose_client.clock_offset = payload['offset']
+        elif kind == run_log.TARGET:
+            agent.controller.set_target(payload['x'], payload['y'])
+            self._start_run(t)
+        elif kind == run_log.PATH:
+            if payload.get('update'):
+                agent.controller.update_path(payload['path'])
+            else:
+                agent.controller.set_path(payload['path'])
+                self._start_run(t)
+        elif kind == run_log.CANCEL:
+            agent.controller.cancel()
+            agent.robot.stop()
+        else:
+            return
+        self.idle = False
+
+    def step(self, pose, measured=True):
+        """One control step on the virtual clock, as CarAgent.control_loop would take it"""
+        recorded = self.step_times.get(round(pose.timestamp, 6))
+        if recorded is not None and self.clock.now < recorded < self.clock.now + 0.2:
+            self.clock.now = recorded
+            self.agent.robot.update()
+        start = real_time.perf_counter()
+        pulse = self.agent.controller.get_pulse(pose, measured)
+        compute_ms = (real_time.perf_counter() - start) * 1000
+        controller = self.agent.controller
+        self.steps.append((self.clock.now, pose.timestamp, pulse, controller.state.value,
+                           controller.iteration, compute_ms))
+        if controller.iteration == 1:
+            self.agent.pose_timeouts = 0
+        self.agent.log_step(pose, pulse)
+        if pulse:
+            self.agent.robot.pulse(*pulse)
+        else:
+            self.idle = True
+        self.wait_start = self.clock.now
+        self.fresh_after = None
+
+    def try_step(self):
+        """Step if the control loop would have a pose to act on now"""
+        if not self.active or self.idle or self.clock.now < self.start_at:
+            return False
+        robot, controller = self.agent.robot, self.agent.controller
+        robot.update()
+        self.wake_at = None
+        if controller.predictor is not None or self.agent.pose_client.tracker is not None:
+            # wait_idle(): the pose wait (and its timeout) starts once queued pulses are done
+            idle_at = robot.idle_at()
+            if idle_at > self.clock.now:
+                self.wake_at = self.wait_start = idle_at
+                return False
+        confirm = controller.awaiting_measurement
+        pose = None if confirm else self.agent.pose_client.get_estimate()
+        if pose is not None:
+            self.step(pose, measured=False)
+            return True
+        if self.fresh_after is None:
+            # Fixed when the loop starts waiting, like wait_for_pose's `after`
+            if controller.predictor is not None and not confirm:
+                self.fresh_after = self.clock.now - controller.settle_time
+            else:
+                self.fresh_after = robot.last_command_end
+        pose = self.agent.pose_client.get_latest()
+        if pose is None or pose.timestamp <= self.fresh_after:
+            return False
+        self.step(pose)
+        return True
+
+    def timeout_step(self):
+        """The pose wait timed out: act on the stale pose, as the live loop does"""
+        self.agent.robot.update()
+        pose = self.agent.pose_client.get_latest()
+        if pose is None:
+            self.clock.sleep(0.05)
+            self.wait_start = self.clock.now
+            return
+        if self.agent.robot.last_command_end > 0:
+            self.agent.pose_timeouts += 1
+        self.step(pose)
+
+    def run(self, events):
+        events = iter(events)
+        pending = next(events, None)
+        while True:
+            # Deliver what arrived while the loop was busy with a pulse, and
+            # the rest of a burst read from the stream in one chunk
+            while pending is not None and pending[2] <= self.clock.now + BURST:
+                self.deliver(pending[0], pending[2], pending[3])
+                pending = next(events, None)
+            if self.try_step():
+                continue
+            if pending is None and self.wake_at is None:
+                break
+            next_time = min(t for t in (pending and pending[2], self.wake_at) if t is not None)
+            if self.clock.now < self.start_at < next_time:
+                self.clock.now = self.start_at
+                continue
+            if self.active and not self.idle and self.wait_start is not None:
+                deadline = self.wait_start + self.agent.controller.settle_time
+                if deadline < next_time:
+                    self.clock.now = deadline
+                    self.timeout_step()
+                    continue
+            self.clock.now = next_time
+
+
+class Replayer(VirtualControlLoop):
+    """Runs one car's control loop over a run log's events"""
+
+    def __init__(self, events, car_index=0, overrides=None, predict=None, track=None, policy=None):
+        self.events = [e for e in events if e[1] in (car_index, run_log.NO_CAR)]
+        config = next((e[3] for e in events if e[0] == run_log.CONFIG), None)
+        if config is None:
+            raise ValueError("run log has no CONFIG record")
+        self.config = config['cars'][car_index]
+        self.car_index = car_index
+
+        self.command_rtts = [e[3]['acked'] - e[3]['sent'] for e in self.events
+                             if e[0] == run_log.COMMAND and e[3]['ok']]
+
+        clock = VirtualClock(self.events[0][2] if self.events else 0.0)
+        vcc.time = clock
+
+        cfg = self.config
+        agent = CarAgent('http://replay', 'http://replay', car_id=cfg['car_id'],
+                         front_keypoint=cfg['front_keypoint'],
+                         follow_paths=cfg['controller'] == 'PathFollowingController',
+                         async_commands=False)
+        agent.robot = ReplayCommander(clock, self.command_rtts, cfg['robot_pulse_duration'],
+                                      asynchronous=cfg.get('async_commands', False))
+        for name, value in dict(cfg['params'], **(overrides or {})).items():
+            if not hasattr(agent.controller, name):
+                raise ValueError(f"{type(agent.controller).__name__} has no parameter {name}")
+            setattr(agent.controller, name, value)
+
+        predict = cfg['predict'] if predict is None else predict
+        track = cfg['track'] if track is None else track
+        if predict:
+            agent.controller.predictor = PosePredictor(agent.robot, *predict)
+        if track:
+            agent.pose_client.tracker = PoseTracker(agent.robot, *track)
+        policy = cfg.get('policy') if policy is None else policy
+        if policy:
+            agent.controller.policy = policy if isinstance(policy, PulsePolicy) else PulsePolicy.from_dict(policy)
+        super().__init__(agent, clock)
+
+        self.recorded_steps = [(e[2], e[3]) for e in self.events if e[0] == run_log.STEP]
+        # The live loop's own overhead (the 0.1s idle poll for a new target,
+        # printing, the GIL) is not modelled; a step on the same pose as a
+        # recorded one is instead taken no earlier than the recorded one was
+        self.step_times = {round(step['pose_t'], 6): t for t, step in self.recorded_steps}
+        self.run_starts = [t for t, step in self.recorded_steps if step['iteration'] == 1]
+
+    def run(self):
+        super().run(self.events)
+
+    def compare(self):
+        """Replayed vs recorded decisions on the same poses"""
+        recorded = {round(step['pose_t'], 6): step for _, step in self.recorded_steps}
+        same_pose = same_command = 0
+        duration_diffs = []
+        for _, pose_t, pulse, _, _, _ in self.steps:
+            step = recorded.get(round(pose_t, 6))
+            if step is None:
+                continue
+            same_pose += 1
+            old = step['pulse']
+            if (old is None) == (pulse is None) and (pulse is None or old[0] == pulse[0]):
+                same_command += 1
+                if pulse is not None:
+                    duration_diffs.append(abs(old[1] - pulse[1]))
+        return same_pose, same_command, duration_diffs
+
+
+def export_video(events, filename, fps):
+    from recording import MjpegAviWriter
+    from mjpeg_stream import jpeg_size
+    writer = None
+    for kind, _, _, payload in events:
+        if kind != run_log.FRAME:
+            continue
+        if writer is None:
+            writer = MjpegAviWriter(filename, fps, jpeg_size(payload))
+        writer.write(payload)
+    if writer is None:
+        print("⚠️ Run log has no frames (record with --log-frames)")
+        return
+    writer.release()
+    print(f"🎞️ {writer.frames} frames written to {filename}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Replay a VizCar run log through the controller',
+                                     formatter_class=argparse.RawDescriptionHelpFormatter,
+                                     epilog=__doc__)
+    parser.add_argument('log', help='Run log written by video_client_controller.py --run-log')
+    parser.add_argument('--car', type=int, default=0, help='Index of the car in the fleet (default: 0)')
+    parser.add_argument('--set', action='append', default=[], metavar='NAME=VALUE',
+                        help='Override a controller parameter (repeatable)')
+    parser.add_argument('--predict', nargs=2, type=float, metavar=('PX_PER_S', 'DEG_PER_S'),
+                        help='Replay with latency prediction at these motion rates')
+    parser.add_argument('--no-predict', action='store_true', help='Replay without prediction')
+    parser.add_argument('--track', nargs=2, type=float, metavar=('PX_PER_S', 'DEG_PER_S'),
+                        help='Replay with the Kalman tracker at these motion rates')
+    parser.add_argument('--no-track', action='store_true', help='Replay without the tracker')
+    parser.add_argument('--pulse-model', type=str, default=None,
+                        help='Replay with pulse durations from pulse_policy.py')
+    parser.add_argument('--no-pulse-model', action='store_true', help='Replay with fixed pulse durations')
+    parser.add_argument('--steps', action='store_true', help='Print every replayed step')
+    parser.add_argument('--video', type=str, default=None, help='Write the logged frames to an MJPEG .avi')
+    parser.add_argument('--fps', type=float, default=30.0, help='Frame rate for --video (default: 30)')
+    args = parser.parse_args()
+
+    overrides = {}
+    for item in args.set:
+        name, _, value = item.partition('=')
+        overrides[name.strip()] = parse_value(value)
+    predict = [] if args.no_predict else (
+        [args.predict[0], math.radians(args.predict[1])] if args.predict else None)
+    track = [] if args.no_track else (
+        [args.track[0], math.radians(args.track[1])] if args.track else None)
+    policy = {} if args.no_pulse_model else (PulsePolicy.load(args.pulse_model) if args.pulse_model else None)
+
+    load_start = real_time.perf_counter()
+    events = sorted(read_run_log(args.log), key=lambda e: e[2])
+    load_s = real_time.perf_counter() - load_start
+    if args.video:
+        export_video(events, args.video, args.fps)
+
+    replayer = Replayer(events, args.car, overrides, predict, track, policy)
+    start = real_time.perf_counter()
+    replayer.run()
+    replay_s = real_time.perf_counter() - start
+
+    span = events[-1][2] - events[0][2] if events else 0.0
+    controller = replayer.agent.controller
+    print(f"📂 {args.log}: {len(events)} records over {span:.1f}s, loaded in {load_s * 1000:.0f}ms")
+    print(f"🎮 {replayer.config['controller']} (car {replayer.config['car_id']}), "
+          f"{'async' if replayer.agent.robot.asynchronous else 'blocking'} commands, "
+          f"median rtt {replayer.agent.robot.median_rtt * 1000:.0f}ms"
+          + (f", overrides {overrides}" if overrides else ""))
+    if controller.policy is not None:
+        print(f"🧠 Pulse policy: {controller.policy.describe()}")
+    if args.steps:
+        for t, pose_t, pulse, state, iteration, compute_ms in replayer.steps:
+            print(f"  {t - events[0][2]:8.3f}s #{iteration:<4} {state:<9} "
+                  f"{pulse[0] + f' {pulse[1]:.3f}s' if pulse else '-':<14} "
+                  f"pose age {(t - pose_t) * 1000:5.0f}ms  {compute_ms:.2f}ms")
+
+    recorded_final = replayer.recorded_steps[-1][1]['state'] if replayer.recorded_steps else '-'
+    print(f"📊 Recorded: {len(replayer.recorded_steps)} steps, final state {recorded_final}")
+    print(f"📊 Replayed: {len(replayer.steps)} steps, final state {controller.state.value}, "
+          f"{replayer.agent.pose_timeouts} pose timeouts")
+    same_pose, same_command, diffs = replayer.compare()
+    if same_pose:
+        print(f"🔁 Same pose as a recorded step: {same_pose}, same command {same_command} "
+              f"({same_command / same_pose:.0%})"
+              + (f", mean |Δduration| {statistics.mean(diffs) * 1000:.1f}ms" if diffs else ""))
+    compute = [s[5] for s in replayer.steps]
+    if compute:
+        print(f"⏱️ Replay {replay_s * 1000:.0f}ms ({span / replay_s:.0f}x real time), "
+              f"controller {statistics.mean(compute):.3f}ms/step (max {max(compute):.3f}ms)")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""
+Compact binary run log of the perception-control loop
+
+The controller (video_client_controller.py --run-log FILE) writes
+everything the control loop saw and did into one file, and replay.py
+feeds it back through PoseClient and the controllers offline.
+
+File layout: the magic b'VZRUN1\\n', then records of
+
+    type: u8 | car: u8 | time: f64 | length: u32 | payload
+
+little-endian, where time is the wall clock when the event happened here
+and car indexes the fleet (NO_CAR for shared events). Payloads are JSON
+except for FRAME (the JPEG as received) and POSE/DETECTIONS (the NN
+server's JSON as received, unparsed).
+"""
+
+import json
+import struct
+import threading
+
+MAGIC = b'VZRUN1\n'
+HEADER = struct.Struct('<BBdI')
+NO_CAR = 255
+
+# Record types
+CONFIG = 1       # {"cars": [{"car_id", "controller", "params", ...}], "transport", ...}
+FRAME = 2        # annotated frame from the NN server
+POSE = 3         # pushed /detections/stream record
+DETECTIONS = 4   # polled /detections response; payload prefixed by f64 request time
+CLOCK = 5        # {"offset"}: NN server clock offset
+COMMAND = 6      # {"seq", "command", "sent", "acked", "ok"}
+STEP = 7         # {"pose_t", "pulse", "state", "iteration"}: one control step
+TARGET = 8       # {"x", "y"}
+PATH = 9         # {"path", "update"?}: path_with_headings list; update: replanned mid-run
+CANCEL = 10      # {}
+
+NAMES = {CONFIG: 'config', FRAME: 'frame', POSE: 'pose', DETECTIONS: 'detections', CLOCK: 'clock',
+         COMMAND: 'command', STEP: 'step', TARGET: 'target', PATH: 'path', CANCEL: 'cancel'}
+
+
+class RunLog:
+    """Thread-safe writer; the stream, pose, command and control threads all log into one file"""
+
+    def __init__(self, filename):
+        self.filename = filename
+        self.file = open(filename, 'wb', buffering=1 << 20)
+        self.file.write(MAGIC)
+        self.lock = threading.Lock()
+        self.counts = {}
+
+    def write(self, kind, t, payload, car=NO_CAR):
+        if isinstance(payload, (dict, list)):
+            payload = json.dumps(payload, separators=(',', ':')).encode()
+        with self.lock:
+            if self.file is None:
+                return
+            self.file.write(HEADER.pack(kind, car, t, len(payload)))
+            self.file.write(payload)
+            self.counts[kind] = self.counts.get(kind, 0) + 1
+
+    def frame(self, t, jpeg):
+        self.write(FRAME, t, bytes(jpeg))
+
+    def detections(self, t, request_time, body, car=NO_CAR):
+        self.write(DETECTIONS, t, struct.pack('<d', request_time) + body, car)
+
+    def close(self):
+        with self.lock:
+            if self.file is not None:
+                self.file.close()
+                self.file = None
+
+    def summary(self):
+        return ", ".join(f"{count} {NAMES.get(kind, kind)}" for kind, count in sorted(self.counts.items()))
+
+
+def read_run_log(filename):
+    """Yield (type, car, time, payload) records; JSON payloads are parsed, others left as bytes"""
+    with open(filename, 'rb') as f:
+        if f.read(len(MAGIC)) != MAGIC:
+            raise ValueError(f"{filename} is not a VizCar run log")
+        while True:
+            header = f.read(HEADER.size)
+            if len(header) < HEADER.size:
+                return  # end of file, or a record cut short by a crash
+            kind, car, t, length = HEADER.unpack(header)
+            payload = f.read(length)
+            if len(payload) < length:
+                return
+            if kind in (FRAME, DETECTIONS, POSE):
+                yield kind, car, t, payload
+            else:
+                yield kind, car, t, json.loads(payload)
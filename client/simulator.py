@@ -0,0 +1,802 @@
+#!/usr/bin/env python3
+"""
+Kinematic VizCar simulator
+
+Simulates one or more differential-drive cars seen by an overhead camera,
+with motor lag, wheel slip, command latency and jitter, and detector
+latency, noise and dropout, and serves the real APIs in one process:
+
+  ESP32 firmware: /go /back /left /right /stop (?seq= echoed as X-Seq),
+                  /drive and /calib (calibrate.py) and /stream, the
+                  overhead view as the firmware's MJPEG stream
+  NN server:      /detections, /detections/stream, /video_feed, /stats, /health
+
+so the unmodified clients drive it (unlike test_server.py, which teleports
+one car on each command). Cars are picked by address on Linux,
+where all of 127/8 is loopback: car N answers at 127.0.0.(10+N), or at
+/car/N/<command> on any address.
+
+  python3 simulator.py --cars 2 --port 5001
+  python3 video_client_controller.py 127.0.0.1 0=127.0.0.10 1=127.0.0.11 --nn-port 5001 --robot-port 5001
+
+--headless instead runs the control loop in-process on a virtual clock
+(replay.py's VirtualControlLoop) against the same car model, as fast as
+the controller computes, and reports each run:
+
+  python3 simulator.py --headless --runs 50 --predict --latency 0.05 --dropout 0.1
+
+--compare runs the same seeds with the blocking and the async commander,
+each plain, with --predict and with --track (the async commander must not
+lose accuracy to either):
+
+  python3 simulator.py --compare --runs 20 --latency 0.05
+"""
+
+import argparse
+import bisect
+import contextlib
+import dataclasses
+import io
+import json
+import logging
+import math
+import os
+import queue
+import random
+import statistics
+import threading
+import time
+from dataclasses import dataclass
+from datetime import datetime
+
+import cv2
+import numpy as np
+from flask import Flask, Response, jsonify, request
+
+import video_client_controller as vcc
+from video_client_controller import (CarAgent, ControlState, PosePredictor, PoseTracker,
+                                     COMMAND_TWIST)
+from pulse_policy import PulsePolicy
+import run_log
+from replay import ReplayCommander, VirtualClock, VirtualControlLoop
+
+PART_BOUNDARY = "123456789000000000000987654321"  # as the firmware's stream
+FIRMWARE_SPEED = 150  # the firmware's `speed` duty
+
+# Signed (left, right) wheel duties of each firmware command, in units of
+# `speed`; positive drives a wheel's M1 pin. The right motor is mounted
+# mirrored, so "back" (+, -) drives both wheels toward the front marker.
+COMMAND_WHEELS = {
+    "go": (-1, 1),
+    "back": (1, -1),
+    "left": (1, 1),
+    "right": (-1, -1),
+    "stop": (0, 0),
+}
+
+
+def default_calibration():
+    """The firmware's MotorCalibration after calib_defaults(), as /calib returns it"""
+    return {'enabled': True, 'speed': FIRMWARE_SPEED, 'gain': [[1.0, 1.0], [1.0, 1.0]],
+            'deadband': [[0, 0], [0, 0]], 'rates': {'go': 0.0, 'back': 0.0, 'left': 0.0, 'right': 0.0}}
+
+
+def wheel_duty(calibration, wheel, duty):
+    """The firmware's wheel_duty(): calibration applied to a signed duty"""
+    if not calibration['enabled'] or duty == 0:
+        return duty
+    direction = 0 if duty > 0 else 1
+    deadband = calibration['deadband'][wheel][direction]
+    out = min(255, deadband + int(calibration['gain'][wheel][direction] * abs(duty) * (255 - deadband) / 255 + 0.5))
+    return out if duty > 0 else -out
+
+
+@dataclass
+class SimParams:
+    forward_speed: float = 150.0    # px/s driving
+    turn_rate: float = 90.0         # deg/s spinning in place
+    track_width: float = 30.0       # px between the wheel tracks
+    motor_lag: float = 0.06         # s, time constant of the wheel speeds
+    slip: float = 0.08              # std of each command's wheel speed gain
+    latency: float = 0.015          # s, one-way command latency
+    jitter: float = 0.01            # s, std of extra one-way latency (half-normal)
+    fps: float = 15.0               # camera frame rate
+    detect_latency: float = 0.08    # s, capture to published detection
+    detect_jitter: float = 0.015    # s, std of extra detection latency (half-normal)
+    noise: float = 2.0              # px, std of keypoint noise
+    dropout: float = 0.03           # probability a car is missed in a frame
+    marker_distance: float = 40.0   # px between the front and back keypoints
+    left_gain: float = 1.0          # left wheel response relative to a nominal wheel
+    right_gain: float = 1.0         # right wheel response relative to a nominal wheel
+    reverse_gain: float = 1.0       # response of a wheel driven on its M0 pin, relative to M1
+    deadband: float = 0.0           # PWM duty below which a wheel does not turn
+    width: int = 1280
+    height: int = 720
+    obstacles: int = 0              # furniture boxes in the camera view (not collided with)
+
+
+class SimCar:
+    """
+    One car: commands are scheduled at the time they reach it, and its
+    state is integrated lazily up to whatever time it is observed at
+
+    Commands become wheel duties as on the firmware, calibration included.
+    A wheel at duty d answers gain * (d - deadband) / (speed - deadband)
+    of its nominal speed, so with the default parameters each command
+    drives at forward_speed or turns at turn_rate.
+    """
+
+    def __init__(self, car_id, x, y, heading, params, rng):
+        self.car_id = car_id
+        self.x, self.y, self.heading = x, y, heading
+        self.params = params
+        self.rng = rng
+        self.t = None
+        self.left = self.right = 0.0          # wheel speeds, px/s
+        self.target = (0.0, 0.0)              # wheel speeds being approached
+        self.command = "stop"
+        self.schedule = []                    # (arrival time, send time, command, duties), by arrival
+        self.trail = []
+        self.calibration = default_calibration()
+
+    def send(self, command, at, sent=None, duties=None):
+        """Schedule a command, or raw (left, right) wheel duties with command "drive" """
+        if duties is None:
+            left, right = COMMAND_WHEELS.get(command, (0, 0))
+            duties = (wheel_duty(self.calibration, 0, left * FIRMWARE_SPEED),
+                      wheel_duty(self.calibration, 1, right * FIRMWARE_SPEED))
+        bisect.insort(self.schedule, (at, at if sent is None else sent, command, duties))
+
+    def cancel_sent_after(self, sent):
+        """Drop commands not sent yet (a client-side queue flush)"""
+        self.schedule = [entry for entry in self.schedule if entry[1] <= sent]
+
+    def _response(self, wheel, duty):
+        """Signed fraction of nominal speed a wheel turns at, toward the front marker"""
+        p = self.params
+        if duty == 0:
+            return 0.0
+        gain = (p.left_gain, p.right_gain)[wheel] * (1.0 if duty > 0 else p.reverse_gain)
+        response = gain * max(0.0, abs(duty) - p.deadband) / max(1.0, FIRMWARE_SPEED - p.deadband)
+        if wheel == 1:
+            duty = -duty  # mirrored motor
+        return response if duty > 0 else -response
+
+    def _apply(self, command, duties):
+        p = self.params
+        left, right = self._response(0, duties[0]), self._response(1, duties[1])
+        gain = max(0.0, 1.0 + self.rng.gauss(0.0, p.slip))
+        bias = self.rng.gauss(0.0, p.slip / 4)  # one side slipping more than the other
+        # Both wheels one way drive at forward_speed, opposite ways spin at turn_rate
+        v = (left + right) / 2 * p.forward_speed * gain
+        w = (right - left) / 2 * math.radians(p.turn_rate) * gain
+        self.target = ((v - w * p.track_width / 2) * (1 + bias),
+                       (v + w * p.track_width / 2) * (1 - bias))
+        self.command = command
+
+    def _integrate(self, dt):
+        p = self.params
+        while dt > 1e-9:
+            h = min(dt, 0.005)
+            decay = math.exp(-h / p.motor_lag) if p.motor_lag > 0 else 0.0
+            self.left = self.target[0] + (self.left - self.target[0]) * decay
+            self.right = self.target[1] + (self.right - self.target[1]) * decay
+            v = (self.left + self.right) / 2
+            w = (self.right - self.left) / p.track_width
+            mid = self.heading + w * h / 2
+            self.x = min(max(self.x + v * h * math.cos(mid), 0.0), p.width)
+            self.y = min(max(self.y + v * h * math.sin(mid), 0.0), p.height)
+            self.heading += w * h
+            dt -= h
+
+    def advance(self, t):
+        if self.t is None:
+            self.t = t
+        while self.schedule and self.schedule[0][0] <= t:
+            at, _, command, duties = self.schedule.pop(0)
+            self._integrate(at - self.t)
+            self.t = max(self.t, at)
+            self._apply(command, duties)
+            if command != "drive_end":
+                # Any command cancels the firmware's timer ending an earlier /drive
+                self.schedule = [entry for entry in self.schedule
+                                 if entry[2] != "drive_end" or entry[1] >= at]
+        self._integrate(t - self.t)
+        self.t = max(self.t, t)
+
+    def keypoints(self):
+        """(front, back) marker positions"""
+        half = self.params.marker_distance / 2
+        dx, dy = half * math.cos(self.heading), half * math.sin(self.heading)
+        return (self.x + dx, self.y + dy), (self.x - dx, self.y - dy)
+
+
+class SimWorld:
+    """The cars, the camera and the detector; thread-safe"""
+
+    def __init__(self, params, cars=1, seed=None, clock=time.time):
+        self.params = params
+        self.rng = random.Random(seed)
+        self.clock = clock
+        self.lock = threading.Lock()
+        columns = max(1, math.ceil(math.sqrt(cars)))
+        rows = math.ceil(cars / columns)
+        self.cars = []
+        for i in range(cars):
+            x = params.width * (i % columns + 0.5) / columns
+            y = params.height * (i // columns + 0.5) / rows
+            self.cars.append(SimCar(i, x, y, self.rng.uniform(-math.pi, math.pi), params,
+                                    random.Random(self.rng.random())))
+        # ((x, y), (w, h), degrees) boxes for grid_planner.py to route around,
+        # kept clear of the cars' starting spots
+        self.obstacles = []
+        while len(self.obstacles) < params.obstacles:
+            box = ((self.rng.uniform(0, params.width), self.rng.uniform(0, params.height)),
+                   (self.rng.uniform(60, 220), self.rng.uniform(40, 120)), self.rng.uniform(0, 180))
+            if all(math.hypot(box[0][0] - car.x, box[0][1] - car.y) > 150 for car in self.cars):
+                self.obstacles.append(box)
+
+    def one_way(self):
+        """A one-way network delay for a command or its response"""
+        return self.params.latency + abs(self.rng.gauss(0.0, self.params.jitter))
+
+    def detection_delay(self):
+        return self.params.detect_latency + abs(self.rng.gauss(0.0, self.params.detect_jitter))
+
+    def command(self, car_id, command, at=None, sent=None):
+        with self.lock:
+            self.cars[car_id].send(command, self.clock() if at is None else at, sent)
+
+    def drive(self, car_id, left, right, duration):
+        """Raw wheel duties for `duration` seconds, timed on the car"""
+        with self.lock:
+            car = self.cars[car_id]
+            at = self.clock()
+            car.send("drive", at, duties=(left, right))
+            if duration > 0:
+                car.send("drive_end", at + duration, sent=at)
+
+    def cancel_sent_after(self, car_id, sent):
+        with self.lock:
+            self.cars[car_id].cancel_sent_after(sent)
+
+    def observe(self, t):
+        """
+        Detect every car at capture time t: [[car_id, conf, x0, y0, c0, x1, y1, c1], ...]
+        with keypoint 0 the front marker, as in the NN server's push records
+        """
+        p = self.params
+        detections = []
+        with self.lock:
+            for car in self.cars:
+                car.advance(t)
+                car.trail.append((car.x, car.y))
+                del car.trail[:-300]
+                if self.rng.random() < p.dropout:
+                    continue
+                conf = round(min(0.99, self.rng.uniform(0.8, 0.97)), 3)
+                record = [car.car_id, conf]
+                for x, y in car.keypoints():
+                    record += [round(x + self.rng.gauss(0.0, p.noise), 1),
+                               round(y + self.rng.gauss(0.0, p.noise), 1), conf]
+                detections.append(record)
+        return detections
+
+    def render(self):
+        """Overhead view of the arena"""
+        p = self.params
+        frame = np.full((p.height, p.width, 3), 60, dtype=np.uint8)
+        for x in range(0, p.width, 80):
+            cv2.line(frame, (x, 0), (x, p.height), (75, 75, 75), 1)
+        for y in range(0, p.height, 80):
+            cv2.line(frame, (0, y), (p.width, y), (75, 75, 75), 1)
+        for box in self.obstacles:
+            cv2.fillPoly(frame, [np.int32(cv2.boxPoints(box))], (45, 95, 140))
+        with self.lock:
+            cars = [(car.car_id, car.x, car.y, car.heading, list(car.trail[-100:])) for car in self.cars]
+        for car_id, x, y, heading, trail in cars:
+            if len(trail) > 1:
+                cv2.polylines(frame, [np.int32(trail)], False, (90, 90, 90), 1)
+            box = cv2.boxPoints(((x, y), (p.marker_distance * 1.5, p.marker_distance), math.degrees(heading)))
+            cv2.fillPoly(frame, [np.int32(box)], (40, 40, 40))
+            half = p.marker_distance / 2
+            front = (int(x + half * math.cos(heading)), int(y + half * math.sin(heading)))
+            back = (int(x - half * math.cos(heading)), int(y - half * math.sin(heading)))
+            cv2.circle(frame, front, 8, (255, 120, 0), -1)
+            cv2.circle(frame, back, 8, (0, 0, 230), -1)
+        cv2.putText(frame, "VizCar simulator", (10, 25), cv2.FONT_HERSHEY_SIMPLEX, 0.7, (220, 220, 220), 2)
+        return frame
+
+
+# ---------------------------------------------------------------------------
+# HTTP servers
+# ---------------------------------------------------------------------------
+
+class SimServer:
+    """Runs the camera and detector in real time and publishes frames and pose records"""
+
+    def __init__(self, world, car_ip_base="127.0.0.10", jpeg_quality=80):
+        self.world = world
+        self.jpeg_quality = jpeg_quality
+        base = car_ip_base.rsplit('.', 1)
+        self.car_ips = {f"{base[0]}.{int(base[1]) + i}": i for i in range(len(world.cars))}
+
+        self.cond = threading.Condition()
+        self.frame_seq = 0
+        self.frame_jpeg = None       # overhead view, as the car's /stream
+        self.annotated_seq = 0
+        self.annotated_jpeg = None   # with detections, as the NN server's /video_feed
+        self.pose_seq = 0
+        self.pose_record = None
+        self.latest = None           # (capture time, detections) of the last published frame
+        self.detector_queue = queue.Queue(maxsize=4)
+        self.running = False
+        self.start_time = time.time()
+        self.fps = 0.0
+
+    def start(self):
+        self.running = True
+        threading.Thread(target=self._camera_loop, daemon=True).start()
+        threading.Thread(target=self._detector_loop, daemon=True).start()
+
+    def _encode(self, frame):
+        ok, buffer = cv2.imencode('.jpg', frame, [cv2.IMWRITE_JPEG_QUALITY, self.jpeg_quality])
+        return buffer.tobytes() if ok else None
+
+    def _camera_loop(self):
+        period = 1.0 / self.world.params.fps
+        next_frame = time.time()
+        while self.running:
+            next_frame += period
+            capture = time.time()
+            detections = self.world.observe(capture)
+            frame = self.world.render()
+            jpeg = self._encode(frame)
+            with self.cond:
+                self.frame_seq += 1
+                self.frame_jpeg = jpeg
+                self.cond.notify_all()
+            try:
+                self.detector_queue.put_nowait((self.frame_seq, capture, frame, detections))
+            except queue.Full:
+                pass  # detector behind; the real one drops frames too
+            time.sleep(max(0.0, next_frame - time.time()))
+
+    def _detector_loop(self):
+        last_publish = 0.0
+        while self.running:
+            src, capture, frame, detections = self.detector_queue.get()
+            publish = max(last_publish, capture + self.world.detection_delay())
+            time.sleep(max(0.0, publish - time.time()))
+            annotated = self._encode(self._annotate(frame, detections))
+            now = time.time()
+            if last_publish:
+                self.fps = 0.9 * self.fps + 0.1 / max(now - last_publish, 1e-3)
+            last_publish = now
+            with self.cond:
+                self.pose_seq += 1
+                self.pose_record = json.dumps({
+                    'seq': self.pose_seq, 'src': src, 'cap': round(capture, 4), 't': round(now, 4),
+                    'ms': round((now - capture) * 1000, 1), 'cars': detections
+                }, separators=(',', ':'))
+                self.latest = (src, capture, detections)
+                self.annotated_seq = self.pose_seq
+                self.annotated_jpeg = annotated
+                self.cond.notify_all()
+
+    @staticmethod
+    def _annotate(frame, detections):
+        frame = frame.copy()
+        for det in detections:
+            (fx, fy), (bx, by) = det[2:4], det[5:7]
+            cv2.line(frame, (int(bx), int(by)), (int(fx), int(fy)), (0, 255, 0), 2)
+            cv2.circle(frame, (int(fx), int(fy)), 5, (0, 255, 0), -1)
+            cv2.putText(frame, f"#{det[0]} {det[1]:.2f}", (int(fx) + 10, int(fy) - 10),
+                        cv2.FONT_HERSHEY_SIMPLEX, 0.5, (0, 255, 0), 1)
+        return frame
+
+    def wait(self, seq_name, value_name, after, timeout=1.0):
+        with self.cond:
+            self.cond.wait_for(lambda: getattr(self, seq_name) > after or not self.running, timeout)
+            return getattr(self, seq_name), getattr(self, value_name)
+
+    def car_for_request(self):
+        """Car addressed by the request's host, car 0 otherwise"""
+        return self.car_ips.get(request.host.rsplit(':', 1)[0], 0)
+
+
+def create_app(server):
+    app = Flask(__name__)
+    world = server.world
+
+    def drive(car_id, command):
+        if not 0 <= car_id < len(world.cars):
+            return jsonify({'error': f'no car {car_id}'}), 404
+        time.sleep(world.one_way())  # request on its way to the car
+        world.command(car_id, command)
+        time.sleep(world.one_way())  # response on its way back
+        response = Response("OK", mimetype='text/html')
+        seq = request.args.get('seq')
+        if seq is not None:
+            response.headers['X-Seq'] = seq
+        return response
+
+    for command in COMMAND_TWIST:
+        app.add_url_rule(f'/{command}', f'{command}',
+                         lambda command=command: drive(server.car_for_request(), command))
+        app.add_url_rule(f'/car/<int:car_id>/{command}', f'car_{command}',
+                         lambda car_id, command=command: drive(car_id, command))
+
+    def clamp(value, low, high, kind=int):
+        return min(max(kind(value), low), high)
+
+    @app.route('/drive')
+    @app.route('/car/<int:car_id>/drive')
+    def raw_drive(car_id=None):
+        """The firmware's /drive?l=&r=&ms=: raw wheel duties, stopped on the car after ms"""
+        car_id = server.car_for_request() if car_id is None else car_id
+        if not 0 <= car_id < len(world.cars):
+            return jsonify({'error': f'no car {car_id}'}), 404
+        left = clamp(request.args.get('l', 0), -255, 255)
+        right = clamp(request.args.get('r', 0), -255, 255)
+        ms = clamp(request.args.get('ms', 0), 0, 5000)
+        time.sleep(world.one_way())
+        world.drive(car_id, left, right, ms / 1000)
+        time.sleep(world.one_way())
+        response = Response("OK", mimetype='text/html')
+        if 'seq' in request.args:
+            response.headers['X-Seq'] = request.args['seq']
+        return response
+
+    @app.route('/calib')
+    @app.route('/car/<int:car_id>/calib')
+    def calib(car_id=None):
+        """The firmware's /calib: the motor calibration, changed by the query as there"""
+        car_id = server.car_for_request() if car_id is None else car_id
+        if not 0 <= car_id < len(world.cars):
+            return jsonify({'error': f'no car {car_id}'}), 404
+        with world.lock:
+            calibration = world.cars[car_id].calibration
+            if 'reset' in request.args:
+                calibration.update(default_calibration())
+            for wheel, keys in enumerate((('lf', 'lb'), ('rf', 'rb'))):
+                for direction, key in enumerate(keys):
+                    if key in request.args:
+                        gain, deadband = request.args[key].split(',')
+                        calibration['gain'][wheel][direction] = clamp(gain, 0.0, 2.0, float)
+                        calibration['deadband'][wheel][direction] = clamp(deadband, 0, 254)
+            if 'rates' in request.args:
+                calibration['rates'] = dict(zip(('go', 'back', 'left', 'right'),
+                                                map(float, request.args['rates'].split(','))))
+            if 'enable' in request.args:
+                calibration['enabled'] = request.args['enable'] != '0'
+            return jsonify(calibration)
+
+    def mjpeg(seq_name, value_name, boundary):
+        seq = 0
+        while server.running:
+            seq, jpeg = server.wait(seq_name, value_name, seq)
+            if jpeg is not None:
+                yield (f'\r\n--{boundary}\r\nContent-Type: image/jpeg\r\n'
+                       f'Content-Length: {len(jpeg)}\r\n\r\n').encode() + jpeg
+
+    @app.route('/stream')
+    @app.route('/car/<int:car_id>/stream')
+    def stream(car_id=0):
+        """The car's camera stream; here everyone sees the overhead view"""
+        return Response(mjpeg('frame_seq', 'frame_jpeg', PART_BOUNDARY),
+                        mimetype=f'multipart/x-mixed-replace;boundary={PART_BOUNDARY}')
+
+    @app.route('/video_feed')
+    def video_feed():
+        return Response(mjpeg('annotated_seq', 'annotated_jpeg', 'frame'),
+                        mimetype='multipart/x-mixed-replace; boundary=frame')
+
+    @app.route('/detections')
+    def detections():
+        latest = server.latest
+        if latest is None:
+            return jsonify({'error': 'No detections yet'}), 503
+        src, capture, cars = latest
+        return jsonify({
+            'timestamp': datetime.now().isoformat(),
+            'seq': server.pose_seq,
+            'source_seq': src,
+            'capture_time': capture,
+            'latency_ms': None,
+            'time': time.time(),
+            'detections': [{
+                'bbox': {'x1': min(c[2], c[5]) - 20, 'y1': min(c[3], c[6]) - 20,
+                         'x2': max(c[2], c[5]) + 20, 'y2': max(c[3], c[6]) + 20,
+                         'confidence': c[1]},
+                'class': 'Car', 'class_id': 0, 'car_id': c[0],
+                'keypoints': [{'name': 'keypoint_0', 'x': c[2], 'y': c[3], 'confidence': c[4]},
+                              {'name': 'keypoint_1', 'x': c[5], 'y': c[6], 'confidence': c[7]}]
+            } for c in cars],
+            'num_detections': len(cars),
+            'fps': server.fps,
+            'inference_ms': 0.0
+        })
+
+    @app.route('/detections/stream')
+    def detections_stream():
+        def events():
+            seq = server.pose_seq
+            while server.running:
+                seq, record = server.wait('pose_seq', 'pose_record', seq)
+                if record is None:
+                    yield ': keepalive\n\n'
+                    continue
+                yield f'id: {seq}\ndata: {record}\n\n'
+        return Response(events(), mimetype='text/event-stream',
+                        headers={'Cache-Control': 'no-cache', 'X-Accel-Buffering': 'no'})
+
+    @app.route('/stats')
+    def stats():
+        with world.lock:
+            cars = [{'car_id': car.car_id, 'x': round(car.x, 1), 'y': round(car.y, 1),
+                     'heading': round(math.degrees(car.heading), 1), 'command': car.command}
+                    for car in world.cars]
+        return jsonify({
+            'fps': server.fps,
+            'source_size': [world.params.width, world.params.height],
+            'time': time.time(),
+            'running': server.running,
+            'simulated': dataclasses.asdict(world.params),
+            'cars': cars
+        })
+
+    @app.route('/health')
+    def health():
+        return jsonify({'status': 'healthy', 'processor_running': server.running})
+
+    @app.route('/')
+    def index():
+        return jsonify({
+            'service': 'VizCar simulator',
+            'cars': {i: f'http://{ip}:{request.host.rsplit(":", 1)[-1]}' for ip, i in server.car_ips.items()},
+            'endpoints': {
+                'robot': ['/go', '/back', '/left', '/right', '/stop', '/drive', '/calib', '/stream',
+                          '/car/<id>/<command>'],
+                'nn_server': ['/detections', '/detections/stream', '/video_feed', '/stats', '/health']
+            }
+        })
+
+    return app
+
+
+# ---------------------------------------------------------------------------
+# Headless runs on a virtual clock
+# ---------------------------------------------------------------------------
+
+class SimCommander(ReplayCommander):
+    """Commander whose commands reach a SimWorld car after the simulated network delay"""
+
+    def __init__(self, clock, world, car_id, pulse_duration, asynchronous=False):
+        super().__init__(clock, [], pulse_duration, asynchronous)
+        self.world = world
+        self.car_id = car_id
+
+    def _next_rtt(self):
+        self.commands_sent += 1
+        return self.world.one_way() + self.world.one_way()
+
+    def _sent(self, command, sent, rtt):
+        super()._sent(command, sent, rtt)
+        self.world.command(self.car_id, command, at=sent + rtt / 2, sent=sent)
+
+    def stop(self):
+        self.world.cancel_sent_after(self.car_id, self.clock.time())
+        super().stop()
+
+
+class SimControlLoop(VirtualControlLoop):
+    """Control loop fed by the simulated detector instead of a log"""
+
+    def __init__(self, agent, clock, world):
+        super().__init__(agent, clock)
+        self.world = world
+        self.started = False
+
+    def deliver(self, kind, t, payload):
+        if kind == run_log.POSE:
+            seq, capture = payload
+            record = {'seq': seq, 'src': seq, 'cap': capture, 't': t,
+                      'ms': round((t - capture) * 1000, 1), 'cars': self.world.observe(capture)}
+            self.agent.pose_client.handle_record(record, t)
+            if self.agent.run_log is not None:
+                self.agent.run_log.write(run_log.POSE, t, record, self.agent.log_index)
+            self.idle = False
+            return
+        if kind in (run_log.TARGET, run_log.PATH):
+            self.started = True
+            if self.agent.run_log is not None:
+                self.agent.run_log.write(kind, t, payload, self.agent.log_index)
+        super().deliver(kind, t, payload)
+
+    def events(self, start_event, time_limit):
+        """Detector output every camera frame, with start_event once the first poses are in"""
+        params = self.world.params
+        seq, last_delivery, started = 0, 0.0, False
+        while True:
+            seq += 1
+            capture = seq / params.fps
+            if not started and capture >= start_event[2]:
+                started = True
+                yield start_event
+            if capture > time_limit or (self.started and not self.active):
+                return
+            last_delivery = max(last_delivery, capture + self.world.detection_delay())
+            yield run_log.POSE, 0, last_delivery, (seq, capture)
+
+
+def run_headless(params, seed, args):
+    """Drive one car to a random target; returns a result dict"""
+    clock = VirtualClock(0.0)
+    vcc.time = clock
+    world = SimWorld(params, cars=1, seed=seed, clock=clock.time)
+    car = world.cars[0]
+    rng = random.Random(seed)
+    margin = 80
+    while True:
+        target = (rng.uniform(margin, params.width - margin), rng.uniform(margin, params.height - margin))
+        if math.hypot(target[0] - car.x, target[1] - car.y) > args.min_distance:
+            break
+
+    agent = CarAgent('http://sim', 'http://sim', car_id=0, async_commands=False)
+    agent.robot = SimCommander(clock, world, 0, args.pulse_duration,
+                               asynchronous=not args.blocking_commands)
+    controller = agent.controller
+    controller.arrival_threshold = args.arrival_threshold
+    controller.heading_threshold = math.radians(args.heading_threshold)
+    controller.pulse_duration = args.pulse_duration
+    controller.settle_time = args.settle_time
+    controller.max_iterations = args.max_iterations
+    if args.predict:
+        controller.predictor = PosePredictor(agent.robot, params.forward_speed, math.radians(params.turn_rate))
+    if args.track:
+        agent.pose_client.tracker = PoseTracker(agent.robot, params.forward_speed, math.radians(params.turn_rate))
+    controller.policy = args.policy
+    log = None
+    if args.run_log:
+        root, ext = os.path.splitext(args.run_log)
+        log = run_log.RunLog(f"{root}_{seed}{ext}" if args.runs > 1 else args.run_log)
+        agent.attach_log(log, 0)
+        log.write(run_log.CONFIG, clock.now, {'cars': [agent.log_config()], 'transport': 'push',
+                                              'frames': False, 'simulated': dataclasses.asdict(params)})
+
+    loop = SimControlLoop(agent, clock, world)
+    start = (run_log.TARGET, 0, 1.0, {'x': target[0], 'y': target[1]})
+    wall_start = time.perf_counter()
+    with contextlib.redirect_stdout(io.StringIO()):
+        loop.run(loop.events(start, args.time_limit))
+    wall = time.perf_counter() - wall_start
+    if log is not None:
+        log.close()
+
+    car.advance(clock.now)
+    front, _ = car.keypoints()
+    return {
+        'seed': seed,
+        'state': controller.state.value,
+        'iterations': controller.iteration,
+        'sim_time': (loop.steps[-1][0] if loop.steps else clock.now) - start[2],
+        'error': math.hypot(front[0] - target[0], front[1] - target[1]),
+        'timeouts': agent.pose_timeouts,
+        'wall': wall
+    }
+
+
+def headless(params, args):
+    args.policy = PulsePolicy.load(args.pulse_model) if args.pulse_model else None
+    if args.policy is not None:
+        print(f"🧠 Pulse policy: {args.policy.describe()}")
+    results = []
+    print(f"{'seed':>6} {'result':>8} {'iters':>6} {'sim s':>7} {'error px':>9} {'timeouts':>9} {'wall ms':>8}")
+    for run in range(args.runs):
+        result = run_headless(params, args.seed + run, args)
+        results.append(result)
+        print(f"{result['seed']:>6} {result['state']:>8} {result['iterations']:>6} {result['sim_time']:>7.1f} "
+              f"{result['error']:>9.1f} {result['timeouts']:>9} {result['wall'] * 1000:>8.1f}")
+    ok = [r for r in results if r['state'] == ControlState.SUCCESS.value]
+    sim_total = sum(r['sim_time'] for r in results)
+    wall_total = sum(r['wall'] for r in results)
+    print("-" * 60)
+    print(f"📊 {len(ok)}/{len(results)} reached the target")
+    if ok:
+        print(f"⏱️ Time to target: mean {statistics.mean(r['sim_time'] for r in ok):.1f}s, "
+              f"iterations mean {statistics.mean(r['iterations'] for r in ok):.0f}, "
+              f"final error mean {statistics.mean(r['error'] for r in ok):.1f}px")
+    if wall_total > 0:
+        print(f"🚀 {sim_total:.0f}s simulated in {wall_total:.2f}s ({sim_total / wall_total:.0f}x real time)")
+
+
+# (label, blocking commands, predict, track) of each --compare configuration
+COMPARE_MODES = [
+    ('blocking', True, False, False),
+    ('async', False, False, False),
+    ('blocking+predict', True, True, False),
+    ('async+predict', False, True, False),
+    ('blocking+track', True, False, True),
+    ('async+track', False, False, True),
+]
+
+
+def compare(params, args):
+    """Same seeds under each commander and latency compensation combination"""
+    args.policy = PulsePolicy.load(args.pulse_model) if args.pulse_model else None
+    print(f"{args.runs} runs per mode, seeds {args.seed}-{args.seed + args.runs - 1}, "
+          f"arrival threshold {args.arrival_threshold:g}px")
+    print(f"{'mode':<18} {'reached':>8} {'sim s':>7} {'iters':>6} {'error px':>9} {'max px':>7} {'timeouts':>9}")
+    for label, blocking, predict, track in COMPARE_MODES:
+        args.blocking_commands, args.predict, args.track = blocking, predict, track
+        results = [run_headless(params, args.seed + run, args) for run in range(args.runs)]
+        ok = [r for r in results if r['state'] == ControlState.SUCCESS.value]
+        print(f"{label:<18} {len(ok):>4}/{len(results):<3} "
+              f"{statistics.mean(r['sim_time'] for r in results):>7.1f} "
+              f"{statistics.mean(r['iterations'] for r in results):>6.0f} "
+              f"{statistics.mean(r['error'] for r in results):>9.1f} "
+              f"{max(r['error'] for r in results):>7.1f} "
+              f"{sum(r['timeouts'] for r in results):>9}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Kinematic VizCar simulator (ESP32 + NN server APIs)',
+                                     formatter_class=argparse.RawDescriptionHelpFormatter,
+                                     epilog=__doc__)
+    parser.add_argument('--cars', type=int, default=1, help='Number of cars (default: 1)')
+    parser.add_argument('--host', type=str, default='0.0.0.0', help='Bind address (default: 0.0.0.0)')
+    parser.add_argument('--port', type=int, default=5001, help='Port for both APIs (default: 5001)')
+    parser.add_argument('--car-ip-base', type=str, default='127.0.0.10',
+                        help='Car N answers at this address + N (default: 127.0.0.10)')
+    parser.add_argument('--seed', type=int, default=1, help='Random seed (default: 1)')
+
+    group = parser.add_argument_group('car, network and detector model')
+    for field in dataclasses.fields(SimParams):
+        group.add_argument(f"--{field.name.replace('_', '-')}", type=field.type, default=field.default,
+                           help=f"(default: {field.default})")
+
+    group = parser.add_argument_group('headless runs')
+    group.add_argument('--headless', action='store_true', help='Run the controller in-process on a virtual clock')
+    group.add_argument('--runs', type=int, default=20, help='Number of runs (default: 20)')
+    group.add_argument('--min-distance', type=float, default=300.0, help='Minimum target distance in px (default: 300)')
+    group.add_argument('--time-limit', type=float, default=300.0, help='Simulated seconds per run (default: 300)')
+    group.add_argument('--arrival-threshold', type=float, default=30.0)
+    group.add_argument('--heading-threshold', type=float, default=8.0, help='Degrees (default: 8)')
+    group.add_argument('--pulse-duration', type=float, default=0.20)
+    group.add_argument('--settle-time', type=float, default=5.0)
+    group.add_argument('--max-iterations', type=int, default=500)
+    group.add_argument('--predict', action='store_true', help='Latency prediction at the simulated rates')
+    group.add_argument('--track', action='store_true', help='Kalman tracker at the simulated rates')
+    group.add_argument('--blocking-commands', action='store_true', help='Blocking commander instead of the async one')
+    group.add_argument('--compare', action='store_true',
+                       help='Run the same seeds with blocking and async commands, each plain, '
+                            'with --predict and with --track, and tabulate')
+    group.add_argument('--pulse-model', type=str, default=None, help='Pulse durations from pulse_policy.py')
+    group.add_argument('--run-log', type=str, default=None,
+                       help='Log each run for replay.py and pulse_policy.py (FILE_<seed>.ext with several runs)')
+    args = parser.parse_args()
+
+    params = SimParams(**{field.name: getattr(args, field.name) for field in dataclasses.fields(SimParams)})
+    if args.compare:
+        compare(params, args)
+        return
+    if args.headless:
+        headless(params, args)
+        return
+
+    world = SimWorld(params, cars=args.cars, seed=args.seed)
+    server = SimServer(world, car_ip_base=args.car_ip_base)
+    server.start()
+    print("=" * 60)
+    print(f"🚗 VizCar simulator: {args.cars} car(s) on {args.host}:{args.port}")
+    for ip, car_id in server.car_ips.items():
+        print(f"🎮 Car #{car_id}: http://{ip}:{args.port} (or /car/{car_id}/...)")
+    print(f"📡 NN server API: http://127.0.0.1:{args.port}/detections/stream")
+    print("=" * 60)
+    logging.getLogger('werkzeug').setLevel(logging.WARNING)  # one line per command otherwise
+    create_app(server).run(host=args.host, port=args.port, threaded=True)
+
+
+if __name__ == '__main__':
+    main()
@@ -6,13 +6,14 @@ Connects via Tailscale network with recording capabilities
 
 import cv2
 import requests
-import numpy as np
 import threading
 import queue
 import time
 import argparse
 import os
 from datetime import datetime
+from mjpeg_stream import MjpegStream
+from recording import Recorder
 
 class VideoStreamClient:
     def __init__(self, server_url):
@@ -21,12 +22,13 @@ class VideoStreamClient:
         self.running = False
         self.stream_thread = None
         
-        # Recording variables
+        # Recording variables: frames are written by a Recorder thread
         self.recording = False
-        self.video_writer = None
+        self.recorder = None
+        self.record_raw = False  # store the server's JPEGs in an AVI instead of encoding mp4
+        self.stream = None
         self.recording_filename = None
         self.recording_start_time = None
-        self.frames_recorded = 0
         
         # Video settings
         self.fps = 30.0
@@ -47,49 +49,35 @@ class VideoStreamClient:
     def fetch_frames(self):
         """Fetch frames from MJPEG stream"""
         try:
-            response = requests.get(
-                f"{self.server_url}/video_feed", 
-                stream=True, 
-                timeout=10
-            )
-            
-            if response.status_code != 200:
-                print(f"Error: HTTP {response.status_code}")
+            stream = MjpegStream(f"{self.server_url}/video_feed")
+            self.stream = stream
+            if self.recorder is not None and self.record_raw:
+                stream.jpeg_sink = self.recorder.write_jpeg
+            try:
+                stream.open()
+            except ConnectionError as e:
+                print(f"Error: {e}")
                 return
-                
-            bytes_data = b''
             
-            for chunk in response.iter_content(chunk_size=1024):
+            # Frames come from the decoder's buffer pool (8 deep), which
+            # covers the 5-frame queue plus the one being shown
+            for frame, _, _ in stream:
                 if not self.running:
                     break
                     
-                bytes_data += chunk
+                # Store frame dimensions on first frame
+                if self.frame_width == 1280:  # Default value
+                    self.frame_height, self.frame_width = frame.shape[:2]
                 
-                start = bytes_data.find(b'\xff\xd8')  # JPEG start
-                end = bytes_data.find(b'\xff\xd9')    # JPEG end
-                
-                if start != -1 and end != -1 and start < end:
-                    jpg_data = bytes_data[start:end + 2]
-                    bytes_data = bytes_data[end + 2:]
-                    
-                    frame = cv2.imdecode(
-                        np.frombuffer(jpg_data, dtype=np.uint8), 
-                        cv2.IMREAD_COLOR
-                    )
-                    
-                    if frame is not None:
-                        # Store frame dimensions on first frame
-                        if self.frame_width == 1280:  # Default value
-                            self.frame_height, self.frame_width = frame.shape[:2]
-                        
-                        try:
-                            self.frame_queue.put(frame, block=False)
-                        except queue.Full:
-                            try:
-                                self.frame_queue.get_nowait()  # Remove oldest frame
-                                self.frame_queue.put(frame, block=False)
-                            except queue.Empty:
-                                pass
+                try:
+                    self.frame_queue.put(frame, block=False)
+                except queue.Full:
+                    try:
+                        self.frame_queue.get_nowait()  # Remove oldest frame
+                        self.frame_queue.put(frame, block=False)
+                    except queue.Empty:
+                        pass
+            stream.close()
                                 
         except Exception as e:
             print(f"Error fetching frames: {e}")
@@ -102,29 +90,27 @@ class VideoStreamClient:
         
         if filename is None:
             timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
-            filename = f"vizcar_recording_{timestamp}.mp4"
+            filename = f"vizcar_recording_{timestamp}.{'avi' if self.record_raw else 'mp4'}"
         
         self.recording_filename = filename
         
-        # Create video writer with H.264 codec
-        fourcc = cv2.VideoWriter_fourcc(*'mp4v')  # or 'XVID' for .avi files
-        self.video_writer = cv2.VideoWriter(
-            filename, 
-            fourcc, 
-            self.fps, 
-            (self.frame_width, self.frame_height)
-        )
-        
-        if not self.video_writer.isOpened():
-            print(f"❌ Failed to create video writer for {filename}")
+        # Raw mode takes the JPEGs straight from the stream thread; otherwise
+        # decoded frames are queued from the display loop (write_frame)
+        try:
+            self.recorder = Recorder(filename, fps=self.fps, raw=self.record_raw).start()
+        except IOError as e:
+            print(f"❌ Failed to create video writer: {e}")
+            self.recorder = None
             return False
+        if self.record_raw and self.stream is not None:
+            self.stream.jpeg_sink = self.recorder.write_jpeg
         
         self.recording = True
         self.recording_start_time = time.time()
-        self.frames_recorded = 0
         
         print(f"🔴 Started recording to: {filename}")
-        print(f"📐 Resolution: {self.frame_width}x{self.frame_height} @ {self.fps} FPS")
+        print(f"📐 Resolution: {self.frame_width}x{self.frame_height} @ {self.fps} FPS"
+              f"{' (raw MJPEG)' if self.record_raw else ''}")
         return True
     
     def stop_recording(self):
@@ -134,26 +120,27 @@ class VideoStreamClient:
             return False
         
         self.recording = False
+        if self.stream is not None:
+            self.stream.jpeg_sink = None
         
-        if self.video_writer:
-            self.video_writer.release()
-            self.video_writer = None
+        recorder = self.recorder
+        recorder.stop()
+        self.recorder = None
         
         recording_duration = time.time() - self.recording_start_time
-        file_size = os.path.getsize(self.recording_filename) / (1024 * 1024)  # MB
+        file_size = sum(os.path.getsize(f) for f in recorder.files if os.path.exists(f)) / (1024 * 1024)  # MB
         
-        print(f"⏹️  Recording stopped: {self.recording_filename}")
+        print(f"⏹️  Recording stopped: {', '.join(recorder.files) or self.recording_filename}")
         print(f"⏱️  Duration: {recording_duration:.1f} seconds")
-        print(f"🎞️  Frames recorded: {self.frames_recorded}")
+        print(f"🎞️  Frames: {recorder.summary()}")
         print(f"📁 File size: {file_size:.1f} MB")
         
         return True
     
     def write_frame(self, frame):
-        """Write frame to video file if recording"""
-        if self.recording and self.video_writer:
-            self.video_writer.write(frame)
-            self.frames_recorded += 1
+        """Queue frame for the recorder if recording (raw recordings are fed by the stream)"""
+        if self.recording and not self.record_raw:
+            self.recorder.write(frame)
     
     def get_recording_info(self):
         """Get current recording information"""
@@ -161,7 +148,10 @@ class VideoStreamClient:
             return "Not recording"
         
         duration = time.time() - self.recording_start_time
-        return f"Recording: {duration:.0f}s | Frames: {self.frames_recorded}"
+        info = f"Recording: {duration:.0f}s | Frames: {self.recorder.frames_written}"
+        if self.recorder.frames_dropped:
+            info += f" | Dropped: {self.recorder.frames_dropped}"
+        return info
     
     def start_streaming(self):
         """Start video streaming with recording support"""
@@ -306,6 +296,11 @@ def main():
         type=float, 
         help='Recording FPS (default: 30.0)'
     )
+    parser.add_argument(
+        '--raw',
+        action='store_true',
+        help="Record the server's JPEGs into an MJPEG .avi as received, without decoding or re-encoding"
+    )
     parser.add_argument(
         '--auto-record', 
         action='store_true', 
@@ -320,6 +315,7 @@ def main():
     
     client = VideoStreamClient(server_url)
     client.fps = args.fps
+    client.record_raw = args.raw
     
     try:
         # Auto-start recording if requested
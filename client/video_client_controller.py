@@ -20,12 +20,19 @@ import queue
 import time
 import argparse
 import math
+import json
+from concurrent.futures import CancelledError, Future
 from datetime import datetime
 from dataclasses import dataclass, field
-from typing import Optional, Tuple, List
+from typing import Optional, Tuple, List, Dict, Union
 from enum import Enum
 from collections import deque
 
+from mjpeg_stream import MjpegStream, estimate_clock_offset
+from recording import Recorder
+import run_log
+import path_codec
+
 class ControlState(Enum):
     IDLE = "IDLE"
     ROTATING = "ROTATING"
@@ -78,6 +85,70 @@ def normalize_angle(angle: float) -> float:
     return angle
 
 
+# Motion produced by each robot command as (forward, turn) unit rates.
+# "back" drives toward the front marker on this chassis, and positive turn
+# is clockwise in image coordinates (same convention as heading error).
+COMMAND_TWIST = {
+    "back": (1.0, 0.0),
+    "go": (-1.0, 0.0),
+    "right": (0.0, 1.0),
+    "left": (0.0, -1.0),
+    "stop": (0.0, 0.0),
+}
+
+
+def move_pose(pose: RobotPose, distance: float, rotation: float,
+              timestamp: Optional[float] = None) -> RobotPose:
+    """Rotate a pose about its center by `rotation`, then drive `distance` along the new heading"""
+    cx, cy = pose.center
+    half_length = math.hypot(pose.front_x - pose.back_x, pose.front_y - pose.back_y) / 2
+    heading = pose.heading + rotation
+    cx += distance * math.cos(heading)
+    cy += distance * math.sin(heading)
+    dx = half_length * math.cos(heading)
+    dy = half_length * math.sin(heading)
+    return RobotPose(
+        front_x=cx + dx, front_y=cy + dy,
+        back_x=cx - dx, back_y=cy - dy,
+        timestamp=pose.timestamp if timestamp is None else timestamp
+    )
+
+
+class PosePredictor:
+    """
+    Projects a (stale) pose forward to the time the next command executes.
+    
+    The pose timestamp is its capture time, so every pulse the robot executed
+    since then is replayed through a constant-rate motion model, and the
+    projection extends to now plus half the measured command round trip.
+    """
+    
+    def __init__(self, commander: 'RobotCommander',
+                 forward_speed: float = 150.0,   # pixels per second while driving
+                 turn_rate: float = math.pi / 2):  # radians per second while rotating
+        self.commander = commander
+        self.forward_speed = forward_speed
+        self.turn_rate = turn_rate
+    
+    def predict(self, pose: RobotPose, at_time: Optional[float] = None) -> RobotPose:
+        """Return the expected pose at `at_time` (default: when a command sent now executes)"""
+        if at_time is None:
+            at_time = self.commander.next_execution_time()
+        
+        predicted = pose
+        for command, start, end in list(self.commander.command_history):
+            overlap = min(end, at_time) - max(start, pose.timestamp)
+            if overlap <= 0:
+                continue
+            forward, turn = COMMAND_TWIST.get(command, (0.0, 0.0))
+            predicted = move_pose(predicted,
+                                  forward * self.forward_speed * overlap,
+                                  turn * self.turn_rate * overlap)
+        
+        return RobotPose(predicted.front_x, predicted.front_y,
+                         predicted.back_x, predicted.back_y, timestamp=at_time)
+
+
 class PathPlanningController:
     """
     Two-phase path planning controller:
@@ -91,7 +162,7 @@ class PathPlanningController:
                  max_iterations: int = 500,            # k_max
                  max_rotation_steps: int = 50,         # max steps in single rotation phase
                  pulse_duration: float = 0.20,         # seconds - motor pulse duration (200ms)
-                 settle_time: float = 5.0):            # seconds - time to wait for new pose after pulse
+                 settle_time: float = 5.0):            # seconds - max wait for a fresh pose after a pulse
         
         self.arrival_threshold = arrival_threshold  # ρ
         self.heading_threshold = heading_threshold  # ε_θ
@@ -105,6 +176,22 @@ class PathPlanningController:
         self.target: Optional[Tuple[float, float]] = None
         self.iteration = 0
         self.rotation_steps = 0
+        self.run_start_time = 0.0
+        
+        # Optional latency compensation (see PosePredictor)
+        self.predictor: Optional[PosePredictor] = None
+        
+        # Optional pulse durations fitted from run logs (see pulse_policy.PulsePolicy)
+        self.policy = None
+        
+        # Errors of the last iteration, after prediction
+        self.distance = float('inf')
+        self.heading_error = 0.0
+        
+        # Set when only a predicted or estimated pose put the car at the
+        # target: the control loop then holds until a detection captured
+        # after the car came to rest confirms it
+        self.awaiting_measurement = False
         
         # Path history for visualization
         self.path_history: deque = deque(maxlen=500)
@@ -115,6 +202,8 @@ class PathPlanningController:
         self.state = ControlState.ROTATING
         self.iteration = 0
         self.rotation_steps = 0
+        self.awaiting_measurement = False
+        self.run_start_time = time.time()
         self.path_history.clear()
         print(f"🎯 Target set: ({x:.1f}, {y:.1f})")
         
@@ -122,6 +211,7 @@ class PathPlanningController:
         """Cancel current navigation"""
         self.state = ControlState.IDLE
         self.target = None
+        self.awaiting_measurement = False
         print("❌ Navigation cancelled")
         
     def compute_desired_heading(self, pose: RobotPose) -> float:
@@ -147,7 +237,24 @@ class PathPlanningController:
         dy = self.target[1] - pose.front_y
         return math.sqrt(dx*dx + dy*dy)
     
-    def get_command(self, pose: RobotPose) -> Optional[str]:
+    def run_rate(self) -> Tuple[float, float]:
+        """Elapsed seconds and achieved iterations per second for the current run"""
+        elapsed = time.time() - self.run_start_time
+        rate = self.iteration / elapsed if elapsed > 0 else 0.0
+        return elapsed, rate
+    
+    def _project_pose(self, pose: RobotPose, measured: bool) -> Tuple[RobotPose, bool]:
+        """
+        The pose to act on, and whether it is a detection of the car at
+        rest rather than a projection over pulses the camera has not seen
+        """
+        self.awaiting_measurement = False
+        if self.predictor is None:
+            return pose, measured
+        measured = measured and pose.timestamp > self.predictor.commander.last_command_end
+        return self.predictor.predict(pose), measured
+    
+    def get_command(self, pose: RobotPose, measured: bool = True) -> Optional[str]:
         """
         Main control loop iteration (Algorithm from your slides):
         
@@ -168,9 +275,14 @@ class PathPlanningController:
         # Record path
         self.path_history.append(pose.front)
         
+        # Act on where the robot will be when the command lands, not where
+        # the camera last saw it
+        pose, measured = self._project_pose(pose, measured)
+        
         # Step 1: Calculate d^k and e_θ^k
         distance = self.compute_distance(pose)
         heading_error = self.compute_heading_error(pose)
+        self.distance, self.heading_error = distance, heading_error
         
         self.iteration += 1
         
@@ -182,6 +294,9 @@ class PathPlanningController:
         
         # Step 2: Check success condition: d^k ≤ ρ
         if distance <= self.arrival_threshold:
+            if not measured:
+                self.awaiting_measurement = True
+                return None
             self.state = ControlState.SUCCESS
             print(f"✅ SUCCESS! Reached target in {self.iteration} iterations")
             return "stop"
@@ -210,6 +325,20 @@ class PathPlanningController:
         self.rotation_steps = 0  # Reset rotation counter
         return "back"
     
+    def get_pulse(self, pose: RobotPose, measured: bool = True) -> Optional[Tuple[str, float]]:
+        """
+        Next command and how long to run it, in seconds; measured=False
+        for a tracker estimate, which cannot by itself end the run
+        """
+        command = self.get_command(pose, measured)
+        if command is None:
+            return None
+        if self.policy is not None and command != "stop":
+            # Cover what is left of the error in one pulse where the policy can
+            remaining = self.distance if command == "back" else abs(self.heading_error)
+            return command, self.policy.duration(command, remaining)
+        return command, self.pulse_duration
+    
     def get_status_text(self, pose: Optional[RobotPose] = None) -> List[str]:
         """Get status text for overlay"""
         lines = [f"State: {self.state.value}"]
@@ -227,6 +356,206 @@ class PathPlanningController:
         return lines
 
 
+class PathFollowingController(PathPlanningController):
+    """
+    Pure-pursuit tracker for a full planned path (path_with_headings output).
+    
+    A lookahead point slides along the path's arc length ahead of the closest
+    point to the robot. Each iteration either turns by exactly the angle to
+    that point or drives toward it, with the pulse length computed from the
+    motion model rates instead of a fixed pulse_duration. Forward pulses are
+    shortened on tight curves so the straight drive never strays more than
+    heading_threshold from the pure-pursuit arc.
+    """
+    
+    def __init__(self,
+                 lookahead: float = 60.0,              # pixels along the path
+                 forward_speed: float = 150.0,         # pixels per second while driving
+                 turn_rate: float = math.pi / 2,       # radians per second while rotating
+                 min_pulse: float = 0.05,              # seconds
+                 max_pulse: float = 0.50,              # seconds
+                 **kwargs):
+        super().__init__(**kwargs)
+        self.lookahead = lookahead
+        self.forward_speed = forward_speed
+        self.turn_rate = turn_rate
+        self.min_pulse = min_pulse
+        self.max_pulse = max_pulse
+        
+        # Path state
+        self.path: Optional[np.ndarray] = None        # Nx2 points
+        self.arc_length: Optional[np.ndarray] = None  # cumulative length at each point
+        self.progress = 0.0                           # arc length of the closest point
+        self.lookahead_point: Optional[Tuple[float, float]] = None
+        self.cross_track_error = 0.0
+    
+    def set_path(self, path_hdg: List[dict]):
+        """Start following a path given as path_with_headings() output"""
+        points = np.array([p["point"] for p in path_hdg], dtype=float)
+        self._load_path(points)
+        self.target = (float(points[-1][0]), float(points[-1][1]))
+        self.state = ControlState.ROTATING
+        self.iteration = 0
+        self.rotation_steps = 0
+        self.awaiting_measurement = False
+        self.run_start_time = time.time()
+        self.path_history.clear()
+        print(f"🛣️ Following path: {len(self.path)} points, {self.arc_length[-1]:.0f}px long")
+    
+    def update_path(self, path_hdg: List[dict]) -> bool:
+        """
+        Swap in a replanned path mid-run without restarting: progress moves
+        to the new path's point closest to where it was on the old one.
+        Returns False when no path is being followed.
+        """
+        if self.path is None or self.state not in (ControlState.ROTATING, ControlState.MOVING):
+            return False
+        here = self._point_at(self.progress)
+        points = np.array([p["point"] for p in path_hdg], dtype=float)
+        self._load_path(points)
+        self.progress = self._project(here, 0, len(self.path))[0]
+        self.target = (float(points[-1][0]), float(points[-1][1]))
+        return True
+    
+    def set_target(self, x: float, y: float):
+        """Single target: follow a straight path from wherever the robot is first seen"""
+        super().set_target(x, y)
+        self.path = None
+        self.lookahead_point = None
+    
+    def cancel(self):
+        super().cancel()
+        self.path = None
+        self.lookahead_point = None
+    
+    def _load_path(self, points: np.ndarray):
+        # Drop repeated samples (segment joints) so every step has a length
+        steps = np.linalg.norm(np.diff(points, axis=0), axis=1)
+        keep = np.concatenate(([True], steps > 1e-6))
+        self.path = points[keep]
+        self.arc_length = np.concatenate(([0.0], np.cumsum(steps[steps > 1e-6])))
+        self.progress = 0.0
+        self.lookahead_point = None
+        self.cross_track_error = 0.0
+    
+    def _point_at(self, s: float) -> Tuple[float, float]:
+        """Point on the path at arc length s (clamped to the ends)"""
+        return (float(np.interp(s, self.arc_length, self.path[:, 0])),
+                float(np.interp(s, self.arc_length, self.path[:, 1])))
+    
+    def _closest(self, point: Tuple[float, float]) -> Tuple[float, float]:
+        """
+        Arc length and distance of the closest path point, searched only
+        around the current progress so self-crossing paths don't jump ahead
+        """
+        lo = max(0, int(np.searchsorted(self.arc_length, self.progress - self.lookahead)) - 1)
+        hi = int(np.searchsorted(self.arc_length, self.progress + 2 * self.lookahead)) + 1
+        hi = min(max(hi, lo + 2), len(self.path))
+        if hi - lo < 2:
+            return self.arc_length[-1], math.dist(point, self.path[-1])
+        return self._project(point, lo, hi)
+    
+    def _project(self, point: Tuple[float, float], lo: int, hi: int) -> Tuple[float, float]:
+        """Arc length and distance of the closest point on path[lo:hi]"""
+        if hi - lo < 2:
+            return 0.0, math.dist(point, self.path[0])
+        a = self.path[lo:hi - 1]
+        b = self.path[lo + 1:hi]
+        ab = b - a
+        seg_len2 = np.einsum('ij,ij->i', ab, ab)
+        t = np.clip(np.einsum('ij,ij->i', np.asarray(point) - a, ab) / seg_len2, 0.0, 1.0)
+        proj = a + ab * t[:, None]
+        dist = np.linalg.norm(proj - np.asarray(point), axis=1)
+        i = int(np.argmin(dist))
+        s = self.arc_length[lo + i] + t[i] * math.sqrt(seg_len2[i])
+        return float(s), float(dist[i])
+    
+    def _rates(self) -> Tuple[float, float]:
+        # Share the predictor's motion model when there is one
+        if self.predictor is not None:
+            return self.predictor.forward_speed, self.predictor.turn_rate
+        return self.forward_speed, self.turn_rate
+    
+    def compute_desired_heading(self, pose: RobotPose) -> float:
+        if self.lookahead_point is None:
+            return super().compute_desired_heading(pose)
+        return math.atan2(self.lookahead_point[1] - pose.front_y,
+                          self.lookahead_point[0] - pose.front_x)
+    
+    def get_command(self, pose: RobotPose, measured: bool = True) -> Optional[str]:
+        pulse = self.get_pulse(pose, measured)
+        return pulse[0] if pulse else None
+    
+    def get_pulse(self, pose: RobotPose, measured: bool = True) -> Optional[Tuple[str, float]]:
+        if self.state in (ControlState.IDLE, ControlState.SUCCESS, ControlState.FAILED):
+            return None
+        if self.target is None:
+            return None
+        
+        self.path_history.append(pose.front)
+        pose, measured = self._project_pose(pose, measured)
+        if self.path is None:
+            self._load_path(np.array([pose.front, self.target], dtype=float))
+        
+        self.iteration += 1
+        if self.iteration >= self.max_iterations:
+            self.state = ControlState.FAILED
+            print(f"❌ FAILED: Max iterations ({self.max_iterations}) exceeded")
+            return "stop", 0.0
+        
+        s, self.cross_track_error = self._closest(pose.front)
+        self.progress = max(self.progress, s)
+        total = self.arc_length[-1]
+        
+        if (total - self.progress <= self.lookahead and
+                self.compute_distance(pose) <= self.arrival_threshold):
+            if not measured:
+                self.awaiting_measurement = True
+                return None
+            self.state = ControlState.SUCCESS
+            elapsed, rate = self.run_rate()
+            print(f"✅ SUCCESS! Finished path in {self.iteration} iterations ({elapsed:.1f}s)")
+            return "stop", 0.0
+        
+        self.lookahead_point = self._point_at(self.progress + self.lookahead)
+        alpha = normalize_angle(self.compute_desired_heading(pose) - pose.heading)
+        chord = max(math.dist(pose.front, self.lookahead_point), 1e-6)
+        forward_speed, turn_rate = self._rates()
+        
+        if abs(alpha) > self.heading_threshold:
+            self.state = ControlState.ROTATING
+            self.rotation_steps += 1
+            if self.rotation_steps > self.max_rotation_steps:
+                self.state = ControlState.FAILED
+                print(f"❌ FAILED: Rotation timeout ({self.max_rotation_steps} steps)")
+                return "stop", 0.0
+            command = "right" if alpha > 0 else "left"
+            if self.policy is not None:
+                return command, self.policy.duration(command, abs(alpha))
+            return command, self._clamp_pulse(abs(alpha) / turn_rate)
+        
+        # Pure pursuit arc through the lookahead point has curvature
+        # 2 sin(alpha) / chord; driving its tangent for d pixels drifts
+        # |kappa| * d radians off it
+        self.state = ControlState.MOVING
+        self.rotation_steps = 0
+        kappa = abs(2 * math.sin(alpha) / chord)
+        distance = chord if kappa < 1e-6 else min(chord, self.heading_threshold / kappa)
+        if self.policy is not None:
+            return "back", self.policy.duration("back", distance)
+        return "back", self._clamp_pulse(distance / forward_speed)
+    
+    def _clamp_pulse(self, duration: float) -> float:
+        return min(self.max_pulse, max(self.min_pulse, duration))
+    
+    def get_status_text(self, pose: Optional[RobotPose] = None) -> List[str]:
+        lines = super().get_status_text(pose)
+        if self.path is not None:
+            lines.append(f"Path: {self.progress:.0f}/{self.arc_length[-1]:.0f}px "
+                         f"(cross-track {self.cross_track_error:.1f}px)")
+        return lines
+
+
 class RobotCommander:
     """Sends HTTP commands to ESP32 robot with pulse timing"""
     
@@ -235,41 +564,456 @@ class RobotCommander:
         self.pulse_duration = pulse_duration
         self.last_command = None
         self.last_command_time = 0
+        self.last_command_end = 0.0  # when the robot last came to rest
+        
+        # Executed motions as (command, start, end) for pose prediction
+        self.command_history: deque = deque(maxlen=100)
+        self.rtt = 0.0  # smoothed request round-trip time in seconds
+        self.rtt_samples: deque = deque(maxlen=500)
+        self.commands_failed = 0
+        self.commands_sent = 0
         
+        # Optional run log (run_log.RunLog) and this car's index in it
+        self.run_log = None
+        self.log_index = run_log.NO_CAR
+        
+    def _log_command(self, seq: int, command: str, sent: float, acked: float, ok: bool):
+        if self.run_log is not None:
+            self.run_log.write(run_log.COMMAND, acked, {'seq': seq, 'command': command, 'sent': sent,
+                                                        'acked': acked, 'ok': ok}, self.log_index)
+    
+    def _record_rtt(self, rtt: float):
+        self.rtt = rtt if self.rtt == 0 else 0.8 * self.rtt + 0.2 * rtt
+        self.rtt_samples.append(rtt)
+    
+    def rtt_summary(self) -> str:
+        """Command round-trip percentiles for the run log"""
+        if not self.rtt_samples:
+            return "no commands"
+        samples = sorted(self.rtt_samples)
+        p50 = samples[len(samples) // 2] * 1000
+        p90 = samples[min(len(samples) - 1, int(0.9 * len(samples)))] * 1000
+        return (f"rtt p50 {p50:.0f}ms p90 {p90:.0f}ms max {samples[-1] * 1000:.0f}ms "
+                f"over {len(samples)} commands, {self.commands_failed} failed")
+    
+    def next_execution_time(self) -> float:
+        """When a command sent now would take effect on the robot"""
+        return time.time() + self.rtt / 2
+    
     def send_command(self, command: str) -> bool:
         """Send command to robot"""
+        self.commands_sent += 1
+        sent = time.time()
         try:
             response = requests.get(f"{self.robot_url}/{command}", timeout=1)
             self.last_command = command
             self.last_command_time = time.time()
-            return response.status_code == 200
+            self._record_rtt(self.last_command_time - sent)
+            ok = response.status_code == 200
         except Exception as e:
+            self.commands_failed += 1
             print(f"⚠️ Command failed: {e}")
-            return False
+            ok = False
+        self._log_command(self.commands_sent, command, sent, time.time(), ok)
+        return ok
     
-    def pulse(self, command: str) -> bool:
+    def pulse(self, command: str, duration: Optional[float] = None) -> bool:
         """Send a pulse command (command for duration, then stop)"""
+        if duration is None:
+            duration = self.pulse_duration
         if command == "stop":
-            return self.send_command("stop")
+            success = self.send_command("stop")
+            self.last_command_end = time.time()
+            return success
         
         success = self.send_command(command)
         if success:
-            time.sleep(self.pulse_duration)
+            # The robot starts (and stops) moving roughly half a round trip
+            # before each request returns
+            start = self.last_command_time - self.rtt / 2
+            time.sleep(duration)
             self.send_command("stop")
+            self.last_command_end = time.time()
+            self.command_history.append(
+                (command, start, self.last_command_time - self.rtt / 2))
         return success
     
+    def wait_idle(self, timeout: Optional[float] = None) -> bool:
+        """Wait until no pulse is in flight; pulse() here returns once it is done"""
+        return True
+    
     def stop(self):
         """Emergency stop"""
         self.send_command("stop")
+    
+    def close(self):
+        pass
+
+
+class AsyncRobotCommander(RobotCommander):
+    """
+    RobotCommander that never blocks the caller on the network
+    
+    Commands go through a queue to one worker thread that owns a keep-alive
+    requests.Session, so the ESP32 sees one persistent connection instead
+    of a TCP handshake per command. Each command carries a sequence number
+    (?seq=N, echoed by the firmware as X-Seq) and gets a Future that
+    resolves to a CommandResult.
+    
+    pulse() returns as soon as the pulse is queued. Its motion is entered
+    into command_history and last_command_end right away with the expected
+    timing (replaced by the measured one when the stop is acknowledged), so
+    the controller's pose wait and the predictor/tracker see a pulse in
+    flight as if it had been executed. At most max_pending pulses are
+    queued; past that pulse() waits for the oldest to finish, which lets
+    the controller plan the next pulse while the current one runs. A
+    control loop planning from predicted or tracked poses calls
+    wait_idle() first instead, so it never plans over queued pulses.
+    """
+    
+    @dataclass
+    class CommandResult:
+        seq: int
+        command: str
+        ok: bool
+        sent: float      # request written
+        acked: float     # response received
+        
+        @property
+        def rtt(self) -> float:
+            return self.acked - self.sent
+    
+    def __init__(self, robot_url: str, pulse_duration: float = 0.15, max_pending: int = 2):
+        super().__init__(robot_url, pulse_duration)
+        self.max_pending = max_pending
+        self.session = requests.Session()
+        self.session.mount('http://', requests.adapters.HTTPAdapter(pool_connections=1, pool_maxsize=1))
+        self.seq = 0
+        self.seq_mismatches = 0
+        self.queue: deque = deque()  # (seq, command, hold, future); hold = wait after previous ack
+        self.cond = threading.Condition()
+        self.pending_pulses = 0
+        self.busy_until = 0.0  # expected time queued work is done
+        self.running = True
+        self.worker = threading.Thread(target=self._run, daemon=True)
+        self.worker.start()
+    
+    def next_execution_time(self) -> float:
+        return max(time.time() + self.rtt / 2, self.busy_until)
+    
+    def submit(self, command: str, hold: float = 0.0) -> Future:
+        """
+        Queue a command, sent `hold` seconds after the previous one is
+        acknowledged; after close() it fails at once instead
+        """
+        future = Future()
+        with self.cond:
+            if not self.running:
+                now = time.time()
+                future.set_result(self.CommandResult(0, command, False, now, now))
+                return future
+            self.seq += 1
+            self.queue.append((self.seq, command, hold, future))
+            self.cond.notify_all()
+        return future
+    
+    def send_command(self, command: str) -> bool:
+        """Send a command and wait for its acknowledgement; False if stop() dropped it"""
+        try:
+            return self.submit(command).result().ok
+        except CancelledError:
+            return False
+    
+    def _send(self, seq: int, command: str) -> 'AsyncRobotCommander.CommandResult':
+        sent = time.time()
+        try:
+            response = self.session.get(f"{self.robot_url}/{command}", params={'seq': seq}, timeout=1)
+            ok = response.status_code == 200
+            echoed = response.headers.get('X-Seq')
+            if echoed is not None and echoed != str(seq):
+                self.seq_mismatches += 1
+        except Exception as e:
+            ok = False
+            print(f"⚠️ Command {command} #{seq} failed: {e}")
+        acked = time.time()
+        if ok:
+            self.last_command = command
+            self.last_command_time = acked
+            self._record_rtt(acked - sent)
+        else:
+            self.commands_failed += 1
+        self._log_command(seq, command, sent, acked, ok)
+        return self.CommandResult(seq, command, ok, sent, acked)
+    
+    def _run(self):
+        previous_ack = 0.0
+        while True:
+            with self.cond:
+                # Hold the head of the queue in place while it waits, so an
+                # emergency stop() can still flush it
+                while True:
+                    if not self.queue:
+                        if not self.running:
+                            return
+                        self.cond.wait()
+                        continue
+                    wait = previous_ack + self.queue[0][2] - time.time()
+                    if wait <= 0:
+                        break
+                    self.cond.wait(wait)
+                seq, command, hold, future = self.queue.popleft()
+            if not future.set_running_or_notify_cancel():
+                continue
+            result = self._send(seq, command)
+            previous_ack = result.acked
+            future.set_result(result)
+    
+    def pulse(self, command: str, duration: Optional[float] = None) -> Future:
+        """Queue a pulse (command for duration, then stop); returns the stop's Future"""
+        if duration is None:
+            duration = self.pulse_duration
+        if command == "stop":
+            future = self.submit("stop")
+            future.add_done_callback(
+                lambda f: f.cancelled() or setattr(self, 'last_command_end', f.result().acked))
+            return future
+        
+        with self.cond:
+            while self.pending_pulses >= self.max_pending and self.running:
+                self.cond.wait(0.1)
+            self.pending_pulses += 1
+            # Expected: go takes effect rtt/2 after it is sent, stop rtt/2
+            # after being sent `duration` past go's acknowledgement
+            start = self.next_execution_time()
+            planned = (command, start, start + duration + self.rtt)
+            self.command_history.append(planned)
+            self.busy_until = planned[2]
+            self.last_command_end = planned[2]
+        
+        go = self.submit(command)
+        stop = self.submit("stop", hold=duration)
+        
+        def finished(stop_future: Future):
+            with self.cond:
+                self.pending_pulses -= 1
+                # A cancelled stop means stop() flushed the queue
+                if not stop_future.cancelled() and go.result().ok:
+                    stop_result = stop_future.result()
+                    actual = (command, go.result().acked - self.rtt / 2, stop_result.acked - self.rtt / 2)
+                    try:
+                        self.command_history[self.command_history.index(planned)] = actual
+                    except ValueError:
+                        self.command_history.append(actual)
+                    if self.pending_pulses == 0:
+                        self.last_command_end = stop_result.acked
+                else:
+                    try:
+                        self.command_history.remove(planned)
+                    except ValueError:
+                        pass
+                self.cond.notify_all()
+        
+        stop.add_done_callback(finished)
+        return stop
+    
+    def wait_idle(self, timeout: Optional[float] = None) -> bool:
+        """Wait until every queued pulse has finished; False on timeout"""
+        deadline = None if timeout is None else time.time() + timeout
+        with self.cond:
+            while self.pending_pulses > 0 and self.running:
+                remaining = None if deadline is None else deadline - time.time()
+                if remaining is not None and remaining <= 0:
+                    return False
+                self.cond.wait(remaining)
+        return True
+    
+    def stop(self):
+        """Emergency stop: drop queued commands and stop right after the one in flight"""
+        if not self.running:
+            return  # closed: the worker already sent its last command
+        with self.cond:
+            for _, _, _, future in self.queue:
+                future.cancel()
+            self.queue.clear()
+            self.busy_until = 0.0
+        try:
+            self.submit("stop").result(timeout=2)
+        except Exception:
+            pass
+        self.last_command_end = time.time()
+    
+    def close(self):
+        with self.cond:
+            if not self.running:
+                return
+            self.running = False
+            self.cond.notify_all()
+        self.worker.join(timeout=2)
+        self.session.close()
+
+
+class PoseTracker:
+    """
+    Extended Kalman filter over detections: state [cx, cy, heading, v, omega]
+    
+    Detections (marker center and heading at capture time) are the
+    measurements. Without a commander the motion model is constant velocity
+    and turn rate. With one, the pulses the robot executed are used as
+    control inputs: the commanded twist while a pulse runs, standing still
+    otherwise. Either way the estimate can be queried at any time, which
+    bridges detection dropouts and lets the controller run faster than the
+    detector.
+    """
+    
+    def __init__(self,
+                 commander: Optional['RobotCommander'] = None,
+                 forward_speed: float = 150.0,      # pixels per second while driving
+                 turn_rate: float = math.pi / 2,    # radians per second while rotating
+                 position_noise: float = 3.0,       # detection std-dev, pixels
+                 heading_noise: float = 0.05,       # detection std-dev, radians
+                 accel_noise: float = 200.0,        # px/s^2, constant-velocity model
+                 turn_accel_noise: float = 2.0,     # rad/s^2, constant-velocity model
+                 slip: float = 0.15):               # relative std-dev of commanded motion
+        self.commander = commander
+        self.forward_speed = forward_speed
+        self.turn_rate = turn_rate
+        self.R = np.diag([position_noise ** 2, position_noise ** 2, heading_noise ** 2])
+        self.accel_noise = accel_noise
+        self.turn_accel_noise = turn_accel_noise
+        self.slip = slip
+        
+        self.x: Optional[np.ndarray] = None
+        self.P: Optional[np.ndarray] = None
+        self.t = 0.0
+        self.half_length = 0.0
+        self.lock = threading.Lock()
+    
+    def reset(self):
+        with self.lock:
+            self.x = None
+    
+    def update(self, pose: RobotPose):
+        """Fuse one detection"""
+        z = np.array([pose.center[0], pose.center[1], pose.heading])
+        half_length = math.hypot(pose.front_x - pose.back_x, pose.front_y - pose.back_y) / 2
+        
+        with self.lock:
+            if self.x is None:
+                self.x = np.array([z[0], z[1], z[2], 0.0, 0.0])
+                self.P = np.diag([self.R[0, 0], self.R[1, 1], self.R[2, 2], 100.0 ** 2, 1.0])
+                self.t = pose.timestamp
+                self.half_length = half_length
+                return
+            if pose.timestamp < self.t:
+                return  # Older than what we've already fused
+            
+            self.x, self.P = self._predict(self.x, self.P, self.t, pose.timestamp)
+            self.t = pose.timestamp
+            self.half_length += 0.1 * (half_length - self.half_length)
+            
+            H = np.zeros((3, 5))
+            H[0, 0] = H[1, 1] = H[2, 2] = 1.0
+            y = z - H @ self.x
+            y[2] = normalize_angle(y[2])
+            S = H @ self.P @ H.T + self.R
+            K = self.P @ H.T @ np.linalg.inv(S)
+            self.x = self.x + K @ y
+            self.x[2] = normalize_angle(self.x[2])
+            self.P = (np.eye(5) - K @ H) @ self.P
+    
+    def query(self, at_time: Optional[float] = None
+              ) -> Optional[Tuple[RobotPose, Tuple[float, float], np.ndarray]]:
+        """Estimated pose, (speed px/s, turn rate rad/s) and covariance at `at_time`"""
+        if at_time is None:
+            at_time = time.time()
+        with self.lock:
+            if self.x is None:
+                return None
+            x, P = self._predict(self.x, self.P, self.t, max(at_time, self.t))
+            half_length = self.half_length
+        
+        cx, cy, theta = float(x[0]), float(x[1]), float(x[2])
+        dx = half_length * math.cos(theta)
+        dy = half_length * math.sin(theta)
+        pose = RobotPose(cx + dx, cy + dy, cx - dx, cy - dy, timestamp=at_time)
+        return pose, (float(x[3]), float(x[4])), P
+    
+    def _predict(self, x: np.ndarray, P: np.ndarray, t0: float, t1: float):
+        for a, b, twist in self._intervals(t0, t1):
+            x, P = self._step(x, P, b - a, twist)
+        return x, P
+    
+    def _intervals(self, t0: float, t1: float):
+        """Split [t0, t1] at pulse boundaries; twist is None without a commander"""
+        if self.commander is None:
+            return [(t0, t1, None)]
+        
+        history = list(self.commander.command_history)
+        cuts = sorted({t0, t1} | {t for _, start, end in history
+                                  for t in (start, end) if t0 < t < t1})
+        intervals = []
+        for a, b in zip(cuts[:-1], cuts[1:]):
+            mid = (a + b) / 2
+            forward, turn = 0.0, 0.0
+            for command, start, end in history:
+                if start <= mid < end:
+                    forward, turn = COMMAND_TWIST.get(command, (0.0, 0.0))
+                    break
+            intervals.append((a, b, (forward * self.forward_speed, turn * self.turn_rate)))
+        return intervals
+    
+    def _step(self, x: np.ndarray, P: np.ndarray, dt: float, twist: Optional[Tuple[float, float]]):
+        if dt <= 0:
+            return x, P
+        x = x.copy()
+        Q = np.zeros((5, 5))
+        if twist is not None:
+            # Velocity is known from the command; uncertainty comes from slip
+            x[3], x[4] = twist
+            P = P.copy()
+            P[3, :] = P[:, 3] = 0.0
+            P[4, :] = P[:, 4] = 0.0
+            P[3, 3] = (self.slip * twist[0]) ** 2 + 1.0
+            P[4, 4] = (self.slip * twist[1]) ** 2 + 1e-4
+        else:
+            Q[3, 3] = (self.accel_noise ** 2) * dt
+            Q[4, 4] = (self.turn_accel_noise ** 2) * dt
+        
+        theta, v, omega = x[2], x[3], x[4]
+        F = np.eye(5)
+        F[0, 2] = -v * math.sin(theta) * dt
+        F[0, 3] = math.cos(theta) * dt
+        F[1, 2] = v * math.cos(theta) * dt
+        F[1, 3] = math.sin(theta) * dt
+        F[2, 4] = dt
+        
+        x[0] += v * math.cos(theta) * dt
+        x[1] += v * math.sin(theta) * dt
+        x[2] = normalize_angle(theta + omega * dt)
+        return x, F @ P @ F.T + Q
+
+
+def fetch_robot_rates(robot_url: str) -> Optional[Tuple[float, float]]:
+    """(forward px/s, turn deg/s) measured by calibrate.py and stored on the robot, or None"""
+    try:
+        response = requests.get(f"{robot_url.rstrip('/')}/calib", timeout=2)
+        rates = response.json()['rates'] if response.status_code == 200 else None
+    except (requests.RequestException, ValueError, KeyError):
+        return None
+    if not rates or not rates.get('back') or not (rates.get('left') and rates.get('right')):
+        return None  # never calibrated
+    return rates['back'], (rates['left'] + rates['right']) / 2
+
 
 
 class PoseClient:
     """Fetches pose data from NN server's /detections endpoint"""
     
-    def __init__(self, nn_server_url: str, front_keypoint: int = 0, car_id: int = 0):
+    def __init__(self, nn_server_url: str, front_keypoint: int = 0, car_id: Optional[int] = None):
         self.nn_server_url = nn_server_url.rstrip('/')
         self.latest_pose: Optional[RobotPose] = None
         self.pose_lock = threading.Lock()
+        self.pose_available = threading.Condition(self.pose_lock)
         self.running = False
         self.poll_thread = None
         
@@ -279,73 +1023,182 @@ class PoseClient:
         self.front_keypoint = front_keypoint
         self.back_keypoint = 1 - front_keypoint  # The other one
         
-        # Which car to track (if multiple detections)
+        # Which car to track: the NN server's persistent track ID, or None
+        # to follow the most confident detection (single car)
         self.car_id = car_id
         
+        # Optional filtering between detections (see PoseTracker)
+        self.tracker: Optional[PoseTracker] = None
+        self.max_position_std = 40.0  # pixels - beyond this the estimate is not trusted
+        
         # Stats
         self.last_fps = 0
         self.last_inference_ms = 0
         self.detection_confidence = 0
+        self.last_seq = 0
+        self.last_record_time = 0.0
+        
+        # Provenance: the NN server reports each frame's capture time on its
+        # clock; clock_offset maps that onto ours
+        self.clock_offset = 0.0
+        self.sensing_latency_ms = 0.0  # capture to receipt here, smoothed
+        
+        # Optional run log (run_log.RunLog) and this car's index in it
+        self.run_log = None
+        self.log_index = run_log.NO_CAR
         
     def fetch_pose(self) -> Optional[RobotPose]:
         """Fetch latest pose from NN server /detections endpoint"""
         try:
+            request_time = time.time()
             response = requests.get(f"{self.nn_server_url}/detections", timeout=1)
             if response.status_code == 200:
-                data = response.json()
-                
-                # Update stats
-                self.last_fps = data.get('fps', 0)
-                self.last_inference_ms = data.get('inference_ms', 0)
-                
-                detections = data.get('detections', [])
-                
-                if not detections:
-                    return None
-                
-                # Find the detection we want to track
-                detection = None
-                if self.car_id < len(detections):
-                    detection = detections[self.car_id]
-                else:
-                    # Just use the first detection
-                    detection = detections[0]
-                
-                if not detection:
-                    return None
-                
-                keypoints = detection.get('keypoints', [])
-                
-                if len(keypoints) < 2:
-                    return None
-                
-                # Extract front and back keypoints
-                front_kp = keypoints[self.front_keypoint]
-                back_kp = keypoints[self.back_keypoint]
-                
-                # Check confidence threshold
-                min_conf = min(front_kp.get('confidence', 0), back_kp.get('confidence', 0))
-                self.detection_confidence = min_conf
-                
-                if min_conf < 0.3:  # Skip low confidence detections
-                    return None
-                
-                pose = RobotPose(
-                    front_x=front_kp['x'],
-                    front_y=front_kp['y'],
-                    back_x=back_kp['x'],
-                    back_y=back_kp['y'],
-                    timestamp=time.time()
-                )
-                
-                with self.pose_lock:
-                    self.latest_pose = pose
-                return pose
-                
+                if self.run_log is not None:
+                    self.run_log.detections(time.time(), request_time, response.content, self.log_index)
+                return self.handle_detections(response.json(), request_time)
         except Exception as e:
             pass  # Silently fail, will retry
         return None
     
+    def handle_detections(self, data: dict, request_time: float) -> Optional[RobotPose]:
+        """Handle one /detections response to a request sent at request_time"""
+        # Update stats
+        self.last_fps = data.get('fps', 0)
+        self.last_inference_ms = data.get('inference_ms', 0)
+        
+        detections = data.get('detections', [])
+        
+        if not detections:
+            return None
+        
+        # Find the detection we want to track
+        detection = self._select(detections,
+                                 lambda d: d.get('car_id'),
+                                 lambda d: d['bbox']['confidence'])
+        
+        if not detection:
+            return None
+        
+        keypoints = detection.get('keypoints', [])
+        
+        if len(keypoints) < 2:
+            return None
+        
+        # Extract front and back keypoints
+        front_kp = keypoints[self.front_keypoint]
+        back_kp = keypoints[self.back_keypoint]
+        
+        if data.get('capture_time') is not None:
+            timestamp = self._capture_time(data['capture_time'], time.time())
+        else:
+            # Older server: the answer is its latest result, so the frame
+            # was captured at least one inference (and up to a frame
+            # interval) before we asked
+            frame_age = self.last_inference_ms / 1000.0
+            if self.last_fps > 0:
+                frame_age += 1.0 / self.last_fps
+            timestamp = request_time - frame_age
+        
+        return self._accept_pose(
+            (front_kp['x'], front_kp['y'], front_kp.get('confidence', 0)),
+            (back_kp['x'], back_kp['y'], back_kp.get('confidence', 0)),
+            timestamp=timestamp
+        )
+    
+    def _capture_time(self, server_capture_time: float, receipt_time: float) -> float:
+        """Map a capture time on the NN server's clock onto ours and track sensing latency"""
+        capture_time = server_capture_time + self.clock_offset
+        latency_ms = (receipt_time - capture_time) * 1000
+        if self.sensing_latency_ms == 0:
+            self.sensing_latency_ms = latency_ms
+        else:
+            self.sensing_latency_ms += 0.1 * (latency_ms - self.sensing_latency_ms)
+        return capture_time
+    
+    def sync_clock(self):
+        """Estimate the NN server's clock offset from /stats"""
+        offset, rtt = estimate_clock_offset(f"{self.nn_server_url}/stats")
+        self.clock_offset = offset
+        if self.run_log is not None:
+            self.run_log.write(run_log.CLOCK, time.time(), {'offset': offset}, self.log_index)
+        if rtt is not None:
+            print(f"🕒 NN server clock offset: {offset * 1000:+.1f}ms (rtt {rtt * 1000:.1f}ms)")
+    
+    def _select(self, cars, car_id_of, confidence_of):
+        """Pick our car from one frame's detections; None if it is not in the frame"""
+        if self.car_id is None:
+            return max(cars, key=confidence_of) if cars else None
+        for car in cars:
+            if car_id_of(car) == self.car_id:
+                return car
+        return None
+    
+    def _accept_pose(self, front: Tuple[float, float, float], back: Tuple[float, float, float],
+                     timestamp: float) -> Optional[RobotPose]:
+        """Publish a detection given as (x, y, confidence) keypoints, if confident enough"""
+        # Check confidence threshold
+        min_conf = min(front[2], back[2])
+        self.detection_confidence = min_conf
+        
+        if min_conf < 0.3:  # Skip low confidence detections
+            return None
+        
+        pose = RobotPose(
+            front_x=front[0],
+            front_y=front[1],
+            back_x=back[0],
+            back_y=back[1],
+            timestamp=timestamp
+        )
+        
+        if self.tracker is not None:
+            self.tracker.update(pose)
+        
+        with self.pose_available:
+            self.latest_pose = pose
+            self.pose_available.notify_all()
+        return pose
+    
+    def handle_record(self, record: dict, receipt_time: float) -> Optional[RobotPose]:
+        """
+        Handle one compact record from /detections/stream:
+        {"seq", "src", "cap", "t", "ms", "cars": [[car_id, conf, x0, y0, c0, x1, y1, c1], ...]}
+        """
+        self.last_inference_ms = record.get('ms', 0)
+        seq = record.get('seq', 0)
+        if self.last_seq and seq > self.last_seq:
+            dt = receipt_time - self.last_record_time
+            if dt > 0:
+                self.last_fps = 0.9 * self.last_fps + 0.1 * (seq - self.last_seq) / dt
+        self.last_seq = seq
+        self.last_record_time = receipt_time
+        
+        cars = record.get('cars', [])
+        if not cars:
+            return None
+        car = self._select(cars, lambda c: c[0], lambda c: c[1])
+        if car is None:
+            return None
+        keypoints = [tuple(car[i:i + 3]) for i in range(2, len(car) - 2, 3)]
+        if len(keypoints) < 2:
+            return None
+        
+        if 'cap' in record:
+            timestamp = self._capture_time(record['cap'], receipt_time)
+        else:
+            # Older server: records are pushed the moment inference finishes
+            timestamp = receipt_time - self.last_inference_ms / 1000.0
+        return self._accept_pose(keypoints[self.front_keypoint], keypoints[self.back_keypoint],
+                                 timestamp=timestamp)
+    
+    def start(self, transport: str = "push"):
+        """Start receiving poses: 'push' (server-sent events, falls back to polling) or 'poll'"""
+        self.sync_clock()
+        if transport == "push":
+            self.start_streaming()
+        else:
+            self.start_polling()
+    
     def start_polling(self, interval: float = 0.05):
         """Start background pose polling"""
         self.running = True
@@ -357,6 +1210,44 @@ class PoseClient:
         while self.running:
             self.fetch_pose()
             time.sleep(interval)
+    
+    def start_streaming(self):
+        """Start receiving pushed poses from /detections/stream"""
+        self.running = True
+        self.poll_thread = threading.Thread(target=self._stream_loop)
+        self.poll_thread.daemon = True
+        self.poll_thread.start()
+    
+    def _stream_loop(self):
+        outage = False  # report a lost stream once, not on every retry
+        while self.running:
+            try:
+                response = requests.get(f"{self.nn_server_url}/detections/stream",
+                                        stream=True, timeout=(5, 10))
+                if response.status_code == 404:
+                    print("⚠️ NN server has no pose stream, falling back to polling")
+                    self._poll_loop(0.05)
+                    return
+                if response.status_code != 200:
+                    raise RuntimeError(f"HTTP {response.status_code}")
+                if outage:
+                    print("✅ Pose stream reconnected")
+                    outage = False
+                
+                for line in response.iter_lines():
+                    if not self.running:
+                        break
+                    if line.startswith(b'data:'):
+                        receipt_time = time.time()
+                        if self.run_log is not None:
+                            self.run_log.write(run_log.POSE, receipt_time, line[5:], self.log_index)
+                        self.handle_record(json.loads(line[5:]), receipt_time)
+                response.close()
+            except Exception as e:
+                if not outage and self.running:
+                    print(f"⚠️ Pose stream lost ({e}), reconnecting...")
+                    outage = True
+                time.sleep(1)  # Reconnect
             
     def stop(self):
         self.running = False
@@ -366,40 +1257,283 @@ class PoseClient:
     def get_latest(self) -> Optional[RobotPose]:
         with self.pose_lock:
             return self.latest_pose
+    
+    def get_estimate(self, at_time: Optional[float] = None) -> Optional[RobotPose]:
+        """Tracker estimate at `at_time` (default now), or None if unavailable or too uncertain"""
+        if self.tracker is None:
+            return None
+        estimate = self.tracker.query(at_time)
+        if estimate is None:
+            return None
+        pose, _, covariance = estimate
+        if math.sqrt(max(covariance[0, 0], covariance[1, 1])) > self.max_position_std:
+            return None
+        return pose
+    
+    def wait_for_pose(self, after: float, timeout: float) -> Optional[RobotPose]:
+        """Block until a pose captured after `after` arrives, or return None on timeout"""
+        deadline = time.time() + timeout
+        with self.pose_available:
+            while self.latest_pose is None or self.latest_pose.timestamp <= after:
+                remaining = deadline - time.time()
+                if remaining <= 0 or not self.running:
+                    return None
+                self.pose_available.wait(remaining)
+            return self.latest_pose
+
 
+class CarAgent:
+    """One car: its pose feed, robot link, controller and control loop"""
+    
+    def __init__(self, nn_server_url: str, robot_url: str, car_id: Optional[int] = None,
+                 front_keypoint: int = 0, follow_paths: bool = False, async_commands: bool = True):
+        self.car_id = car_id
+        self.robot_url = robot_url.rstrip('/')
+        self.pose_client = PoseClient(nn_server_url, front_keypoint=front_keypoint, car_id=car_id)
+        self.robot = AsyncRobotCommander(robot_url) if async_commands else RobotCommander(robot_url)
+        if follow_paths:
+            self.controller = PathFollowingController()
+        else:
+            self.controller = PathPlanningController()
+        
+        # Control thread
+        self.control_thread = None
+        self.control_running = False
+        self.pose_timeouts = 0
+        
+        self.run_log = None
+        self.log_index = run_log.NO_CAR
+    
+    @property
+    def name(self) -> str:
+        return "Car" if self.car_id is None else f"Car #{self.car_id}"
+    
+    def attach_log(self, log: 'run_log.RunLog', index: int):
+        """Log this car's poses, commands, control steps and operator actions"""
+        self.run_log = log
+        self.log_index = index
+        for part in (self.pose_client, self.robot):
+            part.run_log = log
+            part.log_index = index
+    
+    def log_config(self) -> dict:
+        """Controller settings, for the run log"""
+        controller = self.controller
+        params = {name: getattr(controller, name) for name in
+                  ('arrival_threshold', 'heading_threshold', 'pulse_duration', 'settle_time',
+                   'max_iterations', 'lookahead', 'forward_speed', 'turn_rate')
+                  if hasattr(controller, name)}
+        return {
+            'car_id': self.car_id,
+            'controller': type(controller).__name__,
+            'params': params,
+            'front_keypoint': self.pose_client.front_keypoint,
+            # [forward_speed, turn_rate] of the motion models, or None when off
+            'track': ([self.pose_client.tracker.forward_speed, self.pose_client.tracker.turn_rate]
+                      if self.pose_client.tracker is not None else None),
+            'predict': ([controller.predictor.forward_speed, controller.predictor.turn_rate]
+                        if controller.predictor is not None else None),
+            'robot_pulse_duration': self.robot.pulse_duration,
+            # Replay and simulator commanders say which mode they emulate
+            'async_commands': getattr(self.robot, 'asynchronous', isinstance(self.robot, AsyncRobotCommander)),
+            'policy': controller.policy.to_dict() if controller.policy is not None else None
+        }
+    
+    def _log(self, kind: int, payload: dict):
+        if self.run_log is not None:
+            self.run_log.write(kind, time.time(), payload, self.log_index)
+    
+    def set_target(self, x: float, y: float):
+        self._log(run_log.TARGET, {'x': x, 'y': y})
+        self.controller.set_target(x, y)
+    
+    def set_path(self, path: List[dict]):
+        self._log(run_log.PATH, {'path': path})
+        self.controller.set_path(path)
+    
+    def update_path(self, path: List[dict]) -> bool:
+        """Replace the path being followed, if any, keeping progress along it"""
+        if not isinstance(self.controller, PathFollowingController):
+            return False
+        if not self.controller.update_path(path):
+            return False
+        self._log(run_log.PATH, {'path': path, 'update': True})
+        return True
+    
+    def cancel(self):
+        """Cancel navigation and stop the car"""
+        self._log(run_log.CANCEL, {})
+        self.controller.cancel()
+        self.robot.stop()
+    
+    def start(self, pose_transport: str = "push"):
+        """Start receiving poses and run the control loop"""
+        self.pose_client.start(pose_transport)
+        self.control_running = True
+        self.control_thread = threading.Thread(target=self.control_loop)
+        self.control_thread.daemon = True
+        self.control_thread.start()
+    
+    def stop(self):
+        self.control_running = False
+        self.controller.cancel()
+        self.robot.stop()
+        self.pose_client.stop()
+        if self.control_thread and self.control_thread.is_alive():
+            self.control_thread.join(timeout=2)
+        self.robot.close()
+    
+    def control_loop(self):
+        """
+        Background control loop - runs path planning algorithm
+        
+        Each iteration runs as soon as a pose captured after the previous
+        pulse finished arrives. settle_time only bounds that wait; on timeout
+        the latest (stale) pose is used instead. With a predictor the pulses a
+        pose has not seen yet are accounted for, so any pose younger than
+        settle_time is good enough and the loop runs continuously. With a
+        tracker there is a current estimate between detections, so the loop
+        only waits when the estimate has become too uncertain.
+        
+        Either way the loop first waits for the pulses already queued on an
+        async commander to finish: projecting a stale pose over several
+        pulses still to run compounds their errors. And a prediction or
+        estimate cannot end a run by itself; when one reaches the target
+        the loop waits for a detection captured after the car came to rest.
+        """
+        while self.control_running:
+            controller = self.controller
+            if controller.state in (ControlState.ROTATING, ControlState.MOVING):
+                if controller.predictor is not None or self.pose_client.tracker is not None:
+                    self.robot.wait_idle(controller.settle_time)
+                confirm = controller.awaiting_measurement
+                pose = None if confirm else self.pose_client.get_estimate()
+                if pose is not None:
+                    self.control_step(pose, measured=False)
+                    continue
+                
+                if controller.predictor is not None and not confirm:
+                    fresh_after = time.time() - controller.settle_time
+                else:
+                    fresh_after = self.robot.last_command_end
+                pose = self.pose_client.wait_for_pose(
+                    after=fresh_after,
+                    timeout=self.controller.settle_time
+                )
+                if pose is None:
+                    pose = self.pose_client.get_latest()
+                    if pose and self.robot.last_command_end > 0:
+                        self.pose_timeouts += 1
+                if pose:
+                    self.control_step(pose)
+                else:
+                    time.sleep(0.05)  # No pose available, wait
+            else:
+                time.sleep(0.1)  # Idle, check less frequently
+    
+    def log_step(self, pose: RobotPose, pulse: Optional[Tuple[str, float]]):
+        self._log(run_log.STEP, {'pose_t': pose.timestamp, 'pose': [pose.front_x, pose.front_y,
+                                                                    pose.back_x, pose.back_y],
+                                 'pulse': pulse, 'state': self.controller.state.value,
+                                 'iteration': self.controller.iteration})
+    
+    def control_step(self, pose: RobotPose, measured: bool = True):
+        """Run one controller iteration and execute its pulse"""
+        pulse = self.controller.get_pulse(pose, measured)
+        self.log_step(pose, pulse)
+        if self.controller.iteration == 1:
+            self.pose_timeouts = 0
+        if pulse:
+            self.robot.pulse(*pulse)
+        if self.controller.state in (ControlState.SUCCESS, ControlState.FAILED):
+            self.log_run()
+    
+    def log_run(self):
+        """Print timing summary for the run that just finished"""
+        elapsed, rate = self.controller.run_rate()
+        print(f"📊 {self.name} run: {self.controller.iteration} iterations in {elapsed:.1f}s "
+              f"({rate:.2f} it/s, {self.pose_timeouts} pose timeouts)")
+        print(f"📶 {self.name} commands: {self.robot.rtt_summary()}")
+    
 
 class VideoStreamClient:
     """Enhanced video client with path planning control"""
     
-    def __init__(self, nn_server_url: str, robot_url: str, front_keypoint: int = 0):
+    def __init__(self, nn_server_url: str, robot_url: Union[str, Dict[int, str]],
+                 front_keypoint: int = 0, follow_paths: bool = False, view_width: Optional[int] = None,
+                 async_commands: bool = True):
+        """
+        Args:
+            robot_url: The robot's URL, or {NN server track ID: robot URL} to
+                       drive a fleet of cars seen by the same camera
+            view_width: Show the video at least this wide instead of full size;
+                        frames are decoded at a reduced DCT scale, and the
+                        overlay and clicks are mapped to pose coordinates
+            async_commands: Queue robot commands on a keep-alive connection
+                            (AsyncRobotCommander) instead of blocking on each
+        """
         self.nn_server_url = nn_server_url.rstrip('/')
-        self.robot_url = robot_url.rstrip('/')
         
         self.frame_queue = queue.Queue(maxsize=5)
         self.running = False
+        self.stopped = False  # stop() has run; start_streaming() and main() both call it
         self.stream_thread = None
         
-        # Components
-        self.pose_client = PoseClient(nn_server_url, front_keypoint=front_keypoint)
-        self.robot = RobotCommander(robot_url)
-        self.controller = PathPlanningController()
+        # Components: one agent per car, each with its own control loop
+        fleet = robot_url if isinstance(robot_url, dict) else {None: robot_url}
+        self.cars = [CarAgent(nn_server_url, url, car_id=car_id, front_keypoint=front_keypoint,
+                              follow_paths=follow_paths, async_commands=async_commands)
+                     for car_id, url in fleet.items()]
+        self.selected = 0  # car that mouse clicks and keys act on
+        self.planned_path: Optional[List[dict]] = None  # path_with_headings() output
+        self.path_link = None  # path_link.PathSubscriber for paths published from PathGUI
         
-        # Control thread
-        self.control_thread = None
-        self.control_running = False
+        # Obstacle-aware planning (grid_planner.GridPlanner): clicks plan around
+        # what the camera sees, and the route is repaired as obstacles move
+        self.grid_planner = None
+        self.grid_outline = []           # blocked regions in pose pixels, for the overlay
+        self.pending_goal = None         # click to plan to on the next frame
+        self.capture_background = False  # take the next frame as the empty arena
+        self.replan_interval = 0.5       # seconds between repairs while following
+        self.last_replan = 0.0
+        self.pose_transport = "push"
         
         # Recording
         self.recording = False
-        self.video_writer = None
+        self.recorder = None
+        self.record_raw = False  # record the NN server's JPEGs as received, without the overlay
+        self.stream = None
+        
+        # Run log for replay.py (see run_log.py)
+        self.run_log = None
+        self.log_frames = False
         self.recording_filename = None
         self.recording_start_time = None
-        self.frames_recorded = 0
         
         # Video settings
         self.fps = 30.0
         self.frame_width = 640
         self.frame_height = 480
+        self.view_width = view_width
+        self.source_width = None  # width of the pose coordinate space
+        self.view_scale = 1.0     # displayed pixels per pose pixel
         
+    @property
+    def car(self) -> CarAgent:
+        return self.cars[self.selected]
+    
+    @property
+    def pose_client(self) -> PoseClient:
+        return self.car.pose_client
+    
+    @property
+    def robot(self) -> RobotCommander:
+        return self.car.robot
+    
+    @property
+    def controller(self) -> PathPlanningController:
+        return self.car.controller
+    
     def test_connection(self) -> bool:
         """Test connections to NN server and robot"""
         try:
@@ -407,85 +1541,85 @@ class VideoStreamClient:
             response = requests.get(f"{self.nn_server_url}/status", timeout=5)
             if response.status_code == 200:
                 print(f"✅ Connected to NN server: {self.nn_server_url}")
+                self.source_width = self._source_width()
             else:
                 print(f"⚠️ NN server responded with: {response.status_code}")
         except Exception as e:
             print(f"❌ Failed to connect to NN server: {e}")
             return False
             
-        try:
-            # Test robot (just check if reachable)
-            response = requests.get(f"{self.robot_url}/", timeout=5)
-            print(f"✅ Connected to robot: {self.robot_url}")
-        except Exception as e:
-            print(f"⚠️ Robot connection test failed (may still work): {e}")
+        for car in self.cars:
+            try:
+                # Test robot (just check if reachable)
+                response = requests.get(f"{car.robot_url}/", timeout=5)
+                print(f"✅ Connected to robot: {car.robot_url}")
+            except Exception as e:
+                print(f"⚠️ Robot connection test failed (may still work): {e}")
             
         return True
     
+    def _source_width(self) -> Optional[int]:
+        """Width of the frames the NN server's poses refer to (its /stats source_size), if reported"""
+        try:
+            size = requests.get(f"{self.nn_server_url}/stats", timeout=5).json().get('source_size')
+            return int(size[0]) if size else None
+        except Exception:
+            return None
+    
+    def to_view(self, x: float, y: float) -> Tuple[int, int]:
+        """Pose (source pixel) coordinates -> displayed pixel"""
+        return int(x * self.view_scale), int(y * self.view_scale)
+    
     def fetch_frames(self):
         """Fetch frames from MJPEG stream"""
         try:
-            response = requests.get(
-                f"{self.nn_server_url}/video_feed", 
-                stream=True, 
-                timeout=10
-            )
-            
-            if response.status_code != 200:
-                print(f"Error: HTTP {response.status_code}")
+            target = (self.view_width, 0) if self.view_width else None
+            stream = MjpegStream(f"{self.nn_server_url}/video_feed", target_size=target)
+            self.stream = stream
+            stream.jpeg_sink = self._on_jpeg
+            try:
+                stream.open()
+            except ConnectionError as e:
+                print(f"Error: {e}")
                 return
-                
-            bytes_data = b''
             
-            for chunk in response.iter_content(chunk_size=1024):
+            # Frames come from the decoder's buffer pool (8 deep), which
+            # covers the 5-frame queue plus the one being drawn on
+            for frame, _, _ in stream:
                 if not self.running:
                     break
-                    
-                bytes_data += chunk
                 
-                start = bytes_data.find(b'\xff\xd8')
-                end = bytes_data.find(b'\xff\xd9')
+                if self.frame_width == 640:
+                    self.frame_height, self.frame_width = frame.shape[:2]
+                    # The NN server may stream reduced frames itself; fall back
+                    # to the JPEG's own size when it doesn't say
+                    source_size = stream.decoder.source_size or (self.frame_width, self.frame_height)
+                    source_width = self.source_width or source_size[0]
+                    self.view_scale = self.frame_width / source_width
+                    if self.view_scale != 1.0:
+                        print(f"🖼️ Showing {self.frame_width}x{self.frame_height} "
+                              f"({self.view_scale:.2f}x of the pose coordinates)")
                 
-                if start != -1 and end != -1 and start < end:
-                    jpg_data = bytes_data[start:end + 2]
-                    bytes_data = bytes_data[end + 2:]
-                    
-                    frame = cv2.imdecode(
-                        np.frombuffer(jpg_data, dtype=np.uint8), 
-                        cv2.IMREAD_COLOR
-                    )
-                    
-                    if frame is not None:
-                        if self.frame_width == 640:
-                            self.frame_height, self.frame_width = frame.shape[:2]
-                        
-                        try:
-                            self.frame_queue.put(frame, block=False)
-                        except queue.Full:
-                            try:
-                                self.frame_queue.get_nowait()
-                                self.frame_queue.put(frame, block=False)
-                            except queue.Empty:
-                                pass
+                try:
+                    self.frame_queue.put(frame, block=False)
+                except queue.Full:
+                    try:
+                        self.frame_queue.get_nowait()
+                        self.frame_queue.put(frame, block=False)
+                    except queue.Empty:
+                        pass
+            stream.close()
                                 
         except Exception as e:
             print(f"Error fetching frames: {e}")
     
-    def control_loop(self):
-        """Background control loop - runs path planning algorithm"""
-        while self.control_running:
-            if self.controller.state in (ControlState.ROTATING, ControlState.MOVING):
-                pose = self.pose_client.get_latest()
-                if pose:
-                    command = self.controller.get_command(pose)
-                    if command:
-                        self.robot.pulse(command)
-                        # Wait for robot to settle and new pose
-                        time.sleep(self.controller.settle_time)
-                else:
-                    time.sleep(0.05)  # No pose available, wait
-            else:
-                time.sleep(0.1)  # Idle, check less frequently
+    def _on_jpeg(self, jpeg):
+        """Each JPEG as received, before decoding: raw recording and the run log"""
+        recorder = self.recorder
+        if recorder is not None and self.record_raw:
+            recorder.write_jpeg(jpeg)
+        if self.run_log is not None and self.log_frames:
+            self.run_log.frame(time.time(), jpeg)
     
     def draw_overlay(self, frame: np.ndarray, pose: Optional[RobotPose]) -> np.ndarray:
         """Draw visualization overlay on frame"""
@@ -493,23 +1627,51 @@ class VideoStreamClient:
         
         # Draw target
         if self.controller.target:
-            tx, ty = int(self.controller.target[0]), int(self.controller.target[1])
+            tx, ty = self.to_view(*self.controller.target[:2])
             # Target circle with crosshair
-            cv2.circle(overlay, (tx, ty), int(self.controller.arrival_threshold), (0, 255, 255), 2)
+            cv2.circle(overlay, (tx, ty), int(self.controller.arrival_threshold * self.view_scale),
+                       (0, 255, 255), 2)
             cv2.circle(overlay, (tx, ty), 5, (0, 255, 255), -1)
             cv2.line(overlay, (tx - 15, ty), (tx + 15, ty), (0, 255, 255), 2)
             cv2.line(overlay, (tx, ty - 15), (tx, ty + 15), (0, 255, 255), 2)
         
+        # Obstacles the grid planner routes around
+        if self.grid_outline:
+            cv2.polylines(overlay, [(c * self.view_scale).astype(np.int32) for c in self.grid_outline],
+                          True, (0, 0, 255), 1)
+        
+        # Draw planned path and lookahead point when following one
+        path = getattr(self.controller, 'path', None)
+        if path is not None:
+            cv2.polylines(overlay, [(path * self.view_scale).astype(np.int32)], False, (255, 0, 255), 1)
+            lookahead = self.controller.lookahead_point
+            if lookahead is not None:
+                cv2.circle(overlay, self.to_view(lookahead[0], lookahead[1]), 5, (255, 0, 255), -1)
+        
         # Draw path history
         if len(self.controller.path_history) > 1:
-            points = np.array(list(self.controller.path_history), dtype=np.int32)
+            points = (np.array(list(self.controller.path_history)) * self.view_scale).astype(np.int32)
             cv2.polylines(overlay, [points], False, (255, 255, 0), 2)
         
+        # Draw the rest of the fleet: pose, label and target
+        for car in self.cars:
+            if car is self.car:
+                continue
+            other = car.pose_client.get_latest()
+            if other:
+                fx, fy = self.to_view(other.front_x, other.front_y)
+                cv2.line(overlay, self.to_view(other.back_x, other.back_y), (fx, fy), (160, 160, 160), 3)
+                cv2.circle(overlay, (fx, fy), 6, (160, 160, 160), -1)
+                cv2.putText(overlay, f"#{car.car_id}", (fx + 10, fy - 10),
+                           cv2.FONT_HERSHEY_SIMPLEX, 0.5, (160, 160, 160), 2)
+            if car.controller.target and car.controller.state != ControlState.IDLE:
+                cv2.circle(overlay, self.to_view(*car.controller.target[:2]), 5, (160, 160, 160), -1)
+        
         # Draw robot pose
         if pose:
-            fx, fy = int(pose.front_x), int(pose.front_y)
-            bx, by = int(pose.back_x), int(pose.back_y)
-            cx, cy = int(pose.center[0]), int(pose.center[1])
+            fx, fy = self.to_view(pose.front_x, pose.front_y)
+            bx, by = self.to_view(pose.back_x, pose.back_y)
+            cx, cy = self.to_view(*pose.center)
             
             # Robot body line
             cv2.line(overlay, (bx, by), (fx, fy), (0, 255, 0), 3)
@@ -556,6 +1718,9 @@ class VideoStreamClient:
         cv2.rectangle(overlay, (frame.shape[1] - 120, 10), (frame.shape[1] - 10, 40), color, -1)
         cv2.putText(overlay, self.controller.state.value, (frame.shape[1] - 115, 32),
                    cv2.FONT_HERSHEY_SIMPLEX, 0.5, (0, 0, 0), 2)
+        if len(self.cars) > 1:
+            cv2.putText(overlay, self.car.name, (frame.shape[1] - 115, 60),
+                       cv2.FONT_HERSHEY_SIMPLEX, 0.5, (0, 255, 0), 2)
         
         # Recording indicator
         if self.recording:
@@ -565,6 +1730,8 @@ class VideoStreamClient:
         
         # Timestamp and NN stats
         stats_text = f"{time.strftime('%H:%M:%S')} | NN: {self.pose_client.last_fps:.1f}fps {self.pose_client.last_inference_ms:.0f}ms"
+        if self.pose_client.sensing_latency_ms:
+            stats_text += f" | Latency: {self.pose_client.sensing_latency_ms:.0f}ms"
         if pose:
             stats_text += f" | Conf: {self.pose_client.detection_confidence:.2f}"
         cv2.putText(overlay, stats_text, (10, frame.shape[0] - 10),
@@ -575,12 +1742,14 @@ class VideoStreamClient:
     def mouse_callback(self, event, x, y, flags, param):
         """Handle mouse clicks to set target"""
         if event == cv2.EVENT_LBUTTONDOWN:
-            # Left click - set target
-            self.controller.set_target(x, y)
+            # Left click - set target, or plan a route to it around obstacles
+            if self.grid_planner is not None:
+                self.pending_goal = (x / self.view_scale, y / self.view_scale)
+            else:
+                self.car.set_target(x / self.view_scale, y / self.view_scale)
         elif event == cv2.EVENT_RBUTTONDOWN:
             # Right click - cancel navigation
-            self.controller.cancel()
-            self.robot.stop()
+            self.car.cancel()
     
     def start_recording(self, filename=None):
         """Start recording video"""
@@ -589,22 +1758,21 @@ class VideoStreamClient:
         
         if filename is None:
             timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
-            filename = f"vizcar_recording_{timestamp}.mp4"
+            filename = f"vizcar_recording_{timestamp}.{'avi' if self.record_raw else 'mp4'}"
         
+        # Encoding runs on the recorder's thread so it never holds up the
+        # display and control loop; raw mode is fed by the stream thread
         self.recording_filename = filename
-        fourcc = cv2.VideoWriter_fourcc(*'mp4v')
-        self.video_writer = cv2.VideoWriter(
-            filename, fourcc, self.fps, (self.frame_width, self.frame_height)
-        )
-        
-        if not self.video_writer.isOpened():
-            print(f"❌ Failed to create video writer")
+        try:
+            self.recorder = Recorder(filename, fps=self.fps, raw=self.record_raw).start()
+        except IOError as e:
+            print(f"❌ Failed to create video writer: {e}")
+            self.recorder = None
             return False
         
         self.recording = True
         self.recording_start_time = time.time()
-        self.frames_recorded = 0
-        print(f"🔴 Recording started: {filename}")
+        print(f"🔴 Recording started: {filename}{' (raw MJPEG)' if self.record_raw else ''}")
         return True
     
     def stop_recording(self):
@@ -613,11 +1781,12 @@ class VideoStreamClient:
             return False
         
         self.recording = False
-        if self.video_writer:
-            self.video_writer.release()
-            self.video_writer = None
+        recorder = self.recorder
+        recorder.stop()
+        self.recorder = None
         
-        print(f"⏹️ Recording stopped: {self.recording_filename}")
+        print(f"⏹️ Recording stopped: {', '.join(recorder.files) or self.recording_filename} "
+              f"({recorder.summary()})")
         return True
     
     def start_streaming(self):
@@ -627,19 +1796,23 @@ class VideoStreamClient:
         
         self.running = True
         
-        # Start pose polling
-        self.pose_client.start_polling()
-        
         # Start frame fetching
         self.stream_thread = threading.Thread(target=self.fetch_frames)
         self.stream_thread.daemon = True
         self.stream_thread.start()
         
-        # Start control loop
-        self.control_running = True
-        self.control_thread = threading.Thread(target=self.control_loop)
-        self.control_thread.daemon = True
-        self.control_thread.start()
+        if self.run_log is not None:
+            for index, car in enumerate(self.cars):
+                car.attach_log(self.run_log, index)
+            self.run_log.write(run_log.CONFIG, time.time(), {
+                'cars': [car.log_config() for car in self.cars],
+                'transport': self.pose_transport,
+                'frames': self.log_frames
+            })
+        
+        # Start receiving poses and the control loop of each car
+        for car in self.cars:
+            car.start(self.pose_transport)
         
         print("\n🎥 Video stream started!")
         print("📋 Controls:")
@@ -649,7 +1822,13 @@ class VideoStreamClient:
         print("  's'         - Save screenshot")
         print("  'r'         - Start/stop recording")
         print("  'c'         - Cancel navigation")
-        print("  'SPACE'     - Emergency stop")
+        if self.planned_path is not None or self.path_link is not None:
+            print("  'f'         - Follow the loaded path")
+        if self.grid_planner is not None:
+            print("  'b'         - Capture the empty arena as background (obstacle detection)")
+        if len(self.cars) > 1:
+            print(f"  '1'-'{len(self.cars)}'       - Select car ({', '.join(car.name for car in self.cars)})")
+        print("  'SPACE'     - Emergency stop (all cars)")
         print("  '+'         - Increase arrival threshold")
         print("  '-'         - Decrease arrival threshold")
         print()
@@ -662,6 +1841,14 @@ class VideoStreamClient:
             try:
                 frame = self.frame_queue.get(timeout=1)
                 
+                # Paths from PathGUI; cars already following switch over mid-run
+                if self.path_link is not None:
+                    self.take_published_path()
+                
+                # Plan clicks around obstacles and repair the route as they move
+                if self.grid_planner is not None:
+                    self.run_grid_planner(frame)
+                
                 # Get current pose for overlay
                 pose = self.pose_client.get_latest()
                 
@@ -669,9 +1856,8 @@ class VideoStreamClient:
                 display_frame = self.draw_overlay(frame, pose)
                 
                 # Record if active
-                if self.recording and self.video_writer:
-                    self.video_writer.write(display_frame)
-                    self.frames_recorded += 1
+                if self.recording and not self.record_raw:
+                    self.recorder.write(display_frame)
                 
                 cv2.imshow(window_name, display_frame)
                 
@@ -689,12 +1875,18 @@ class VideoStreamClient:
                     else:
                         self.start_recording()
                 elif key == ord('c'):
-                    self.controller.cancel()
-                    self.robot.stop()
+                    self.car.cancel()
+                elif key == ord('f') and self.planned_path is not None:
+                    self.car.set_path(self.planned_path)
+                elif key == ord('b') and self.grid_planner is not None:
+                    self.capture_background = True
                 elif key == ord(' '):  # Space = emergency stop
-                    self.controller.cancel()
-                    self.robot.stop()
+                    for car in self.cars:
+                        car.cancel()
                     print("🛑 EMERGENCY STOP")
+                elif ord('1') <= key < ord('1') + min(len(self.cars), 9):
+                    self.selected = key - ord('1')
+                    print(f"🚗 Selected {self.car.name}")
                 elif key == ord('+') or key == ord('='):
                     self.controller.arrival_threshold += 5
                     print(f"📏 Arrival threshold: {self.controller.arrival_threshold}")
@@ -710,28 +1902,107 @@ class VideoStreamClient:
         self.stop()
         return True
     
+    def take_published_path(self):
+        """Apply the latest path from the path broker, if a new one arrived"""
+        update = self.path_link.take()
+        if update is None:
+            return
+        path, revision = update
+        self.planned_path = path
+        if path is None:
+            for car in self.cars:
+                if isinstance(car.controller, PathFollowingController) and car.controller.path is not None:
+                    car.cancel()
+            print("🧹 Published path cleared")
+            return
+        lag = (time.time() - self.path_link.received_at) * 1000
+        following = [car.name for car in self.cars if car.update_path(path)]
+        print(f"🛣️ Path revision {revision}: {len(path)} points ({lag:.0f}ms after arrival)"
+              f"{', updated ' + ', '.join(following) if following else ''}")
+    
+    def car_discs(self, pose: Optional[RobotPose]) -> List[Tuple[float, float, float]]:
+        """The selected car as a disc the planner keeps free; other cars stay obstacles"""
+        if pose is None:
+            return []
+        cx, cy = pose.center
+        return [(cx, cy, 1.2 * math.dist(pose.front, pose.back))]
+    
+    def run_grid_planner(self, frame: np.ndarray):
+        """Plan a pending click, or repair the route being followed every replan_interval"""
+        planner = self.grid_planner
+        pose = self.pose_client.get_latest()
+        if self.capture_background:
+            self.capture_background = False
+            planner.set_background(frame, self.car_discs(pose), self.view_scale)
+            print("🖼️ Background captured; obstacles are what differs from it")
+        goal, self.pending_goal = self.pending_goal, None
+        if not planner.ready:
+            if goal is not None:
+                print("⚠️ No background yet: press 'b' with the arena clear of obstacles")
+            return
+        
+        following = (planner.goal is not None and getattr(self.controller, 'path', None) is not None and
+                     self.controller.state in (ControlState.ROTATING, ControlState.MOVING))
+        if goal is None and not (following and time.time() - self.last_replan >= self.replan_interval):
+            return
+        if pose is None:
+            if goal is not None:
+                print("⚠️ No pose yet, can't plan from the car")
+            return
+        self.last_replan = time.time()
+        grid = planner.update_grid(frame, self.car_discs(pose), self.view_scale)
+        self.grid_outline = grid.outline()
+        
+        if goal is not None:
+            t0 = time.perf_counter()
+            path = planner.plan(pose.front, goal)
+            if path is None:
+                print("❌ No obstacle-free path to that point")
+                return
+            print(f"🧭 Planned around obstacles: {len(path)} points in "
+                  f"{(time.perf_counter() - t0) * 1000:.0f}ms")
+            self.planned_path = path
+            self.car.set_path(path)
+            return
+        
+        path = planner.replan(pose.front)
+        if path is None:
+            print("🚧 Route blocked, stopping (click to plan again)")
+            planner.goal = None
+            self.car.cancel()
+        elif planner.last_changed:
+            # Only when the grid changed; the car moving needs no new path
+            self.planned_path = path
+            self.car.update_path(path)
+    
     def stop(self):
         """Stop all components"""
+        if self.stopped:
+            return
+        self.stopped = True
         print("\n🛑 Shutting down...")
         
         self.running = False
-        self.control_running = False
         
-        # Stop robot
-        self.robot.stop()
+        if self.path_link is not None:
+            self.path_link.close()
+        
+        # Stop robots, control loops and pose clients
+        for car in self.cars:
+            car.stop()
         
         # Stop recording
         if self.recording:
             self.stop_recording()
         
-        # Stop pose client
-        self.pose_client.stop()
-        
         # Wait for threads
         if self.stream_thread and self.stream_thread.is_alive():
             self.stream_thread.join(timeout=2)
-        if self.control_thread and self.control_thread.is_alive():
-            self.control_thread.join(timeout=2)
+        
+        if self.run_log is not None:
+            self.run_log.close()
+            print(f"🗒️ Run log: {self.run_log.filename} ({self.run_log.summary()})")
+            self.run_log = None
         
         cv2.destroyAllWindows()
         print("👋 Goodbye!")
@@ -746,13 +2017,15 @@ Examples:
   %(prog)s 192.168.1.100 192.168.1.50
   %(prog)s 100.64.0.1 192.168.4.1 --nn-port 5000 --robot-port 80
   %(prog)s 100.64.0.1 192.168.4.1 --arrival-threshold 50 --heading-threshold 10
+  %(prog)s 100.64.0.1 0=192.168.4.1 1=192.168.4.2   (fleet: NN track ID=robot IP)
         """
     )
     
     parser.add_argument('nn_server_ip', 
                         help='IP address of NN server (provides video feed and pose)')
-    parser.add_argument('robot_ip', 
-                        help='IP address of ESP32 robot')
+    parser.add_argument('robot_ip', nargs='+',
+                        help='IP address of ESP32 robot, or ID=IP per car to drive several cars '
+                             'by their NN server track IDs')
     parser.add_argument('--nn-port', type=int, default=5000,
                         help='NN server port (default: 5000)')
     parser.add_argument('--robot-port', type=int, default=80,
@@ -764,38 +2037,160 @@ Examples:
     parser.add_argument('--pulse-duration', type=float, default=0.20,
                         help='Motor pulse duration in seconds (default: 0.20)')
     parser.add_argument('--settle-time', type=float, default=5.0,
-                        help='Wait time after each pulse in seconds (default: 5.0)')
+                        help='Max wait for a fresh pose after each pulse in seconds (default: 5.0)')
     parser.add_argument('--max-iterations', type=int, default=500,
                         help='Maximum control iterations (default: 500)')
     parser.add_argument('--front-keypoint', type=int, default=0, choices=[0, 1],
                         help='Which keypoint index is the front marker: 0 or 1 (default: 0)')
+    parser.add_argument('--pose-transport', choices=['push', 'poll'], default='push',
+                        help='Receive poses pushed by the NN server or poll /detections (default: push)')
+    parser.add_argument('--path', type=str, default=None,
+                        help='Path to follow with pure pursuit: a binary robot/path payload (path_codec.py), '
+                             'PathGUI JSON payload or path_with_headings list')
+    parser.add_argument('--path-broker', type=str, default=None,
+                        help='Also take paths published by PathGUI from this MQTT broker, '
+                             'updating a path being followed as it is edited')
+    parser.add_argument('--grid-plan', action='store_true',
+                        help='Plan clicks around obstacles seen by the camera (grid_planner.py) and '
+                             "repair the route as they move; press 'b' to capture the empty arena")
+    parser.add_argument('--hsv-low', type=int, nargs=3, default=None,
+                        help='With --grid-plan, also treat this OpenCV HSV colour range as obstacles '
+                             '(with --hsv-high), e.g. 0 120 80')
+    parser.add_argument('--hsv-high', type=int, nargs=3, default=None)
+    parser.add_argument('--grid-cell', type=float, default=8.0,
+                        help='Grid planner cell size in pixels (default: 8)')
+    parser.add_argument('--inflate', type=float, default=40.0,
+                        help='Clearance kept from obstacles in pixels, about half the car (default: 40)')
+    parser.add_argument('--lookahead', type=float, default=60.0,
+                        help='Pure pursuit lookahead distance in pixels (default: 60)')
+    parser.add_argument('--track', action='store_true',
+                        help='Filter detections with a Kalman tracker and control from its estimate')
+    parser.add_argument('--predict', action='store_true',
+                        help='Compensate pose latency with a motion model and run without settling')
+    parser.add_argument('--forward-speed', type=float, default=150.0,
+                        help='Driving speed used for prediction in pixels/s (default: 150)')
+    parser.add_argument('--turn-rate', type=float, default=90.0,
+                        help='Rotation rate used for prediction in degrees/s (default: 90)')
+    parser.add_argument('--pulse-model', type=str, default=None,
+                        help='Pulse durations from a model fitted by pulse_policy.py instead of '
+                             'a fixed --pulse-duration')
+    parser.add_argument('--robot-calib', action='store_true',
+                        help='Take the forward speed and turn rate each robot measured in calibrate.py, '
+                             'where it has them')
+    parser.add_argument('--blocking-commands', action='store_true',
+                        help='Send each robot command on a new connection and wait for it, '
+                             'instead of queueing them on a keep-alive session')
+    parser.add_argument('--run-log', type=str, default=None,
+                        help='Log poses, commands, control steps and clicks to this file for replay.py')
+    parser.add_argument('--log-frames', action='store_true',
+                        help='Also put the video frames in the run log')
+    parser.add_argument('--record-raw', action='store_true',
+                        help="Record the NN server's annotated JPEGs into an .avi as received, "
+                             "without the controller overlay or re-encoding")
+    parser.add_argument('--view-width', type=int, default=None,
+                        help='Decode the video at a reduced scale at least this wide, e.g. 640 '
+                             '(default: full size)')
     
     args = parser.parse_args()
     
     nn_server_url = f"http://{args.nn_server_ip}:{args.nn_port}"
-    robot_url = f"http://{args.robot_ip}:{args.robot_port}"
+    if len(args.robot_ip) == 1 and '=' not in args.robot_ip[0]:
+        robot_url = f"http://{args.robot_ip[0]}:{args.robot_port}"
+    else:
+        robot_url = {}
+        for index, spec in enumerate(args.robot_ip):
+            car_id, _, ip = spec.rpartition('=')
+            robot_url[int(car_id) if car_id else index] = f"http://{ip}:{args.robot_port}"
     
     print("=" * 60)
     print("🤖 VizCar Path Planning Controller")
     print("=" * 60)
     print(f"📡 NN Server: {nn_server_url}")
-    print(f"🎮 Robot:     {robot_url}")
+    if isinstance(robot_url, dict):
+        for car_id, url in robot_url.items():
+            print(f"🎮 Robot #{car_id}:  {url}")
+    else:
+        print(f"🎮 Robot:     {robot_url}")
     print(f"📏 Arrival threshold: {args.arrival_threshold} pixels")
     print(f"🧭 Heading threshold: {args.heading_threshold}°")
     print(f"⏱️ Pulse duration: {args.pulse_duration}s")
-    print(f"⏳ Settle time: {args.settle_time}s")
+    print(f"⏳ Pose timeout: {args.settle_time}s")
     print(f"🔑 Front keypoint index: {args.front_keypoint}")
+    if args.predict:
+        print(f"🔮 Prediction: {args.forward_speed} px/s, {args.turn_rate}°/s")
+    if args.track:
+        print("🛰️ Kalman pose tracking enabled")
+    policy = None
+    if args.pulse_model:
+        from pulse_policy import PulsePolicy
+        policy = PulsePolicy.load(args.pulse_model)
+        print(f"🧠 Pulse policy: {policy.describe()}")
     print("=" * 60)
     
-    client = VideoStreamClient(nn_server_url, robot_url, front_keypoint=args.front_keypoint)
+    client = VideoStreamClient(nn_server_url, robot_url, front_keypoint=args.front_keypoint,
+                               follow_paths=(args.path is not None or args.path_broker is not None
+                                             or args.grid_plan),
+                               view_width=args.view_width,
+                               async_commands=not args.blocking_commands)
+    client.pose_transport = args.pose_transport
+    client.record_raw = args.record_raw
+    if args.run_log:
+        client.run_log = run_log.RunLog(args.run_log)
+        client.log_frames = args.log_frames
+        print(f"🗒️ Logging run to {args.run_log}{' (with frames)' if args.log_frames else ''}")
+    
+    if args.path:
+        with open(args.path, 'rb') as f:
+            data = f.read()
+        if path_codec.is_binary_path(data):
+            client.planned_path = path_codec.decode_path(data)[1]
+        else:
+            data = json.loads(data)
+            client.planned_path = data["path"] if isinstance(data, dict) else data
+        print(f"🛣️ Loaded path: {len(client.planned_path)} points from {args.path} (press 'f' to follow)")
+    if args.path_broker:
+        from path_link import PathSubscriber
+        client.path_link = PathSubscriber(args.path_broker)
+    if args.grid_plan:
+        from grid_planner import GridPlanner
+        client.grid_planner = GridPlanner(args.grid_cell, args.inflate,
+                                          hsv_low=args.hsv_low, hsv_high=args.hsv_high)
+        print(f"🧱 Grid planning: {args.grid_cell:g}px cells, {args.inflate:g}px clearance"
+              f"{', colour mask' if args.hsv_low else ''}")
     
-    # Configure controller
-    client.controller.arrival_threshold = args.arrival_threshold
-    client.controller.heading_threshold = math.radians(args.heading_threshold)
-    client.controller.pulse_duration = args.pulse_duration
-    client.controller.settle_time = args.settle_time
-    client.controller.max_iterations = args.max_iterations
-    client.robot.pulse_duration = args.pulse_duration
+    # Configure each car's controller
+    for car in client.cars:
+        forward_speed, turn_rate = args.forward_speed, args.turn_rate
+        if args.robot_calib:
+            rates = fetch_robot_rates(car.robot_url)
+            if rates is not None:
+                forward_speed, turn_rate = rates
+                print(f"🔧 {car.name} calibrated: {forward_speed:.0f} px/s, {turn_rate:.0f}°/s")
+            else:
+                print(f"⚠️ {car.name} has no stored calibration, using {forward_speed} px/s, {turn_rate}°/s")
+        if args.path or args.path_broker or args.grid_plan:
+            car.controller.lookahead = args.lookahead
+            car.controller.forward_speed = forward_speed
+            car.controller.turn_rate = math.radians(turn_rate)
+        car.controller.arrival_threshold = args.arrival_threshold
+        car.controller.heading_threshold = math.radians(args.heading_threshold)
+        car.controller.pulse_duration = args.pulse_duration
+        car.controller.settle_time = args.settle_time
+        car.controller.max_iterations = args.max_iterations
+        car.controller.policy = policy
+        car.robot.pulse_duration = args.pulse_duration
+        if args.track:
+            car.pose_client.tracker = PoseTracker(
+                car.robot,
+                forward_speed=forward_speed,
+                turn_rate=math.radians(turn_rate)
+            )
+        if args.predict:
+            car.controller.predictor = PosePredictor(
+                car.robot,
+                forward_speed=forward_speed,
+                turn_rate=math.radians(turn_rate)
+            )
     
     try:
         client.start_streaming()
@@ -6,6 +6,9 @@ Serves raw video footage via HTTP API endpoint
 
 from flask import Flask, Response, jsonify
 import cv2
+import numpy as np
+import argparse
+import os
 import threading
 import time
 import logging
@@ -15,12 +18,70 @@ logger = logging.getLogger(__name__)
 
 app = Flask(__name__)
 
+class FrameBus:
+    """
+    Latest encoded frame, published once per capture
+    
+    The capture thread publishes each frame's JPEG bytes (never modified
+    afterwards) with its sequence number; stream clients block on the
+    condition until a newer sequence is published, so every client gets
+    every frame as soon as it exists and nobody encodes it twice.
+    """
+    
+    def __init__(self):
+        self.cond = threading.Condition()
+        self.jpeg = None
+        self.seq = 0
+        self.capture_time = 0.0
+        self.subscribers = 0
+        self.frames_published = 0
+    
+    def publish(self, jpeg, seq, capture_time):
+        with self.cond:
+            self.jpeg, self.seq, self.capture_time = jpeg, seq, capture_time
+            self.frames_published += 1
+            self.cond.notify_all()
+    
+    def latest(self):
+        """(jpeg, seq, capture_time) of the last published frame"""
+        with self.cond:
+            return self.jpeg, self.seq, self.capture_time
+    
+    def wait(self, after_seq, timeout=1.0):
+        """Block until a frame newer than after_seq is published; (None, after_seq, 0.0) on timeout"""
+        with self.cond:
+            if not self.cond.wait_for(lambda: self.seq > after_seq, timeout):
+                return None, after_seq, 0.0
+            return self.jpeg, self.seq, self.capture_time
+    
+    def subscribe(self):
+        with self.cond:
+            self.subscribers += 1
+    
+    def unsubscribe(self):
+        with self.cond:
+            self.subscribers -= 1
+
 class VideoCamera:
-    def __init__(self, camera_index=0):
+    def __init__(self, camera_index=0, passthrough=True):
+        """
+        Args:
+            camera_index: Preferred /dev/video index
+            passthrough: Keep the camera's own MJPEG frames as captured and
+                         serve them without decoding and re-encoding; frames
+                         are only decoded when something needs pixels
+        """
         self.camera_index = camera_index
+        self.passthrough = passthrough
         self.video = None
         self.fps = 30
+        self.capture_fps = 0.0  # measured
         self.frame = None
+        self.bus = FrameBus()   # latest frame as JPEG bytes, for all consumers
+        self.encode_lock = threading.Lock()
+        self.decoded = (0, None)  # (seq, frame) decoded from the bus on demand
+        self.frame_seq = 0      # increments once per captured frame
+        self.frame_time = 0.0   # wall-clock time the latest frame was captured
         self.lock = threading.Lock()
         self.running = False
         self.thread = None
@@ -97,6 +158,9 @@ class VideoCamera:
                 
                 self.video.set(cv2.CAP_PROP_AUTO_EXPOSURE, 1)  # Manual exposure mode
                 self.video.set(cv2.CAP_PROP_AUTOFOCUS, 1)      # autofocus
+                if self.passthrough:
+                    # V4L2 backend hands back the mmap'd MJPEG buffer undecoded
+                    self.video.set(cv2.CAP_PROP_CONVERT_RGB, 0)
                 
                 import time
                 time.sleep(3)
@@ -111,7 +175,9 @@ class VideoCamera:
                 ret, test_frame = self.video.read()
                 if ret and test_frame is not None and test_frame.size > 0:
                     self.camera_index = idx
-                    height, width = test_frame.shape[:2]
+                    self._check_passthrough(test_frame)
+                    width = int(self.video.get(cv2.CAP_PROP_FRAME_WIDTH))
+                    height = int(self.video.get(cv2.CAP_PROP_FRAME_HEIGHT))
                     logger.info(f"Camera initialized successfully at index {idx}")
                     logger.info(f"Frame size: {width}x{height}")
                     logger.info(f"FPS: {self.video.get(cv2.CAP_PROP_FPS)}")
@@ -146,11 +212,14 @@ class VideoCamera:
                     self.video.set(cv2.CAP_PROP_FRAME_HEIGHT, 720)
                     self.video.set(cv2.CAP_PROP_FPS, 30)
                     self.video.set(cv2.CAP_PROP_BUFFERSIZE, 1)
+                    if self.passthrough:
+                        self.video.set(cv2.CAP_PROP_CONVERT_RGB, 0)
                     
                     time.sleep(2)
                     ret, test_frame = self.video.read()
                     if ret and test_frame is not None:
                         self.camera_index = idx
+                        self._check_passthrough(test_frame)
                         logger.info(f"Camera initialized at index {idx}")
                         return True
                         
@@ -164,6 +233,18 @@ class VideoCamera:
         logger.error("Or check: v4l2-ctl --device=/dev/video0 --list-formats-ext")
         return False
     
+    def _check_passthrough(self, test_frame):
+        """Fall back to decoded capture if the camera did not deliver raw JPEG bytes"""
+        if not self.passthrough:
+            return
+        raw = test_frame.reshape(-1)
+        if test_frame.ndim <= 2 and min(test_frame.shape) == 1 and raw[:2].tobytes() == b'\xff\xd8':
+            logger.info("📦 MJPEG passthrough: serving the camera's JPEG frames as captured")
+            return
+        logger.warning("Camera does not deliver raw MJPEG, falling back to decode/re-encode")
+        self.passthrough = False
+        self.video.set(cv2.CAP_PROP_CONVERT_RGB, 1)
+    
     def start_capture(self):
         """Start video capture in separate thread"""
         if not self.initialize_camera():
@@ -181,8 +262,27 @@ class VideoCamera:
             try:
                 ret, frame = self.video.read()
                 if ret:
+                    # read() returns as soon as the driver has the frame, so this
+                    # is the closest we get to the exposure time
+                    captured = time.time()
+                    if self.frame_time:
+                        interval = captured - self.frame_time
+                        if interval > 0:
+                            self.capture_fps += 0.1 * (1.0 / interval - self.capture_fps)
+                    if self.passthrough:
+                        # The camera's compressed frame goes out as it is
+                        with self.lock:
+                            self.frame_seq += 1
+                            self.frame_time = captured
+                        self.bus.publish(frame.tobytes(), self.frame_seq, captured)
+                        continue
+                    # read() allocates a new array per frame, so no copy is needed
                     with self.lock:
-                        self.frame = frame.copy()
+                        self.frame = frame
+                        self.frame_seq += 1
+                        self.frame_time = captured
+                    if self.bus.subscribers:
+                        self.get_jpeg_info()  # encode once for all stream clients
                 else:
                     logger.warning("Failed to read frame from camera")
                     time.sleep(0.1)
@@ -193,8 +293,50 @@ class VideoCamera:
     
     def get_frame(self):
         """Get the latest frame"""
+        return self.get_frame_info()[0]
+    
+    def get_frame_info(self):
+        """Get (frame, sequence number, capture time) of the latest frame"""
+        if self.passthrough:
+            return self._decode_latest()
+        with self.lock:
+            if self.frame is None:
+                return None, 0, 0.0
+            return self.frame.copy(), self.frame_seq, self.frame_time
+    
+    def _decode_latest(self):
+        """Decode the latest passthrough JPEG, at most once per frame"""
+        jpeg, seq, capture_time = self.bus.latest()
         with self.lock:
-            return self.frame.copy() if self.frame is not None else None
+            cached_seq, cached = self.decoded
+        if jpeg is None:
+            return None, 0, 0.0
+        if cached_seq != seq:
+            cached = cv2.imdecode(np.frombuffer(jpeg, dtype=np.uint8), cv2.IMREAD_COLOR)
+            with self.lock:
+                self.decoded = (seq, cached)
+        return (cached.copy() if cached is not None else None), seq, capture_time
+    
+    def get_jpeg_info(self, quality=80):
+        """
+        Get (JPEG bytes, sequence number, capture time) of the latest frame
+        
+        In decode mode the frame is encoded by whoever asks first and
+        published on the bus, so it is encoded once however many want it.
+        """
+        if self.passthrough:
+            return self.bus.latest()
+        with self.encode_lock:
+            with self.lock:
+                frame, seq, capture_time = self.frame, self.frame_seq, self.frame_time
+            if frame is None:
+                return None, 0, 0.0
+            if self.bus.seq != seq:
+                ret, buffer = cv2.imencode('.jpg', frame, [cv2.IMWRITE_JPEG_QUALITY, quality])
+                if not ret:
+                    return None, 0, 0.0
+                self.bus.publish(buffer.tobytes(), seq, capture_time)
+            return self.bus.latest()
     
     def stop(self):
         """Stop video capture and cleanup"""
@@ -205,21 +347,59 @@ class VideoCamera:
             self.video.release()
         logger.info("Camera stopped")
 
+class CpuMeter:
+    """Process CPU use (% of one core) between successive reads"""
+    
+    def __init__(self):
+        self.last = (time.time(), self._cpu_seconds())
+        self.percent = 0.0
+    
+    @staticmethod
+    def _cpu_seconds():
+        t = os.times()
+        return t.user + t.system
+    
+    def read(self, min_interval=1.0):
+        now, cpu = time.time(), self._cpu_seconds()
+        wall = now - self.last[0]
+        if wall >= min_interval:
+            self.percent = 100.0 * (cpu - self.last[1]) / wall
+            self.last = (now, cpu)
+        return self.percent
+
 # Global camera instance
 camera = VideoCamera()
+cpu_meter = CpuMeter()
+
+def mjpeg_part(frame_bytes, seq, capture_time):
+    """
+    One multipart part carrying a JPEG and its provenance
+    
+    X-Frame-Seq and X-Timestamp (capture time, Unix seconds) let consumers
+    measure latency from the moment of capture; Content-Length lets them
+    read the part without scanning for JPEG markers.
+    """
+    return (b'--frame\r\n'
+            b'Content-Type: image/jpeg\r\n'
+            + f'Content-Length: {len(frame_bytes)}\r\n'
+              f'X-Frame-Seq: {seq}\r\n'
+              f'X-Timestamp: {capture_time:.6f}\r\n\r\n'.encode()
+            + frame_bytes + b'\r\n')
 
 def generate_mjpeg_stream():
-    """Generate MJPEG stream for HTTP response"""
-    while True:
-        frame = camera.get_frame()
-        if frame is not None:
-            # encode as JPEG
-            ret, buffer = cv2.imencode('.jpg', frame, [cv2.IMWRITE_JPEG_QUALITY, 80])
-            if ret:
-                frame_bytes = buffer.tobytes()
-                yield (b'--frame\r\n'
-                       b'Content-Type: image/jpeg\r\n\r\n' + frame_bytes + b'\r\n')
-        time.sleep(1/30)  # ~30 FPS
+    """Generate MJPEG stream for HTTP response, one part per captured frame"""
+    camera.bus.subscribe()
+    try:
+        # Start with the current frame, then wake up for each new one
+        jpeg, seq, capture_time = camera.get_jpeg_info()
+        if jpeg is not None:
+            yield mjpeg_part(jpeg, seq, capture_time)
+        while camera.running:
+            jpeg, seq, capture_time = camera.bus.wait(seq)
+            if jpeg is not None:
+                yield mjpeg_part(jpeg, seq, capture_time)
+    finally:
+        camera.bus.unsubscribe()
 
 @app.route('/')
 def index():
@@ -239,7 +419,15 @@ def status():
     return jsonify({
         'camera_active': camera.running,
         'camera_index': camera.camera_index,
-        'fps': camera.fps
+        'fps': camera.fps,
+        'capture_fps': round(camera.capture_fps, 1),
+        'mode': 'passthrough' if camera.passthrough else 'decode',
+        'cpu_percent': round(cpu_meter.read(), 1),  # this process, % of one core
+        'cpu_count': os.cpu_count(),
+        'frame_seq': camera.frame_seq,
+        'viewers': camera.bus.subscribers,
+        'frames_published': camera.bus.frames_published,
+        'time': time.time()  # for clock offset estimation by consumers
     })
 
 @app.route('/video_feed')
@@ -253,15 +441,23 @@ def video_feed():
 @app.route('/frame')
 def get_single_frame():
     """Get a single frame as JPEG"""
-    frame = camera.get_frame()
-    if frame is not None:
-        ret, buffer = cv2.imencode('.jpg', frame, [cv2.IMWRITE_JPEG_QUALITY, 80])
-        if ret:
-            return Response(buffer.tobytes(), mimetype='image/jpeg')
+    jpeg, seq, capture_time = camera.get_jpeg_info()
+    if jpeg is not None:
+        return Response(jpeg, mimetype='image/jpeg',
+                        headers={'X-Frame-Seq': str(seq),
+                                 'X-Timestamp': f'{capture_time:.6f}'})
     
     return jsonify({'error': 'No frame available'}), 500
 
 if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='VizCar video streaming server')
+    parser.add_argument('--mode', choices=['passthrough', 'decode'], default='passthrough',
+                        help='passthrough: serve the camera\'s MJPEG frames as captured; '
+                             'decode: decode and re-encode every frame (default: passthrough)')
+    parser.add_argument('--port', type=int, default=5000, help='HTTP port (default: 5000)')
+    args = parser.parse_args()
+    camera.passthrough = args.mode == 'passthrough'
+    
     try:
         logger.info("Starting video streaming server...")
         
@@ -273,7 +469,7 @@ if __name__ == '__main__':
         
         # Run Flask server
         # Use 0.0.0.0 to allow connections from other devices in Tailnet
-        app.run(host='0.0.0.0', port=5000, debug=False, threaded=True)
+        app.run(host='0.0.0.0', port=args.port, debug=False, threaded=True)
         
     except KeyboardInterrupt:
         logger.info("Shutting down...")